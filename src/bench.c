@@ -0,0 +1,1639 @@
+// bench.c
+//
+// Command line benchmarks for the asset pipeline.
+// None of this touches OpenGL, so it runs anywhere
+// the loader builds.
+//
+// 		wb_bench fbx [model.fbx] [iterations] [sdk | workers]
+// 		wb_bench cache [model.fbx] [iterations]
+// 		wb_bench weld [model.fbx] [iterations]
+// 		wb_bench vcache [model.fbx] [iterations] [cache size]
+// 		wb_bench packed [model.fbx]
+// 		wb_bench tangents [model.fbx] [iterations]
+// 		wb_bench meshlets [model.fbx]
+// 		wb_bench lods [model.fbx] [iterations]
+// 		wb_bench unload [model.fbx] [iterations] [nocache]
+// 		wb_bench async [model.fbx] [nocache]
+// 		wb_bench bounds [model.fbx]
+// 		wb_bench textures [directory] [iterations]
+// 		wb_bench cook [directory] [iterations]
+// 		wb_bench mips [directory] [iterations]
+// 		wb_bench png [directory] [iterations]
+// 		wb_bench cull [count] [iterations] [workers]
+//
+// fbx always parses the FBX file; cache goes through the
+// baked .wbm file next to it, writing it first if needed.
+// Peak RSS is per process, so compare paths by running
+// the benchmark once per path rather than both in one go.
+// sdk loads once, since its models can't be freed between runs.
+// Passing a worker count instead of sdk sizes the job pool,
+// for checking how array decoding scales with cores.
+// weld expands the loaded meshes back out to one vertex per
+// polygon vertex and times welding that stream again.
+// vcache loads the model in file order and reports ACMR/ATVR
+// before and after the vertex cache and fetch passes.
+// packed compares WFBX_LOAD_PACKED against full floats:
+// size, and the worst error each attribute picks up.
+// tangents runs frag3d's normal mapping on the CPU, once the way it
+// rebuilt the tangent frame from derivatives and once with the
+// loader's tangents, timing both and comparing what they produce.
+// meshlets builds meshlets and culls them along the same orbit
+// main.c's camera takes, drawing the model at the same five offsets.
+// lods times building LODs on load, lists them, and reports which
+// ones main.c's selection picks along the orbit and further out.
+// unload loads and frees the model over and over, first on the heap
+// and then in one arena that gets reset after every load, and checks
+// memory doesn't grow; nocache parses the FBX every time.
+// async loads the model the way main.c does, on the job pool, and
+// reports how soon the call returns, the progress it polls along
+// the way, and that it gets the same model as a blocking load.
+// bounds checks every vertex is inside its mesh's box and sphere and
+// the model's, that the cache hands back the same ones, and how
+// much tighter the spheres are than the ones around the boxes.
+// textures decodes main.c's four PNGs one after another, then all
+// at once on the job pool the way main.c does, and compares the
+// pool's wall time with the slowest single decode.
+// cook compresses main.c's textures the way loadTexture does on a
+// cache miss, folding the emissive map into pbr's alpha when it can,
+// timing it and reporting the size against RGBA8 with mips and the
+// PSNR of the top level.
+// mips times building main.c's four mip chains with the box and the
+// Kaiser kernel, with and without SIMD, checks they make the same
+// bits, and compares the 1x1 level's brightness with the source's,
+// against what averaging sRGB values as they are would give.
+// png decodes main.c's four PNGs from memory with stb_image and with
+// wb_png, with and without SIMD, checks all three make the same
+// bytes, and reports MB/s of RGBA8 out.
+// cull frustum culls count random spheres (a million by default)
+// with wb_cull along the meshlets orbit, plain C on one thread, SIMD
+// on one thread and SIMD on the job pool, checks all three keep the
+// same spheres, and reports the best time for each.
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <time.h>
+#include <sys/resource.h>
+#endif
+
+typedef int32_t i32;
+typedef uint8_t u8;
+typedef uint32_t u32;
+typedef float f32;
+typedef double f64;
+typedef ptrdiff_t isize;
+typedef const char* string;
+
+#include "wb_fbx.cc"
+#include "wb_jobs.h"
+#include "wb_mesh.h"
+
+#define WB_TEX_IMPLEMENTATION
+#include "wb_tex.h"
+
+#define WB_PNG_IMPLEMENTATION
+#include "wb_png.h"
+
+#define WB_CULL_IMPLEMENTATION
+#include "wb_cull.h"
+
+#define STB_IMAGE_IMPLEMENTATION
+#define STB_IMAGE_ONLY_PNG
+#include "stb_image.h"
+
+#ifdef WB_BENCH_FBXSDK
+// From wb_fbx_sdk.cc
+wfbxModel* wfbxLoadModelFromFileSdk(
+		const char* filename,
+		wfbxMaterialTexture* defaultMaterial);
+#endif
+
+f64 benchTime()
+{
+#ifdef _WIN32
+	LARGE_INTEGER now, freq;
+	QueryPerformanceCounter(&now);
+	QueryPerformanceFrequency(&freq);
+	return (f64)now.QuadPart / (f64)freq.QuadPart;
+#else
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+#endif
+}
+
+// In megabytes
+f64 benchPeakRss()
+{
+#ifdef _WIN32
+	PROCESS_MEMORY_COUNTERS pmc;
+	GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc));
+	return pmc.PeakWorkingSetSize / (1024.0 * 1024.0);
+#else
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	return usage.ru_maxrss / 1024.0;
+#endif
+}
+
+void benchSleep(i32 milliseconds)
+{
+#ifdef _WIN32
+	Sleep(milliseconds);
+#else
+	struct timespec t = {0, milliseconds * 1000000L};
+	nanosleep(&t, NULL);
+#endif
+}
+
+// Unpacks packed vertices the same way vert3d.glsl does
+void benchGetVertex(wfbxModel* model, isize mesh, isize index, wfbxVertex* v)
+{
+	if(model->meshes[mesh]) {
+		*v = model->meshes[mesh][index];
+		return;
+	}
+
+	wfbxPackedVertex* p = model->packedMeshes[mesh] + index;
+	wfbxBounds* b = model->bounds + mesh;
+	for(isize i = 0; i < 3; ++i) {
+		v->pos[i] = b->min[i] + (b->max[i] - b->min[i]) * (p->pos[i] / 65535.0f);
+	}
+	v->pos[3] = 1;
+	wmeshDecodeOctahedral(v->normal, p->normal);
+	v->normal[3] = 0;
+	v->uv[0] = wmeshDequantizeHalf(p->uv[0]);
+	v->uv[1] = wmeshDequantizeHalf(p->uv[1]);
+	wmeshDecodeTangent(v->tangent, v->normal, p->pos[3]);
+}
+
+void benchPrintModel(wfbxModel* model)
+{
+	// A cheap fingerprint, so different paths can be eyeballed for equality
+	isize vertexCount = 0, indexCount = 0;
+	f64 positionSum = 0, uvSum = 0;
+	u32 indexHash = 2166136261u;
+	for(isize m = 0; m < model->count; ++m) {
+		vertexCount += model->meshSizes[m];
+		indexCount += model->indexCounts[m];
+		for(isize i = 0; i < model->meshSizes[m]; ++i) {
+			wfbxVertex v;
+			benchGetVertex(model, m, i, &v);
+			positionSum += v.pos[0] + v.pos[1] + v.pos[2];
+			uvSum += v.uv[0] + v.uv[1];
+		}
+		for(isize i = 0; i < model->indexCounts[m]; ++i) {
+			indexHash = (indexHash ^ model->indices[m][i]) * 16777619u;
+		}
+	}
+
+	printf("  meshes %td, vertices %td, indices %td\n",
+			model->count, vertexCount, indexCount);
+	printf("  position sum %.4f, uv sum %.4f, index hash %08x\n",
+			positionSum, uvSum, indexHash);
+}
+
+int benchFbx(int argc, char** argv)
+{
+	string fileName = argc > 2 ? argv[2] : "model0/enemyFighter.fbx";
+	isize iterations = argc > 3 ? atoi(argv[3]) : 20;
+	int useSdk = argc > 4 && strcmp(argv[4], "sdk") == 0;
+	if(iterations < 1) iterations = 1;
+	if(argc > 4 && !useSdk) {
+		wjobStartup(atoi(argv[4]));
+	}
+	// The sdk's models have no free function, so it loads once per
+	// process; more runs would only pile models up in the peak RSS
+	if(useSdk) iterations = 1;
+
+	wfbxMaterialTexture material;
+	memset(&material, 0, sizeof(material));
+
+	f64 best = 1e30, total = 0;
+	wfbxModel* model = NULL;
+	for(isize i = 0; i < iterations; ++i) {
+		// Freeing the last run's model isn't part of loading
+		wfbxFreeModel(model);
+		model = NULL;
+		f64 start = benchTime();
+		if(useSdk) {
+#ifdef WB_BENCH_FBXSDK
+			model = wfbxLoadModelFromFileSdk(fileName, &material);
+#else
+			printf("Built without WB_BENCH_FBXSDK\n");
+			return 1;
+#endif
+		} else {
+			model = wfbxLoadModel(fileName, &material, WFBX_LOAD_SKIP_CACHE);
+		}
+		f64 elapsed = benchTime() - start;
+		if(!model) {
+			printf("Failed to load %s\n", fileName);
+			return 1;
+		}
+		if(elapsed < best) best = elapsed;
+		total += elapsed;
+	}
+
+	printf("%s (%s, %d workers)\n", fileName,
+			useSdk ? "fbxsdk" : "native", useSdk ? 0 : wjobWorkerCount());
+	benchPrintModel(model);
+	printf("  load: best %.3f ms, mean %.3f ms over %td runs\n",
+			best * 1000.0, total * 1000.0 / iterations, iterations);
+	printf("  peak rss: %.2f MB\n", benchPeakRss());
+	return 0;
+}
+
+int benchCache(int argc, char** argv)
+{
+	string fileName = argc > 2 ? argv[2] : "model0/enemyFighter.fbx";
+	isize iterations = argc > 3 ? atoi(argv[3]) : 20;
+	if(iterations < 1) iterations = 1;
+
+	wfbxMaterialTexture material;
+	memset(&material, 0, sizeof(material));
+
+	// The first load writes the cache if it's missing or stale
+	f64 start = benchTime();
+	wfbxModel* model = wfbxLoadModelFromFile(fileName, &material);
+	f64 first = benchTime() - start;
+	if(!model) {
+		printf("Failed to load %s\n", fileName);
+		return 1;
+	}
+
+	f64 best = 1e30, total = 0;
+	for(isize i = 0; i < iterations; ++i) {
+		wfbxFreeModel(model);
+		start = benchTime();
+		model = wfbxLoadModelFromFile(fileName, &material);
+		f64 elapsed = benchTime() - start;
+		if(!model || !model->cache) {
+			printf("Cache for %s wasn't used\n", fileName);
+			return 1;
+		}
+		if(elapsed < best) best = elapsed;
+		total += elapsed;
+	}
+
+	printf("%s (cached)\n", fileName);
+	benchPrintModel(model);
+	printf("  first load: %.3f ms\n", first * 1000.0);
+	printf("  cached load: best %.3f ms, mean %.3f ms over %td runs\n",
+			best * 1000.0, total * 1000.0 / iterations, iterations);
+	printf("  peak rss: %.2f MB\n", benchPeakRss());
+	return 0;
+}
+
+int benchWeld(int argc, char** argv)
+{
+	string fileName = argc > 2 ? argv[2] : "model0/enemyFighter.fbx";
+	isize iterations = argc > 3 ? atoi(argv[3]) : 50;
+	if(iterations < 1) iterations = 1;
+
+	wfbxMaterialTexture material;
+	memset(&material, 0, sizeof(material));
+	wfbxModel* model = wfbxLoadModel(fileName, &material, WFBX_LOAD_SKIP_CACHE);
+	if(!model) {
+		printf("Failed to load %s\n", fileName);
+		return 1;
+	}
+
+	printf("%s\n", fileName);
+	isize totalStream = 0;
+	f64 totalBest = 0;
+	for(isize m = 0; m < model->count; ++m) {
+		isize indexCount = model->indexCounts[m];
+		wfbxVertex* stream = (wfbxVertex*)malloc(sizeof(wfbxVertex) * (indexCount + 1));
+		u32* remap = (u32*)malloc(sizeof(u32) * (indexCount + 1));
+		for(isize i = 0; i < indexCount; ++i) {
+			stream[i] = model->meshes[m][model->indices[m][i]];
+		}
+
+		// Positions alone, i.e. what one vertex per control point gave us
+		f32* positions = (f32*)malloc(sizeof(f32) * 4 * (indexCount + 1));
+		for(isize i = 0; i < indexCount; ++i) {
+			memcpy(positions + i * 4, stream[i].pos, sizeof(f32) * 4);
+		}
+		isize positionCount = wmeshWeld(remap, positions, indexCount, sizeof(f32) * 4);
+
+		f64 best = 1e30;
+		isize welded = 0;
+		for(isize i = 0; i < iterations; ++i) {
+			f64 start = benchTime();
+			welded = wmeshWeld(remap, stream, indexCount, sizeof(wfbxVertex));
+			f64 elapsed = benchTime() - start;
+			if(elapsed < best) best = elapsed;
+		}
+
+		printf("  mesh %td: %td polygon vertices, %td unique positions -> %td welded vertices\n",
+				m, indexCount, positionCount, welded);
+		printf("    weld: best %.3f ms, %.1f Mverts/s, %.1f MB/s\n",
+				best * 1000.0, indexCount / best * 1e-6,
+				indexCount * sizeof(wfbxVertex) / best / (1024.0 * 1024.0));
+		totalStream += indexCount;
+		totalBest += best;
+
+		free(positions);
+		free(remap);
+		free(stream);
+	}
+
+	if(totalBest > 0) {
+		printf("  total: %td polygon vertices in %.3f ms, %.1f Mverts/s\n",
+				totalStream, totalBest * 1000.0, totalStream / totalBest * 1e-6);
+	}
+	return 0;
+}
+
+int benchVertexCache(int argc, char** argv)
+{
+	string fileName = argc > 2 ? argv[2] : "model0/enemyFighter.fbx";
+	isize iterations = argc > 3 ? atoi(argv[3]) : 50;
+	isize cacheSize = argc > 4 ? atoi(argv[4]) : WMESH_VERTEX_CACHE_SIZE;
+	if(iterations < 1) iterations = 1;
+	if(cacheSize < 3) cacheSize = 3;
+
+	wfbxMaterialTexture material;
+	memset(&material, 0, sizeof(material));
+	wfbxModel* model = wfbxLoadModel(fileName, &material,
+			WFBX_LOAD_SKIP_CACHE | WFBX_LOAD_NO_REORDER);
+	if(!model) {
+		printf("Failed to load %s\n", fileName);
+		return 1;
+	}
+
+	printf("%s (FIFO cache of %td)\n", fileName, cacheSize);
+	for(isize m = 0; m < model->count; ++m) {
+		isize vertexCount = model->meshSizes[m];
+		isize indexCount = model->indexCounts[m];
+		u32* indices = (u32*)malloc(sizeof(u32) * (indexCount + 1));
+		wfbxVertex* vertices = (wfbxVertex*)malloc(sizeof(wfbxVertex) * (vertexCount + 1));
+
+		wmeshVertexCacheStats before = wmeshAnalyzeVertexCache(
+				model->indices[m], indexCount, vertexCount, cacheSize);
+
+		f64 bestCache = 1e30, bestFetch = 1e30;
+		for(isize i = 0; i < iterations; ++i) {
+			f64 start = benchTime();
+			wmeshOptimizeVertexCache(indices, model->indices[m],
+					indexCount, vertexCount, cacheSize);
+			f64 elapsed = benchTime() - start;
+			if(elapsed < bestCache) bestCache = elapsed;
+
+			start = benchTime();
+			wmeshOptimizeVertexFetch(vertices, indices, indexCount,
+					model->meshes[m], vertexCount, sizeof(wfbxVertex));
+			elapsed = benchTime() - start;
+			if(elapsed < bestFetch) bestFetch = elapsed;
+		}
+
+		wmeshVertexCacheStats after = wmeshAnalyzeVertexCache(
+				indices, indexCount, vertexCount, cacheSize);
+
+		isize triangleCount = indexCount / 3;
+		printf("  mesh %td: %td triangles, %td vertices\n", m, triangleCount, vertexCount);
+		printf("    file order: ACMR %.3f, ATVR %.3f\n", before.acmr, before.atvr);
+		printf("    optimized:  ACMR %.3f, ATVR %.3f\n", after.acmr, after.atvr);
+		printf("    vertex cache pass: best %.3f ms, %.1f Mtris/s\n",
+				bestCache * 1000.0, triangleCount / bestCache * 1e-6);
+		printf("    vertex fetch pass: best %.3f ms, %.1f Mverts/s\n",
+				bestFetch * 1000.0, vertexCount / bestFetch * 1e-6);
+
+		free(vertices);
+		free(indices);
+	}
+	return 0;
+}
+
+int benchPacked(int argc, char** argv)
+{
+	string fileName = argc > 2 ? argv[2] : "model0/enemyFighter.fbx";
+
+	wfbxMaterialTexture material;
+	memset(&material, 0, sizeof(material));
+	wfbxModel* model = wfbxLoadModel(fileName, &material, WFBX_LOAD_SKIP_CACHE);
+	wfbxModel* packed = wfbxLoadModel(fileName, &material,
+			WFBX_LOAD_SKIP_CACHE | WFBX_LOAD_PACKED);
+	if(!model || !packed || model->count != packed->count) {
+		printf("Failed to load %s\n", fileName);
+		return 1;
+	}
+
+	printf("%s\n", fileName);
+	printf("  vertex size: %zu bytes -> %zu bytes\n",
+			sizeof(wfbxVertex), sizeof(wfbxPackedVertex));
+
+	isize vertexCount = 0;
+	f64 positionError = 0, relativeError = 0, normalError = 0, uvError = 0;
+	for(isize m = 0; m < model->count; ++m) {
+		if(model->meshSizes[m] != packed->meshSizes[m]) {
+			printf("  mesh %td has a different vertex count when packed\n", m);
+			return 1;
+		}
+		wfbxBounds* b = model->bounds + m;
+		f64 extent = 0;
+		for(isize j = 0; j < 3; ++j) {
+			f64 e = b->max[j] - b->min[j];
+			if(e > extent) extent = e;
+		}
+
+		for(isize i = 0; i < model->meshSizes[m]; ++i) {
+			wfbxVertex* a = model->meshes[m] + i;
+			wfbxVertex v;
+			benchGetVertex(packed, m, i, &v);
+			for(isize j = 0; j < 3; ++j) {
+				f64 d = fabs((f64)a->pos[j] - v.pos[j]);
+				if(d > positionError) positionError = d;
+				if(extent > 0 && d / extent > relativeError) relativeError = d / extent;
+			}
+			for(isize j = 0; j < 2; ++j) {
+				f64 d = fabs((f64)a->uv[j] - v.uv[j]);
+				if(d > uvError) uvError = d;
+			}
+
+			// Angle between the two, skipping vertices without a normal
+			f64 length = sqrt((f64)a->normal[0] * a->normal[0] +
+					(f64)a->normal[1] * a->normal[1] +
+					(f64)a->normal[2] * a->normal[2]);
+			if(length > 0) {
+				f64 n[3] = {a->normal[0] / length, a->normal[1] / length, a->normal[2] / length};
+				f64 cx = n[1] * v.normal[2] - n[2] * v.normal[1];
+				f64 cy = n[2] * v.normal[0] - n[0] * v.normal[2];
+				f64 cz = n[0] * v.normal[1] - n[1] * v.normal[0];
+				f64 dot = n[0] * v.normal[0] + n[1] * v.normal[1] + n[2] * v.normal[2];
+				f64 angle = atan2(sqrt(cx * cx + cy * cy + cz * cz), dot) * 57.29577951308232;
+				if(angle > normalError) normalError = angle;
+			}
+		}
+		vertexCount += model->meshSizes[m];
+	}
+
+	printf("  vertex buffers: %.1f KB -> %.1f KB\n",
+			vertexCount * sizeof(wfbxVertex) / 1024.0,
+			vertexCount * sizeof(wfbxPackedVertex) / 1024.0);
+	printf("  max position error: %g (%.2e of the largest extent)\n",
+			positionError, relativeError);
+	printf("  max normal error: %.4f degrees\n", normalError);
+	printf("  max uv error: %g\n", uvError);
+	return 0;
+}
+
+void benchCross(f32* dst, const f32* a, const f32* b)
+{
+	f32 x = a[1] * b[2] - a[2] * b[1];
+	f32 y = a[2] * b[0] - a[0] * b[2];
+	f32 z = a[0] * b[1] - a[1] * b[0];
+	dst[0] = x;
+	dst[1] = y;
+	dst[2] = z;
+}
+
+void benchNormalize(f32* v)
+{
+	f32 length = sqrtf(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+	if(length > 0) {
+		v[0] /= length;
+		v[1] /= length;
+		v[2] /= length;
+	}
+}
+
+// frag3d's normal mapping before it had tangents, line for line:
+// the frame is rebuilt from screen-space derivatives, then the 
+// sample goes through it
+void benchDerivativeTbn(f32* N, const f32* vertexNormal,
+		const f32* posDx, const f32* posDy, const f32* texDx, const f32* texDy,
+		const f32* sample)
+{
+	f32 tangent[3], binormal[3], xAxis[3];
+	for(isize k = 0; k < 3; ++k) {
+		tangent[k] = texDy[1] * posDx[k] - texDx[1] * posDy[k];
+		binormal[k] = texDy[0] * posDx[k] - texDx[0] * posDy[k];
+	}
+	benchNormalize(tangent);
+	benchNormalize(binormal);
+	benchCross(xAxis, vertexNormal, tangent);
+	benchCross(tangent, xAxis, vertexNormal);
+	benchNormalize(tangent);
+	benchCross(xAxis, binormal, vertexNormal);
+	benchCross(binormal, vertexNormal, xAxis);
+	benchNormalize(binormal);
+	for(isize k = 0; k < 3; ++k) {
+		N[k] = tangent[k] * sample[0] + binormal[k] * sample[1] + vertexNormal[k] * sample[2];
+	}
+	benchNormalize(N);
+}
+
+// ...and with them: one cross product for the bitangent, then the multiply
+void benchVertexTbn(f32* N, const f32* vertexNormal, const f32* tangent, const f32* sample)
+{
+	f32 bitangent[3];
+	benchCross(bitangent, vertexNormal, tangent);
+	for(isize k = 0; k < 3; ++k) {
+		bitangent[k] *= -tangent[3];
+		N[k] = tangent[k] * sample[0] + bitangent[k] * sample[1] + vertexNormal[k] * sample[2];
+	}
+	benchNormalize(N);
+}
+
+int benchTangents(int argc, char** argv)
+{
+	string fileName = argc > 2 ? argv[2] : "model0/enemyFighter.fbx";
+	isize iterations = argc > 3 ? atoi(argv[3]) : 50;
+	if(iterations < 1) iterations = 1;
+
+	wfbxMaterialTexture material;
+	memset(&material, 0, sizeof(material));
+	wfbxModel* model = wfbxLoadModel(fileName, &material, WFBX_LOAD_SKIP_CACHE);
+	wfbxModel* packed = wfbxLoadModel(fileName, &material,
+			WFBX_LOAD_SKIP_CACHE | WFBX_LOAD_PACKED);
+	if(!model || !packed) {
+		printf("Failed to load %s\n", fileName);
+		return 1;
+	}
+
+	// Every triangle corner stands in for a fragment, seen from the
+	// front: the triangle's edges and UV deltas play dFdx and dFdy.
+	// The sample is a tilted normal map texel, already unpacked.
+	isize fragmentCount = 0;
+	for(isize m = 0; m < model->count; ++m) {
+		fragmentCount += model->indexCounts[m] / 3 * 3;
+	}
+	f32* inputs = (f32*)malloc(sizeof(f32) * 16 * (fragmentCount + 1));
+	f32* out = inputs;
+	isize mirrored = 0;
+	for(isize m = 0; m < model->count; ++m) {
+		wfbxVertex* vertices = model->meshes[m];
+		u32* indices = model->indices[m];
+		for(isize t = 0; t + 2 < model->indexCounts[m]; t += 3) {
+			wfbxVertex* a = vertices + indices[t];
+			wfbxVertex* b = vertices + indices[t + 1];
+			wfbxVertex* c = vertices + indices[t + 2];
+			for(isize corner = 0; corner < 3; ++corner, out += 16) {
+				wfbxVertex* v = vertices + indices[t + corner];
+				for(isize k = 0; k < 3; ++k) {
+					out[k] = v->normal[k];
+					out[3 + k] = b->pos[k] - a->pos[k];
+					out[6 + k] = c->pos[k] - a->pos[k];
+					out[12 + k] = v->tangent[k];
+				}
+				benchNormalize(out);
+				out[9] = b->uv[0] - a->uv[0];
+				out[10] = b->uv[1] - a->uv[1];
+				out[11] = c->uv[0] - a->uv[0];
+				out[15] = c->uv[1] - a->uv[1];
+				if(v->tangent[3] < 0) mirrored++;
+			}
+		}
+	}
+
+	f32 sample[3] = {0.3f, -0.2f, 0.93f};
+	benchNormalize(sample);
+	f64 before = 1e30, after = 1e30, checksum = 0;
+	for(isize i = 0; i < iterations; ++i) {
+		f64 start = benchTime();
+		for(isize f = 0; f < fragmentCount; ++f) {
+			f32* in = inputs + f * 16;
+			f32 texDy[2] = {in[11], in[15]}, N[3];
+			benchDerivativeTbn(N, in, in + 3, in + 6, in + 9, texDy, sample);
+			checksum += N[0];
+		}
+		f64 elapsed = benchTime() - start;
+		if(elapsed < before) before = elapsed;
+	}
+
+	// The tangent's w sits where texDy's v does; put it back
+	f32* tangents = (f32*)malloc(sizeof(f32) * 4 * (fragmentCount + 1));
+	isize f = 0;
+	for(isize m = 0; m < model->count; ++m) {
+		for(isize i = 0; i + 2 < model->indexCounts[m]; i += 3) {
+			for(isize corner = 0; corner < 3; ++corner, ++f) {
+				memcpy(tangents + f * 4, model->meshes[m][model->indices[m][i + corner]].tangent,
+						sizeof(f32) * 4);
+			}
+		}
+	}
+	for(isize i = 0; i < iterations; ++i) {
+		f64 start = benchTime();
+		for(isize f = 0; f < fragmentCount; ++f) {
+			f32 N[3];
+			benchVertexTbn(N, inputs + f * 16, tangents + f * 4, sample);
+			checksum += N[0];
+		}
+		f64 elapsed = benchTime() - start;
+		if(elapsed < after) after = elapsed;
+	}
+
+	// How far apart the two land, with mirrored UVs counted apart:
+	// the derivative frame is per triangle and turns the sample the
+	// other way around on those, the tangents are smoothed per vertex
+	f64 sumAngle[2] = {0}, maxAngle[2] = {0};
+	isize within[2] = {0}, counted[2] = {0};
+	for(isize f = 0; f < fragmentCount; ++f) {
+		f32* in = inputs + f * 16;
+		f32 texDy[2] = {in[11], in[15]}, a[3], b[3];
+		benchDerivativeTbn(a, in, in + 3, in + 6, in + 9, texDy, sample);
+		benchVertexTbn(b, in, tangents + f * 4, sample);
+		f64 dot = a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+		if(dot > 1) dot = 1;
+		if(dot < -1) dot = -1;
+		f64 angle = acos(dot) * 57.29577951308232;
+		isize side = tangents[f * 4 + 3] < 0;
+		counted[side]++;
+		sumAngle[side] += angle;
+		if(angle > maxAngle[side]) maxAngle[side] = angle;
+		if(angle < 1) within[side]++;
+	}
+
+	// Packed tangents, against the floats
+	f64 packedError = 0;
+	for(isize m = 0; m < model->count && m < packed->count; ++m) {
+		for(isize i = 0; i < model->meshSizes[m] && i < packed->meshSizes[m]; ++i) {
+			wfbxVertex* a = model->meshes[m] + i;
+			wfbxVertex v;
+			benchGetVertex(packed, m, i, &v);
+			f64 dot = a->tangent[0] * v.tangent[0] + a->tangent[1] * v.tangent[1] + 
+				a->tangent[2] * v.tangent[2];
+			if(dot > 1) dot = 1;
+			if(dot < -1) dot = -1;
+			f64 angle = acos(dot) * 57.29577951308232;
+			if(a->tangent[3] != v.tangent[3]) angle = 180;
+			if(angle > packedError) packedError = angle;
+		}
+	}
+
+	printf("%s, %td fragments, %td on mirrored UVs\n", fileName, fragmentCount, mirrored);
+	printf("  derivative TBN: %.2f ns per fragment\n", before * 1e9 / fragmentCount);
+	printf("  vertex tangents: %.2f ns per fragment (%.1fx)\n",
+			after * 1e9 / fragmentCount, before / after);
+	for(isize side = 0; side < 2; ++side) {
+		if(!counted[side]) continue;
+		printf("  difference%s: mean %.2f degrees, max %.2f, %.1f%% under a degree\n",
+				side ? " (mirrored)" : "", sumAngle[side] / counted[side], maxAngle[side],
+				100.0 * within[side] / counted[side]);
+	}
+	printf("  max packed tangent error: %.4f degrees\n", packedError);
+	printf("  (checksum %g)\n", checksum);
+	free(tangents);
+	free(inputs);
+	return 0;
+}
+
+// main.c's camera at time t: orbiting the origin, looking at (0, 6, 0),
+// with a 90 degree fov at 16:9. Same math as render_util.c.
+void benchOrbitCamera(f32* viewProjection, f32* cameraPos, f32 t)
+{
+	f32 camDist = 8;
+	f32 pos[3] = {sinf(t) * camDist, camDist * 1.5f, cosf(t) * camDist};
+	f32 target[3] = {0, 6, 0};
+
+	f32 z[3] = {pos[0] - target[0], pos[1] - target[1], pos[2] - target[2]};
+	f32 zl = sqrtf(z[0] * z[0] + z[1] * z[1] + z[2] * z[2]);
+	for(isize i = 0; i < 3; ++i) z[i] /= zl;
+	// up x z, with up = (0, 1, 0)
+	f32 x[3] = {z[2], 0, -z[0]};
+	f32 xl = sqrtf(x[0] * x[0] + x[2] * x[2]);
+	x[0] /= xl;
+	x[2] /= xl;
+	f32 y[3] = {
+		z[1] * x[2] - z[2] * x[1],
+		z[2] * x[0] - z[0] * x[2],
+		z[0] * x[1] - z[1] * x[0]
+	};
+
+	f32 view[16] = {
+		x[0], y[0], z[0], 0,
+		x[1], y[1], z[1], 0,
+		x[2], y[2], z[2], 0,
+		-(x[0] * pos[0] + x[1] * pos[1] + x[2] * pos[2]),
+		-(y[0] * pos[0] + y[1] * pos[1] + y[2] * pos[2]),
+		-(z[0] * pos[0] + z[1] * pos[1] + z[2] * pos[2]),
+		1
+	};
+
+	f32 nearPlane = 0.02f, farPlane = 1000.0f;
+	f32 yScale = 1.0f / tanf(90.0f * 3.14159265f / 180.0f / 2);
+	f32 diff = nearPlane - farPlane;
+	f32 proj[16] = {0};
+	proj[0] = yScale / (1280.0f / 720.0f);
+	proj[5] = yScale;
+	proj[10] = farPlane / diff;
+	proj[11] = -1;
+	proj[14] = (2 * nearPlane * farPlane) / diff;
+
+	for(isize c = 0; c < 4; ++c) {
+		for(isize r = 0; r < 4; ++r) {
+			f32 sum = 0;
+			for(isize k = 0; k < 4; ++k) sum += proj[k * 4 + r] * view[c * 4 + k];
+			viewProjection[c * 4 + r] = sum;
+		}
+	}
+	memcpy(cameraPos, pos, sizeof(pos));
+}
+
+int benchMeshlets(int argc, char** argv)
+{
+	string fileName = argc > 2 ? argv[2] : "model0/enemyFighter.fbx";
+
+	wfbxMaterialTexture material;
+	memset(&material, 0, sizeof(material));
+	wfbxModel* model = wfbxLoadModel(fileName, &material, WFBX_LOAD_SKIP_CACHE);
+	if(!model) {
+		printf("Failed to load %s\n", fileName);
+		return 1;
+	}
+
+	// The offsets main.c draws at
+	static const f32 offsets[5][3] = {
+		{0, -2, 0}, {10, -2, 0}, {-10, -2, 0}, {0, 8, 0}, {0, -10, 5}
+	};
+	// One full orbit, at main.c's 0.005 per frame
+	isize frameCount = (isize)(2 * 3.14159265 / 0.005);
+
+	printf("%s\n", fileName);
+	for(isize m = 0; m < model->count; ++m) {
+		isize indexCount = model->indexCounts[m];
+		isize triangleCount = indexCount / 3;
+		wmeshMeshlet* meshlets = (wmeshMeshlet*)malloc(
+				sizeof(wmeshMeshlet) * wmeshMeshletCountBound(indexCount));
+		u32* meshletVertices = (u32*)malloc(sizeof(u32) * wmeshMeshletVertexBound(indexCount));
+		u8* meshletTriangles = (u8*)malloc(wmeshMeshletTriangleBound(indexCount));
+
+		f64 start = benchTime();
+		isize meshletCount = wmeshBuildMeshlets(meshlets, meshletVertices, meshletTriangles,
+				model->indices[m], indexCount,
+				model->meshes[m], model->meshSizes[m], sizeof(wfbxVertex));
+		f64 buildTime = benchTime() - start;
+
+		isize vertexTotal = 0, cones = 0;
+		for(isize i = 0; i < meshletCount; ++i) {
+			vertexTotal += meshlets[i].vertexCount;
+			cones += meshlets[i].coneCutoff < 1;
+		}
+		printf("  mesh %td: %td triangles -> %td meshlets in %.3f ms\n",
+				m, triangleCount, meshletCount, buildTime * 1000.0);
+		if(meshletCount == 0) continue;
+		printf("    %.1f vertices, %.1f triangles per meshlet; %td of them can backface cull\n",
+				(f64)vertexTotal / meshletCount, (f64)triangleCount / meshletCount, cones);
+
+		// Per triangle backfacing, as the best cone culling could ever do
+		f32* normals = (f32*)malloc(sizeof(f32) * 3 * (triangleCount + 1));
+		for(isize t = 0; t < triangleCount; ++t) {
+			f32* a = model->meshes[m][model->indices[m][t * 3]].pos;
+			f32* b = model->meshes[m][model->indices[m][t * 3 + 1]].pos;
+			f32* c = model->meshes[m][model->indices[m][t * 3 + 2]].pos;
+			f32 e0[3] = {b[0] - a[0], b[1] - a[1], b[2] - a[2]};
+			f32 e1[3] = {c[0] - a[0], c[1] - a[1], c[2] - a[2]};
+			normals[t * 3] = e0[1] * e1[2] - e0[2] * e1[1];
+			normals[t * 3 + 1] = e0[2] * e1[0] - e0[0] * e1[2];
+			normals[t * 3 + 2] = e0[0] * e1[1] - e0[1] * e1[0];
+		}
+
+		f64 culledTriangles = 0, backfacingTriangles = 0, cullTime = 0;
+		isize culledMeshlets = 0, tests = 0;
+		for(isize frame = 0; frame < frameCount; ++frame) {
+			f32 viewProjection[16], cameraPos[3], planes[24];
+			benchOrbitCamera(viewProjection, cameraPos, frame * 0.005f);
+			wmeshFrustumPlanes(planes, viewProjection);
+
+			for(isize o = 0; o < 5; ++o) {
+				// Move the camera into the mesh's space instead of moving the mesh
+				const f32* offset = offsets[o];
+				f32 localCamera[3], localPlanes[24];
+				for(isize k = 0; k < 3; ++k) localCamera[k] = cameraPos[k] - offset[k];
+				for(isize p = 0; p < 6; ++p) {
+					f32* src = planes + p * 4;
+					f32* dst = localPlanes + p * 4;
+					memcpy(dst, src, sizeof(f32) * 4);
+					dst[3] += src[0] * offset[0] + src[1] * offset[1] + src[2] * offset[2];
+				}
+
+				start = benchTime();
+				for(isize i = 0; i < meshletCount; ++i) {
+					if(wmeshCullMeshlet(meshlets + i, localCamera, localPlanes)) {
+						culledMeshlets++;
+						culledTriangles += meshlets[i].triangleCount;
+					}
+				}
+				cullTime += benchTime() - start;
+				tests += meshletCount;
+
+				for(isize t = 0; t < triangleCount; ++t) {
+					f32* a = model->meshes[m][model->indices[m][t * 3]].pos;
+					f32* n = normals + t * 3;
+					f32 d = (a[0] - localCamera[0]) * n[0] +
+						(a[1] - localCamera[1]) * n[1] +
+						(a[2] - localCamera[2]) * n[2];
+					backfacingTriangles += d >= 0;
+				}
+			}
+		}
+
+		f64 drawn = (f64)triangleCount * frameCount * 5;
+		printf("    orbit of %td frames x 5 instances:\n", frameCount);
+		printf("      meshlets culled: %.1f%%, triangles culled: %.1f%%\n",
+				100.0 * culledMeshlets / tests, 100.0 * culledTriangles / drawn);
+		printf("      backfacing triangles (per-triangle ideal): %.1f%%\n",
+				100.0 * backfacingTriangles / drawn);
+		printf("      cull cost: %.1f ns per meshlet\n", cullTime * 1e9 / tests);
+
+		free(normals);
+		free(meshletTriangles);
+		free(meshletVertices);
+		free(meshlets);
+	}
+	return 0;
+}
+
+// main.c's projection: 720 pixels high, 90 degree fov
+#define BENCH_PIXELS_PER_UNIT (720.0f / (2 * 1.0f))
+#define BENCH_LOD_PIXEL_ERROR 1.0f
+
+// From a camera to the closest a mesh's bounds get, the way main.c
+// measures it: the distance to the center, minus the radius
+f32 benchLodDistance(wfbxBounds* bounds, const f32* offset, const f32* cameraPos)
+{
+	f32 d2 = 0, r2 = 0;
+	for(isize k = 0; k < 3; ++k) {
+		f32 center = (bounds->min[k] + bounds->max[k]) * 0.5f + offset[k];
+		f32 half = (bounds->max[k] - bounds->min[k]) * 0.5f;
+		d2 += (center - cameraPos[k]) * (center - cameraPos[k]);
+		r2 += half * half;
+	}
+	return sqrtf(d2) - sqrtf(r2);
+}
+
+int benchLods(int argc, char** argv)
+{
+	string fileName = argc > 2 ? argv[2] : "model0/enemyFighter.fbx";
+	isize iterations = argc > 3 ? atoi(argv[3]) : 5;
+	if(iterations < 1) iterations = 1;
+
+	wfbxMaterialTexture material;
+	memset(&material, 0, sizeof(material));
+
+	// Best of a few loads with and without LODs; the difference is
+	// what building them costs, with every level running at once
+	f64 plain = 1e30, withLods = 1e30;
+	wfbxModel* model = NULL;
+	for(isize i = 0; i < iterations; ++i) {
+		f64 start = benchTime();
+		wfbxModel* m = wfbxLoadModel(fileName, &material, WFBX_LOAD_SKIP_CACHE);
+		f64 elapsed = benchTime() - start;
+		if(!m) {
+			printf("Failed to load %s\n", fileName);
+			return 1;
+		}
+		if(elapsed < plain) plain = elapsed;
+		wfbxFreeModel(m);
+
+		wfbxFreeModel(model);
+		start = benchTime();
+		model = wfbxLoadModel(fileName, &material, WFBX_LOAD_SKIP_CACHE | WFBX_LOAD_LODS);
+		elapsed = benchTime() - start;
+		if(elapsed < withLods) withLods = elapsed;
+	}
+
+	printf("%s, %d workers\n", fileName, wjobWorkerCount());
+	printf("  load: %.2f ms, with LODs %.2f ms (+%.2f ms)\n",
+			plain * 1000.0, withLods * 1000.0, (withLods - plain) * 1000.0);
+
+	// The offsets main.c draws at
+	static const f32 offsets[5][3] = {
+		{0, -2, 0}, {10, -2, 0}, {-10, -2, 0}, {0, 8, 0}, {0, -10, 5}
+	};
+	isize frameCount = (isize)(2 * 3.14159265 / 0.005);
+
+	for(isize m = 0; m < model->count; ++m) {
+		isize fullTriangles = model->indexCounts[m] / 3;
+		printf("  mesh %td: %td triangles, %td LODs\n", m, fullTriangles, model->lodCounts[m]);
+		for(isize i = 0; i < model->lodCounts[m]; ++i) {
+			wfbxLod* lod = model->lods[m] + i;
+			// Past this distance, the LOD's error is under a pixel
+			f32 distance = lod->error * BENCH_PIXELS_PER_UNIT / BENCH_LOD_PIXEL_ERROR;
+			printf("    LOD %td: %u triangles (%.1f%%), error %.4f, used past %.1f units\n",
+					i, lod->indexCount / 3, 100.0 * lod->indexCount / model->indexCounts[m],
+					lod->error, distance);
+		}
+
+		// main.c's orbit, and then the same scene from further away
+		static const f32 scales[] = {1, 4, 16};
+		for(isize s = 0; s < 3; ++s) {
+			f64 drawn = 0;
+			isize picks[WFBX_MAX_LODS + 1] = {0};
+			for(isize frame = 0; frame < frameCount; ++frame) {
+				f32 viewProjection[16], cameraPos[3];
+				benchOrbitCamera(viewProjection, cameraPos, frame * 0.005f);
+				// Pull the camera back from the orbit's target
+				cameraPos[1] = 6 + (cameraPos[1] - 6) * scales[s];
+				cameraPos[0] *= scales[s];
+				cameraPos[2] *= scales[s];
+
+				for(isize o = 0; o < 5; ++o) {
+					f32 distance = benchLodDistance(model->bounds + m, offsets[o], cameraPos);
+					int lod = wfbxSelectLod(model, m, distance,
+							BENCH_PIXELS_PER_UNIT, BENCH_LOD_PIXEL_ERROR);
+					picks[lod + 1]++;
+					drawn += lod < 0 ? fullTriangles : model->lods[m][lod].indexCount / 3;
+				}
+			}
+			printf("    orbit x%.0f: %.1f%% of full triangles drawn; full",
+					scales[s], 100.0 * drawn / ((f64)fullTriangles * frameCount * 5));
+			for(isize i = 0; i <= model->lodCounts[m]; ++i) {
+				if(i) printf(", LOD %td", i - 1);
+				printf(" %.1f%%", 100.0 * picks[i] / (frameCount * 5));
+			}
+			printf("\n");
+		}
+	}
+	return 0;
+}
+
+int benchUnload(int argc, char** argv)
+{
+	string fileName = argc > 2 ? argv[2] : "model0/enemyFighter.fbx";
+	isize iterations = argc > 3 ? atoi(argv[3]) : 200;
+	u32 flags = argc > 4 && strcmp(argv[4], "nocache") == 0 ? WFBX_LOAD_SKIP_CACHE : 0;
+	if(iterations < 1) iterations = 1;
+
+	wfbxMaterialTexture material;
+	memset(&material, 0, sizeof(material));
+
+	// The first load writes the cache, if we're using it
+	wfbxModel* model = wfbxLoadModel(fileName, &material, flags);
+	if(!model) {
+		printf("Failed to load %s\n", fileName);
+		return 1;
+	}
+	wfbxFreeModel(model);
+
+	// Untouched pages cost nothing, so the arena can be generous
+	wfbxArena arena = {0};
+	arena.size = 256 << 20;
+	arena.base = malloc(arena.size);
+	model = wfbxLoadModelInArena(fileName, &material, flags, &arena);
+	isize footprint = arena.used;
+	wfbxFreeModel(model);
+
+	f64 heapTime = 0, arenaTime = 0;
+	f64 startRss = benchPeakRss();
+	for(isize i = 0; i < iterations; ++i) {
+		f64 start = benchTime();
+		model = wfbxLoadModel(fileName, &material, flags);
+		wfbxFreeModel(model);
+		heapTime += benchTime() - start;
+	}
+	f64 heapRss = benchPeakRss();
+
+	for(isize i = 0; i < iterations; ++i) {
+		f64 start = benchTime();
+		arena.used = 0;
+		model = wfbxLoadModelInArena(fileName, &material, flags, &arena);
+		// Still needed to unmap the cache
+		wfbxFreeModel(model);
+		arenaTime += benchTime() - start;
+	}
+	f64 arenaRss = benchPeakRss();
+	free(arena.base);
+
+	printf("%s (%s)\n", fileName, flags & WFBX_LOAD_SKIP_CACHE ? "native" : "cached");
+	printf("  model footprint: %.1f KB\n", footprint / 1024.0);
+	printf("  heap: %.3f ms per load and free, peak rss %.2f -> %.2f MB over %td loads\n",
+			heapTime * 1000.0 / iterations, startRss, heapRss, iterations);
+	printf("  arena: %.3f ms per load and reset, peak rss %.2f MB\n",
+			arenaTime * 1000.0 / iterations, arenaRss);
+	return 0;
+}
+
+int benchAsync(int argc, char** argv)
+{
+	string fileName = argc > 2 ? argv[2] : "model0/enemyFighter.fbx";
+	u32 flags = argc > 3 && strcmp(argv[3], "nocache") == 0 ? WFBX_LOAD_SKIP_CACHE : 0;
+	flags |= WFBX_LOAD_PACKED | WFBX_LOAD_LODS;
+
+	wfbxMaterialTexture material;
+	memset(&material, 0, sizeof(material));
+
+	// Same flags as main.c. Blocking first, which also writes the 
+	// cache if we're using it, so both loads take the same path after.
+	wfbxModel* model = wfbxLoadModel(fileName, &material, flags);
+	if(!model) {
+		printf("Failed to load %s\n", fileName);
+		return 1;
+	}
+	wfbxFreeModel(model);
+	f64 start = benchTime();
+	model = wfbxLoadModel(fileName, &material, flags);
+	f64 blocking = benchTime() - start;
+	printf("%s (%s)\n", fileName, flags & WFBX_LOAD_SKIP_CACHE ? "native" : "cached");
+	printf("  blocking load: %.3f ms\n", blocking * 1000.0);
+	benchPrintModel(model);
+	wfbxFreeModel(model);
+
+	// Then the way main.c does it, polling once a "frame", with the
+	// thread asleep for 1 ms in between the way a render thread 
+	// waiting on the swap would be, and noting whenever progress
+	// moves 10% or more
+	start = benchTime();
+	wfbxLoad* load = wfbxLoadModelAsync(fileName, &material, flags);
+	f64 returned = benchTime() - start;
+	isize polls = 0;
+	f32 lastShown = -1;
+	printf("  progress:");
+	while(!wfbxLoadReady(load)) {
+		f32 progress = wfbxLoadProgress(load);
+		if(progress >= lastShown + 0.1f) {
+			printf(" %.0f%% at %.2f ms,", progress * 100, (benchTime() - start) * 1000.0);
+			lastShown = progress;
+		}
+		polls++;
+		benchSleep(1);
+	}
+	model = wfbxFinishLoad(load);
+	f64 finished = benchTime() - start;
+	printf(" done at %.2f ms\n", finished * 1000.0);
+	if(!model) {
+		printf("Failed to load %s\n", fileName);
+		return 1;
+	}
+
+	printf("  async: returned after %.3f ms, ready after %.3f ms, %td polls\n",
+			returned * 1000.0, finished * 1000.0, polls);
+	benchPrintModel(model);
+	wfbxFreeModel(model);
+	return 0;
+}
+
+// How far outside the sphere point is, over the radius
+f64 benchSphereOvershoot(const wfbxSphere* sphere, const f32* point)
+{
+	f64 d = 0;
+	for(isize k = 0; k < 3; ++k) {
+		f64 e = (f64)point[k] - sphere->center[k];
+		d += e * e;
+	}
+	return sphere->radius > 0 ? (sqrt(d) - sphere->radius) / sphere->radius : sqrt(d);
+}
+
+int benchBounds(int argc, char** argv)
+{
+	string fileName = argc > 2 ? argv[2] : "model0/enemyFighter.fbx";
+
+	wfbxMaterialTexture material;
+	memset(&material, 0, sizeof(material));
+	wfbxModel* model = wfbxLoadModel(fileName, &material, WFBX_LOAD_SKIP_CACHE);
+	// Once to write the cache, once to read it back
+	wfbxFreeModel(wfbxLoadModel(fileName, &material, 0));
+	wfbxModel* cached = wfbxLoadModel(fileName, &material, 0);
+	if(!model || !cached || model->count != cached->count) {
+		printf("Failed to load %s\n", fileName);
+		return 1;
+	}
+
+	int same = memcmp(&model->modelBounds, &cached->modelBounds, sizeof(wfbxBounds)) == 0 &&
+		memcmp(&model->modelSphere, &cached->modelSphere, sizeof(wfbxSphere)) == 0;
+	for(isize m = 0; m < model->count; ++m) {
+		same = same && memcmp(model->bounds + m, cached->bounds + m, sizeof(wfbxBounds)) == 0 &&
+			memcmp(model->spheres + m, cached->spheres + m, sizeof(wfbxSphere)) == 0;
+	}
+
+	printf("%s\n", fileName);
+	f64 worstMesh = 0, worstModel = 0;
+	isize outsideBox = 0;
+	for(isize m = 0; m < model->count; ++m) {
+		wfbxBounds* b = model->bounds + m;
+		wfbxSphere* s = model->spheres + m;
+		f64 corner = 0;
+		for(isize k = 0; k < 3; ++k) {
+			f64 e = (b->max[k] - b->min[k]) / 2.0;
+			corner += e * e;
+		}
+		corner = sqrt(corner);
+
+		for(isize i = 0; i < model->meshSizes[m]; ++i) {
+			f32* pos = model->meshes[m][i].pos;
+			for(isize k = 0; k < 3; ++k) {
+				if(pos[k] < b->min[k] || pos[k] > b->max[k]) outsideBox++;
+			}
+			f64 over = benchSphereOvershoot(s, pos);
+			if(over > worstMesh) worstMesh = over;
+			over = benchSphereOvershoot(&model->modelSphere, pos);
+			if(over > worstModel) worstModel = over;
+		}
+
+		printf("  mesh %td: center (%.3f, %.3f, %.3f), radius %.4f\n",
+				m, s->center[0], s->center[1], s->center[2], s->radius);
+		printf("    sphere around the box: %.4f, %.1f%% more volume\n",
+				corner, corner > 0 ? 100.0 * (pow(corner / s->radius, 3) - 1) : 0.0);
+	}
+
+	wfbxBounds* b = &model->modelBounds;
+	wfbxSphere* s = &model->modelSphere;
+	printf("  model: (%.3f, %.3f, %.3f) to (%.3f, %.3f, %.3f), radius %.4f\n",
+			b->min[0], b->min[1], b->min[2], b->max[0], b->max[1], b->max[2], s->radius);
+	printf("  vertices outside their box: %td; worst overshoot %.2e (mesh), %.2e (model)\n",
+			outsideBox, worstMesh, worstModel);
+	printf("  cache: %s\n", same ? "same bounds and spheres" : "DIFFERENT");
+
+	wfbxFreeModel(model);
+	wfbxFreeModel(cached);
+	return same && !outsideBox && worstMesh < 1e-6 && worstModel < 1e-6 ? 0 : 1;
+}
+
+typedef struct
+{
+	char filename[256];
+	u8* pixels;
+	i32 w, h;
+	f64 seconds;
+} BenchDecode;
+
+void benchDecodeJob(void* data)
+{
+	BenchDecode* decode = data;
+	i32 bpp;
+	f64 start = benchTime();
+	decode->pixels = stbi_load(decode->filename, &decode->w, &decode->h, &bpp, STBI_rgb_alpha);
+	decode->seconds = benchTime() - start;
+}
+
+int benchTextures(int argc, char** argv)
+{
+	string directory = argc > 2 ? argv[2] : "model0";
+	isize iterations = argc > 3 ? atoi(argv[3]) : 5;
+	if(iterations < 1) iterations = 1;
+	string names[4] = {"diffuse.png", "normals.png", "pbr.png", "emissive.png"};
+
+	// Same as main.c
+	stbi_set_flip_vertically_on_load(1);
+
+	BenchDecode serial[4], pooled[4];
+	f64 best[4], serialBest = 1e30, pooledBest = 1e30;
+	for(isize i = 0; i < 4; ++i) {
+		snprintf(serial[i].filename, sizeof(serial[i].filename), "%s/%s", directory, names[i]);
+		memcpy(pooled[i].filename, serial[i].filename, sizeof(serial[i].filename));
+		best[i] = 1e30;
+	}
+
+	int same = 1;
+	for(isize n = 0; n < iterations; ++n) {
+		f64 start = benchTime();
+		for(isize i = 0; i < 4; ++i) {
+			benchDecodeJob(serial + i);
+			if(serial[i].seconds < best[i]) best[i] = serial[i].seconds;
+		}
+		f64 serialTime = benchTime() - start;
+		if(serialTime < serialBest) serialBest = serialTime;
+
+		wjobCounter counter = {0};
+		start = benchTime();
+		for(isize i = 0; i < 4; ++i) {
+			wjobAdd(&counter, benchDecodeJob, pooled + i);
+		}
+		wjobWait(&counter);
+		f64 pooledTime = benchTime() - start;
+		if(pooledTime < pooledBest) pooledBest = pooledTime;
+
+		for(isize i = 0; i < 4; ++i) {
+			if(!serial[i].pixels || !pooled[i].pixels) {
+				printf("Failed to load %s\n", serial[i].filename);
+				return 1;
+			}
+			same = same && serial[i].w == pooled[i].w && serial[i].h == pooled[i].h &&
+				memcmp(serial[i].pixels, pooled[i].pixels, (size_t)serial[i].w * serial[i].h * 4) == 0;
+			stbi_image_free(serial[i].pixels);
+			stbi_image_free(pooled[i].pixels);
+		}
+	}
+
+	printf("%s, %d workers\n", directory, wjobWorkerCount());
+	f64 slowest = 0;
+	for(isize i = 0; i < 4; ++i) {
+		printf("  %s: %dx%d, best %.2f ms\n", names[i], serial[i].w, serial[i].h, best[i] * 1000.0);
+		if(best[i] > slowest) slowest = best[i];
+	}
+	printf("  one after another: best %.2f ms\n", serialBest * 1000.0);
+	printf("  on the pool: best %.2f ms (%.2fx the slowest decode, %.1fx faster)\n",
+			pooledBest * 1000.0, pooledBest / slowest, serialBest / pooledBest);
+	printf("  pool decodes: %s\n", same ? "same pixels" : "DIFFERENT");
+	return same ? 0 : 1;
+}
+
+int benchCook(int argc, char** argv)
+{
+	string directory = argc > 2 ? argv[2] : "model0";
+	isize iterations = argc > 3 ? atoi(argv[3]) : 3;
+	if(iterations < 1) iterations = 1;
+
+	// Same choices as main.c
+	string names[4] = {"diffuse.png", "normals.png", "pbr.png", "emissive.png"};
+	i32 formats[4] = {WTEX_FORMAT_BC7, WTEX_FORMAT_BC5, WTEX_FORMAT_BC7, WTEX_FORMAT_BC7};
+	u32 mips[4] = {
+		WTEX_MIPS_SRGB | WTEX_MIPS_KAISER, WTEX_MIPS_NORMAL,
+		WTEX_MIPS_KAISER, WTEX_MIPS_SRGB | WTEX_MIPS_KAISER
+	};
+	string formatNames[4] = {"", "BC4", "BC5", "BC7"};
+	stbi_set_flip_vertically_on_load(1);
+
+	printf("%s, %d workers\n", directory, wjobWorkerCount());
+
+	// The emissive map folds into the pbr map's alpha if it can
+	char emissiveName[256];
+	snprintf(emissiveName, sizeof(emissiveName), "%s/%s", directory, names[3]);
+	i32 emissiveW = 0, emissiveH = 0, emissiveBpp;
+	u8* emissive = stbi_load(emissiveName, &emissiveW, &emissiveH, &emissiveBpp, STBI_rgb_alpha);
+	u8 tint[4] = {0};
+	i32 folded = emissive ? wtexFindTint(tint, NULL, emissive, emissiveW, emissiveH, 2) : 0;
+
+	int valid = 1;
+	f64 total = 0;
+	for(isize i = 0; i < 4; ++i) {
+		if(i == 3 && folded) {
+			printf("  %s: folded into %s's alpha, as %s (%d, %d, %d)\n", names[i], names[2],
+					folded == WTEX_TINT_MASK ? "a mask for" : "just", tint[0], tint[1], tint[2]);
+			continue;
+		}
+		char filename[256];
+		snprintf(filename, sizeof(filename), "%s/%s", directory, names[i]);
+		i32 w, h, bpp;
+		u8* pixels = stbi_load(filename, &w, &h, &bpp, STBI_rgb_alpha);
+		if(!pixels) {
+			printf("Failed to load %s\n", filename);
+			return 1;
+		}
+		if(i == 2 && folded) {
+			if(w == emissiveW && h == emissiveH) {
+				wtexFindTint(tint, pixels + 3, emissive, w, h, 2);
+			} else {
+				folded = 0;
+			}
+		}
+
+		f64 best = 1e30;
+		u8* cooked = NULL;
+		isize size = 0;
+		for(isize n = 0; n < iterations; ++n) {
+			free(cooked);
+			f64 start = benchTime();
+			cooked = wtexCook(&size, pixels, w, h, formats[i], mips[i],
+					i == 2 && folded ? tint : NULL, 0, 0);
+			f64 seconds = benchTime() - start;
+			if(!cooked) {
+				printf("Out of memory cooking %s\n", filename);
+				return 1;
+			}
+			if(seconds < best) best = seconds;
+		}
+		total += best;
+
+		wtexImage image;
+		if(!wtexParse(&image, cooked, size)) {
+			printf("  %s: cooked file doesn't parse\n", names[i]);
+			valid = 0;
+			free(cooked);
+			stbi_image_free(pixels);
+			continue;
+		}
+
+		// Top level against the source; BC5 only keeps red and green
+		i32 channels = formats[i] == WTEX_FORMAT_BC5 ? 2 : formats[i] == WTEX_FORMAT_BC4 ? 1 : 4;
+		isize blockBytes = wtexBlockBytes(formats[i]);
+		isize blocksX = (w + 3) / 4;
+		f64 squared = 0;
+		for(i32 y = 0; y < h; ++y) {
+			for(i32 x = 0; x < w; ++x) {
+				u8 block[64];
+				wtexDecodeBlock(block, image.levels[0] + ((y / 4) * blocksX + x / 4) * blockBytes, formats[i]);
+				u8* a = block + ((y % 4) * 4 + x % 4) * 4;
+				u8* b = pixels + ((isize)y * w + x) * 4;
+				for(i32 c = 0; c < channels; ++c) {
+					f64 d = (f64)a[c] - (f64)b[c];
+					squared += d * d;
+				}
+			}
+		}
+		f64 mse = squared / ((f64)w * h * channels);
+		f64 psnr = mse > 0 ? 10.0 * log10(255.0 * 255.0 / mse) : 99.0;
+
+		// What uploadTextureToGpu used to put in VRAM: RGBA8 plus a full chain
+		isize uncompressed = 0;
+		for(i32 level = 0; level < image.levelCount; ++level) {
+			i32 lw = w >> level, lh = h >> level;
+			uncompressed += (isize)(lw ? lw : 1) * (lh ? lh : 1) * 4;
+		}
+		printf("  %s: %dx%d %s, %d levels, best %.1f ms (%.2f Mpixels/s)\n",
+				names[i], w, h, formatNames[formats[i]], image.levelCount,
+				best * 1000.0, (f64)w * h / best / 1e6);
+		printf("    %td bytes, %.1fx smaller than RGBA8; top level %.2f dB\n",
+				size, (f64)uncompressed / (f64)size, psnr);
+
+		free(cooked);
+		stbi_image_free(pixels);
+	}
+	stbi_image_free(emissive);
+	printf("  all of them: %.1f ms\n", total * 1000.0);
+	return valid ? 0 : 1;
+}
+
+f64 benchSrgbToLinear(f64 s)
+{
+	s /= 255.0;
+	return s <= 0.04045 ? s / 12.92 : pow((s + 0.055) / 1.055, 2.4);
+}
+
+int benchMips(int argc, char** argv)
+{
+	string directory = argc > 2 ? argv[2] : "model0";
+	isize iterations = argc > 3 ? atoi(argv[3]) : 5;
+	if(iterations < 1) iterations = 1;
+
+	string names[4] = {"diffuse.png", "normals.png", "pbr.png", "emissive.png"};
+	u32 mips[4] = {WTEX_MIPS_SRGB, WTEX_MIPS_NORMAL, 0, WTEX_MIPS_SRGB};
+	stbi_set_flip_vertically_on_load(1);
+
+	printf("%s, %d workers\n", directory, wjobWorkerCount());
+	int same = 1;
+	for(isize i = 0; i < 4; ++i) {
+		char filename[256];
+		snprintf(filename, sizeof(filename), "%s/%s", directory, names[i]);
+		i32 w, h, bpp;
+		u8* pixels = stbi_load(filename, &w, &h, &bpp, STBI_rgb_alpha);
+		if(!pixels) {
+			printf("Failed to load %s\n", filename);
+			return 1;
+		}
+		isize bytes = wtexMipBytes(w, h);
+		u8* simd = (u8*)malloc(bytes);
+		u8* scalar = (u8*)malloc(bytes);
+		printf("  %s: %dx%d, %d levels\n", names[i], w, h, wtexLevelCount(w, h));
+
+		for(isize kaiser = 0; kaiser < 2; ++kaiser) {
+			u32 flags = mips[i] | (kaiser ? WTEX_MIPS_KAISER : 0);
+			f64 best[2] = {1e30, 1e30};
+			for(isize n = 0; n < iterations; ++n) {
+				f64 start = benchTime();
+				wtexBuildMips(simd, pixels, w, h, flags);
+				f64 middle = benchTime();
+				wtexBuildMips(scalar, pixels, w, h, flags | WTEX_MIPS_SCALAR);
+				f64 end = benchTime();
+				if(middle - start < best[0]) best[0] = middle - start;
+				if(end - middle < best[1]) best[1] = end - middle;
+			}
+			int match = memcmp(simd, scalar, bytes) == 0;
+			same = same && match;
+			printf("    %s: best %.2f ms (%.1f Mpixels/s), plain C %.2f ms; %s\n",
+					kaiser ? "kaiser" : "box", best[0] * 1000.0, (f64)w * h / best[0] / 1e6,
+					best[1] * 1000.0, match ? "same bits" : "DIFFERENT");
+		}
+
+		// The 1x1 level is every pixel averaged, so it should be
+		// as bright as the whole image is in linear light
+		if(mips[i] & WTEX_MIPS_SRGB) {
+			wtexBuildMips(simd, pixels, w, h, mips[i]);
+			u8* last = simd + bytes - 4;
+			f64 source = 0, naive = 0, mip = 0;
+			for(isize c = 0; c < 3; ++c) {
+				f64 sum = 0, sumSrgb = 0;
+				for(isize p = 0; p < (isize)w * h; ++p) {
+					sum += benchSrgbToLinear(pixels[p * 4 + c]);
+					sumSrgb += pixels[p * 4 + c];
+				}
+				source += sum / ((f64)w * h) / 3;
+				naive += benchSrgbToLinear(sumSrgb / ((f64)w * h)) / 3;
+				mip += benchSrgbToLinear(last[c]) / 3;
+			}
+			printf("    1x1 brightness: %.2f%% off the source; averaging sRGB would be %.2f%% off\n",
+					100.0 * (mip - source) / source, 100.0 * (naive - source) / source);
+		}
+
+		free(simd);
+		free(scalar);
+		stbi_image_free(pixels);
+	}
+	return same ? 0 : 1;
+}
+
+u8* benchReadFile(string filename, isize* size)
+{
+	FILE* f = fopen(filename, "rb");
+	if(!f) return NULL;
+	fseek(f, 0, SEEK_END);
+	*size = ftell(f);
+	fseek(f, 0, SEEK_SET);
+	u8* data = (u8*)malloc(*size);
+	if(fread(data, 1, *size, f) != (size_t)*size) {
+		free(data);
+		data = NULL;
+	}
+	fclose(f);
+	return data;
+}
+
+int benchPng(int argc, char** argv)
+{
+	string directory = argc > 2 ? argv[2] : "model0";
+	isize iterations = argc > 3 ? atoi(argv[3]) : 5;
+	if(iterations < 1) iterations = 1;
+
+	string names[4] = {"diffuse.png", "normals.png", "pbr.png", "emissive.png"};
+	stbi_set_flip_vertically_on_load(1);
+
+	printf("%s\n", directory);
+	int same = 1;
+	for(isize i = 0; i < 4; ++i) {
+		char filename[256];
+		snprintf(filename, sizeof(filename), "%s/%s", directory, names[i]);
+		isize size = 0;
+		u8* source = benchReadFile(filename, &size);
+		i32 w, h;
+		if(!source || !wpngInfo(source, size, &w, &h)) {
+			printf("Failed to load %s\n", filename);
+			return 1;
+		}
+		isize bytes = (isize)w * h * 4;
+		u8* simd = (u8*)malloc(bytes);
+		u8* scalar = (u8*)malloc(bytes);
+		u8* reference = NULL;
+		int decoded = 1;
+
+		f64 best[3] = {1e30, 1e30, 1e30};
+		for(isize n = 0; n < iterations; ++n) {
+			i32 stbW, stbH, bpp;
+			f64 start = benchTime();
+			u8* pixels = stbi_load_from_memory(source, (i32)size, &stbW, &stbH, &bpp, STBI_rgb_alpha);
+			f64 first = benchTime();
+			decoded &= wpngDecode(simd, source, size, WPNG_FLIP);
+			f64 second = benchTime();
+			decoded &= wpngDecode(scalar, source, size, WPNG_FLIP | WPNG_SCALAR);
+			f64 end = benchTime();
+			if(first - start < best[0]) best[0] = first - start;
+			if(second - first < best[1]) best[1] = second - first;
+			if(end - second < best[2]) best[2] = end - second;
+			decoded &= pixels && stbW == w && stbH == h;
+			if(reference) stbi_image_free(pixels);
+			else reference = pixels;
+		}
+		int match = decoded && memcmp(reference, simd, bytes) == 0 && memcmp(reference, scalar, bytes) == 0;
+		same = same && match;
+		f64 megabytes = bytes / 1e6;
+		printf("  %s: %dx%d, %.0f KB\n", names[i], w, h, size / 1024.0);
+		printf("    stb_image %.2f ms (%.0f MB/s), wb_png %.2f ms (%.0f MB/s, %.1fx), plain C %.2f ms (%.0f MB/s); %s\n",
+				best[0] * 1000.0, megabytes / best[0], best[1] * 1000.0, megabytes / best[1], best[0] / best[1],
+				best[2] * 1000.0, megabytes / best[2], match ? "same bytes" : "DIFFERENT");
+
+		free(simd);
+		free(scalar);
+		stbi_image_free(reference);
+		free(source);
+	}
+	return same ? 0 : 1;
+}
+
+int benchCull(int argc, char** argv)
+{
+	isize count = argc > 2 ? atoi(argv[2]) : 1000000;
+	isize iterations = argc > 3 ? atoi(argv[3]) : 20;
+	if(count < 1) count = 1;
+	if(iterations < 1) iterations = 1;
+	if(argc > 4) {
+		wjobStartup(atoi(argv[4]));
+	}
+
+	// Spread through a box around the orbit, about as dense
+	// whatever the count, so a similar share ends up in view
+	wcullSpheres spheres;
+	if(!wcullCreate(&spheres, count)) {
+		printf("Out of memory\n");
+		return 1;
+	}
+	f32 half = 10.0f * cbrtf((f32)count);
+	u32 state = 0x9E3779B9u;
+	for(isize i = 0; i < count; ++i) {
+		f32 r[4];
+		for(isize k = 0; k < 4; ++k) {
+			state ^= state << 13;
+			state ^= state >> 17;
+			state ^= state << 5;
+			r[k] = (state >> 8) / 16777216.0f;
+		}
+		spheres.x[i] = (r[0] * 2 - 1) * half;
+		spheres.y[i] = (r[1] * 2 - 1) * half;
+		spheres.z[i] = (r[2] * 2 - 1) * half;
+		spheres.radius[i] = 0.5f + r[3] * 4;
+	}
+
+	unsigned int* lists[3];
+	for(isize i = 0; i < 3; ++i) {
+		lists[i] = (unsigned int*)malloc(sizeof(unsigned int) * spheres.padded);
+	}
+	static const u32 flags[3] = {WCULL_SINGLE_THREAD | WCULL_SCALAR, WCULL_SINGLE_THREAD, 0};
+	f64 best[3] = {1e30, 1e30, 1e30};
+	isize kept = 0;
+	int same = 1;
+	for(isize n = 0; n < iterations; ++n) {
+		f32 viewProjection[16], cameraPos[3], planes[24];
+		benchOrbitCamera(viewProjection, cameraPos, n * 6.2831853f / iterations);
+		wcullPlanes(planes, viewProjection);
+		isize found[3];
+		for(isize i = 0; i < 3; ++i) {
+			f64 start = benchTime();
+			found[i] = wcullFrustum(lists[i], &spheres, planes, flags[i]);
+			f64 elapsed = benchTime() - start;
+			if(elapsed < best[i]) best[i] = elapsed;
+		}
+		for(isize i = 1; i < 3; ++i) {
+			same = same && found[i] == found[0] && 
+				memcmp(lists[i], lists[0], sizeof(unsigned int) * found[0]) == 0;
+		}
+		kept += found[0];
+	}
+
+	printf("%td spheres, %d workers, %.1f%% in view on average\n", count, wjobWorkerCount(),
+			100.0 * kept / iterations / count);
+	printf("  plain C %.3f ms, SIMD %.3f ms (%.1fx), SIMD on the pool %.3f ms (%.1fx); %s\n",
+			best[0] * 1000.0, best[1] * 1000.0, best[0] / best[1],
+			best[2] * 1000.0, best[0] / best[2], same ? "same spheres" : "DIFFERENT");
+	for(isize i = 0; i < 3; ++i) free(lists[i]);
+	wcullDestroy(&spheres);
+	return same ? 0 : 1;
+}
+
+int main(int argc, char** argv)
+{
+	if(argc > 1 && strcmp(argv[1], "fbx") == 0) {
+		return benchFbx(argc, argv);
+	}
+	if(argc > 1 && strcmp(argv[1], "cache") == 0) {
+		return benchCache(argc, argv);
+	}
+	if(argc > 1 && strcmp(argv[1], "weld") == 0) {
+		return benchWeld(argc, argv);
+	}
+	if(argc > 1 && strcmp(argv[1], "vcache") == 0) {
+		return benchVertexCache(argc, argv);
+	}
+	if(argc > 1 && strcmp(argv[1], "packed") == 0) {
+		return benchPacked(argc, argv);
+	}
+	if(argc > 1 && strcmp(argv[1], "tangents") == 0) {
+		return benchTangents(argc, argv);
+	}
+	if(argc > 1 && strcmp(argv[1], "meshlets") == 0) {
+		return benchMeshlets(argc, argv);
+	}
+	if(argc > 1 && strcmp(argv[1], "lods") == 0) {
+		return benchLods(argc, argv);
+	}
+	if(argc > 1 && strcmp(argv[1], "unload") == 0) {
+		return benchUnload(argc, argv);
+	}
+	if(argc > 1 && strcmp(argv[1], "async") == 0) {
+		return benchAsync(argc, argv);
+	}
+	if(argc > 1 && strcmp(argv[1], "bounds") == 0) {
+		return benchBounds(argc, argv);
+	}
+	if(argc > 1 && strcmp(argv[1], "textures") == 0) {
+		return benchTextures(argc, argv);
+	}
+	if(argc > 1 && strcmp(argv[1], "cook") == 0) {
+		return benchCook(argc, argv);
+	}
+	if(argc > 1 && strcmp(argv[1], "mips") == 0) {
+		return benchMips(argc, argv);
+	}
+	if(argc > 1 && strcmp(argv[1], "png") == 0) {
+		return benchPng(argc, argv);
+	}
+	if(argc > 1 && strcmp(argv[1], "cull") == 0) {
+		return benchCull(argc, argv);
+	}
+
+	printf("usage: wb_bench fbx [model.fbx] [iterations] [sdk | workers]\n");
+	printf("       wb_bench cache [model.fbx] [iterations]\n");
+	printf("       wb_bench weld [model.fbx] [iterations]\n");
+	printf("       wb_bench vcache [model.fbx] [iterations] [cache size]\n");
+	printf("       wb_bench packed [model.fbx]\n");
+	printf("       wb_bench tangents [model.fbx] [iterations]\n");
+	printf("       wb_bench meshlets [model.fbx]\n");
+	printf("       wb_bench lods [model.fbx] [iterations]\n");
+	printf("       wb_bench unload [model.fbx] [iterations] [nocache]\n");
+	printf("       wb_bench async [model.fbx] [nocache]\n");
+	printf("       wb_bench bounds [model.fbx]\n");
+	printf("       wb_bench textures [directory] [iterations]\n");
+	printf("       wb_bench cook [directory] [iterations]\n");
+	printf("       wb_bench mips [directory] [iterations]\n");
+	printf("       wb_bench png [directory] [iterations]\n");
+	printf("       wb_bench cull [count] [iterations] [workers]\n");
+	return 1;
+}
@@ -3,8 +3,8 @@
 // stddef gets me ptrdiff_t, which I use a lot,
 // stdint gets me nice integers types,
 // and stdio gets me printf. 
-// If it weren't for fbxsdk, I probably wouldn't
-// compile with the CRT.
+// I could probably get away without the CRT
+// now that the FBX loader doesn't need fbxsdk.
 #include <stddef.h>
 #include <stdint.h>
 #include <stdio.h> 
@@ -21,7 +21,11 @@
 // but in C we don't have those
 #include "shaders.h"
 
-// Other than the CRT and fbxsdk, stb_image is the only library I'm using.
+// The job pool wb_fbx uses; textures decode on it too.
+// Its implementation comes in with wb_fbx.cc.
+#include "wb_jobs.h"
+
+// Other than the CRT, stb_image is the only library I'm using.
 // PNG decoding is involved even if you have a deflate decoder handy, 
 // so this ends up being the lightest implementation around.
 #define STB_IMAGE_IMPLEMENTATION
@@ -37,10 +41,29 @@
 #define WB_GL_USE_ALL_VERSIONS
 #include "wb_gl_loader.h"
 
+// Textures get cooked into block compressed mip chains the first
+// time they load, and the result kept next to the PNG.
+// Its implementation goes here, since nothing else uses it.
+#define WB_TEX_IMPLEMENTATION
+#include "wb_tex.h"
+
+// stb_image is thorough, but slow on big PNGs, so the textures
+// decode through this first and only fall back on stb_image for
+// the PNGs it won't take.
+#define WB_PNG_IMPLEMENTATION
+#include "wb_png.h"
+
+// --cpu-cull tests every copy's sphere against the frustum with
+// this, 8 at a time and across the job pool, before going through
+// the meshes of the ones left.
+#define WB_CULL_IMPLEMENTATION
+#include "wb_cull.h"
+
 // nice numerical types
 typedef int32_t i32;
 typedef uint8_t u8;
 typedef uint32_t u32;
+typedef uint64_t u64;
 typedef float f32;
 typedef ptrdiff_t isize;
 
@@ -48,9 +71,9 @@ typedef ptrdiff_t isize;
 // exclusively means "string literal" in my code
 typedef const char* string;
 
-// I compile the fbx loading code separately 
-// because huge libraries in C++ take a long
-// time to compile
+// I compile the fbx loading code separately;
+// it used to pull in fbxsdk, and huge libraries
+// in C++ take a long time to compile
 #include "wb_fbx.cc"
 
 // I pulled a lot of the stuff that goes into 
@@ -66,9 +89,16 @@ typedef const char* string;
 //
 // The program doesn't need these to run
 // Hopefully self-explanatory
-Texture* loadTexture(string filename);
-void uploadTextureToGpu(Texture* texture);
+Texture* loadTexture(string filename, string maskFilename, i32 format, u32 mipFlags, u8* staging, isize stagingSize);
+void uploadTextureToGpu(Texture* texture, TextureStaging* staging);
+void createTextureStaging(TextureStaging* staging, isize slotSize);
+void destroyTextureStaging(TextureStaging* staging);
+u8* acquireStagingSlot(TextureStaging* staging, i32* slot);
+void releaseStagingSlot(TextureStaging* staging, i32 slot);
+u32 createSolidTexture(const u8* rgba);
 void createShader(Shader* shader, string vertSrc, string fragSrc);
+void createComputeShader(Shader* shader, string compSrc);
+void bindStorageBlock(u32 program, string name, u32 binding, u32 buffer);
 
 // Standard look-at camera setup
 void makeCamera(Camera* cam, vec3 pos, vec3 target, vec3 up);
@@ -85,7 +115,12 @@ void perspectiveMatrix4(f32* matrix,
 		f32 nearPlane, f32 farPlane);
 void orthoMatrix4(f32* matrix, f32 w, f32 h);
 
-// Some convenience structure for creating lighting
+// Frustum culling: planes is 6 xyzw planes
+void frustumPlanes(f32* planes, f32* proj, f32* view);
+i32 sphereInFrustum(f32* planes, vec3 center, f32 radius);
+
+// Some convenience structure for creating lighting.
+// pos.w is the light's radius; it fades out to nothing there.
 typedef struct
 {
 	float pos[4];
@@ -93,18 +128,236 @@ typedef struct
 } Light;
 
 struct {
-	Light lights[16];
-	int lightCount;
+	Light* lights;
+	isize lightCount, lightCapacity;
 } scene;
 
-void addLight(f32 x, f32 y, f32 z, f32 r, f32 g, f32 b)
+// Clustered lighting
+//
+// The view frustum gets cut into a grid of clusters: tiles across
+// the screen, and slices in depth that get thicker with distance,
+// so far clusters aren't slivers. Every frame, each light goes in
+// the clusters its sphere touches, and frag3d only goes through the
+// lights in its own cluster, so the cost per fragment follows how
+// many lights reach it rather than how many there are.
+#define CLUSTER_X 16
+#define CLUSTER_Y 9
+#define CLUSTER_Z 24
+#define CLUSTER_COUNT (CLUSTER_X * CLUSTER_Y * CLUSTER_Z)
+// Lights past this many, over all the clusters, get left out
+#define CLUSTER_INDEX_CAPACITY (1 << 20)
+
+// ranges is each cluster's first index and count, for frag3d's
+// ClusterBuffer, and indices its lights, for LightIndexBuffer.
+// Clusters go x first, then y, then z.
+typedef struct
+{
+	u32 ranges[CLUSTER_COUNT][2];
+	u32* indices;
+	isize indexCount;
+	// Scratch, for filling the ranges in
+	u32 filled[CLUSTER_COUNT];
+} LightClusters;
+
+// Every mesh shares one vertex and one index buffer, so the whole
+// model, in every place we put it, goes out in one multi-draw.
+// Each mesh gets a command per LOD, the full mesh first, and every
+// copy of the model drawing that LOD is an instance of it.
+//
+// A mesh's indices are followed by its LOD indices, and they're all 
+// relative to the mesh's first vertex, which baseVertex adds back.
+typedef struct
+{
+	u32 firstIndex;
+	u32 indexCount;
+	i32 baseVertex;
+	u32 firstLodIndex;
+	u32 firstCommand;
+} MeshRange;
+
+// Laid out the way glMultiDrawElementsIndirect reads them
+typedef struct
+{
+	u32 count;
+	u32 instanceCount;
+	u32 firstIndex;
+	i32 baseVertex;
+	u32 baseInstance;
+} DrawCommand;
+
+// One copy of the model, laid out for vert3d's InstanceBuffer.
+// The transform is the top three rows of a row-major matrix, with
+// the same scale on every axis; scale is that scale, for spheres.
+typedef struct
+{
+	f32 rows[3][4];
+	u32 material;
+	f32 scale;
+	u32 pad[2];
+} Instance;
+
+// Per mesh, for vert3d's MeshBuffer.
+// Positions are stored relative to each mesh's bounds.
+typedef struct
+{
+	f32 boundsMin[4];
+	f32 boundsExtent[4];
+} MeshData;
+
+// Per mesh, for compCull's CullMeshBuffer
+typedef struct
+{
+	f32 sphere[4];
+	u32 firstCommand;
+	u32 lodCount;
+	u32 pad[2];
+} CullMesh;
+
+// Per-instance vertex attribute: the copy and the mesh it draws.
+// Instance attributes still honor baseInstance with a divisor of 1,
+// so each command reads its own run of these.
+typedef struct
+{
+	u32 instance;
+	u32 mesh;
+} DrawData;
+
+// Textures decode on the job pool while we render, one job each
+typedef struct
+{
+	string filename;
+	// The emissive map, for the pbr map's alpha
+	string maskFilename;
+	i32 format;
+	u32 mipFlags;
+	Texture* texture;
+	// The slot of the staging ring the job writes into, if it got one
+	u8* staging;
+	isize stagingSize;
+	i32 stagingSlot;
+	wjobCounter counter;
+	i32 done;
+} TextureLoad;
+
+void loadTextureJob(void* data)
+{
+	TextureLoad* load = data;
+	load->texture = loadTexture(load->filename, load->maskFilename, load->format, load->mipFlags, 
+			load->staging, load->stagingSize);
+}
+
+void queueTextureLoad(TextureLoad* load, TextureStaging* staging)
+{
+	load->done = 0;
+	load->staging = acquireStagingSlot(staging, &load->stagingSlot);
+	load->stagingSize = load->staging ? staging->slotSize : 0;
+	wjobAdd(&load->counter, loadTextureJob, load);
+}
+
+// Where the copies of the model go
+#define PLACEMENT_COUNT 5
+f32 placements[PLACEMENT_COUNT][3] = {
+	{0, -2, 0}, {10, -2, 0}, {-10, -2, 0}, {0, 8, 0}, {0, -10, 5}
+};
+
+// Room for each copy in the stress test's grid; the model's
+// about 15 units across
+#define STRESS_SPACING 20.0f
+
+// The placements above, or for the stress test, count copies in
+// a cube around the origin, each turned, scaled and tinted at random
+void placeInstances(Instance* instances, isize count, i32 stress)
 {
-	if(scene.lightCount >= 16) return;
+	isize side = 1;
+	while(side * side * side < count) side++;
+	u32 seed = 0x9E3779B9;
+	for(isize i = 0; i < count; ++i) {
+		Instance* instance = instances + i;
+		f32 angle = 0, scale = 1, offset[3];
+		u32 material = 0;
+		if(stress) {
+			for(isize k = 0; k < 3; ++k) {
+				seed ^= seed << 13;
+				seed ^= seed >> 17;
+				seed ^= seed << 5;
+			}
+			angle = (seed & 0xFFFF) * (6.28318531f / 65536);
+			scale = 0.75f + ((seed >> 16) & 0xFF) / 512.0f;
+			material = seed >> 30;
+			offset[0] = (i % side - side / 2) * STRESS_SPACING;
+			offset[1] = (i / side % side - side / 2) * STRESS_SPACING;
+			offset[2] = (i / side / side - side / 2) * STRESS_SPACING;
+		} else {
+			memcpy(offset, placements[i], sizeof(offset));
+		}
+		// A turn about y, scaled
+		f32 c = cosf(angle) * scale, s = sinf(angle) * scale;
+		f32 rows[3][4] = {
+			{c, 0, s, offset[0]},
+			{0, scale, 0, offset[1]},
+			{-s, 0, c, offset[2]}
+		};
+		memcpy(instance->rows, rows, sizeof(rows));
+		instance->material = material;
+		instance->scale = scale;
+		instance->pad[0] = instance->pad[1] = 0;
+	}
+}
+
+// Where --lights puts its lights: spread through the box around
+// the five copies, or the stress test's cube, with a random color.
+// The fewer there are, the bigger they get, so about as many reach
+// any one spot, and the brighter, so they light it about as much.
+void scatterLights(Light* lights, isize count, i32 stress, isize instanceCount)
+{
+	f32 boxMin[3] = {-20, -16, -10}, boxSize[3] = {40, 32, 25};
+	if(stress) {
+		f32 gridSize = cbrtf((f32)instanceCount) * STRESS_SPACING;
+		for(isize k = 0; k < 3; ++k) {
+			boxMin[k] = -gridSize / 2;
+			boxSize[k] = gridSize;
+		}
+	}
+	f32 radius = 2 * cbrtf(boxSize[0] * boxSize[1] * boxSize[2] / count);
+	f32 brightness = 0.02f * radius * radius;
+	u32 seed = 0x2545F491;
+	for(isize i = 0; i < count; ++i) {
+		f32 r[6];
+		for(isize k = 0; k < 6; ++k) {
+			seed ^= seed << 13;
+			seed ^= seed >> 17;
+			seed ^= seed << 5;
+			r[k] = (seed >> 8) / 16777216.0f;
+		}
+		Light* l = lights + i;
+		for(isize k = 0; k < 3; ++k) {
+			l->pos[k] = boxMin[k] + r[k] * boxSize[k];
+			l->color[k] = (0.2f + 0.8f * r[3 + k]) * brightness;
+		}
+		l->pos[3] = radius;
+		l->color[3] = 1;
+	}
+}
+
+// Where a point in the model ends up for an instance
+vec3 instancePoint(Instance* instance, const f32* p)
+{
+	f32 out[3];
+	for(isize k = 0; k < 3; ++k) {
+		f32* row = instance->rows[k];
+		out[k] = row[0] * p[0] + row[1] * p[1] + row[2] * p[2] + row[3];
+	}
+	return v3(out[0], out[1], out[2]);
+}
+
+void addLight(f32 x, f32 y, f32 z, f32 r, f32 g, f32 b, f32 radius)
+{
+	if(scene.lightCount >= scene.lightCapacity) return;
 	Light* l = scene.lights + scene.lightCount++;
 	l->pos[0] = x;
 	l->pos[1] = y;
 	l->pos[2] = z;
-	l->pos[3] = 0;
+	l->pos[3] = radius;
 
 	l->color[0] = r;
 	l->color[1] = g;
@@ -112,6 +365,94 @@ void addLight(f32 x, f32 y, f32 z, f32 r, f32 g, f32 b)
 	l->color[3] = 1;
 }
 
+// The tiles a light's sphere covers in one slice, as the part of
+// the sphere between the slice's depths, boxed up and projected.
+// The box is widest on its near side left of center, and its far
+// side right of it, and the same for y.
+// Returns 0 if it misses the screen.
+i32 lightClusterRect(i32* rect, f32* center, f32 radius, f32 nearDepth, f32 farDepth, f32* proj)
+{
+	// Depths are positive going into the screen
+	f32 depth = -center[2];
+	f32 lo = depth - radius > nearDepth ? depth - radius : nearDepth;
+	f32 hi = depth + radius < farDepth ? depth + radius : farDepth;
+	f32 dz = depth < lo ? lo - depth : depth > hi ? depth - hi : 0;
+	f32 r2 = radius * radius - dz * dz;
+	f32 r = r2 > 0 ? sqrtf(r2) : 0;
+	static const i32 tiles[2] = {CLUSTER_X, CLUSTER_Y};
+	for(isize k = 0; k < 2; ++k) {
+		f32 scale = proj[k * 5];
+		f32 low = center[k] - r, high = center[k] + r;
+		f32 ndcLow = scale * low / (low < 0 ? lo : hi);
+		f32 ndcHigh = scale * high / (high > 0 ? lo : hi);
+		if(ndcLow >= 1 || ndcHigh <= -1) return 0;
+		i32 first = (i32)((ndcLow * 0.5f + 0.5f) * tiles[k]);
+		i32 last = (i32)((ndcHigh * 0.5f + 0.5f) * tiles[k]);
+		rect[k * 2] = first < 0 ? 0 : first;
+		rect[k * 2 + 1] = last >= tiles[k] ? tiles[k] - 1 : last;
+	}
+	return 1;
+}
+
+// Puts every light in the clusters it reaches, for proj and view.
+// Slice z covers depths near * (far / near)^(z / CLUSTER_Z) up to
+// the next one's, the same as frag3d works them out.
+// Two passes: one counts each cluster's lights, so each knows
+// where its run of indices starts, and one fills them in.
+void buildLightClusters(LightClusters* clusters, f32* proj, f32* view, f32 nearPlane, f32 farPlane)
+{
+	f32 depths[CLUSTER_Z + 1];
+	f32 slicesPerLog = CLUSTER_Z / logf(farPlane / nearPlane);
+	for(isize z = 0; z <= CLUSTER_Z; ++z) {
+		depths[z] = nearPlane * expf(z / slicesPerLog);
+	}
+	memset(clusters->ranges, 0, sizeof(clusters->ranges));
+	memset(clusters->filled, 0, sizeof(clusters->filled));
+
+	for(isize pass = 0; pass < 2; ++pass) {
+		for(isize i = 0; i < scene.lightCount; ++i) {
+			f32* pos = scene.lights[i].pos;
+			f32 center[3];
+			for(isize k = 0; k < 3; ++k) {
+				center[k] = view[k] * pos[0] + view[4 + k] * pos[1] + view[8 + k] * pos[2] + view[12 + k];
+			}
+			f32 radius = pos[3];
+			f32 depth = -center[2];
+			if(depth + radius < nearPlane || depth - radius > farPlane) continue;
+			i32 firstSlice = depth - radius > nearPlane ? (i32)(logf((depth - radius) / nearPlane) * slicesPerLog) : 0;
+			i32 lastSlice = (i32)(logf((depth + radius) / nearPlane) * slicesPerLog);
+			if(firstSlice > CLUSTER_Z - 1) firstSlice = CLUSTER_Z - 1;
+			if(lastSlice > CLUSTER_Z - 1) lastSlice = CLUSTER_Z - 1;
+			for(i32 z = firstSlice; z <= lastSlice; ++z) {
+				i32 rect[4];
+				if(!lightClusterRect(rect, center, radius, depths[z], depths[z + 1], proj)) continue;
+				for(i32 y = rect[2]; y <= rect[3]; ++y) {
+					for(i32 x = rect[0]; x <= rect[1]; ++x) {
+						isize c = (z * CLUSTER_Y + y) * CLUSTER_X + x;
+						if(pass == 0) {
+							clusters->ranges[c][1]++;
+						} else if(clusters->filled[c] < clusters->ranges[c][1]) {
+							clusters->indices[clusters->ranges[c][0] + clusters->filled[c]++] = i;
+						}
+					}
+				}
+			}
+		}
+		if(pass == 0) {
+			// Runs go back to back, as long as there's room
+			u32 first = 0;
+			for(isize c = 0; c < CLUSTER_COUNT; ++c) {
+				u32 count = clusters->ranges[c][1];
+				if(count > CLUSTER_INDEX_CAPACITY - first) count = CLUSTER_INDEX_CAPACITY - first;
+				clusters->ranges[c][0] = first;
+				clusters->ranges[c][1] = count;
+				first += count;
+			}
+			clusters->indexCount = first;
+		}
+	}
+}
+
 // I know long functions are generally frowned upon, but in
 // the name of simplicity, I think it makes sense for a program
 // this small to keep the main program code together and sequential
@@ -119,7 +460,37 @@ int main(int argc, char** argv)
 {
 	stbi_set_flip_vertically_on_load(1);
 
-	// Simplistic way of setting up command line args
+	// Simplistic way of setting up command line args.
+	// Options go ahead of the rest:
+	// --instances n swaps the five copies of the model for n of
+	// them in a grid, and reports frame times.
+	// --cpu-cull culls and picks LODs on the CPU instead of in a 
+	// compute shader.
+	// --lights n adds n small lights drifting around the copies,
+	// for seeing how the clustered lighting holds up.
+	isize instanceCount = PLACEMENT_COUNT;
+	isize extraLights = 0;
+	i32 stress = 0, cpuCull = 0;
+	while(argc > 1 && strncmp(argv[1], "--", 2) == 0) {
+		if(argc > 2 && strcmp(argv[1], "--instances") == 0) {
+			instanceCount = atoi(argv[2]);
+			if(instanceCount < 1) instanceCount = 1;
+			stress = 1;
+			argc--;
+			argv++;
+		} else if(argc > 2 && strcmp(argv[1], "--lights") == 0) {
+			extraLights = atoi(argv[2]);
+			if(extraLights < 0) extraLights = 0;
+			argc--;
+			argv++;
+		} else if(strcmp(argv[1], "--cpu-cull") == 0) {
+			cpuCull = 1;
+		} else {
+			printf("Unknown option %s\n", argv[1]);
+		}
+		argc--;
+		argv++;
+	}
 	string fileName = NULL;
 	string diffuseTextureName = NULL;
 	string normalTextureName = NULL;
@@ -193,6 +564,10 @@ int main(int argc, char** argv)
 	}
 
 	SDL_GL_MakeCurrent(window, glctx);
+	// The stress tests want frame times, not the refresh rate
+	if(stress || extraLights) {
+		SDL_GL_SetSwapInterval(0);
+	}
 	struct wbgl_ErrorContext errorCtx;
 	if(wbgl_load_all(&errorCtx)) {
 		printf("Failed to load %d OpenGL functions \n", errorCtx.error_count);
@@ -215,44 +590,100 @@ int main(int argc, char** argv)
 	}
 
 	// Most of our OpenGL state
-	u32 vao, vbo, eab, ssbo;
+	u32 vao, vbo, eab, ssbo, drawDataBuffer, commandBuffer;
+	u32 instanceBuffer, meshBuffer;
+	u32 cullMeshBuffer, lodErrorBuffer, countBuffer, choiceBuffer;
+	u32 clusterBuffer, lightIndexBuffer;
 	Shader shader;
 
 	Camera cam;
 
-	Texture *diffuse = NULL, *normals = NULL, *pbr = NULL, *emissive = NULL;
-	i32 uViewLoc, uProjLoc, uDiffuse, uNormal, uPbr, uEmissive, uOffset, uDoLightSkip;
+	i32 uViewLoc, uProjLoc, uDiffuse, uNormal, uPbr, uEmissive, uDoLightSkip;
+	i32 uEmissiveColor, uEmissiveTextured, uClusterScale, uClusterDepth;
 	f32 projMatrix[16], viewMatrix[16];
 	i32 lightSkip = 1;
+
+	// Nothing loads up front; the model and textures stream in on 
+	// the job pool while we render. Until a texture lands, its slot 
+	// holds a 1x1 placeholder, and until the model does, we draw 
+	// just the lights. The GL side of both happens in the main loop.
+	string textureNames[4] = {
+		diffuseTextureName, normalTextureName, pbrTextureName, emissiveTextureName
+	};
+	// Color in BC7 with its mips filtered in linear light; normals in
+	// BC5, x and y only; metal/rough/AO in BC7, filtered as they are.
+	// Normals stick to the box, since Kaiser's ringing turns into
+	// sparkle once it's lit.
+	static const i32 textureFormats[4] = {
+		WTEX_FORMAT_BC7, WTEX_FORMAT_BC5, WTEX_FORMAT_BC7, WTEX_FORMAT_BC7
+	};
+	static const u32 textureMips[4] = {
+		WTEX_MIPS_SRGB | WTEX_MIPS_KAISER,
+		WTEX_MIPS_NORMAL,
+		WTEX_MIPS_KAISER,
+		WTEX_MIPS_SRGB | WTEX_MIPS_KAISER
+	};
+	TextureLoad textureLoads[4];
+	TextureStaging textureStaging;
+	u32 textures[4];
+	wfbxLoad* modelLoad = NULL;
 	wfbxModel* model = NULL;
+	MeshRange* meshRanges = NULL;
+	DrawCommand* commands = NULL;
+	isize commandCount = 0;
+	Instance* instances = malloc(sizeof(Instance) * instanceCount);
+	placeInstances(instances, instanceCount, stress);
+	// --lights' lights drift around where they start out
+	Light* lightHomes = malloc(sizeof(Light) * (extraLights ? extraLights : 1));
+	scatterLights(lightHomes, extraLights, stress, instanceCount);
+	scene.lightCapacity = 6 + extraLights;
+	scene.lights = malloc(sizeof(Light) * scene.lightCapacity);
+	LightClusters* clusters = malloc(sizeof(LightClusters));
+	clusters->indices = malloc(sizeof(u32) * CLUSTER_INDEX_CAPACITY);
+	// Per frame: which command each mesh of each copy went to, and
+	// the copies and meshes sorted by command
+	u32* drawCommands = NULL;
+	DrawData* drawData = NULL;
+	// With --cpu-cull, every copy's model sphere, and the ones in view
+	wcullSpheres instanceSpheres = {0};
+	u32* visibleInstances = NULL;
 	{
-		// Load our textures if we got filenames for them
-		if(diffuseTextureName) {
-			diffuse = loadTexture(diffuseTextureName);
-			uploadTextureToGpu(diffuse);
-		}
-
-		if(normalTextureName) {
-			normals = loadTexture(normalTextureName);
-			uploadTextureToGpu(normals);
-		}
-
-		if(pbrTextureName) {
-			pbr = loadTexture(pbrTextureName);
-			uploadTextureToGpu(pbr);
+		// Grey, a flat normal, rough and unoccluded, and no glow
+		static const u8 placeholders[4][4] = {
+			{128, 128, 128, 255}, {128, 128, 255, 255}, {0, 200, 255, 255}, {0, 0, 0, 255}
+		};
+		memset(textureLoads, 0, sizeof(textureLoads));
+		// Enough for a 2048x2048 BC7 texture with its mips
+		createTextureStaging(&textureStaging, 8 << 20);
+		// The emissive map tries folding into the pbr map's alpha, as
+		// a mask for a color frag3d gets as a uniform. It only loads
+		// on its own if that doesn't work out; see the pickup below.
+		if(pbrTextureName && emissiveTextureName) {
+			textureLoads[2].maskFilename = emissiveTextureName;
 		}
-
-		if(emissiveTextureName) {
-			emissive = loadTexture(emissiveTextureName);
-			uploadTextureToGpu(emissive);
+		for(isize i = 0; i < 4; ++i) {
+			textures[i] = createSolidTexture(placeholders[i]);
+			textureLoads[i].filename = textureNames[i];
+			textureLoads[i].format = textureFormats[i];
+			textureLoads[i].mipFlags = textureMips[i];
+			if(i == 3 && textureLoads[2].maskFilename) {
+				textureLoads[i].done = 1;
+			} else if(textureNames[i]) {
+				queueTextureLoad(textureLoads + i, &textureStaging);
+			} else {
+				textureLoads[i].done = 1;
+			}
 		}
 
-		// Create our model
+		// Materials are for renderers that bind per mesh; 
+		// we bind our own, so they just get the placeholders.
+		// Packed vertices are 16 bytes instead of 56;
+		// vert3d unpacks them. LODs get picked per draw, below.
 		wfbxMaterialTexture defaultTexture = {
-			diffuse->id, normals->id, pbr->id, emissive->id,
-			diffuse->w, diffuse->h
+			textures[0], textures[1], textures[2], textures[3], 1, 1
 		};
-		model = wfbxLoadModelFromFile(fileName, &defaultTexture);
+		modelLoad = wfbxLoadModelAsync(fileName, &defaultTexture, 
+				WFBX_LOAD_PACKED | WFBX_LOAD_LODS);
 
 		// Do all the OpenGL stuff that OpenGL wants
 		// vert3d and frag3d are from shaders.h, by the way.
@@ -265,33 +696,31 @@ int main(int argc, char** argv)
 		glBindBuffer(GL_ARRAY_BUFFER, vbo);
 
 		isize i = 0; 
-		i32 stride = sizeof(wfbxVertex);
-#define voffset(name) (void*)(offsetof(wfbxVertex, name))
-		glVertexAttribPointer(i, 4, GL_FLOAT, 0, stride, voffset(pos));
+		i32 stride = sizeof(wfbxPackedVertex);
+#define voffset(name) (void*)(offsetof(wfbxPackedVertex, name))
+		glVertexAttribPointer(i, 4, GL_UNSIGNED_SHORT, 1, stride, voffset(pos));
 		glEnableVertexAttribArray(i++);
-		glVertexAttribPointer(i, 4, GL_FLOAT, 0, stride, voffset(normal));
+		glVertexAttribPointer(i, 2, GL_SHORT, 1, stride, voffset(normal));
 		glEnableVertexAttribArray(i++);
-		glVertexAttribPointer(i, 2, GL_FLOAT, 0, stride, voffset(uv));
+		glVertexAttribPointer(i, 2, GL_HALF_FLOAT, 0, stride, voffset(uv));
 		glEnableVertexAttribArray(i++);
 
-		// Buffer static model data
-		glBufferData(GL_ARRAY_BUFFER, 
-				sizeof(wfbxVertex) * model->meshSizes[0], 
-				model->meshes[0],
-				GL_STATIC_DRAW);
+		// Per-instance attributes, filled in every frame once the 
+		// model's here
+		glGenBuffers(1, &drawDataBuffer);
+		glBindBuffer(GL_ARRAY_BUFFER, drawDataBuffer);
+		glVertexAttribIPointer(i, 2, GL_UNSIGNED_INT, sizeof(DrawData), (void*)0);
+		glVertexAttribDivisor(i, 1);
+		glEnableVertexAttribArray(i++);
 
 		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, eab);
-		glBufferData(GL_ELEMENT_ARRAY_BUFFER, 
-				sizeof(int) * model->indexCounts[0], 
-				model->indices[0],
-				GL_STATIC_DRAW);
+		glGenBuffers(1, &commandBuffer);
 
 		glUseProgram(shader.program);
 
 		// Uniform locations
 		uProjLoc = glGetUniformLocation(shader.program, "uProjection");
 		uViewLoc = glGetUniformLocation(shader.program, "uView");
-		uOffset = glGetUniformLocation(shader.program, "uOffset");
 		uDoLightSkip = glGetUniformLocation(shader.program, "uDoLightSkip");
 
 		glUniform1i(uDoLightSkip, lightSkip);
@@ -307,6 +736,13 @@ int main(int argc, char** argv)
 		glUniform1i(uPbr, 2);
 		glUniform1i(uEmissive, 3);
 
+		// No glow until the pbr map says what color it is, unless
+		// the emissive map is on its own from the start
+		uEmissiveColor = glGetUniformLocation(shader.program, "uEmissiveColor");
+		uEmissiveTextured = glGetUniformLocation(shader.program, "uEmissiveTextured");
+		glUniform3f(uEmissiveColor, 0, 0, 0);
+		glUniform1i(uEmissiveTextured, textureLoads[2].maskFilename == NULL);
+
 		// Set up ssbo for lights
 		glGenBuffers(1, &ssbo);
 		i32 index = glGetProgramResourceIndex(
@@ -317,9 +753,60 @@ int main(int argc, char** argv)
 
 		glBindBuffer(GL_SHADER_STORAGE_BUFFER, ssbo);
 		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, ssbo);
+
+		// And for which of them reach each cluster, filled in with
+		// the lights every frame
+		glGenBuffers(1, &clusterBuffer);
+		glGenBuffers(1, &lightIndexBuffer);
+		bindStorageBlock(shader.program, "ClusterBuffer", 10, clusterBuffer);
+		bindStorageBlock(shader.program, "LightIndexBuffer", 11, lightIndexBuffer);
+		uClusterScale = glGetUniformLocation(shader.program, "uClusterScale");
+		uClusterDepth = glGetUniformLocation(shader.program, "uClusterDepth");
+
+		// Instances never move, so they go up once; the meshes'
+		// bounds follow with the model
+		glGenBuffers(1, &instanceBuffer);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, instanceBuffer);
+		glBufferStorage(GL_SHADER_STORAGE_BUFFER, 
+				sizeof(Instance) * instanceCount, 
+				instances, 
+				0);
+		bindStorageBlock(shader.program, "InstanceBuffer", 2, instanceBuffer);
+		glGenBuffers(1, &meshBuffer);
+		bindStorageBlock(shader.program, "MeshBuffer", 3, meshBuffer);
 		glBindVertexArray(0);
 	}
 
+	// Setup the compute pass that culls on the GPU; see compCull.
+	// Its buffers get their storage with the model.
+	Shader cullShader;
+	i32 uCullPass, uCullPlanes, uCullModelSphere, uCullCamera, uCullPixelsPerUnit;
+	i32 uCullMeshCount, uCullCommandCount;
+	{
+		createComputeShader(&cullShader, compCull);
+		glUseProgram(cullShader.program);
+		uCullPass = glGetUniformLocation(cullShader.program, "uPass");
+		uCullPlanes = glGetUniformLocation(cullShader.program, "uPlanes");
+		uCullModelSphere = glGetUniformLocation(cullShader.program, "uModelSphere");
+		uCullCamera = glGetUniformLocation(cullShader.program, "uCamera");
+		uCullPixelsPerUnit = glGetUniformLocation(cullShader.program, "uPixelsPerUnit");
+		uCullMeshCount = glGetUniformLocation(cullShader.program, "uMeshCount");
+		uCullCommandCount = glGetUniformLocation(cullShader.program, "uCommandCount");
+		glUniform1ui(glGetUniformLocation(cullShader.program, "uInstanceCount"), instanceCount);
+
+		glGenBuffers(1, &cullMeshBuffer);
+		glGenBuffers(1, &lodErrorBuffer);
+		glGenBuffers(1, &countBuffer);
+		glGenBuffers(1, &choiceBuffer);
+		bindStorageBlock(cullShader.program, "InstanceBuffer", 2, instanceBuffer);
+		bindStorageBlock(cullShader.program, "CullMeshBuffer", 4, cullMeshBuffer);
+		bindStorageBlock(cullShader.program, "LodErrorBuffer", 5, lodErrorBuffer);
+		bindStorageBlock(cullShader.program, "CommandBuffer", 6, commandBuffer);
+		bindStorageBlock(cullShader.program, "CountBuffer", 7, countBuffer);
+		bindStorageBlock(cullShader.program, "ChoiceBuffer", 8, choiceBuffer);
+		bindStorageBlock(cullShader.program, "DrawDataBuffer", 9, drawDataBuffer);
+	}
+
 	// Setup OpenGL for light circles
 	Shader lightShader;
 	u32 lightVao, lightVbo;
@@ -347,6 +834,20 @@ int main(int argc, char** argv)
 
 	}
 
+	// GPU time for the model pass. Queries are read three frames 
+	// after they're issued, so asking for the result never stalls.
+	u32 timerQueries[4];
+	isize frameIndex = 0, timedFrames = 0;
+	f32 gpuMilliseconds = 0;
+	glGenQueries(4, timerQueries);
+
+	// Whole frames, swap to swap, building the light clusters, and
+	// how many meshes got drawn when the CPU culls, averaged over
+	// the same frames
+	u64 lastSwap = SDL_GetPerformanceCounter();
+	f32 frameMilliseconds = 0, clusterTime = 0, clusterMilliseconds = 0;
+	isize drawnMeshes = 0, drawnMeshTotal = 0;
+
 	// Generic timer
 	f32 t = 0.0;
 
@@ -377,13 +878,233 @@ int main(int argc, char** argv)
 			}
 		}
 
+		// Pick up whatever finished loading since last frame,
+		// one upload a frame so a burst of them can't hitch
+		for(isize i = 0; i < 4; ++i) {
+			TextureLoad* load = textureLoads + i;
+			if(load->done || wjobPending(&load->counter, NULL)) continue;
+			load->done = 1;
+			if(load->maskFilename) {
+				glUseProgram(shader.program);
+				if(load->texture && load->texture->image.tint[3] == 255) {
+					u8* tint = load->texture->image.tint;
+					glUniform3f(uEmissiveColor, tint[0] / 255.0f, tint[1] / 255.0f, tint[2] / 255.0f);
+				} else {
+					// It didn't fold in, so it's a texture after all
+					queueTextureLoad(textureLoads + 3, &textureStaging);
+					glUniform1i(uEmissiveTextured, 1);
+				}
+			}
+			if(!load->texture) {
+				printf("Failed to load %s, keeping the placeholder\n", load->filename);
+				releaseStagingSlot(&textureStaging, load->stagingSlot);
+				continue;
+			}
+			uploadTextureToGpu(load->texture, &textureStaging);
+			// The slot comes back once the GPU has read out of it
+			releaseStagingSlot(&textureStaging, load->stagingSlot);
+			if(!load->texture->staged) free(load->texture->pixels);
+			load->texture->pixels = NULL;
+			glDeleteTextures(1, textures + i);
+			textures[i] = load->texture->id;
+			break;
+		}
+
+		if(modelLoad && !wfbxLoadReady(modelLoad)) {
+			char title[64];
+			snprintf(title, sizeof(title), "3D Test (loading, %d%%)", 
+					(int)(wfbxLoadProgress(modelLoad) * 100));
+			SDL_SetWindowTitle(window, title);
+		} else if(modelLoad) {
+			model = wfbxFinishLoad(modelLoad);
+			modelLoad = NULL;
+			SDL_SetWindowTitle(window, "3D Test");
+			if(!model) {
+				printf("Failed to load %s, quitting...\n", fileName);
+				goto MainLoopEnd;
+			}
+
+			// Buffer static model data
+			// After the first run, the model comes from the baked .wbm 
+			// cache, and these pointers go straight into the mapped file,
+			// so the driver copies from the page cache with nothing in between.
+			// The buffers never change after this, so immutable storage is fine;
+			// it just needs the dynamic bit to be filled a mesh at a time.
+			isize meshCount = model->count;
+			meshRanges = malloc(sizeof(MeshRange) * meshCount);
+			isize vertexTotal = 0, indexTotal = 0;
+			for(isize m = 0; m < meshCount; ++m) {
+				isize lodIndexCount = 0;
+				if(model->lodCounts[m]) {
+					wfbxLod* last = model->lods[m] + model->lodCounts[m] - 1;
+					lodIndexCount = last->firstIndex + last->indexCount;
+				}
+				meshRanges[m].firstIndex = indexTotal;
+				meshRanges[m].indexCount = model->indexCounts[m];
+				meshRanges[m].baseVertex = vertexTotal;
+				meshRanges[m].firstLodIndex = indexTotal + model->indexCounts[m];
+				meshRanges[m].firstCommand = commandCount;
+				vertexTotal += model->meshSizes[m];
+				indexTotal += model->indexCounts[m] + lodIndexCount;
+				commandCount += 1 + model->lodCounts[m];
+			}
+
+			glBindVertexArray(vao);
+			glBindBuffer(GL_ARRAY_BUFFER, vbo);
+			glBufferStorage(GL_ARRAY_BUFFER, 
+					sizeof(wfbxPackedVertex) * vertexTotal, 
+					NULL,
+					GL_DYNAMIC_STORAGE_BIT);
+			glBufferStorage(GL_ELEMENT_ARRAY_BUFFER, 
+					sizeof(u32) * indexTotal, 
+					NULL,
+					GL_DYNAMIC_STORAGE_BIT);
+			for(isize m = 0; m < meshCount; ++m) {
+				MeshRange* range = meshRanges + m;
+				glBufferSubData(GL_ARRAY_BUFFER, 
+						sizeof(wfbxPackedVertex) * range->baseVertex,
+						sizeof(wfbxPackedVertex) * model->meshSizes[m], 
+						model->packedMeshes[m]);
+				glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, 
+						sizeof(u32) * range->firstIndex,
+						sizeof(u32) * range->indexCount, 
+						model->indices[m]);
+				isize end = m + 1 < meshCount ? range[1].firstIndex : indexTotal;
+				glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, 
+						sizeof(u32) * range->firstLodIndex,
+						sizeof(u32) * (end - range->firstLodIndex), 
+						model->lodIndices[m]);
+			}
+
+			// The GPU has its own copy now; keep just the counts,
+			// bounds and LOD ranges the draw loop needs
+			wfbxReleaseGeometry(model);
+
+			MeshData* meshData = malloc(sizeof(MeshData) * meshCount);
+			for(isize m = 0; m < meshCount; ++m) {
+				wfbxBounds* bounds = model->bounds + m;
+				for(isize k = 0; k < 3; ++k) {
+					meshData[m].boundsMin[k] = bounds->min[k];
+					meshData[m].boundsExtent[k] = bounds->max[k] - bounds->min[k];
+				}
+				meshData[m].boundsMin[3] = meshData[m].boundsExtent[3] = 0;
+			}
+			glBindBuffer(GL_SHADER_STORAGE_BUFFER, meshBuffer);
+			glBufferStorage(GL_SHADER_STORAGE_BUFFER, sizeof(MeshData) * meshCount, meshData, 0);
+			glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, meshBuffer);
+			free(meshData);
+
+			// At most every mesh of every copy gets drawn
+			isize drawCount = meshCount * instanceCount;
+			glBindBuffer(GL_ARRAY_BUFFER, drawDataBuffer);
+			glBufferStorage(GL_ARRAY_BUFFER, 
+					sizeof(DrawData) * drawCount, 
+					NULL, 
+					GL_DYNAMIC_STORAGE_BIT);
+
+			// Which indices each command draws never changes; only 
+			// how many instances, and which, do
+			commands = malloc(sizeof(DrawCommand) * commandCount);
+			for(isize m = 0; m < meshCount; ++m) {
+				MeshRange* range = meshRanges + m;
+				for(isize lod = -1; lod < model->lodCounts[m]; ++lod) {
+					DrawCommand* command = commands + range->firstCommand + 1 + lod;
+					command->count = range->indexCount;
+					command->instanceCount = 0;
+					command->firstIndex = range->firstIndex;
+					command->baseVertex = range->baseVertex;
+					command->baseInstance = 0;
+					if(lod >= 0) {
+						command->firstIndex = range->firstLodIndex + model->lods[m][lod].firstIndex;
+						command->count = model->lods[m][lod].indexCount;
+					}
+				}
+			}
+			glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer);
+			glBufferStorage(GL_DRAW_INDIRECT_BUFFER, 
+					sizeof(DrawCommand) * commandCount, 
+					commands, 
+					GL_DYNAMIC_STORAGE_BIT);
+			glBindVertexArray(0);
+
+			if(cpuCull) {
+				drawCommands = malloc(sizeof(u32) * drawCount);
+				drawData = malloc(sizeof(DrawData) * drawCount);
+				if(wcullCreate(&instanceSpheres, instanceCount)) {
+					visibleInstances = malloc(sizeof(u32) * instanceSpheres.padded);
+				}
+				if(!drawCommands || !drawData || !visibleInstances) {
+					printf("Not enough memory to cull on the CPU, culling on the GPU instead\n");
+					free(drawCommands);
+					free(drawData);
+					free(visibleInstances);
+					drawCommands = NULL;
+					drawData = NULL;
+					visibleInstances = NULL;
+					wcullDestroy(&instanceSpheres);
+					cpuCull = 0;
+				}
+			}
+			if(cpuCull) {
+				// The copies don't move, so their spheres only need
+				// working out once
+				wfbxSphere* whole = &model->modelSphere;
+				for(isize p = 0; p < instanceCount; ++p) {
+					vec3 center = instancePoint(instances + p, whole->center);
+					instanceSpheres.x[p] = center.x;
+					instanceSpheres.y[p] = center.y;
+					instanceSpheres.z[p] = center.z;
+					instanceSpheres.radius[p] = whole->radius * instances[p].scale;
+				}
+			} else {
+				// Everything compCull needs to know about the model
+				CullMesh* cullMeshes = malloc(sizeof(CullMesh) * meshCount);
+				f32* lodErrors = calloc(commandCount, sizeof(f32));
+				for(isize m = 0; m < meshCount; ++m) {
+					CullMesh* cull = cullMeshes + m;
+					memcpy(cull->sphere, model->spheres[m].center, sizeof(f32) * 3);
+					cull->sphere[3] = model->spheres[m].radius;
+					cull->firstCommand = meshRanges[m].firstCommand;
+					cull->lodCount = model->lodCounts[m];
+					cull->pad[0] = cull->pad[1] = 0;
+					for(isize lod = 0; lod < model->lodCounts[m]; ++lod) {
+						lodErrors[cull->firstCommand + 1 + lod] = model->lods[m][lod].error;
+					}
+				}
+				glBindBuffer(GL_SHADER_STORAGE_BUFFER, cullMeshBuffer);
+				glBufferStorage(GL_SHADER_STORAGE_BUFFER, sizeof(CullMesh) * meshCount, cullMeshes, 0);
+				glBindBuffer(GL_SHADER_STORAGE_BUFFER, lodErrorBuffer);
+				glBufferStorage(GL_SHADER_STORAGE_BUFFER, sizeof(f32) * commandCount, lodErrors, 0);
+				glBindBuffer(GL_SHADER_STORAGE_BUFFER, countBuffer);
+				glBufferStorage(GL_SHADER_STORAGE_BUFFER, sizeof(u32) * commandCount, NULL, 0);
+				glBindBuffer(GL_SHADER_STORAGE_BUFFER, choiceBuffer);
+				glBufferStorage(GL_SHADER_STORAGE_BUFFER, sizeof(u32) * drawCount, NULL, 0);
+				free(cullMeshes);
+				free(lodErrors);
+
+				glUseProgram(cullShader.program);
+				wfbxSphere* whole = &model->modelSphere;
+				glUniform4f(uCullModelSphere, whole->center[0], whole->center[1], whole->center[2], whole->radius);
+				glUniform1ui(uCullMeshCount, meshCount);
+				glUniform1ui(uCullCommandCount, commandCount);
+			}
+		}
+
 		// I clear all of these; some vendors don't initialize them to zero
 		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
 
 		// Render our model.
 		{
-			//Update camera and projection for both shaders
-			f32 camDist = 8;
+			//Update camera and projection for both shaders.
+			// The stress test circles inside the grid, halfway out,
+			// and sees all the way across it.
+			f32 camDist = 8, nearPlane = 0.02f, farPlane = 1000.0f;
+			if(stress) {
+				f32 gridSize = cbrtf((f32)instanceCount) * STRESS_SPACING;
+				camDist = gridSize / 4;
+				nearPlane = 0.25f;
+				farPlane = gridSize * 2 > farPlane ? gridSize * 2 : farPlane;
+			}
 			makeCamera(&cam, 
 					v3(sinf(t) * camDist, camDist * 1.5, cosf(t) * camDist), 
 					v3(0, 6, 0), CameraDefaultUp);
@@ -391,10 +1112,12 @@ int main(int argc, char** argv)
 			viewMatrix4(viewMatrix, &cam);
 			perspectiveMatrix4(projMatrix, 
 					windowWidth / windowHeight, 
-					90, 0.02f, 1000.0f);
+					90, nearPlane, farPlane);
 			glUseProgram(shader.program);
 			glUniformMatrix4fv(uProjLoc, 1, 0, projMatrix);
 			glUniformMatrix4fv(uViewLoc, 1, 0, viewMatrix);
+			glUniform2f(uClusterScale, CLUSTER_X / windowWidth, CLUSTER_Y / windowHeight);
+			glUniform2f(uClusterDepth, nearPlane, CLUSTER_Z / logf(farPlane / nearPlane));
 
 			glUseProgram(lightShader.program);
 			glUniformMatrix4fv(uLightProjLoc, 1, 0, projMatrix);
@@ -403,92 +1126,167 @@ int main(int argc, char** argv)
 			// move and upload lights every frame
 			{
 				scene.lightCount = 0;
-				addLight(cam.pos.x, cam.pos.y + 1, cam.pos.z, 1, 1, 1);
-				addLight(-6, 8, 1, 1, 0.5, 1);
-				addLight(10 + cosf(t*4)*2, 5+sinf(t*4)*2, -3, 1, 0.5, 0.5);
-				addLight(cosf(t*4), -10, 0, (cosf(t*3)+1)/2.0, 0.5, 1);
-				addLight(0, sinf(t*2) * 6 + 4, 4.5, 1, 1, 1);
-				addLight(-1, 8, -12, 1, 1, 1);
-
+				addLight(cam.pos.x, cam.pos.y + 1, cam.pos.z, 1, 1, 1, 50);
+				addLight(-6, 8, 1, 1, 0.5, 1, 50);
+				addLight(10 + cosf(t*4)*2, 5+sinf(t*4)*2, -3, 1, 0.5, 0.5, 50);
+				addLight(cosf(t*4), -10, 0, (cosf(t*3)+1)/2.0, 0.5, 1, 50);
+				addLight(0, sinf(t*2) * 6 + 4, 4.5, 1, 1, 1, 50);
+				addLight(-1, 8, -12, 1, 1, 1, 50);
+				// Each of --lights' wanders around its home
+				for(isize i = 0; i < extraLights; ++i) {
+					Light* home = lightHomes + i;
+					f32 phase = i * 0.61803399f * 6.2831853f;
+					f32 wander = home->pos[3] * 0.5f;
+					addLight(home->pos[0] + sinf(t*2 + phase) * wander, 
+							home->pos[1] + cosf(t*3 + phase) * wander, 
+							home->pos[2] + sinf(t*5 + phase) * wander, 
+							home->color[0], home->color[1], home->color[2], home->pos[3]);
+				}
+
+				u64 clusterStart = SDL_GetPerformanceCounter();
+				buildLightClusters(clusters, projMatrix, viewMatrix, nearPlane, farPlane);
+				clusterTime = (SDL_GetPerformanceCounter() - clusterStart) * 1000.0f / 
+					SDL_GetPerformanceFrequency();
 
 				glBindVertexArray(vao);
 				glBindBuffer(GL_SHADER_STORAGE_BUFFER, ssbo);
 				glBufferData(
 						GL_SHADER_STORAGE_BUFFER,
-						sizeof(scene),
-						&scene,
+						sizeof(Light) * scene.lightCount,
+						scene.lights,
+						GL_STREAM_DRAW);
+				glBindBuffer(GL_SHADER_STORAGE_BUFFER, clusterBuffer);
+				glBufferData(GL_SHADER_STORAGE_BUFFER, 
+						sizeof(clusters->ranges), 
+						clusters->ranges, 
+						GL_STREAM_DRAW);
+				// Never empty, so the binding always has something behind it
+				glBindBuffer(GL_SHADER_STORAGE_BUFFER, lightIndexBuffer);
+				glBufferData(GL_SHADER_STORAGE_BUFFER, 
+						sizeof(u32) * (clusters->indexCount ? clusters->indexCount : 1), 
+						clusters->indices, 
 						GL_STREAM_DRAW);
 				glBindVertexArray(0);
 			}
 
-			//Bind textures if available
-			if(diffuse) {
-				glActiveTexture(GL_TEXTURE0);
-				glBindTexture(GL_TEXTURE_2D, diffuse->id);
-			}
-
-			if(normals) {
-				glActiveTexture(GL_TEXTURE1);
-				glBindTexture(GL_TEXTURE_2D, normals->id);
+			//Bind textures, or their placeholders
+			for(isize i = 0; i < 4; ++i) {
+				glActiveTexture(GL_TEXTURE0 + i);
+				glBindTexture(GL_TEXTURE_2D, textures[i]);
 			}
 
-			if(pbr) {
-				glActiveTexture(GL_TEXTURE2);
-				glBindTexture(GL_TEXTURE_2D, pbr->id);
-			}
+			// Draw a bunch of them all over the place, once they're here.
+			// The timer runs either way, so there's always a query to read.
+			glBeginQuery(GL_TIME_ELAPSED, timerQueries[frameIndex % 4]);
+			if(model) {
+				// Each mesh in each copy gets the coarsest LOD that stays 
+				// within a pixel of the full mesh. pixelsPerUnit is how big
+				// one unit looks at distance 1, for our 90 degree fov.
+				f32 pixelsPerUnit = windowHeight / (2 * tanf(90 * 3.14159265f / 360));
+
+				// Copies whose sphere is out of view skip all their meshes; 
+				// otherwise each mesh gets tested on its own. Each mesh
+				// that's left counts as an instance of its LOD's command.
+				// LOD errors grow with a copy's scale, so the distance
+				// shrinks by it instead.
+				f32 planes[24];
+				frustumPlanes(planes, projMatrix, viewMatrix);
+				isize meshCount = model->count;
+				if(cpuCull) {
+					for(isize c = 0; c < commandCount; ++c) {
+						commands[c].instanceCount = 0;
+					}
+					// In index order, so the DrawData comes out the same
+					isize visibleCount = wcullFrustum(visibleInstances, &instanceSpheres, planes, 0);
+					for(isize v = 0; v < visibleCount; ++v) {
+						Instance* instance = instances + visibleInstances[v];
+						for(isize m = 0; m < meshCount; ++m) {
+							u32* drawCommand = drawCommands + v * meshCount + m;
+							wfbxSphere* sphere = model->spheres + m;
+							vec3 center = instancePoint(instance, sphere->center);
+							f32 radius = sphere->radius * instance->scale;
+							if(!sphereInFrustum(planes, center, radius)) {
+								*drawCommand = (u32)-1;
+								continue;
+							}
+							vec3 toMesh = v3Sub(center, cam.pos);
+							f32 distance = (sqrtf(v3Dot(toMesh, toMesh)) - radius) / instance->scale;
+							i32 lod = wfbxSelectLod(model, m, distance, pixelsPerUnit, 1.0f);
+							*drawCommand = meshRanges[m].firstCommand + 1 + lod;
+							commands[*drawCommand].instanceCount++;
+						}
+					}
 
-			if(emissive) {
-				glActiveTexture(GL_TEXTURE3);
-				glBindTexture(GL_TEXTURE_2D, emissive->id);
-			}
+					// Commands take their instances' DrawData back to back
+					u32 drawn = 0;
+					for(isize c = 0; c < commandCount; ++c) {
+						commands[c].baseInstance = drawn;
+						drawn += commands[c].instanceCount;
+						// Counts back up again as the DrawData goes in
+						commands[c].instanceCount = 0;
+					}
+					for(isize v = 0; v < visibleCount; ++v) {
+						for(isize m = 0; m < meshCount; ++m) {
+							u32 c = drawCommands[v * meshCount + m];
+							if(c == (u32)-1) continue;
+							DrawData* d = drawData + commands[c].baseInstance + commands[c].instanceCount++;
+							d->instance = visibleInstances[v];
+							d->mesh = m;
+						}
+					}
+					drawnMeshes = drawn;
+
+					glBindBuffer(GL_ARRAY_BUFFER, drawDataBuffer);
+					glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(DrawData) * drawn, drawData);
+					glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer);
+					glBufferSubData(GL_DRAW_INDIRECT_BUFFER, 0, 
+							sizeof(DrawCommand) * commandCount, commands);
+				} else {
+					// The same, in compCull, so the CPU's part stays the same
+					// however many instances there are. Counts start at zero;
+					// each pass waits on the last one's writes, and the draw 
+					// on the commands and DrawData.
+					glUseProgram(cullShader.program);
+					glUniform4fv(uCullPlanes, 6, planes);
+					glUniform3f(uCullCamera, cam.pos.x, cam.pos.y, cam.pos.z);
+					glUniform1f(uCullPixelsPerUnit, pixelsPerUnit);
+					glBindBuffer(GL_SHADER_STORAGE_BUFFER, countBuffer);
+					glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, NULL);
+					u32 groups = (instanceCount + 255) / 256;
+					for(i32 pass = 0; pass < 3; ++pass) {
+						glUniform1i(uCullPass, pass);
+						glDispatchCompute(pass == 1 ? 1 : groups, 1, 1);
+						glMemoryBarrier(pass < 2 ? GL_SHADER_STORAGE_BARRIER_BIT : 
+								GL_COMMAND_BARRIER_BIT | GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT);
+					}
+				}
 
-			// Draw a bunch of them all over the place
-			{
 				glEnable(GL_CULL_FACE);
 				glUseProgram(shader.program);
 				glBindVertexArray(vao);
 				glBindBuffer(GL_ARRAY_BUFFER, vbo);
-
-				glUniform3f(uOffset, 0, -2, 0);
-				glDrawElements(GL_TRIANGLES, 
-						model->indexCounts[0], 
-						GL_UNSIGNED_INT, 0);
-
-				glUniform3f(uOffset, 10, -2, 0);
-				glDrawElements(GL_TRIANGLES,
-						model->indexCounts[0], 
-						GL_UNSIGNED_INT, 0);
-
-				glUniform3f(uOffset, -10, -2, 0);
-				glDrawElements(GL_TRIANGLES, 
-						model->indexCounts[0],
-						GL_UNSIGNED_INT, 0);
-
-				glUniform3f(uOffset, 0, 8, 0);
-				glDrawElements(GL_TRIANGLES, 
-						model->indexCounts[0],
-						GL_UNSIGNED_INT, 0);
-
-				glUniform3f(uOffset, 0, -10, 5);
-				glDrawElements(GL_TRIANGLES, 
-						model->indexCounts[0],
-						GL_UNSIGNED_INT, 0);
+				glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer);
+				glMultiDrawElementsIndirect(GL_TRIANGLES, 
+						GL_UNSIGNED_INT, NULL, commandCount, 0);
 				glBindVertexArray(0);
 			}
+			glEndQuery(GL_TIME_ELAPSED);
 
-			// Draw some circles to represent our lights
+			// Draw some circles to represent our lights.
+			// Just the first six; --lights' would cover everything.
 			{
+				isize circleCount = scene.lightCount < 6 ? scene.lightCount : 6;
 				glDisable(GL_CULL_FACE);
 				glUseProgram(lightShader.program);
 				glBindVertexArray(lightVao);
 				glBindBuffer(GL_ARRAY_BUFFER, lightVbo);
 				glBufferData(GL_ARRAY_BUFFER,
-						sizeof(Light) * scene.lightCount,
+						sizeof(Light) * circleCount,
 						scene.lights,
 						GL_STREAM_DRAW);
 				glDrawArraysInstanced(
 						GL_TRIANGLE_STRIP,
-						0, 4, scene.lightCount);
+						0, 4, circleCount);
 				glBindVertexArray(0);
 			}
 
@@ -503,6 +1301,42 @@ int main(int argc, char** argv)
 
 
 		SDL_GL_SwapWindow(window);
+		u64 swap = SDL_GetPerformanceCounter();
+		f32 frameTime = (swap - lastSwap) * 1000.0f / SDL_GetPerformanceFrequency();
+		lastSwap = swap;
+
+		// Every 300 frames, or 5 seconds when they're slow; only the
+		// stress tests print it, but the queries run either way
+		if(frameIndex >= 3) {
+			GLuint64 elapsed;
+			glGetQueryObjectui64v(timerQueries[(frameIndex - 3) % 4], 
+					GL_QUERY_RESULT, &elapsed);
+			gpuMilliseconds += elapsed / 1000000.0f;
+			frameMilliseconds += frameTime;
+			clusterMilliseconds += clusterTime;
+			drawnMeshTotal += drawnMeshes;
+			if(++timedFrames == 300 || frameMilliseconds > 5000) {
+				if(stress || extraLights) {
+					printf("Frame: %.3f ms, model pass %.3f ms on the GPU, %td lights clustered in %.3f ms", 
+							frameMilliseconds / timedFrames,
+							gpuMilliseconds / timedFrames,
+							scene.lightCount, clusterMilliseconds / timedFrames);
+					// Only the CPU knows what it culled without asking
+					if(cpuCull) {
+						printf(", %td of %td meshes drawn", 
+								drawnMeshTotal / timedFrames,
+								model ? model->count * instanceCount : 0);
+					}
+					printf("\n");
+				}
+				gpuMilliseconds = 0;
+				frameMilliseconds = 0;
+				clusterMilliseconds = 0;
+				drawnMeshTotal = 0;
+				timedFrames = 0;
+			}
+		}
+		frameIndex++;
 	}
 	// The side-effect of long stretches of inline code
 	// is that you have to explicity use goto to skip 
@@ -510,6 +1344,36 @@ int main(int argc, char** argv)
 	// of a function
 MainLoopEnd:
 
+	// A load still in flight has to finish before its memory goes
+	if(modelLoad) {
+		model = wfbxFinishLoad(modelLoad);
+	}
+	for(isize i = 0; i < 4; ++i) {
+		wjobWait(&textureLoads[i].counter);
+	}
+	// Picked up textures are left with just their struct; one that
+	// finished but never got picked up still has its pixels, unless
+	// they were in the staging ring
+	for(isize i = 0; i < 4; ++i) {
+		Texture* texture = textureLoads[i].texture;
+		if(!texture) continue;
+		if(!texture->staged) free(texture->pixels);
+		free(texture);
+	}
+	glDeleteTextures(4, textures);
+	destroyTextureStaging(&textureStaging);
+	free(drawData);
+	free(drawCommands);
+	free(visibleInstances);
+	wcullDestroy(&instanceSpheres);
+	free(instances);
+	free(lightHomes);
+	free(scene.lights);
+	free(clusters->indices);
+	free(clusters);
+	free(commands);
+	free(meshRanges);
+	wfbxFreeModel(model);
 	SDL_Quit();
 	return 0;
 }
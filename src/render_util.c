@@ -2,6 +2,7 @@
 #define CameraDefaultUp v3(0, 1, 0)
 
 typedef struct Texture Texture;
+typedef struct TextureStaging TextureStaging;
 typedef struct Shader Shader;
 typedef struct Camera Camera;
 typedef struct vec3 vec3;
@@ -15,13 +16,39 @@ struct Texture
 {
 	u32 id;
 	i32 w, h;
+	// The whole cooked .wbt; image's levels point into it.
+	// It's in a staging slot if staged, and malloced if not.
 	u8* pixels;
+	i32 staged;
+	wtexImage image;
 	string filename;
 };
 
+// Texture staging
+//
+// Cooked textures go to the GPU through slots in one persistently
+// mapped GL_PIXEL_UNPACK_BUFFER. A load gets a slot when it's queued,
+// and the job reads the .wbt straight into it; the upload then just
+// hands the driver buffer offsets, and it copies in the background,
+// where uploading from client memory would copy it all before
+// returning. After the upload the slot gets a fence, and it's only
+// handed out again once the GPU is past it. Slots go round in a ring,
+// so the oldest fence is the one being waited on.
+#define STAGING_SLOTS 4
+
+struct TextureStaging
+{
+	u32 buffer;
+	u8* memory;
+	isize slotSize;
+	i32 next;
+	i32 taken[STAGING_SLOTS];
+	GLsync fences[STAGING_SLOTS];
+};
+
 struct Shader 
 {
-	u32 program, vert, frag;
+	u32 program, vert, frag, comp;
 	string vertSrc, fragSrc;
 };
 
@@ -107,6 +134,7 @@ void printGLProgramError(u32 program, string header)
 
 void createShader(Shader* shader, string vertSrc, string fragSrc)
 {
+	shader->comp = 0;
 	shader->vert = glCreateShader(GL_VERTEX_SHADER);
 	glShaderSource(shader->vert, 1, (const GLchar* const*)&vertSrc, NULL);
 	glCompileShader(shader->vert);
@@ -124,6 +152,28 @@ void createShader(Shader* shader, string vertSrc, string fragSrc)
 	printGLProgramError(shader->program, "Program Link Log");
 }
 
+void createComputeShader(Shader* shader, string compSrc)
+{
+	shader->vert = shader->frag = 0;
+	shader->comp = glCreateShader(GL_COMPUTE_SHADER);
+	glShaderSource(shader->comp, 1, (const GLchar* const*)&compSrc, NULL);
+	glCompileShader(shader->comp);
+	printShaderError(shader->comp, "Compute Shader Compile Log");
+
+	shader->program = glCreateProgram();
+	glAttachShader(shader->program, shader->comp);
+	glLinkProgram(shader->program);
+	printGLProgramError(shader->program, "Program Link Log");
+}
+
+// Points a program's buffer block at a binding, and puts buffer there
+void bindStorageBlock(u32 program, string name, u32 binding, u32 buffer)
+{
+	i32 index = glGetProgramResourceIndex(program, GL_SHADER_STORAGE_BLOCK, name);
+	glShaderStorageBlockBinding(program, index, binding);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, binding, buffer);
+}
+
 static inline
 void identityMatrix4(f32* matrix)
 {
@@ -212,23 +262,186 @@ void viewMatrix4(f32* matrix, Camera* cam)
 	matrix[15] = 1.0f;
 }
 
-Texture* loadTexture(string filename)
+// The six planes of proj * view, straight out of its rows
+// (Gribb and Hartmann) by wcullPlanes, as xyzw with xyz pointing inside and
+// normalized, so dot(xyz, p) + w is how far inside p is
+static inline
+void frustumPlanes(f32* planes, f32* proj, f32* view)
+{
+	f32 m[16];
+	for(isize c = 0; c < 4; ++c) {
+		for(isize r = 0; r < 4; ++r) {
+			m[c * 4 + r] = 0;
+			for(isize k = 0; k < 4; ++k) {
+				m[c * 4 + r] += proj[k * 4 + r] * view[c * 4 + k];
+			}
+		}
+	}
+
+	wcullPlanes(planes, m);
+}
+
+// Conservative: spheres near a corner can pass without being in view
+static inline
+i32 sphereInFrustum(f32* planes, vec3 center, f32 radius)
 {
-	i32 w, h, bpp;
-	u8* data = stbi_load(filename, &w, &h, &bpp, STBI_rgb_alpha);
-	if(w == 0 || h == 0) {
+	for(isize i = 0; i < 6; ++i) {
+		f32* plane = planes + i * 4;
+		f32 d = plane[0] * center.x + plane[1] * center.y + plane[2] * center.z + plane[3];
+		if(d < -radius) return 0;
+	}
+	return 1;
+}
+
+// RGBA8, flipped the way main.c has stb_image flip them. wb_png
+// decodes every PNG we ship; stb_image gets whatever it turns
+// down. Both malloc the pixels, so they go back with free().
+u8* decodePng(const u8* source, isize size, i32* w, i32* h)
+{
+	if(wpngInfo(source, size, w, h)) {
+		u8* pixels = (u8*)malloc((isize)*w * *h * 4);
+		if(pixels && wpngDecode(pixels, source, size, WPNG_FLIP)) return pixels;
+		free(pixels);
+	}
+	i32 bpp;
+	return stbi_load_from_memory(source, (i32)size, w, h, &bpp, STBI_rgb_alpha);
+}
+
+// The whole file, in buffer if it fits in capacity bytes and
+// in one malloc if it doesn't, or NULL
+u8* readWholeFile(string filename, isize* size, u8* buffer, isize capacity)
+{
+	FILE* f = fopen(filename, "rb");
+	if(!f) return NULL;
+	u8* data = NULL;
+	if(fseek(f, 0, SEEK_END) == 0) {
+		long length = ftell(f);
+		if(length > 0 && fseek(f, 0, SEEK_SET) == 0) {
+			data = buffer && length <= capacity ? buffer : (u8*)malloc(length);
+			if(data && fread(data, 1, length, f) != (size_t)length) {
+				if(data != buffer) free(data);
+				data = NULL;
+			}
+			*size = length;
+		}
+	}
+	fclose(f);
+	return data;
+}
+
+// Textures come from a cooked .wbt next to the PNG (diffuse.png ->
+// diffuse.wbt), with every mip level already block compressed.
+// When it's missing, or was cooked from a different PNG or with
+// different settings, the PNG gets decoded and cooked on the spot,
+// and the .wbt written for next time. wtexParse checks every range,
+// so a half-written file just gets cooked again.
+// format and mipFlags are WTEX_FORMAT_* and WTEX_MIPS_*.
+//
+// maskFilename, if it's there, is an image to fold into this one's
+// alpha: when wtexFindTint finds it's one color, or one color through
+// a mask, the mask goes in alpha and the color in the image's tint,
+// with tint's alpha at 255. Otherwise tint stays 0 and the other image
+// still needs loading on its own. Both go into the .wbt's hash.
+//
+// staging is a TextureStaging slot of stagingSize bytes, or NULL.
+// When the cooked texture fits, it ends up there instead of the heap.
+Texture* loadTexture(string filename, string maskFilename, i32 format, u32 mipFlags,
+		u8* staging, isize stagingSize)
+{
+	isize sourceSize = 0;
+	u8* source = readWholeFile(filename, &sourceSize, NULL, 0);
+	if(!source) return NULL;
+	u64 sourceHash = wtexHash(source, sourceSize);
+	isize maskSize = 0;
+	u8* maskSource = maskFilename ? readWholeFile(maskFilename, &maskSize, NULL, 0) : NULL;
+	if(maskSource) {
+		sourceHash ^= wtexHash(maskSource, maskSize) * 0x9e3779b97f4a7c15ull;
+		sourceSize += maskSize;
+	}
+
+	isize length = strlen(filename);
+	isize extension = length;
+	for(isize i = length - 1; i >= 0 && filename[i] != '/' && filename[i] != '\\'; --i) {
+		if(filename[i] == '.') {
+			extension = i;
+			break;
+		}
+	}
+	char* cachePath = (char*)malloc(extension + 5);
+	if(!cachePath) {
+		free(source);
+		free(maskSource);
 		return NULL;
 	}
+	memcpy(cachePath, filename, extension);
+	memcpy(cachePath + extension, ".wbt", 5);
+
+	wtexImage image;
+	isize cookedSize = 0;
+	u8* cooked = readWholeFile(cachePath, &cookedSize, staging, stagingSize);
+	if(!cooked || !wtexParse(&image, cooked, cookedSize) ||
+			image.sourceHash != sourceHash || image.sourceSize != (u64)sourceSize ||
+			image.format != format || image.mipFlags != mipFlags) {
+		if(cooked != staging) free(cooked);
+		cooked = NULL;
+
+		i32 w = 0, h = 0;
+		u8* data = decodePng(source, sourceSize - maskSize, &w, &h);
+		u8 tint[4] = {0};
+		if(data && maskSource) {
+			// Within 2 of the original on every channel
+			i32 maskW = 0, maskH = 0;
+			u8* mask = decodePng(maskSource, maskSize, &maskW, &maskH);
+			if(mask && maskW == w && maskH == h) {
+				wtexFindTint(tint, data + 3, mask, w, h, 2);
+			}
+			free(mask);
+		}
+		if(data && w > 0 && h > 0) {
+			cooked = wtexCook(&cookedSize, data, w, h, format, mipFlags, tint, sourceHash, sourceSize);
+			if(cooked && wtexParse(&image, cooked, cookedSize)) {
+				FILE* f = fopen(cachePath, "wb");
+				if(f) {
+					fwrite(cooked, 1, cookedSize, f);
+					fclose(f);
+				}
+				if(staging && cookedSize <= stagingSize) {
+					memcpy(staging, cooked, cookedSize);
+					free(cooked);
+					cooked = staging;
+					wtexParse(&image, cooked, cookedSize);
+				}
+			} else {
+				// Out of memory, so there's nothing to write or upload
+				free(cooked);
+				cooked = NULL;
+			}
+		}
+		free(data);
+	}
+	free(cachePath);
+	free(source);
+	free(maskSource);
+	if(!cooked) return NULL;
 
 	Texture* t = (Texture*)malloc(sizeof(Texture));
-	t->w = w;
-	t->h = h;
-	t->pixels = data;
+	if(!t) {
+		if(cooked != staging) free(cooked);
+		return NULL;
+	}
+	t->w = image.width;
+	t->h = image.height;
+	t->pixels = cooked;
+	t->staged = cooked == staging;
+	t->image = image;
 	t->id = -1;
 	return t; 
 }
 
-void uploadTextureToGpu(Texture* texture)
+// Staged textures upload from staging's buffer; the rest from
+// client memory, the slow way. Either way, pixels can go after this,
+// but a staging slot needs releasing, not freeing.
+void uploadTextureToGpu(Texture* texture, TextureStaging* staging)
 {
 	glGenTextures(1, &texture->id);
 	glBindTexture(GL_TEXTURE_2D, texture->id);
@@ -236,13 +449,101 @@ void uploadTextureToGpu(Texture* texture)
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
 
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 
-			texture->w, texture->h, 0, 
-			GL_RGBA, GL_UNSIGNED_BYTE, 
-			texture->pixels);
-	glGenerateMipmap(GL_TEXTURE_2D);
+	// Every level comes cooked, so there's nothing to generate
+	wtexImage* image = &texture->image;
+	u32 glFormat = GL_COMPRESSED_RGBA_BPTC_UNORM;
+	if(image->format == WTEX_FORMAT_BC4) glFormat = GL_COMPRESSED_RED_RGTC1;
+	if(image->format == WTEX_FORMAT_BC5) glFormat = GL_COMPRESSED_RG_RGTC2;
+	glTexStorage2D(GL_TEXTURE_2D, image->levelCount, glFormat, image->width, image->height);
+
+	// With an unpack buffer bound, the pointers are offsets into it
+	const u8* base = NULL;
+	if(texture->staged) {
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, staging->buffer);
+		base = staging->memory;
+	}
+	i32 w = image->width, h = image->height;
+	for(i32 i = 0; i < image->levelCount; ++i) {
+		const void* data = base ? (const void*)(image->levels[i] - base) : image->levels[i];
+		glCompressedTexSubImage2D(GL_TEXTURE_2D, i, 0, 0, w, h, glFormat,
+				(i32)image->levelSizes[i], data);
+		w = w > 1 ? w / 2 : 1;
+		h = h > 1 ? h / 2 : 1;
+	}
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+// slotSize bytes per slot. If the mapping fails, no slots
+// get handed out, and every texture uploads the slow way.
+void createTextureStaging(TextureStaging* staging, isize slotSize)
+{
+	memset(staging, 0, sizeof(*staging));
+	staging->slotSize = slotSize;
+	glGenBuffers(1, &staging->buffer);
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, staging->buffer);
+	// Read too, since loadTexture checks the .wbt header in place
+	u32 flags = GL_MAP_READ_BIT | GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+	glBufferStorage(GL_PIXEL_UNPACK_BUFFER, slotSize * STAGING_SLOTS, NULL, flags);
+	staging->memory = (u8*)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, slotSize * STAGING_SLOTS, flags);
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+}
+
+void destroyTextureStaging(TextureStaging* staging)
+{
+	for(isize i = 0; i < STAGING_SLOTS; ++i) {
+		if(staging->fences[i]) glDeleteSync(staging->fences[i]);
+	}
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, staging->buffer);
+	if(staging->memory) glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	glDeleteBuffers(1, &staging->buffer);
+	memset(staging, 0, sizeof(*staging));
+}
+
+// The next free slot around the ring, or NULL if every one is
+// taken or still being read by the GPU. Never waits.
+u8* acquireStagingSlot(TextureStaging* staging, i32* slot)
+{
+	*slot = -1;
+	if(!staging->memory) return NULL;
+	for(i32 n = 0; n < STAGING_SLOTS; ++n) {
+		i32 i = (staging->next + n) % STAGING_SLOTS;
+		if(staging->taken[i]) continue;
+		if(staging->fences[i]) {
+			u32 status = glClientWaitSync(staging->fences[i], 0, 0);
+			if(status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) continue;
+			glDeleteSync(staging->fences[i]);
+			staging->fences[i] = NULL;
+		}
+		staging->taken[i] = 1;
+		staging->next = (i + 1) % STAGING_SLOTS;
+		*slot = i;
+		return staging->memory + i * staging->slotSize;
+	}
+	return NULL;
+}
+
+// Once the last upload out of the slot has been issued
+void releaseStagingSlot(TextureStaging* staging, i32 slot)
+{
+	if(slot < 0) return;
+	staging->fences[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	staging->taken[slot] = 0;
+}
+
+// A 1x1 texture of one color, to stand in for one that's still loading
+u32 createSolidTexture(const u8* rgba)
+{
+	u32 id;
+	glGenTextures(1, &id);
+	glBindTexture(GL_TEXTURE_2D, id);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, rgba);
 	glBindTexture(GL_TEXTURE_2D, 0);
+	return id;
 }
@@ -1,7 +1,146 @@
+const char* compCull = "" "#version 430\n"
+"// Frustum culling and LOD picking for every mesh of every instance,\n"
+"// in three passes over the same buffers, one dispatch each:\n"
+"// 0: each instance's meshes pick a command, or none, and count\n"
+"//    themselves into it\n"
+"// 1: one invocation turns the counts into each command's instances\n"
+"//    and first instance, and zeroes them again\n"
+"// 2: each instance's meshes take the next place in their command's\n"
+"//    run of DrawData\n"
+"layout(local_size_x = 256) in;\n"
+"// Same as vert3d's\n"
+"struct Instance\n"
+"{\n"
+"	vec4 rows[3];\n"
+"	uint material;\n"
+"	float scale;\n"
+"	uint pad0;\n"
+"	uint pad1;\n"
+"};\n"
+"layout(std430) readonly buffer InstanceBuffer\n"
+"{\n"
+"	Instance instances[];\n"
+"};\n"
+"// A mesh's sphere, and its commands: the full mesh, then its LODs\n"
+"struct CullMesh\n"
+"{\n"
+"	vec4 sphere;\n"
+"	uint firstCommand;\n"
+"	uint lodCount;\n"
+"	uint pad0;\n"
+"	uint pad1;\n"
+"};\n"
+"layout(std430) readonly buffer CullMeshBuffer\n"
+"{\n"
+"	CullMesh cullMeshes[];\n"
+"};\n"
+"// Per command, how far its LOD can be from the full mesh\n"
+"layout(std430) readonly buffer LodErrorBuffer\n"
+"{\n"
+"	float lodErrors[];\n"
+"};\n"
+"// Laid out the way glMultiDrawElementsIndirect reads them\n"
+"struct DrawCommand\n"
+"{\n"
+"	uint count;\n"
+"	uint instanceCount;\n"
+"	uint firstIndex;\n"
+"	int baseVertex;\n"
+"	uint baseInstance;\n"
+"};\n"
+"layout(std430) buffer CommandBuffer\n"
+"{\n"
+"	DrawCommand commands[];\n"
+"};\n"
+"// Zeroed before each frame's first pass\n"
+"layout(std430) buffer CountBuffer\n"
+"{\n"
+"	uint counts[];\n"
+"};\n"
+"// The command each mesh of each instance went to, for the last pass\n"
+"layout(std430) buffer ChoiceBuffer\n"
+"{\n"
+"	uint choices[];\n"
+"};\n"
+"// What vert3d reads as vDraw\n"
+"layout(std430) writeonly buffer DrawDataBuffer\n"
+"{\n"
+"	uvec2 drawData[];\n"
+"};\n"
+"uniform int uPass;\n"
+"uniform vec4 uPlanes[6];\n"
+"uniform vec4 uModelSphere;\n"
+"uniform vec3 uCamera;\n"
+"uniform float uPixelsPerUnit;\n"
+"uniform uint uInstanceCount;\n"
+"uniform uint uMeshCount;\n"
+"uniform uint uCommandCount;\n"
+"const uint culled = 0xFFFFFFFFu;\n"
+"// Same as sphereInFrustum\n"
+"bool sphereInFrustum(vec3 center, float radius)\n"
+"{\n"
+"	for(int i = 0; i < 6; ++i) {\n"
+"		if(dot(uPlanes[i].xyz, center) + uPlanes[i].w < -radius) return false;\n"
+"	}\n"
+"	return true;\n"
+"}\n"
+"vec3 instancePoint(Instance instance, vec3 p)\n"
+"{\n"
+"	vec4 q = vec4(p, 1);\n"
+"	return vec3(dot(instance.rows[0], q), dot(instance.rows[1], q), dot(instance.rows[2], q));\n"
+"}\n"
+"void main()\n"
+"{\n"
+"	uint i = gl_GlobalInvocationID.x;\n"
+"	if(uPass == 1) {\n"
+"		if(i != 0u) return;\n"
+"		uint first = 0u;\n"
+"		for(uint c = 0u; c < uCommandCount; ++c) {\n"
+"			commands[c].instanceCount = counts[c];\n"
+"			commands[c].baseInstance = first;\n"
+"			first += counts[c];\n"
+"			counts[c] = 0u;\n"
+"		}\n"
+"		return;\n"
+"	}\n"
+"	if(i >= uInstanceCount) return;\n"
+"	if(uPass == 2) {\n"
+"		for(uint m = 0u; m < uMeshCount; ++m) {\n"
+"			uint c = choices[i * uMeshCount + m];\n"
+"			if(c == culled) continue;\n"
+"			uint slot = atomicAdd(counts[c], 1u);\n"
+"			drawData[commands[c].baseInstance + slot] = uvec2(i, m);\n"
+"		}\n"
+"		return;\n"
+"	}\n"
+"	Instance instance = instances[i];\n"
+"	bool visible = sphereInFrustum(instancePoint(instance, uModelSphere.xyz), uModelSphere.w * instance.scale);\n"
+"	for(uint m = 0u; m < uMeshCount; ++m) {\n"
+"		CullMesh mesh = cullMeshes[m];\n"
+"		vec3 center = instancePoint(instance, mesh.sphere.xyz);\n"
+"		float radius = mesh.sphere.w * instance.scale;\n"
+"		uint c = culled;\n"
+"		if(visible && sphereInFrustum(center, radius)) {\n"
+"			// wfbxSelectLod, within a pixel, with the distance\n"
+"			// in the mesh's own units\n"
+"			float distance = (length(center - uCamera) - radius) / instance.scale;\n"
+"			c = mesh.firstCommand;\n"
+"			for(uint lod = 0u; distance > 0.0 && lod < mesh.lodCount; ++lod) {\n"
+"				if(lodErrors[mesh.firstCommand + 1u + lod] * uPixelsPerUnit > distance) break;\n"
+"				c = mesh.firstCommand + 1u + lod;\n"
+"			}\n"
+"			atomicAdd(counts[c], 1u);\n"
+"		}\n"
+"		choices[i * uMeshCount + m] = c;\n"
+"	}\n"
+"}\n"
+;
 const char* frag3d = "" "#version 450\n"
 "// Normal from model\n"
 "in vec4 fNormal;\n"
-"// This is always white\n"
+"// MikkTSpace tangent, w is the bitangent sign\n"
+"in vec4 fTangent;\n"
+"// Per-instance material tint, from materialTints in vert3d\n"
 "in vec3 fRGB;\n"
 "in vec3 fPos;\n"
 "in vec3 fEye;\n"
@@ -16,6 +155,7 @@ const char* frag3d = "" "#version 450\n"
 "uniform mat4 uView;\n"
 "// Light struct and scene buffer\n"
 "// I'm using vec4's to be explicit; everything's aligned to 16 bytes anyway\n"
+"// pos.w is the light's radius\n"
 "struct Light\n"
 "{\n"
 "	vec4 pos;\n"
@@ -23,14 +163,34 @@ const char* frag3d = "" "#version 450\n"
 "};\n"
 "layout(std430, location=1) buffer SceneBuffer\n"
 "{\n"
-"	Light lights[16];\n"
-"	int lightCount;\n"
+"	Light lights[];\n"
 "} scene;\n"
+"// Clustered lighting, built by buildLightClusters in main.c:\n"
+"// the first of each cluster's light indices, and how many it has\n"
+"layout(std430) readonly buffer ClusterBuffer\n"
+"{\n"
+"	uvec2 clusterRanges[];\n"
+"};\n"
+"layout(std430) readonly buffer LightIndexBuffer\n"
+"{\n"
+"	uint lightIndices[];\n"
+"};\n"
+"// Same as CLUSTER_X, CLUSTER_Y and CLUSTER_Z\n"
+"const uvec3 clusterGrid = uvec3(16, 9, 24);\n"
+"// Clusters per pixel, across and up\n"
+"uniform vec2 uClusterScale;\n"
+"// The near plane, and CLUSTER_Z over ln(far / near), so a depth's\n"
+"// slice is ln(depth / near) times that\n"
+"uniform vec2 uClusterDepth;\n"
 "// All of our textures. I could have made a texture array, but this was simpler\n"
 "uniform sampler2D uDiffuse;\n"
 "uniform sampler2D uNormal;\n"
 "uniform sampler2D uPbr;\n"
 "uniform sampler2D uEmissive;\n"
+"// The emissive map usually folds into the pbr map's alpha, as a mask\n"
+"// for uEmissiveColor; uEmissiveTextured means it's a texture after all\n"
+"uniform vec3 uEmissiveColor;\n"
+"uniform int uEmissiveTextured;\n"
 "// f0 is base specular\n"
 "// Product could be NdV or HdV depending on technique\n"
 "// We use the latter with Cook-Torrance\n"
@@ -103,29 +263,24 @@ const char* frag3d = "" "#version 450\n"
 "void main()\n"
 "{\n"
 "	vec4 color = texture(uDiffuse, fUV) * vec4(fRGB, 1);\n"
-"	vec4 normal = texture(uNormal, fUV);\n"
+"	// BC5 normal maps only keep x and y; z comes back from the length\n"
+"	vec2 normalXy = texture(uNormal, fUV).xy * 2.0 - 1.0;\n"
+"	vec3 normal = vec3(normalXy, sqrt(max(0.0, 1.0 - dot(normalXy, normalXy))));\n"
 "	vec4 pbr = texture(uPbr, fUV);\n"
-"	vec4 emissive = texture(uEmissive, fUV);\n"
+"	vec3 emissive = uEmissiveColor * pbr.a;\n"
+"	if(uEmissiveTextured != 0) {\n"
+"		emissive = texture(uEmissive, fUV).rgb;\n"
+"	}\n"
 "	\n"
 "	// Apply ambient occlusion to albedo map\n"
 "	color *= pbr.z;\n"
-"	vec3 vertexNormal = fNormal.xyz;\n"
-"	//create TBN matrix\n"
-"	vec3 posDx = dFdx(fPos);\n"
-"	vec3 posDy = dFdy(fPos);\n"
-"	vec2 texDx = dFdx(fUV);\n"
-"	vec2 texDy = dFdy(fUV);\n"
-"	vec3 tangent = normalize(texDy.y * posDx - texDx.y * posDy);\n"
-"	vec3 binormal = normalize(texDy.x * posDx - texDx.x * posDy);\n"
-"	//rebuild tangent from existing normal\n"
-"	vec3 xAxis = cross(vertexNormal, tangent);\n"
-"	tangent = normalize(cross(xAxis, vertexNormal));\n"
-"	//now bi-tangent\n"
-"	xAxis = cross(binormal, vertexNormal);\n"
-"	binormal = normalize(cross(vertexNormal, xAxis));\n"
-"	mat3 tbn = mat3(tangent, binormal, vertexNormal);\n"
+"	//TBN matrix, straight from the vertex tangents; MikkTSpace\n"
+"	//leaves these unnormalized until after the multiply.\n"
+"	//Our normal maps' green points down v, so the bitangent does too\n"
+"	vec3 bitangent = -fTangent.w * cross(fNormal.xyz, fTangent.xyz);\n"
+"	mat3 tbn = mat3(fTangent.xyz, bitangent, fNormal.xyz);\n"
 "	//transform normal map into real space\n"
-"	vec3 N = normalize(tbn * (normal.xyz * 2.0 - 1.0));\n"
+"	vec3 N = normalize(tbn * normal);\n"
 "	// grab some PBR terms\n"
 "	float roughness = pbr.y;\n"
 "	float metallic = pbr.x;\n"
@@ -137,13 +292,25 @@ const char* frag3d = "" "#version 450\n"
 "	// output color in linear space\n"
 "	vec3 lightSum = vec3(0);\n"
 "	\n"
-"	for(int i = 0; i < scene.lightCount; ++i) {\n"
+"	// Which cluster we're in: the tile from where we are on screen,\n"
+"	// and the slice from how deep\n"
+"	uvec2 tile = min(uvec2(gl_FragCoord.xy * uClusterScale), clusterGrid.xy - 1u);\n"
+"	float depth = max(-fPos.z, uClusterDepth.x);\n"
+"	uint slice = min(uint(log(depth / uClusterDepth.x) * uClusterDepth.y), clusterGrid.z - 1u);\n"
+"	uvec2 cluster = clusterRanges[(slice * clusterGrid.y + tile.y) * clusterGrid.x + tile.x];\n"
+"	for(uint n = 0u; n < cluster.y; ++n) {\n"
+"		Light light = scene.lights[lightIndices[cluster.x + n]];\n"
 "		// Light position in view space\n"
-"		vec3 localLight = (uView * vec4(scene.lights[i].pos.xyz, 1)).xyz;\n"
+"		vec3 localLight = (uView * vec4(light.pos.xyz, 1)).xyz;\n"
 "		\n"
 "		// The constant here is an artistic choice\n"
-"		// Values >1 are effectively a multiplier on brightness\n"
-"		float attenuation = 4.0 / dot(localLight - fPos, localLight - fPos);\n"
+"		// Values >1 are effectively a multiplier on brightness.\n"
+"		// It's eased down to nothing at the light's radius, so\n"
+"		// leaving it out of clusters past there doesn't show.\n"
+"		float distance2 = dot(localLight - fPos, localLight - fPos);\n"
+"		float falloff = distance2 / (light.pos.w * light.pos.w);\n"
+"		float window = clamp(1.0 - falloff * falloff, 0.0, 1.0);\n"
+"		float attenuation = 4.0 / distance2 * window * window;\n"
 "		vec3 lightDirection = normalize(localLight - fPos);\n"
 "		vec3 V = fEye;\n"
 "		vec3 L = lightDirection;\n"
@@ -179,11 +346,9 @@ const char* frag3d = "" "#version 450\n"
 "		// Just... go ahead and assemble light from what we've got.\n"
 "		vec3 reflectedLight = vec3(0);\n"
 "		vec3 diffuseLight = vec3(0);\n"
-"		vec3 radiance = scene.lights[i].color.rgb * attenuation;\n"
+"		vec3 radiance = light.color.rgb * attenuation;\n"
 "		reflectedLight += specRef * radiance;\n"
 "		diffuseLight += diffuseRef * radiance;\n"
-"		diffuseLight += emissive.rgb;\n"
-"		reflectedLight += emissive.rgb;\n"
 "		//...and here's where we'd do IBL lighting with a cubemap\n"
 "		// Apparently the surface we have here is almost completely metallic, \n"
 "		// which means that the diffuse light terms are almost completely \n"
@@ -194,6 +359,8 @@ const char* frag3d = "" "#version 450\n"
 "		// ...but I think it looks better, so I left it in.\n"
 "		lightSum += result;\n"
 "	}\n"
+"	// Glow goes in once, however many lights reach us\n"
+"	lightSum += emissive * mix(color.xyz, vec3(0), metallic) + emissive;\n"
 "	// Gamma correction\n"
 "	lightSum = lightSum / (lightSum + vec3(1.0));\n"
 "	lightSum = pow(lightSum, vec3(1.0/2.2));\n"
@@ -212,28 +379,95 @@ const char* fragSimple = "" "#version 330\n"
 "	gColor = color;\n"
 "}\n"
 ;
-const char* vert3d = "" "#version 330\n"
+const char* vert3d = "" "#version 430\n"
+"// wfbxPackedVertex:\n"
+"// position is unorm16 inside the mesh's bounds, with the tangent in w,\n"
+"// the normal is octahedral snorm16, and UVs are halfs\n"
 "layout(location=0) in vec4 vPos;\n"
-"layout(location=1) in vec4 vNormal;\n"
+"layout(location=1) in vec2 vNormal;\n"
 "layout(location=2) in vec2 vUV;\n"
+"// Per instance: which copy of the model, and which of its meshes\n"
+"layout(location=3) in uvec2 vDraw;\n"
+"// Every copy's transform, as the top three rows of a row-major\n"
+"// matrix with no shear or stretch, and its material\n"
+"struct Instance\n"
+"{\n"
+"	vec4 rows[3];\n"
+"	uint material;\n"
+"	float scale;\n"
+"	uint pad0;\n"
+"	uint pad1;\n"
+"};\n"
+"layout(std430) readonly buffer InstanceBuffer\n"
+"{\n"
+"	Instance instances[];\n"
+"};\n"
+"struct Mesh\n"
+"{\n"
+"	vec4 boundsMin;\n"
+"	vec4 boundsExtent;\n"
+"};\n"
+"layout(std430) readonly buffer MeshBuffer\n"
+"{\n"
+"	Mesh meshes[];\n"
+"};\n"
+"// Materials just tint the diffuse map for now\n"
+"const vec3 materialTints[4] = vec3[4](\n"
+"	vec3(1.0, 1.0, 1.0),\n"
+"	vec3(1.0, 0.55, 0.45),\n"
+"	vec3(0.5, 0.8, 1.0),\n"
+"	vec3(0.7, 1.0, 0.55)\n"
+");\n"
 "out vec4 fNormal;\n"
+"out vec4 fTangent;\n"
 "out vec3 fRGB;\n"
 "out vec3 fPos;\n"
 "out vec3 fEye;\n"
 "out vec2 fUV;\n"
-"uniform vec3 uOffset;\n"
 "uniform mat4 uProjection;\n"
 "uniform mat4 uView;\n"
 "uniform vec2 uTextureSize;\n"
+"vec3 octDecode(vec2 e)\n"
+"{\n"
+"	vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));\n"
+"	float t = max(-n.z, 0.0);\n"
+"	n.x += n.x >= 0.0 ? -t : t;\n"
+"	n.y += n.y >= 0.0 ? -t : t;\n"
+"	return normalize(n);\n"
+"}\n"
+"// Same as wmeshDecodeTangent: an angle around the normal, in a basis\n"
+"// built from it, with the basis' hemisphere and the bitangent sign on top\n"
+"vec4 tangentDecode(vec3 n, float w)\n"
+"{\n"
+"	uint bits = uint(w * 65535.0 + 0.5);\n"
+"	float s = (bits & 0x4000u) != 0u ? -1.0 : 1.0;\n"
+"	float a = -1.0 / (s + n.z);\n"
+"	float b = n.x * n.y * a;\n"
+"	vec3 b1 = vec3(1.0 + s * n.x * n.x * a, s * b, -s * n.x);\n"
+"	vec3 b2 = vec3(b, s + n.y * n.y * a, -n.y);\n"
+"	float angle = float(bits & 0x3FFFu) * (6.28318531 / 16383.0) - 3.14159265;\n"
+"	return vec4(b1 * cos(angle) + b2 * sin(angle), (bits & 0x8000u) != 0u ? -1.0 : 1.0);\n"
+"}\n"
 "void main()\n"
 "{\n"
-"	vec4 localPos = uView * vec4(uOffset + vPos.xyz, 1);\n"
+"	Instance instance = instances[vDraw.x];\n"
+"	Mesh mesh = meshes[vDraw.y];\n"
+"	vec4 pos = vec4(mesh.boundsMin.xyz + vPos.xyz * mesh.boundsExtent.xyz, 1);\n"
+"	vec3 world = vec3(dot(instance.rows[0], pos), dot(instance.rows[1], pos), dot(instance.rows[2], pos));\n"
+"	// The scale is the same on every axis, so normals and\n"
+"	// tangents go through the same 3x3 and get renormalized\n"
+"	mat3 basis = transpose(mat3(instance.rows[0].xyz, instance.rows[1].xyz, instance.rows[2].xyz));\n"
+"	vec4 localPos = uView * vec4(world, 1);\n"
 "	gl_Position = uProjection * localPos; \n"
 "	fPos = localPos.xyz;\n"
 "	fEye = normalize(-fPos);\n"
-"	fRGB = vec3(1.0, 1.0, 1.0);\n"
+"	fRGB = materialTints[instance.material % 4u];\n"
 "	fUV = vUV;\n"
-"	fNormal = transpose(inverse(uView)) * vNormal;\n"
+"	vec3 normal = octDecode(vNormal);\n"
+"	vec4 tangent = tangentDecode(normal, vPos.w);\n"
+"	normal = normalize(basis * normal);\n"
+"	fNormal = transpose(inverse(uView)) * vec4(normal, 0);\n"
+"	fTangent = vec4((uView * vec4(normalize(basis * tangent.xyz), 0)).xyz, tangent.w);\n"
 "}\n"
 ;
 const char* vertSimple = "" "#version 330\n"
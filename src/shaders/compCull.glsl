@@ -0,0 +1,153 @@
+#version 430
+// Frustum culling and LOD picking for every mesh of every instance,
+// in three passes over the same buffers, one dispatch each:
+// 0: each instance's meshes pick a command, or none, and count
+//    themselves into it
+// 1: one invocation turns the counts into each command's instances
+//    and first instance, and zeroes them again
+// 2: each instance's meshes take the next place in their command's
+//    run of DrawData
+layout(local_size_x = 256) in;
+
+// Same as vert3d's
+struct Instance
+{
+	vec4 rows[3];
+	uint material;
+	float scale;
+	uint pad0;
+	uint pad1;
+};
+
+layout(std430) readonly buffer InstanceBuffer
+{
+	Instance instances[];
+};
+
+// A mesh's sphere, and its commands: the full mesh, then its LODs
+struct CullMesh
+{
+	vec4 sphere;
+	uint firstCommand;
+	uint lodCount;
+	uint pad0;
+	uint pad1;
+};
+
+layout(std430) readonly buffer CullMeshBuffer
+{
+	CullMesh cullMeshes[];
+};
+
+// Per command, how far its LOD can be from the full mesh
+layout(std430) readonly buffer LodErrorBuffer
+{
+	float lodErrors[];
+};
+
+// Laid out the way glMultiDrawElementsIndirect reads them
+struct DrawCommand
+{
+	uint count;
+	uint instanceCount;
+	uint firstIndex;
+	int baseVertex;
+	uint baseInstance;
+};
+
+layout(std430) buffer CommandBuffer
+{
+	DrawCommand commands[];
+};
+
+// Zeroed before each frame's first pass
+layout(std430) buffer CountBuffer
+{
+	uint counts[];
+};
+
+// The command each mesh of each instance went to, for the last pass
+layout(std430) buffer ChoiceBuffer
+{
+	uint choices[];
+};
+
+// What vert3d reads as vDraw
+layout(std430) writeonly buffer DrawDataBuffer
+{
+	uvec2 drawData[];
+};
+
+uniform int uPass;
+uniform vec4 uPlanes[6];
+uniform vec4 uModelSphere;
+uniform vec3 uCamera;
+uniform float uPixelsPerUnit;
+uniform uint uInstanceCount;
+uniform uint uMeshCount;
+uniform uint uCommandCount;
+
+const uint culled = 0xFFFFFFFFu;
+
+// Same as sphereInFrustum
+bool sphereInFrustum(vec3 center, float radius)
+{
+	for(int i = 0; i < 6; ++i) {
+		if(dot(uPlanes[i].xyz, center) + uPlanes[i].w < -radius) return false;
+	}
+	return true;
+}
+
+vec3 instancePoint(Instance instance, vec3 p)
+{
+	vec4 q = vec4(p, 1);
+	return vec3(dot(instance.rows[0], q), dot(instance.rows[1], q), dot(instance.rows[2], q));
+}
+
+void main()
+{
+	uint i = gl_GlobalInvocationID.x;
+	if(uPass == 1) {
+		if(i != 0u) return;
+		uint first = 0u;
+		for(uint c = 0u; c < uCommandCount; ++c) {
+			commands[c].instanceCount = counts[c];
+			commands[c].baseInstance = first;
+			first += counts[c];
+			counts[c] = 0u;
+		}
+		return;
+	}
+	if(i >= uInstanceCount) return;
+
+	if(uPass == 2) {
+		for(uint m = 0u; m < uMeshCount; ++m) {
+			uint c = choices[i * uMeshCount + m];
+			if(c == culled) continue;
+			uint slot = atomicAdd(counts[c], 1u);
+			drawData[commands[c].baseInstance + slot] = uvec2(i, m);
+		}
+		return;
+	}
+
+	Instance instance = instances[i];
+	bool visible = sphereInFrustum(instancePoint(instance, uModelSphere.xyz), uModelSphere.w * instance.scale);
+	for(uint m = 0u; m < uMeshCount; ++m) {
+		CullMesh mesh = cullMeshes[m];
+		vec3 center = instancePoint(instance, mesh.sphere.xyz);
+		float radius = mesh.sphere.w * instance.scale;
+		uint c = culled;
+		if(visible && sphereInFrustum(center, radius)) {
+			// wfbxSelectLod, within a pixel, with the distance
+			// in the mesh's own units
+			float distance = (length(center - uCamera) - radius) / instance.scale;
+			c = mesh.firstCommand;
+			for(uint lod = 0u; distance > 0.0 && lod < mesh.lodCount; ++lod) {
+				if(lodErrors[mesh.firstCommand + 1u + lod] * uPixelsPerUnit > distance) break;
+				c = mesh.firstCommand + 1u + lod;
+			}
+			atomicAdd(counts[c], 1u);
+		}
+		choices[i * uMeshCount + m] = c;
+	}
+}
@@ -2,7 +2,9 @@
 
 // Normal from model
 in vec4 fNormal;
-// This is always white
+// MikkTSpace tangent, w is the bitangent sign
+in vec4 fTangent;
+// Per-instance material tint, from materialTints in vert3d
 in vec3 fRGB;
 in vec3 fPos;
 in vec3 fEye;
@@ -19,6 +21,7 @@ uniform mat4 uView;
 
 // Light struct and scene buffer
 // I'm using vec4's to be explicit; everything's aligned to 16 bytes anyway
+// pos.w is the light's radius
 struct Light
 {
 	vec4 pos;
@@ -27,16 +30,40 @@ struct Light
 
 layout(std430, location=1) buffer SceneBuffer
 {
-	Light lights[16];
-	int lightCount;
+	Light lights[];
 } scene;
 
+// Clustered lighting, built by buildLightClusters in main.c:
+// the first of each cluster's light indices, and how many it has
+layout(std430) readonly buffer ClusterBuffer
+{
+	uvec2 clusterRanges[];
+};
+
+layout(std430) readonly buffer LightIndexBuffer
+{
+	uint lightIndices[];
+};
+
+// Same as CLUSTER_X, CLUSTER_Y and CLUSTER_Z
+const uvec3 clusterGrid = uvec3(16, 9, 24);
+// Clusters per pixel, across and up
+uniform vec2 uClusterScale;
+// The near plane, and CLUSTER_Z over ln(far / near), so a depth's
+// slice is ln(depth / near) times that
+uniform vec2 uClusterDepth;
+
 // All of our textures. I could have made a texture array, but this was simpler
 uniform sampler2D uDiffuse;
 uniform sampler2D uNormal;
 uniform sampler2D uPbr;
 uniform sampler2D uEmissive;
 
+// The emissive map usually folds into the pbr map's alpha, as a mask
+// for uEmissiveColor; uEmissiveTextured means it's a texture after all
+uniform vec3 uEmissiveColor;
+uniform int uEmissiveTextured;
+
 // f0 is base specular
 // Product could be NdV or HdV depending on technique
 // We use the latter with Cook-Torrance
@@ -117,31 +144,26 @@ vec3 specularCookTorrance(float NdL, float NdV, float NdH,
 void main()
 {
 	vec4 color = texture(uDiffuse, fUV) * vec4(fRGB, 1);
-	vec4 normal = texture(uNormal, fUV);
+	// BC5 normal maps only keep x and y; z comes back from the length
+	vec2 normalXy = texture(uNormal, fUV).xy * 2.0 - 1.0;
+	vec3 normal = vec3(normalXy, sqrt(max(0.0, 1.0 - dot(normalXy, normalXy))));
 	vec4 pbr = texture(uPbr, fUV);
-	vec4 emissive = texture(uEmissive, fUV);
+	vec3 emissive = uEmissiveColor * pbr.a;
+	if(uEmissiveTextured != 0) {
+		emissive = texture(uEmissive, fUV).rgb;
+	}
 	
 	// Apply ambient occlusion to albedo map
 	color *= pbr.z;
 
-	vec3 vertexNormal = fNormal.xyz;
-	//create TBN matrix
-	vec3 posDx = dFdx(fPos);
-	vec3 posDy = dFdy(fPos);
-	vec2 texDx = dFdx(fUV);
-	vec2 texDy = dFdy(fUV);
-	vec3 tangent = normalize(texDy.y * posDx - texDx.y * posDy);
-	vec3 binormal = normalize(texDy.x * posDx - texDx.x * posDy);
-	//rebuild tangent from existing normal
-	vec3 xAxis = cross(vertexNormal, tangent);
-	tangent = normalize(cross(xAxis, vertexNormal));
-	//now bi-tangent
-	xAxis = cross(binormal, vertexNormal);
-	binormal = normalize(cross(vertexNormal, xAxis));
-	mat3 tbn = mat3(tangent, binormal, vertexNormal);
+	//TBN matrix, straight from the vertex tangents; MikkTSpace
+	//leaves these unnormalized until after the multiply.
+	//Our normal maps' green points down v, so the bitangent does too
+	vec3 bitangent = -fTangent.w * cross(fNormal.xyz, fTangent.xyz);
+	mat3 tbn = mat3(fTangent.xyz, bitangent, fNormal.xyz);
 
 	//transform normal map into real space
-	vec3 N = normalize(tbn * (normal.xyz * 2.0 - 1.0));
+	vec3 N = normalize(tbn * normal);
 
 	// grab some PBR terms
 	float roughness = pbr.y;
@@ -155,14 +177,26 @@ void main()
 	// output color in linear space
 	vec3 lightSum = vec3(0);
 	
-
-	for(int i = 0; i < scene.lightCount; ++i) {
+	// Which cluster we're in: the tile from where we are on screen,
+	// and the slice from how deep
+	uvec2 tile = min(uvec2(gl_FragCoord.xy * uClusterScale), clusterGrid.xy - 1u);
+	float depth = max(-fPos.z, uClusterDepth.x);
+	uint slice = min(uint(log(depth / uClusterDepth.x) * uClusterDepth.y), clusterGrid.z - 1u);
+	uvec2 cluster = clusterRanges[(slice * clusterGrid.y + tile.y) * clusterGrid.x + tile.x];
+
+	for(uint n = 0u; n < cluster.y; ++n) {
+		Light light = scene.lights[lightIndices[cluster.x + n]];
 		// Light position in view space
-		vec3 localLight = (uView * vec4(scene.lights[i].pos.xyz, 1)).xyz;
+		vec3 localLight = (uView * vec4(light.pos.xyz, 1)).xyz;
 		
 		// The constant here is an artistic choice
-		// Values >1 are effectively a multiplier on brightness
-		float attenuation = 4.0 / dot(localLight - fPos, localLight - fPos);
+		// Values >1 are effectively a multiplier on brightness.
+		// It's eased down to nothing at the light's radius, so
+		// leaving it out of clusters past there doesn't show.
+		float distance2 = dot(localLight - fPos, localLight - fPos);
+		float falloff = distance2 / (light.pos.w * light.pos.w);
+		float window = clamp(1.0 - falloff * falloff, 0.0, 1.0);
+		float attenuation = 4.0 / distance2 * window * window;
 		vec3 lightDirection = normalize(localLight - fPos);
 
 		vec3 V = fEye;
@@ -206,14 +240,11 @@ void main()
 		vec3 reflectedLight = vec3(0);
 		vec3 diffuseLight = vec3(0);
 
-		vec3 radiance = scene.lights[i].color.rgb * attenuation;
+		vec3 radiance = light.color.rgb * attenuation;
 
 		reflectedLight += specRef * radiance;
 		diffuseLight += diffuseRef * radiance;
 
-		diffuseLight += emissive.rgb;
-		reflectedLight += emissive.rgb;
-
 		//...and here's where we'd do IBL lighting with a cubemap
 
 		// Apparently the surface we have here is almost completely metallic, 
@@ -226,6 +257,9 @@ void main()
 		lightSum += result;
 	}
 
+	// Glow goes in once, however many lights reach us
+	lightSum += emissive * mix(color.xyz, vec3(0), metallic) + emissive;
+
 
 	// Gamma correction
 	lightSum = lightSum / (lightSum + vec3(1.0));
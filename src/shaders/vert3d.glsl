@@ -1,26 +1,100 @@
-#version 330
+#version 430
+// wfbxPackedVertex:
+// position is unorm16 inside the mesh's bounds, with the tangent in w,
+// the normal is octahedral snorm16, and UVs are halfs
 layout(location=0) in vec4 vPos;
-layout(location=1) in vec4 vNormal;
+layout(location=1) in vec2 vNormal;
 layout(location=2) in vec2 vUV;
+// Per instance: which copy of the model, and which of its meshes
+layout(location=3) in uvec2 vDraw;
+
+// Every copy's transform, as the top three rows of a row-major
+// matrix with no shear or stretch, and its material
+struct Instance
+{
+	vec4 rows[3];
+	uint material;
+	float scale;
+	uint pad0;
+	uint pad1;
+};
+
+layout(std430) readonly buffer InstanceBuffer
+{
+	Instance instances[];
+};
+
+struct Mesh
+{
+	vec4 boundsMin;
+	vec4 boundsExtent;
+};
+
+layout(std430) readonly buffer MeshBuffer
+{
+	Mesh meshes[];
+};
+
+// Materials just tint the diffuse map for now
+const vec3 materialTints[4] = vec3[4](
+	vec3(1.0, 1.0, 1.0),
+	vec3(1.0, 0.55, 0.45),
+	vec3(0.5, 0.8, 1.0),
+	vec3(0.7, 1.0, 0.55)
+);
 
 out vec4 fNormal;
+out vec4 fTangent;
 out vec3 fRGB;
 out vec3 fPos;
 out vec3 fEye;
 out vec2 fUV;
 
-uniform vec3 uOffset;
 uniform mat4 uProjection;
 uniform mat4 uView;
 uniform vec2 uTextureSize;
 
+vec3 octDecode(vec2 e)
+{
+	vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+	float t = max(-n.z, 0.0);
+	n.x += n.x >= 0.0 ? -t : t;
+	n.y += n.y >= 0.0 ? -t : t;
+	return normalize(n);
+}
+
+// Same as wmeshDecodeTangent: an angle around the normal, in a basis
+// built from it, with the basis' hemisphere and the bitangent sign on top
+vec4 tangentDecode(vec3 n, float w)
+{
+	uint bits = uint(w * 65535.0 + 0.5);
+	float s = (bits & 0x4000u) != 0u ? -1.0 : 1.0;
+	float a = -1.0 / (s + n.z);
+	float b = n.x * n.y * a;
+	vec3 b1 = vec3(1.0 + s * n.x * n.x * a, s * b, -s * n.x);
+	vec3 b2 = vec3(b, s + n.y * n.y * a, -n.y);
+	float angle = float(bits & 0x3FFFu) * (6.28318531 / 16383.0) - 3.14159265;
+	return vec4(b1 * cos(angle) + b2 * sin(angle), (bits & 0x8000u) != 0u ? -1.0 : 1.0);
+}
+
 void main()
 {
-	vec4 localPos = uView * vec4(uOffset + vPos.xyz, 1);
+	Instance instance = instances[vDraw.x];
+	Mesh mesh = meshes[vDraw.y];
+	vec4 pos = vec4(mesh.boundsMin.xyz + vPos.xyz * mesh.boundsExtent.xyz, 1);
+	vec3 world = vec3(dot(instance.rows[0], pos), dot(instance.rows[1], pos), dot(instance.rows[2], pos));
+	// The scale is the same on every axis, so normals and
+	// tangents go through the same 3x3 and get renormalized
+	mat3 basis = transpose(mat3(instance.rows[0].xyz, instance.rows[1].xyz, instance.rows[2].xyz));
+	vec4 localPos = uView * vec4(world, 1);
 	gl_Position = uProjection * localPos; 
 	fPos = localPos.xyz;
 	fEye = normalize(-fPos);
-	fRGB = vec3(1.0, 1.0, 1.0);
+	fRGB = materialTints[instance.material % 4u];
 	fUV = vUV;
-	fNormal = transpose(inverse(uView)) * vNormal;
+	vec3 normal = octDecode(vNormal);
+	vec4 tangent = tangentDecode(normal, vPos.w);
+	normal = normalize(basis * normal);
+	fNormal = transpose(inverse(uView)) * vec4(normal, 0);
+	fTangent = vec4((uView * vec4(normalize(basis * tangent.xyz), 0)).xyz, tangent.w);
 }
@@ -0,0 +1,339 @@
+/* wb_cull.h
+ *
+ * Frustum culling for lots of bounding spheres on the CPU, with
+ * nothing but a list of indices coming out, so it works the same
+ * whatever the GPU can or can't do.
+ *
+ * Spheres live in a wcullSpheres as separate x, y, z and radius
+ * arrays, so AVX2 tests 8 of them against a plane in a handful of
+ * instructions; without AVX2 it's SSE2, 4 at a time. The arrays
+ * are padded out to a multiple of 8 with spheres nothing can see.
+ *
+ * wcullFrustum splits the spheres into ranges, one job each on
+ * the wb_jobs pool, so include wb_jobs.h's dependencies when
+ * linking, same as wb_tex. While it waits, the calling thread
+ * only runs those ranges, never anyone else's jobs. Each range
+ * writes the spheres it keeps into its own part of the output, and
+ * the parts get moved together at the end, so the list comes out
+ * in order.
+ *
+ * The tests are sphereInFrustum's, in render_util.c: the same
+ * multiplies and adds in the same order, and the same conservative
+ * answer for spheres just off a corner, so every path keeps the
+ * same spheres.
+ *
+ * Like wb_tex.h, the implementation goes in one translation
+ * unit with WB_CULL_IMPLEMENTATION defined; main.c does this.
+ *
+ */
+
+#ifndef WB_CULL_H
+#define WB_CULL_H
+
+#include <stddef.h>
+
+enum
+{
+	// All on the calling thread, for benchmarks
+	WCULL_SINGLE_THREAD = 1 << 0,
+	// No SIMD, for benchmarks. It keeps the same spheres.
+	WCULL_SCALAR = 1 << 1,
+};
+
+typedef struct
+{
+	float* x;
+	float* y;
+	float* z;
+	float* radius;
+	ptrdiff_t count;
+	// count rounded up to a multiple of 8; the arrays hold this many
+	ptrdiff_t padded;
+} wcullSpheres;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Room for count spheres, all of them out of sight until they're
+// set. Fill in the arrays directly. Returns 0 if it's out of memory.
+int wcullCreate(wcullSpheres* spheres, ptrdiff_t count);
+void wcullDestroy(wcullSpheres* spheres);
+
+// The six planes of a column-major projection times view matrix:
+// left, right, bottom, top, near and far, each as xyzw with xyz a
+// unit vector pointing inward
+void wcullPlanes(float* planes, const float* projView);
+
+// Writes the index of every sphere at least partly inside planes,
+// lowest first, to visible, which needs room for spheres->padded of
+// them; what's past the returned count is scratch.
+// Returns how many there are.
+ptrdiff_t wcullFrustum(
+		unsigned int* visible,
+		const wcullSpheres* spheres,
+		const float* planes,
+		unsigned int flags);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
+
+#if defined(WB_CULL_IMPLEMENTATION) && !defined(WB_CULL_IMPLEMENTED)
+#define WB_CULL_IMPLEMENTED
+#include <float.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#include "wb_jobs.h"
+
+#ifndef wcullMalloc
+#define wcullMalloc(size) malloc(size)
+#define wcullFree(ptr) free(ptr)
+#endif
+
+// Spheres per job: a few hundred microseconds of work, well past
+// what the pool's one lock costs, and a multiple of 8
+#define WCULL__RANGE 65536
+
+int wcullCreate(wcullSpheres* spheres, ptrdiff_t count)
+{
+	ptrdiff_t padded = (count + 7) & ~(ptrdiff_t)7;
+	float* block = (float*)wcullMalloc(sizeof(float) * 4 * (padded ? padded : 8));
+	memset(spheres, 0, sizeof(*spheres));
+	if(!block) return 0;
+	spheres->x = block;
+	spheres->y = block + padded;
+	spheres->z = block + padded * 2;
+	spheres->radius = block + padded * 3;
+	spheres->count = count;
+	spheres->padded = padded;
+	// Every plane's distance is finite and less than FLT_MAX,
+	// so no plane passes these
+	memset(block, 0, sizeof(float) * 3 * padded);
+	for(ptrdiff_t i = 0; i < padded; ++i) spheres->radius[i] = -FLT_MAX;
+	return 1;
+}
+
+void wcullDestroy(wcullSpheres* spheres)
+{
+	wcullFree(spheres->x);
+	memset(spheres, 0, sizeof(*spheres));
+}
+
+void wcullPlanes(float* planes, const float* m)
+{
+	// Left, right, bottom, top, near, far: row 3 plus or minus row 0, 1, 2
+	for(int i = 0; i < 6; ++i) {
+		int row = i / 2;
+		float sign = i & 1 ? -1.0f : 1.0f;
+		float* plane = planes + i * 4;
+		for(int c = 0; c < 4; ++c) {
+			plane[c] = m[c * 4 + 3] + sign * m[c * 4 + row];
+		}
+		float length = sqrtf(plane[0] * plane[0] + plane[1] * plane[1] + plane[2] * plane[2]);
+		if(length > 0) {
+			for(int c = 0; c < 4; ++c) plane[c] /= length;
+		}
+	}
+}
+
+// The range loops
+//
+// A sphere is out once its center is more than its radius behind
+// any plane. Keeping a sphere is "not less than" rather than
+// "greater or equal", so a NaN keeps it, like sphereInFrustum.
+//
+// Kept indices get written without branching: every index in a
+// block goes to the next free slot, and only the kept ones move
+// the slot along. Nothing ever gets written past the block being
+// tested, so ranges can't step on each other.
+static
+ptrdiff_t wcull__rangeScalar(unsigned int* out, const wcullSpheres* s, const float* planes,
+		ptrdiff_t first, ptrdiff_t end)
+{
+	ptrdiff_t n = 0;
+	for(ptrdiff_t i = first; i < end; ++i) {
+		int inside = 1;
+		for(int k = 0; k < 6; ++k) {
+			const float* plane = planes + k * 4;
+			float d = plane[0] * s->x[i] + plane[1] * s->y[i] + plane[2] * s->z[i] + plane[3];
+			inside &= !(d < -s->radius[i]);
+		}
+		out[n] = (unsigned int)i;
+		n += inside;
+	}
+	return n;
+}
+
+static
+ptrdiff_t wcull__rangeSse(unsigned int* out, const wcullSpheres* s, const float* planes,
+		ptrdiff_t first, ptrdiff_t end)
+{
+	__m128 p[24];
+	for(int k = 0; k < 24; ++k) p[k] = _mm_set1_ps(planes[k]);
+	const __m128 zero = _mm_setzero_ps();
+	ptrdiff_t n = 0;
+	for(ptrdiff_t i = first; i < end; i += 4) {
+		__m128 x = _mm_loadu_ps(s->x + i);
+		__m128 y = _mm_loadu_ps(s->y + i);
+		__m128 z = _mm_loadu_ps(s->z + i);
+		__m128 negR = _mm_sub_ps(zero, _mm_loadu_ps(s->radius + i));
+		__m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+		for(int k = 0; k < 6; ++k) {
+			__m128 d = _mm_add_ps(_mm_add_ps(_mm_add_ps(
+							_mm_mul_ps(p[k * 4], x),
+							_mm_mul_ps(p[k * 4 + 1], y)),
+						_mm_mul_ps(p[k * 4 + 2], z)),
+					p[k * 4 + 3]);
+			inside = _mm_and_ps(inside, _mm_cmpnlt_ps(d, negR));
+		}
+		int mask = _mm_movemask_ps(inside);
+		if(!mask) continue;
+		for(int k = 0; k < 4; ++k) {
+			out[n] = (unsigned int)(i + k);
+			n += (mask >> k) & 1;
+		}
+	}
+	return n;
+}
+
+#if defined(__GNUC__) || defined(__clang__)
+#define WCULL__AVX2 __attribute__((target("avx2")))
+#else
+#define WCULL__AVX2
+#endif
+
+static
+int wcull__hasAvx2(void)
+{
+#if defined(_MSC_VER)
+	int info[4];
+	__cpuid(info, 0);
+	if(info[0] < 7) return 0;
+	__cpuid(info, 1);
+	// The OS has to save the YMM registers too
+	if(!(info[2] & (1 << 27)) || !(info[2] & (1 << 28))) return 0;
+	if((_xgetbv(0) & 6) != 6) return 0;
+	__cpuidex(info, 7, 0);
+	return (info[1] & (1 << 5)) != 0;
+#elif defined(__GNUC__) || defined(__clang__)
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("avx2") != 0;
+#else
+	return 0;
+#endif
+}
+
+static WCULL__AVX2
+ptrdiff_t wcull__rangeAvx2(unsigned int* out, const wcullSpheres* s, const float* planes,
+		ptrdiff_t first, ptrdiff_t end)
+{
+	__m256 p[24];
+	for(int k = 0; k < 24; ++k) p[k] = _mm256_set1_ps(planes[k]);
+	const __m256 zero = _mm256_setzero_ps();
+	ptrdiff_t n = 0;
+	for(ptrdiff_t i = first; i < end; i += 8) {
+		__m256 x = _mm256_loadu_ps(s->x + i);
+		__m256 y = _mm256_loadu_ps(s->y + i);
+		__m256 z = _mm256_loadu_ps(s->z + i);
+		__m256 negR = _mm256_sub_ps(zero, _mm256_loadu_ps(s->radius + i));
+		__m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+		for(int k = 0; k < 6; ++k) {
+			__m256 d = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(
+							_mm256_mul_ps(p[k * 4], x),
+							_mm256_mul_ps(p[k * 4 + 1], y)),
+						_mm256_mul_ps(p[k * 4 + 2], z)),
+					p[k * 4 + 3]);
+			inside = _mm256_and_ps(inside, _mm256_cmp_ps(d, negR, _CMP_NLT_UQ));
+		}
+		int mask = _mm256_movemask_ps(inside);
+		if(!mask) continue;
+		for(int k = 0; k < 8; ++k) {
+			out[n] = (unsigned int)(i + k);
+			n += (mask >> k) & 1;
+		}
+	}
+	return n;
+}
+
+typedef struct
+{
+	const wcullSpheres* spheres;
+	const float* planes;
+	unsigned int* visible;
+	ptrdiff_t first, end;
+	int avx2, scalar;
+	// What the job kept, at visible + first
+	ptrdiff_t kept;
+} wcull__Job;
+
+static
+void wcull__job(void* data)
+{
+	wcull__Job* job = (wcull__Job*)data;
+	unsigned int* out = job->visible + job->first;
+	if(job->scalar) {
+		job->kept = wcull__rangeScalar(out, job->spheres, job->planes, job->first, job->end);
+	} else if(job->avx2) {
+		job->kept = wcull__rangeAvx2(out, job->spheres, job->planes, job->first, job->end);
+	} else {
+		job->kept = wcull__rangeSse(out, job->spheres, job->planes, job->first, job->end);
+	}
+}
+
+ptrdiff_t wcullFrustum(
+		unsigned int* visible,
+		const wcullSpheres* spheres,
+		const float* planes,
+		unsigned int flags)
+{
+	static int avx2 = -1;
+	if(avx2 < 0) avx2 = wcull__hasAvx2();
+
+	wcull__Job one;
+	one.spheres = spheres;
+	one.planes = planes;
+	one.visible = visible;
+	one.first = 0;
+	one.end = spheres->padded;
+	one.avx2 = avx2;
+	one.scalar = (flags & WCULL_SCALAR) != 0;
+	if(spheres->padded <= WCULL__RANGE || (flags & WCULL_SINGLE_THREAD)) {
+		wcull__job(&one);
+		return one.kept;
+	}
+
+	ptrdiff_t jobCount = (spheres->padded + WCULL__RANGE - 1) / WCULL__RANGE;
+	wcull__Job* jobs = (wcull__Job*)wcullMalloc(sizeof(wcull__Job) * jobCount);
+	if(!jobs) {
+		wcull__job(&one);
+		return one.kept;
+	}
+	wjobCounter counter = {0};
+	for(ptrdiff_t i = 0; i < jobCount; ++i) {
+		jobs[i] = one;
+		jobs[i].first = i * WCULL__RANGE;
+		jobs[i].end = jobs[i].first + WCULL__RANGE < spheres->padded ? jobs[i].first + WCULL__RANGE : spheres->padded;
+		wjobAdd(&counter, wcull__job, jobs + i);
+	}
+	// wjobWait could pick up some other, much slower job, and this
+	// runs every frame
+	wjobWaitOwn(&counter);
+
+	// The first range's are already in place
+	ptrdiff_t total = jobs[0].kept;
+	for(ptrdiff_t i = 1; i < jobCount; ++i) {
+		memmove(visible + total, visible + jobs[i].first, sizeof(unsigned int) * jobs[i].kept);
+		total += jobs[i].kept;
+	}
+	wcullFree(jobs);
+	return total;
+}
+
+#endif
@@ -4,19 +4,25 @@
  * This isn't really useful software yet, I just packaged 
  * it separately to improve my compile times. 
  * 
- * wb_fbx loads simple FBX models, using fbxsdk.
+ * wb_fbx loads simple binary FBX (7.x) models.
+ * It used to go through fbxsdk, but building a whole FbxScene
+ * just to copy four arrays out of it was most of our load time,
+ * so now it maps the file and walks the node records itself.
+ * The compressed arrays are all inflated at once on the
+ * wb_jobs worker pool, so include wb_jobs.h's dependencies
+ * (pthreads, on Linux) when linking.
+ *
  * ...and when I mean simple, I mean a subset that:
+ * 		- Is a binary FBX file (no ASCII)
  * 		- Only has one layer per mesh
- * 		- Doesn't need any rotations
  * 		- You have to provide the material textures
- * 		- Has specific mapping/reference modes
- * 			- UVs must be PolygonVertex and IndexToDirect
- * 			- Normals must be ControlPoint and Direct
  * 		- Doesn't use anything other than Polygons, UVs, and Normals
  *
  * However, it does provide you with a bunch of data that's
- * easy to use with OpenGL, already transformed and scaled, 
- * with a nice-and-simple C API.
+ * easy to use with OpenGL, already baked into world space
+ * through the whole node hierarchy (pivots, pre/post rotation
+ * and geometric transforms included) and with MikkTSpace tangents
+ * generated, with a nice-and-simple C API.
  *
  * You probably want to compile this separately, 
  * defining WB_FBX_IMPLEMENTATION with a compiler command.
@@ -24,14 +30,33 @@
  */
 
 #include <stddef.h>
+#include "wb_mesh.h"
 
 typedef struct 
 {
 	float pos[4];
 	float normal[4];
 	float uv[2];
+	// MikkTSpace tangent; w is the bitangent sign, 
+	// so bitangent = w * cross(normal, tangent)
+	float tangent[4];
 } wfbxVertex;
 
+// Loaded with WFBX_LOAD_PACKED, in 16 bytes instead of 56:
+// 		pos - unorm16, relative to the mesh's bounds; 
+// 		w is the tangent, see wmeshEncodeTangent
+// 		normal - octahedral, snorm16
+// 		uv - half floats
+// vert3d.glsl shows how to unpack it.
+typedef struct 
+{
+	unsigned short pos[4];
+	short normal[2];
+	unsigned short uv[2];
+} wfbxPackedVertex;
+
+// The mesh node's own Lcl Translation/Rotation/Scaling, for reference.
+// Vertices already have the full world transform baked in.
 typedef struct
 {
 	float translation[3];
@@ -45,27 +70,190 @@ typedef struct
 	int width, height;
 } wfbxMaterialTexture;
 
+typedef struct 
+{
+	float min[3];
+	float max[3];
+} wfbxBounds;
+
+// Centered on the bounds, just reaching the farthest vertex; cheaper
+// than the box for frustum tests and distances
+typedef struct 
+{
+	float center[3];
+	float radius;
+} wfbxSphere;
+
+// One simplified version of a mesh: a range of the mesh's lodIndices,
+// and how far its surface can be from the full mesh, in model units
+typedef struct 
+{
+	unsigned int firstIndex;
+	unsigned int indexCount;
+	float error;
+} wfbxLod;
+
 typedef struct 
 {
 	wfbxVertex** meshes;
 	ptrdiff_t* meshSizes;
 
+	// Only with WFBX_LOAD_PACKED, which leaves meshes NULL.
+	// Dequantize positions with bounds.
+	wfbxPackedVertex** packedMeshes;
+
 	unsigned int** indices;
 	ptrdiff_t* indexCounts;
 
+	// Only with WFBX_LOAD_MESHLETS; see wb_mesh.h.
+	// Meshlet vertices are indices into the mesh's vertices.
+	wmeshMeshlet** meshlets;
+	ptrdiff_t* meshletCounts;
+	unsigned int** meshletVertices;
+	unsigned char** meshletTriangles;
+
+	// Only with WFBX_LOAD_LODS: simplified versions of each mesh,
+	// finest first, as index buffers over the same vertices.
+	// A mesh's LODs all live in its lodIndices, back to back.
+	wfbxLod** lods;
+	ptrdiff_t* lodCounts;
+	unsigned int** lodIndices;
+
 	wfbxTransform* transforms;
 	wfbxMaterialTexture* materials;
+	wfbxBounds* bounds;
+	wfbxSphere* spheres;
+
+	// The whole model: every mesh's bounds, and a sphere around
+	// all of the meshes' spheres
+	wfbxBounds modelBounds;
+	wfbxSphere modelSphere;
 
 	ptrdiff_t count;
+
+	// When the model came from a baked cache, meshes and indices
+	// point straight into this mapping of the .wbm file
+	void* cache;
+
+	// Everything else is in two blocks: this struct with all the
+	// per-mesh arrays, counts and meshlet/LOD descriptors, and
+	// geometry, with the vertices and indices (NULL when they're
+	// in the cache). They're malloced unless the model was loaded
+	// into a wfbxArena, which leaves freeing them to you.
+	void* geometry;
+	// The malloc holding this struct, which can start a few bytes
+	// before it, so everything carved out of it lines up
+	void* block;
+	int inArena;
 } wfbxModel;
 
+// Caller-owned memory to load models into. Loads carve out what they
+// need from base + used and move used along; when it runs out, the
+// load fails and used is left where it was. Reset used to drop
+// everything loaded into it at once.
+typedef struct 
+{
+	void* base;
+	ptrdiff_t size;
+	ptrdiff_t used;
+} wfbxArena;
+
+// Baked model cache (.wbm)
+//
+// The first load of model.fbx writes model.wbm next to it, holding the
+// final vertex and index buffers, mesh ranges, transforms and bounds.
+// Later loads map that file and hand back pointers into it, so
+// the buffers can go straight to glBufferData with no copies.
+//
+// The cache is keyed by a hash of the source file and by
+// WFBX_LOADER_VERSION, which goes up whenever the loader's output
+// changes. Anything that doesn't match is rebuilt from the FBX.
+#define WFBX_LOADER_VERSION 5
+
+enum
+{
+	// Don't read or write a .wbm cache
+	WFBX_LOAD_SKIP_CACHE = 1 << 0,
+	// Keep triangles and vertices in file order instead of
+	// optimizing them for the vertex cache
+	WFBX_LOAD_NO_REORDER = 1 << 1,
+	// Fill packedMeshes instead of meshes
+	WFBX_LOAD_PACKED = 1 << 2,
+	// Split meshes into meshlets, for cluster culling
+	WFBX_LOAD_MESHLETS = 1 << 3,
+	// Build up to WFBX_MAX_LODS simplified LODs per mesh
+	WFBX_LOAD_LODS = 1 << 4,
+};
+
+// LODs aim for 50%, 25%, 10% and 3% of the triangles. Meshes that
+// can't get that small without tearing seams get fewer of them.
+#define WFBX_MAX_LODS 4
+
 #ifdef __cplusplus
-extern "C" 
+extern "C" {
 #endif
 wfbxModel* wfbxLoadModelFromFile(
 		const char* filename, 
 		wfbxMaterialTexture* defaultMaterial);
 
+// flags are WFBX_LOAD_*
+wfbxModel* wfbxLoadModel(
+		const char* filename, 
+		wfbxMaterialTexture* defaultMaterial,
+		unsigned int flags);
+
+// Same, but the model lives in arena instead of the heap
+wfbxModel* wfbxLoadModelInArena(
+		const char* filename, 
+		wfbxMaterialTexture* defaultMaterial,
+		unsigned int flags,
+		wfbxArena* arena);
+
+// Unmaps the cache and frees the model's blocks, unless they're in an arena
+void wfbxFreeModel(wfbxModel* model);
+
+// Asynchronous loading
+//
+// Queues the whole load (reading the file, parsing, baking, the cache)
+// on the wb_jobs pool and returns right away. Poll wfbxLoadReady and
+// wfbxLoadProgress from your render thread; once it's ready,
+// wfbxFinishLoad hands the model over (NULL if the load failed) and
+// frees the handle. Nothing here touches OpenGL, so creating buffers
+// is still up to you, on the thread that owns the context.
+// defaultMaterial and filename are copied, so they needn't outlive the call.
+typedef struct wfbxLoad wfbxLoad;
+wfbxLoad* wfbxLoadModelAsync(
+		const char* filename, 
+		wfbxMaterialTexture* defaultMaterial,
+		unsigned int flags);
+int wfbxLoadReady(wfbxLoad* load);
+// From 0 to 1, roughly in proportion to the time left; loads 
+// that come out of the cache go straight to 1
+float wfbxLoadProgress(wfbxLoad* load);
+// Waits for the load if it isn't ready yet
+wfbxModel* wfbxFinishLoad(wfbxLoad* load);
+
+// Drops the vertices and indices (every mesh's meshes, packedMeshes,
+// indices, meshletVertices, meshletTriangles and lodIndices) once
+// they're on the GPU. Counts, bounds, spheres, transforms, materials and the
+// meshlet and LOD descriptors stay, so you can keep drawing and culling.
+void wfbxReleaseGeometry(wfbxModel* model);
+
+// Picks the coarsest of a mesh's LODs whose error would cover at most
+// maxPixelError pixels, or -1 for the full mesh. distance is from the
+// camera to the closest the mesh gets; pixelsPerUnit is the screen
+// height over 2 * tan(fov / 2), so a unit at distance 1 covers that
+// many pixels.
+int wfbxSelectLod(
+		const wfbxModel* model,
+		ptrdiff_t mesh,
+		float distance,
+		float pixelsPerUnit,
+		float maxPixelError);
+#ifdef __cplusplus
+}
+#endif
+
 #if WB_FBX_IMPLEMENTATION
 //Allocators, overload at compile time
 #define wfbxMalloc(size) malloc(size)
@@ -75,161 +263,2716 @@ wfbxModel* wfbxLoadModelFromFile(
 #define wfbxNewArray(type, count) (type*)wfbxMalloc(sizeof(type) * count)
 
 typedef ptrdiff_t isize;
+typedef unsigned char u8;
+typedef int i32;
 typedef unsigned int u32;
+typedef long long i64;
+typedef unsigned long long u64;
 typedef float f32;
+typedef double f64;
 
-#define Fenum(t) FbxLayerElement::EType::e ## t
-#include <fbxsdk.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <immintrin.h>
+#ifdef _MSC_VER
 #include <intrin.h>
+#endif
+
+#define WB_INFLATE_IMPLEMENTATION
+#include "wb_inflate.h"
+
+#define WB_JOBS_IMPLEMENTATION
+#include "wb_jobs.h"
+
+#define wmeshMalloc(size) wfbxMalloc(size)
+#define wmeshFree(ptr) wfbxFree(ptr)
+#define WB_MESH_IMPLEMENTATION
+#include "wb_mesh.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Read-only file mapping
+//
+// We never copy the file; node records and uncompressed
+// arrays are read straight out of the mapped pages.
+typedef struct 
+{
+	const u8* data;
+	isize size;
+#ifdef _WIN32
+	HANDLE file, mapping;
+#endif
+} wfbx__MappedFile;
 
 static 
-void buildModelFromMeshesRecursively(
-		FbxNode* node, 
-		isize* meshIndex, 
-		wfbxModel* model,
-		wfbxMaterialTexture* defaultMaterial);
-static
-void countMeshesRecursively(FbxNode* node, isize* meshCount);
+int wfbx__mapFile(const char* fileName, wfbx__MappedFile* f)
+{
+	memset(f, 0, sizeof(*f));
+#ifdef _WIN32
+	f->file = CreateFileA(fileName, GENERIC_READ, FILE_SHARE_READ,
+			NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if(f->file == INVALID_HANDLE_VALUE) return 0;
 
-wfbxModel* wfbxLoadModelFromFile(
-		const char* fileName, 
-		wfbxMaterialTexture* defaultMaterial)
+	LARGE_INTEGER size;
+	if(!GetFileSizeEx(f->file, &size) || size.QuadPart == 0) {
+		CloseHandle(f->file);
+		return 0;
+	}
+
+	f->mapping = CreateFileMappingA(f->file, NULL, PAGE_READONLY, 0, 0, NULL);
+	if(!f->mapping) {
+		CloseHandle(f->file);
+		return 0;
+	}
+
+	f->data = (const u8*)MapViewOfFile(f->mapping, FILE_MAP_READ, 0, 0, 0);
+	if(!f->data) {
+		CloseHandle(f->mapping);
+		CloseHandle(f->file);
+		return 0;
+	}
+	f->size = (isize)size.QuadPart;
+#else
+	int fd = open(fileName, O_RDONLY);
+	if(fd < 0) return 0;
+
+	struct stat st;
+	if(fstat(fd, &st) != 0 || st.st_size == 0) {
+		close(fd);
+		return 0;
+	}
+
+	void* data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if(data == MAP_FAILED) return 0;
+	f->data = (const u8*)data;
+	f->size = (isize)st.st_size;
+#endif
+	return 1;
+}
+
+static 
+void wfbx__unmapFile(wfbx__MappedFile* f)
 {
-	FbxManager* sdkManager = FbxManager::Create();
-	FbxIOSettings* ios = FbxIOSettings::Create(sdkManager, IOSROOT);
-	FbxImporter* importer = FbxImporter::Create(sdkManager, "");
-	if(!importer->Initialize(fileName, -1, sdkManager->GetIOSettings())) {
-		return NULL;
+	if(!f->data) return;
+#ifdef _WIN32
+	UnmapViewOfFile(f->data);
+	CloseHandle(f->mapping);
+	CloseHandle(f->file);
+#else
+	munmap((void*)f->data, f->size);
+#endif
+	f->data = NULL;
+}
+
+// Binary FBX layout
+//
+// After a 27 byte header, the file is a tree of node records:
+// 		u32/u64 endOffset, propertyCount, propertyListLength
+// 		u8 nameLength, char name[nameLength]
+// 		properties[propertyCount]
+// 		child records, ended by an all-zero record
+// The offsets became 64-bit in version 7500.
+//
+// Properties are a type code followed by the value:
+// 		Y C I F D L - i16, bool, i32, f32, f64, i64
+// 		S R - u32 length, bytes
+// 		f d l i b - u32 count, u32 encoding, u32 byteLength, data
+// Arrays with encoding 1 are zlib streams.
+typedef struct 
+{
+	const u8* data;
+	const u8* end;
+	u32 version;
+} wfbx__Document;
+
+typedef struct 
+{
+	const char* name;
+	isize nameLength;
+	const u8* props;
+	isize propCount;
+	// children run from here up to end
+	const u8* children;
+	const u8* end;
+} wfbx__Node;
+
+typedef struct 
+{
+	char type;
+	i64 i;
+	f64 f;
+	// strings, raw data and array payloads
+	const u8* data;
+	isize size;
+	// arrays only
+	isize count;
+	u32 encoding;
+} wfbx__Prop;
+
+static inline
+u32 wfbx__readU32(const u8* p)
+{
+	u32 v;
+	memcpy(&v, p, 4);
+	return v;
+}
+
+static inline
+u64 wfbx__readU64(const u8* p)
+{
+	u64 v;
+	memcpy(&v, p, 8);
+	return v;
+}
+
+static 
+int wfbx__openDocument(wfbx__Document* doc, const u8* data, isize size)
+{
+	static const char magic[] = "Kaydara FBX Binary  ";
+	if(size < 27 || memcmp(data, magic, sizeof(magic)) != 0) return 0;
+	doc->data = data;
+	doc->end = data + size;
+	doc->version = wfbx__readU32(data + 23);
+	return doc->version >= 7000 && doc->version < 8000;
+}
+
+// Returns 0 at the null record that ends a child list,
+// or if the record doesn't fit in the file
+static 
+int wfbx__readNode(wfbx__Document* doc, const u8* at, wfbx__Node* node)
+{
+	int wide = doc->version >= 7500;
+	isize headerSize = wide ? 25 : 13;
+	if(doc->end - at < headerSize) return 0;
+
+	u64 endOffset, propCount, propLength;
+	if(wide) {
+		endOffset = wfbx__readU64(at);
+		propCount = wfbx__readU64(at + 8);
+		propLength = wfbx__readU64(at + 16);
+	} else {
+		endOffset = wfbx__readU32(at);
+		propCount = wfbx__readU32(at + 4);
+		propLength = wfbx__readU32(at + 8);
 	}
-	FbxScene* scene = FbxScene::Create(sdkManager, "defaultScene");
-	importer->Import(scene);
-	importer->Destroy();
+	if(endOffset == 0) return 0;
 
+	// As offsets, so huge values from a bad file can't wrap around
+	u64 atOffset = (u64)(at - doc->data);
+	isize nameLength = at[headerSize - 1];
+	if(endOffset > (u64)(doc->end - doc->data) || endOffset <= atOffset) return 0;
+	if((u64)(headerSize + nameLength) > endOffset - atOffset) return 0;
+	const u8* end = doc->data + endOffset;
+	const u8* props = at + headerSize + nameLength;
+	if(propLength > (u64)(end - props)) return 0;
 
-	FbxNode* root = scene->GetRootNode();
-	if(!root) { return NULL; }
+	node->name = (const char*)(at + headerSize);
+	node->nameLength = nameLength;
+	node->props = props;
+	node->propCount = (isize)propCount;
+	node->children = props + propLength;
+	node->end = end;
+	return 1;
+}
 
-	wfbxModel* model = wfbxNew(wfbxModel);
-	isize meshCount = 0;
-	countMeshesRecursively(root, &meshCount);
-
-	model->meshes = wfbxNewArray(wfbxVertex*, meshCount);
-	model->meshSizes = wfbxNewArray(isize, meshCount);
-	model->indices = wfbxNewArray(u32*, meshCount);
-	model->indexCounts = wfbxNewArray(isize, meshCount);
-	model->transforms = wfbxNewArray(wfbxTransform, meshCount);
-	model->materials = wfbxNewArray(wfbxMaterialTexture, meshCount);
-	model->count = meshCount;
-	isize meshIndex = 0;
+static inline
+int wfbx__nameIs(wfbx__Node* node, const char* name)
+{
+	isize length = (isize)strlen(name);
+	return node->nameLength == length && memcmp(node->name, name, length) == 0;
+}
 
-	buildModelFromMeshesRecursively(root, &meshIndex, model, defaultMaterial);
-	return model;
+static 
+int wfbx__getProp(wfbx__Node* node, isize index, wfbx__Prop* prop)
+{
+	const u8* p = node->props;
+	const u8* end = node->children;
+	if(index >= node->propCount) return 0;
+
+	for(isize i = 0; i <= index; ++i) {
+		if(p >= end) return 0;
+		memset(prop, 0, sizeof(*prop));
+		prop->type = (char)*p++;
+		isize size = 0;
+		switch(prop->type) {
+			case 'C': size = 1; break;
+			case 'Y': size = 2; break;
+			case 'I': case 'F': size = 4; break;
+			case 'L': case 'D': size = 8; break;
+			case 'S':
+			case 'R':
+				if(end - p < 4) return 0;
+				prop->size = wfbx__readU32(p);
+				prop->data = p + 4;
+				size = 4 + prop->size;
+				break;
+			case 'f': case 'd': case 'l': case 'i': case 'b':
+				if(end - p < 12) return 0;
+				prop->count = wfbx__readU32(p);
+				prop->encoding = wfbx__readU32(p + 4);
+				prop->size = wfbx__readU32(p + 8);
+				prop->data = p + 12;
+				size = 12 + prop->size;
+				break;
+			default:
+				return 0;
+		}
+		if(size > end - p) return 0;
+
+		switch(prop->type) {
+			case 'C': prop->i = *p; break;
+			case 'Y': { short v; memcpy(&v, p, 2); prop->i = v; } break;
+			case 'I': prop->i = (i32)wfbx__readU32(p); break;
+			case 'L': prop->i = (i64)wfbx__readU64(p); break;
+			case 'F': { f32 v; memcpy(&v, p, 4); prop->f = v; } break;
+			case 'D': memcpy(&prop->f, p, 8); break;
+		}
+		p += size;
+	}
+	return 1;
 }
 
 static 
-void buildModelFromMeshesRecursively(
-		FbxNode* node, 
-		isize* meshIndex, 
-		wfbxModel* model,
-		wfbxMaterialTexture* defaultMaterial)
+int wfbx__findChild(wfbx__Document* doc, wfbx__Node* parent, const char* name, wfbx__Node* child)
+{
+	const u8* at = parent->children;
+	while(at < parent->end && wfbx__readNode(doc, at, child)) {
+		if(wfbx__nameIs(child, name)) return 1;
+		at = child->end;
+	}
+	return 0;
+}
+
+static 
+int wfbx__findTopLevel(wfbx__Document* doc, const char* name, wfbx__Node* node)
+{
+	const u8* at = doc->data + 27;
+	while(wfbx__readNode(doc, at, node)) {
+		if(wfbx__nameIs(node, name)) return 1;
+		at = node->end;
+	}
+	return 0;
+}
+
+static inline
+int wfbx__propStringIs(wfbx__Prop* prop, const char* s)
+{
+	isize length = (isize)strlen(s);
+	return prop->type == 'S' && prop->size == length &&
+		memcmp(prop->data, s, length) == 0;
+}
+
+// Copies or inflates an array property into dst,
+// which must hold exactly count elements of the property's type
+static 
+int wfbx__readArray(wfbx__Prop* prop, void* dst)
+{
+	isize elementSize = 0;
+	switch(prop->type) {
+		case 'b': elementSize = 1; break;
+		case 'i': case 'f': elementSize = 4; break;
+		case 'l': case 'd': elementSize = 8; break;
+		default: return 0;
+	}
+	isize size = prop->count * elementSize;
+	if(prop->encoding == 0) {
+		if(prop->size != size) return 0;
+		memcpy(dst, prop->data, size);
+		return 1;
+	} else if(prop->encoding == 1) {
+		return wbInflateZlib(dst, size, prop->data, prop->size) == size;
+	}
+	return 0;
+}
+
+// Scene graph
+//
+// Objects only hold the data; the hierarchy comes from the
+// Connections section, as (child, parent) id pairs. Id 0 is
+// the root node.
+typedef struct 
+{
+	i64 id;
+	f64 translation[3];
+	f64 rotation[3];
+	f64 scale[3];
+
+	// Maya's pivots; see wfbx__localMatrix for how they stack up
+	f64 rotationOffset[3];
+	f64 rotationPivot[3];
+	f64 scalingOffset[3];
+	f64 scalingPivot[3];
+	f64 preRotation[3];
+	f64 postRotation[3];
+	i32 rotationOrder;
+	// Without this, pre/post rotation and the rotation order are ignored
+	i32 rotationActive;
+
+	// Only moves this node's geometry, children don't inherit it
+	f64 geometricTranslation[3];
+	f64 geometricRotation[3];
+	f64 geometricScaling[3];
+} wfbx__Model;
+
+typedef struct 
+{
+	i64 id;
+	wfbx__Node node;
+} wfbx__Geometry;
+
+typedef struct 
+{
+	i64 child, parent;
+	// Where it was in the file, so sorting keeps that order
+	isize order;
+	// What child turned out to be, if it's either
+	wfbx__Model* model;
+	wfbx__Geometry* geometry;
+} wfbx__Connection;
+
+typedef struct 
+{
+	i64 id;
+	isize index;
+} wfbx__IdIndex;
+
+typedef struct 
 {
-	FbxDouble3 nodeTrans = node->LclTranslation.Get();
-	FbxDouble3 nodeRot = node->LclRotation.Get();
-	FbxDouble3 nodeScale = node->LclScaling.Get();
+	wfbx__Document doc;
 
-	isize attribCount = node->GetNodeAttributeCount();
-	for(isize i = 0; i < attribCount; ++i) {
-		FbxNodeAttribute* attrib = node->GetNodeAttributeByIndex(i);
-		if(attrib->GetAttributeType() == FbxNodeAttribute::eMesh) {
-			FbxMesh* mesh = (FbxMesh*)attrib;
-			isize count = mesh->GetControlPointsCount();
+	wfbx__Model* models;
+	isize modelCount;
 
-			wfbxVertex* modelMesh = wfbxNewArray(wfbxVertex, count);
-			model->meshes[*meshIndex] = modelMesh;
-			model->meshSizes[*meshIndex] = count;
+	wfbx__Geometry* geometries;
+	isize geometryCount;
+
+	// Sorted by parent, so a node's children sit together
+	wfbx__Connection* connections;
+	isize connectionCount;
+
+	// Sorted by id, for binary searches
+	wfbx__IdIndex* modelIds;
+	wfbx__IdIndex* geometryIds;
+} wfbx__Scene;
+
+static 
+void wfbx__readModelProperties(wfbx__Document* doc, wfbx__Node* node, wfbx__Model* model)
+{
+	i64 id = model->id;
+	memset(model, 0, sizeof(*model));
+	model->id = id;
+	for(isize i = 0; i < 3; ++i) {
+		model->scale[i] = 1;
+		model->geometricScaling[i] = 1;
+	}
 
-			FbxStatus status;
-			FbxDouble4* verts = mesh->GetControlPoints(&status);
-			int* indices = mesh->GetPolygonVertices();
+	wfbx__Node props70, p;
+	if(!wfbx__findChild(doc, node, "Properties70", &props70)) return;
 
-			isize indexCount = mesh->GetPolygonVertexCount();
-			u32* modelIndices = wfbxNewArray(u32, indexCount);
-			model->indices[*meshIndex] = modelIndices;
-			model->indexCounts[*meshIndex] = indexCount;
+	const u8* at = props70.children;
+	while(at < props70.end && wfbx__readNode(doc, at, &p)) {
+		at = p.end;
+		wfbx__Prop name;
+		if(!wfbx__nameIs(&p, "P") || !wfbx__getProp(&p, 0, &name)) continue;
 
-			for(isize i = 0; i < indexCount; ++i) {
-				modelIndices[i] = (u32)indices[i];
+		i32* flag = NULL;
+		if(wfbx__propStringIs(&name, "RotationOrder")) {
+			flag = &model->rotationOrder;
+		} else if(wfbx__propStringIs(&name, "RotationActive")) {
+			flag = &model->rotationActive;
+		}
+		if(flag) {
+			wfbx__Prop v;
+			if(wfbx__getProp(&p, 4, &v) && (v.type == 'I' || v.type == 'C' || v.type == 'L')) {
+				*flag = (i32)v.i;
 			}
+			continue;
+		}
 
-			double* scale = nodeScale.Buffer();
-			double* trans = nodeTrans.Buffer();
-			double* rot = nodeRot.Buffer();
+		f64* dst = NULL;
+		if(wfbx__propStringIs(&name, "Lcl Translation")) {
+			dst = model->translation;
+		} else if(wfbx__propStringIs(&name, "Lcl Rotation")) {
+			dst = model->rotation;
+		} else if(wfbx__propStringIs(&name, "Lcl Scaling")) {
+			dst = model->scale;
+		} else if(wfbx__propStringIs(&name, "RotationOffset")) {
+			dst = model->rotationOffset;
+		} else if(wfbx__propStringIs(&name, "RotationPivot")) {
+			dst = model->rotationPivot;
+		} else if(wfbx__propStringIs(&name, "ScalingOffset")) {
+			dst = model->scalingOffset;
+		} else if(wfbx__propStringIs(&name, "ScalingPivot")) {
+			dst = model->scalingPivot;
+		} else if(wfbx__propStringIs(&name, "PreRotation")) {
+			dst = model->preRotation;
+		} else if(wfbx__propStringIs(&name, "PostRotation")) {
+			dst = model->postRotation;
+		} else if(wfbx__propStringIs(&name, "GeometricTranslation")) {
+			dst = model->geometricTranslation;
+		} else if(wfbx__propStringIs(&name, "GeometricRotation")) {
+			dst = model->geometricRotation;
+		} else if(wfbx__propStringIs(&name, "GeometricScaling")) {
+			dst = model->geometricScaling;
+		}
+		if(!dst) continue;
 
-			for(isize i = 0; i < 3; ++i) {
-				model->transforms[*meshIndex].translation[i] = (f32)trans[i];
-				model->transforms[*meshIndex].scale[i] = (f32)scale[i];
-				model->transforms[*meshIndex].rotation[i] = (f32)rot[i];
+		for(isize i = 0; i < 3; ++i) {
+			wfbx__Prop v;
+			if(wfbx__getProp(&p, 4 + i, &v) && v.type == 'D') {
+				dst[i] = v.f;
 			}
+		}
+	}
+}
+
+// By id, then file order, so the first of any duplicates wins
+static 
+int wfbx__compareIds(const void* a, const void* b)
+{
+	const wfbx__IdIndex* ia = (const wfbx__IdIndex*)a;
+	const wfbx__IdIndex* ib = (const wfbx__IdIndex*)b;
+	if(ia->id != ib->id) return (ia->id > ib->id) - (ia->id < ib->id);
+	return (ia->index > ib->index) - (ia->index < ib->index);
+}
+
+static 
+int wfbx__compareConnections(const void* a, const void* b)
+{
+	const wfbx__Connection* ca = (const wfbx__Connection*)a;
+	const wfbx__Connection* cb = (const wfbx__Connection*)b;
+	if(ca->parent != cb->parent) return (ca->parent > cb->parent) - (ca->parent < cb->parent);
+	return (ca->order > cb->order) - (ca->order < cb->order);
+}
 
-			__m128 vscale = _mm_setr_ps(scale[0], scale[1], scale[2], 1);
-			__m128 vtrans = _mm_setr_ps(trans[0], trans[1], trans[2], 0);
-			//TODO(will): add rotation support
-			//__mm128 vrot= _mm_setr_ps(rot[0],   rot[1],   rot[2],   0);
-
-			//TODO(will): Support for multiple layers
-			FbxLayer* l = mesh->GetLayer(0);
-			FbxLayerElementUV* uvs = l->GetUVs();
-
-			FbxLayerElementNormal* normals = l->GetNormals();
-			auto normalArray = normals->GetDirectArray();
-			for(isize i = 0; i < count; ++i) {
-				double* vb = verts[i].Buffer();
-				__m128 v = _mm_setr_ps(vb[0], vb[1], vb[2], vb[3]);
-				v = _mm_mul_ps(v, vscale);
-				v = _mm_add_ps(v, vtrans);
-				*(__m128*)&modelMesh[i].pos = v;
-
-				vb = normalArray[i].Buffer();
-				v = _mm_setr_ps(vb[0], vb[1], vb[2], vb[3]);
-				*(__m128*)&modelMesh[i].normal = v;
+// The index of the first entry with id, or -1
+static 
+isize wfbx__searchIds(const wfbx__IdIndex* ids, isize count, i64 id)
+{
+	isize first = 0, last = count;
+	while(first < last) {
+		isize middle = first + (last - first) / 2;
+		if(ids[middle].id < id) {
+			first = middle + 1;
+		} else {
+			last = middle;
+		}
+	}
+	return first < count && ids[first].id == id ? ids[first].index : -1;
+}
+
+static 
+wfbx__Model* wfbx__findModel(wfbx__Scene* scene, i64 id)
+{
+	isize i = wfbx__searchIds(scene->modelIds, scene->modelCount, id);
+	return i < 0 ? NULL : scene->models + i;
+}
+
+static 
+wfbx__Geometry* wfbx__findGeometry(wfbx__Scene* scene, i64 id)
+{
+	isize i = wfbx__searchIds(scene->geometryIds, scene->geometryCount, id);
+	return i < 0 ? NULL : scene->geometries + i;
+}
+
+// The connections with parent as their parent, in file order
+static 
+wfbx__Connection* wfbx__findChildren(wfbx__Scene* scene, i64 parent, isize* count)
+{
+	isize first = 0, last = scene->connectionCount;
+	while(first < last) {
+		isize middle = first + (last - first) / 2;
+		if(scene->connections[middle].parent < parent) {
+			first = middle + 1;
+		} else {
+			last = middle;
+		}
+	}
+	isize end = first;
+	while(end < scene->connectionCount && scene->connections[end].parent == parent) ++end;
+	*count = end - first;
+	return scene->connections + first;
+}
+
+static 
+int wfbx__readScene(wfbx__Scene* scene)
+{
+	wfbx__Document* doc = &scene->doc;
+	wfbx__Node objects, connections, node;
+	wfbx__Prop id, type;
+
+	if(!wfbx__findTopLevel(doc, "Objects", &objects)) return 0;
+
+	// Count first so we only allocate once
+	const u8* at = objects.children;
+	while(at < objects.end && wfbx__readNode(doc, at, &node)) {
+		at = node.end;
+		if(wfbx__nameIs(&node, "Model")) scene->modelCount++;
+		if(wfbx__nameIs(&node, "Geometry")) scene->geometryCount++;
+	}
+
+	scene->models = wfbxNewArray(wfbx__Model, scene->modelCount + 1);
+	scene->geometries = wfbxNewArray(wfbx__Geometry, scene->geometryCount + 1);
+	scene->modelIds = wfbxNewArray(wfbx__IdIndex, scene->modelCount + 1);
+	scene->geometryIds = wfbxNewArray(wfbx__IdIndex, scene->geometryCount + 1);
+	if(!scene->models || !scene->geometries || !scene->modelIds || !scene->geometryIds) return 0;
+	isize modelCount = 0, geometryCount = 0;
+
+	at = objects.children;
+	while(at < objects.end && wfbx__readNode(doc, at, &node)) {
+		at = node.end;
+		if(!wfbx__getProp(&node, 0, &id) || id.type != 'L') continue;
+
+		if(wfbx__nameIs(&node, "Model")) {
+			wfbx__Model* model = scene->models + modelCount++;
+			model->id = id.i;
+			wfbx__readModelProperties(doc, &node, model);
+		} else if(wfbx__nameIs(&node, "Geometry")) {
+			if(!wfbx__getProp(&node, 2, &type) || !wfbx__propStringIs(&type, "Mesh")) {
+				continue;
 			}
+			wfbx__Geometry* geometry = scene->geometries + geometryCount++;
+			geometry->id = id.i;
+			geometry->node = node;
+		}
+	}
+	scene->modelCount = modelCount;
+	scene->geometryCount = geometryCount;
+
+	// Looking ids up is most of walking the hierarchy, so it shouldn't
+	// mean a linear search each time
+	for(isize i = 0; i < modelCount; ++i) {
+		scene->modelIds[i].id = scene->models[i].id;
+		scene->modelIds[i].index = i;
+	}
+	for(isize i = 0; i < geometryCount; ++i) {
+		scene->geometryIds[i].id = scene->geometries[i].id;
+		scene->geometryIds[i].index = i;
+	}
+	qsort(scene->modelIds, modelCount, sizeof(wfbx__IdIndex), wfbx__compareIds);
+	qsort(scene->geometryIds, geometryCount, sizeof(wfbx__IdIndex), wfbx__compareIds);
+
+	if(!wfbx__findTopLevel(doc, "Connections", &connections)) return 1;
+
+	isize connectionCount = 0;
+	at = connections.children;
+	while(at < connections.end && wfbx__readNode(doc, at, &node)) {
+		at = node.end;
+		connectionCount++;
+	}
+
+	scene->connections = wfbxNewArray(wfbx__Connection, connectionCount + 1);
+	if(!scene->connections) return 0;
+	at = connections.children;
+	while(at < connections.end && wfbx__readNode(doc, at, &node)) {
+		at = node.end;
+		wfbx__Prop kind, child, parent;
+		// We only care about object-object links
+		if(!wfbx__getProp(&node, 0, &kind) || !wfbx__propStringIs(&kind, "OO")) continue;
+		if(!wfbx__getProp(&node, 1, &child) || !wfbx__getProp(&node, 2, &parent)) continue;
+		wfbx__Connection* c = scene->connections + scene->connectionCount++;
+		c->child = child.i;
+		c->parent = parent.i;
+		c->order = scene->connectionCount - 1;
+		c->model = wfbx__findModel(scene, c->child);
+		c->geometry = wfbx__findGeometry(scene, c->child);
+	}
+	qsort(scene->connections, scene->connectionCount, sizeof(wfbx__Connection), 
+			wfbx__compareConnections);
+	return 1;
+}
+
+static 
+void wfbx__freeScene(wfbx__Scene* scene)
+{
+	wfbxFree(scene->models);
+	wfbxFree(scene->geometries);
+	wfbxFree(scene->connections);
+	wfbxFree(scene->modelIds);
+	wfbxFree(scene->geometryIds);
+}
+
+// Node transforms
+//
+// Column-major 4x4s, in doubles until the very end. A node's local
+// transform is the FBX SDK's
+// 		T * Roff * Rp * Rpre * R * Rpost^-1 * Rp^-1 * Soff * Sp * S * Sp^-1
+// and its world transform is its parent's world times that. Parents
+// are composed as whole matrices, which is right for every inherit
+// type unless a non-uniformly scaled parent has rotated children.
+typedef struct 
+{
+	f64 m[16];
+} wfbx__Matrix;
 
-			auto uvArray = uvs->GetDirectArray();
-			auto uvIndices = uvs->GetIndexArray();
+static 
+void wfbx__identity(wfbx__Matrix* out)
+{
+	memset(out, 0, sizeof(*out));
+	out->m[0] = out->m[5] = out->m[10] = out->m[15] = 1;
+}
 
-			for(isize i = 0; i < indexCount; ++i) {
-				isize index = modelIndices[i];
-				modelMesh[index].uv[0] = uvArray[uvIndices[i]].Buffer()[0];
-				modelMesh[index].uv[1] = uvArray[uvIndices[i]].Buffer()[1];
+// out = a * b; out can be a or b
+static 
+void wfbx__multiply(const wfbx__Matrix* a, const wfbx__Matrix* b, wfbx__Matrix* out)
+{
+	wfbx__Matrix r;
+	for(isize col = 0; col < 4; ++col) {
+		for(isize row = 0; row < 4; ++row) {
+			f64 sum = 0;
+			for(isize k = 0; k < 4; ++k) {
+				sum += a->m[k * 4 + row] * b->m[col * 4 + k];
 			}
-			model->materials[*meshIndex] = *defaultMaterial;
-			*meshIndex = *meshIndex + 1;
+			r.m[col * 4 + row] = sum;
 		}
 	}
-	isize childCount = node->GetChildCount();
-	for(isize i = 0; i < childCount; ++i) {
-		buildModelFromMeshesRecursively(
-				node->GetChild(i),
-				meshIndex,
-				model,
-				defaultMaterial);
+	*out = r;
+}
+
+static 
+void wfbx__translate(wfbx__Matrix* m, const f64* t, f64 sign)
+{
+	wfbx__Matrix factor;
+	wfbx__identity(&factor);
+	for(isize i = 0; i < 3; ++i) {
+		factor.m[12 + i] = t[i] * sign;
+	}
+	wfbx__multiply(m, &factor, m);
+}
+
+static 
+void wfbx__scale(wfbx__Matrix* m, const f64* s)
+{
+	wfbx__Matrix factor;
+	wfbx__identity(&factor);
+	for(isize i = 0; i < 3; ++i) {
+		factor.m[i * 5] = s[i];
 	}
+	wfbx__multiply(m, &factor, m);
 }
 
-static
-void countMeshesRecursively(FbxNode* node, isize* meshCount)
+// Euler angles in degrees. The order names the axes in the order
+// they're applied, so XYZ (0) is Rz * Ry * Rx. Spheric XYZ (6) is
+// only for interpolation and evaluates like XYZ.
+static 
+void wfbx__rotate(wfbx__Matrix* m, const f64* degrees, i32 order, int inverse)
 {
-	isize attribCount = node->GetNodeAttributeCount();
-	for(isize i = 0; i < attribCount; ++i) {
-		FbxNodeAttribute* attrib = node->GetNodeAttributeByIndex(i);
-		if(attrib->GetAttributeType() == FbxNodeAttribute::eMesh) {
-			*meshCount = *meshCount + 1;
+	static const u8 axes[7][3] = {
+		{0, 1, 2}, {0, 2, 1}, {1, 2, 0}, {1, 0, 2}, {2, 0, 1}, {2, 1, 0}, {0, 1, 2}
+	};
+	if(order < 0 || order > 6) order = 0;
+
+	wfbx__Matrix r;
+	wfbx__identity(&r);
+	for(isize i = 0; i < 3; ++i) {
+		isize axis = axes[order][i];
+		f64 angle = degrees[axis] * (3.14159265358979323846 / 180.0);
+		if(angle == 0) continue;
+		f64 c = cos(angle), s = sin(angle);
+		isize u = (axis + 1) % 3, v = (axis + 2) % 3;
+		wfbx__Matrix axisRotation;
+		wfbx__identity(&axisRotation);
+		axisRotation.m[u * 4 + u] = c;
+		axisRotation.m[u * 4 + v] = s;
+		axisRotation.m[v * 4 + u] = -s;
+		axisRotation.m[v * 4 + v] = c;
+		wfbx__multiply(&axisRotation, &r, &r);
+	}
+
+	// A rotation's inverse is its transpose
+	if(inverse) {
+		for(isize row = 0; row < 3; ++row) {
+			for(isize col = row + 1; col < 3; ++col) {
+				f64 t = r.m[col * 4 + row];
+				r.m[col * 4 + row] = r.m[row * 4 + col];
+				r.m[row * 4 + col] = t;
+			}
 		}
 	}
+	wfbx__multiply(m, &r, m);
+}
 
-	isize childCount = node->GetChildCount();
-	for(isize i = 0; i < childCount; ++i) {
-		countMeshesRecursively(node->GetChild(i), meshCount);
+static 
+void wfbx__localMatrix(const wfbx__Model* node, wfbx__Matrix* out)
+{
+	static const f64 zero[3] = {0, 0, 0};
+	const f64* pre = node->rotationActive ? node->preRotation : zero;
+	const f64* post = node->rotationActive ? node->postRotation : zero;
+	i32 order = node->rotationActive ? node->rotationOrder : 0;
+
+	wfbx__identity(out);
+	wfbx__translate(out, node->translation, 1);
+	wfbx__translate(out, node->rotationOffset, 1);
+	wfbx__translate(out, node->rotationPivot, 1);
+	wfbx__rotate(out, pre, 0, 0);
+	wfbx__rotate(out, node->rotation, order, 0);
+	wfbx__rotate(out, post, 0, 1);
+	wfbx__translate(out, node->rotationPivot, -1);
+	wfbx__translate(out, node->scalingOffset, 1);
+	wfbx__translate(out, node->scalingPivot, 1);
+	wfbx__scale(out, node->scale);
+	wfbx__translate(out, node->scalingPivot, -1);
+}
+
+static 
+void wfbx__geometricMatrix(const wfbx__Model* node, wfbx__Matrix* m)
+{
+	wfbx__translate(m, node->geometricTranslation, 1);
+	wfbx__rotate(m, node->geometricRotation, 0, 0);
+	wfbx__scale(m, node->geometricScaling);
+}
+
+// Vertex baking
+//
+// Control points and normals come in as packed f64 xyz, and go out
+// as f32 xyzw, through the mesh's matrix. The kernels convert and
+// deinterleave 4 (SSE) or 8 (AVX2) vectors at a time and do the
+// math with one register per component. They all round the same
+// way as the scalar tail, with no FMA, so every path and every
+// machine bakes the same bits.
+#if defined(__GNUC__) || defined(__clang__)
+#define WFBX__AVX2 __attribute__((target("avx2")))
+#else
+#define WFBX__AVX2
+#endif
+
+typedef struct 
+{
+	// Rows of the 3x4 affine part
+	f32 m[12];
+	// Normals: w = 0, and renormalized after the matrix
+	int normals;
+	f32 min[3], max[3];
+} wfbx__Bake;
+
+static 
+int wfbx__hasAvx2(void)
+{
+#if defined(_MSC_VER)
+	int info[4];
+	__cpuid(info, 0);
+	if(info[0] < 7) return 0;
+	__cpuid(info, 1);
+	// The OS has to save the YMM registers too
+	if(!(info[2] & (1 << 27)) || !(info[2] & (1 << 28))) return 0;
+	if((_xgetbv(0) & 6) != 6) return 0;
+	__cpuidex(info, 7, 0);
+	return (info[1] & (1 << 5)) != 0;
+#elif defined(__GNUC__) || defined(__clang__)
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("avx2") != 0;
+#else
+	return 0;
+#endif
+}
+
+// Splits x0 y0 z0 x1 | y1 z1 x2 y2 | z2 x3 y3 z3 into x, y and z
+#define WFBX__DEINTERLEAVE(shuffle, f0, f1, f2, x, y, z) do { \
+	t = shuffle(f1, f2, _MM_SHUFFLE(2, 1, 3, 2)); \
+	u = shuffle(f0, f1, _MM_SHUFFLE(1, 0, 2, 1)); \
+	x = shuffle(f0, t, _MM_SHUFFLE(2, 0, 3, 0)); \
+	y = shuffle(u, t, _MM_SHUFFLE(3, 1, 2, 0)); \
+	z = shuffle(u, f2, _MM_SHUFFLE(3, 0, 3, 1)); \
+} while(0)
+
+static 
+void wfbx__bakeScalar(wfbx__Bake* bake, f32* dst, const f64* src, isize count)
+{
+	const f32* m = bake->m;
+	for(isize i = 0; i < count; ++i) {
+		f32 x = (f32)src[i * 3], y = (f32)src[i * 3 + 1], z = (f32)src[i * 3 + 2];
+		f32 o[3];
+		for(isize j = 0; j < 3; ++j) {
+			o[j] = m[j * 4] * x + m[j * 4 + 1] * y + m[j * 4 + 2] * z + m[j * 4 + 3];
+		}
+		if(bake->normals) {
+			f32 length = o[0] * o[0] + o[1] * o[1] + o[2] * o[2];
+			if(length > 0) {
+				length = sqrtf(length);
+				for(isize j = 0; j < 3; ++j) o[j] = o[j] / length;
+			}
+		}
+		for(isize j = 0; j < 3; ++j) {
+			if(o[j] < bake->min[j]) bake->min[j] = o[j];
+			if(o[j] > bake->max[j]) bake->max[j] = o[j];
+			dst[i * 4 + j] = o[j];
+		}
+		dst[i * 4 + 3] = bake->normals ? 0.0f : 1.0f;
+	}
+}
+
+// Returns how many vectors it did, a multiple of 4
+static 
+isize wfbx__bakeSse(wfbx__Bake* bake, f32* dst, const f64* src, isize count)
+{
+	__m128 m[12];
+	for(isize j = 0; j < 12; ++j) m[j] = _mm_set1_ps(bake->m[j]);
+	__m128 lo[3], hi[3];
+	for(isize j = 0; j < 3; ++j) {
+		lo[j] = _mm_set1_ps(bake->min[j]);
+		hi[j] = _mm_set1_ps(bake->max[j]);
+	}
+	__m128 zero = _mm_setzero_ps();
+	__m128 w = _mm_set1_ps(bake->normals ? 0.0f : 1.0f);
+
+	isize done = count & ~(isize)3;
+	for(isize i = 0; i < done; i += 4) {
+		const f64* p = src + i * 3;
+		__m128 f0 = _mm_movelh_ps(_mm_cvtpd_ps(_mm_loadu_pd(p)), _mm_cvtpd_ps(_mm_loadu_pd(p + 2)));
+		__m128 f1 = _mm_movelh_ps(_mm_cvtpd_ps(_mm_loadu_pd(p + 4)), _mm_cvtpd_ps(_mm_loadu_pd(p + 6)));
+		__m128 f2 = _mm_movelh_ps(_mm_cvtpd_ps(_mm_loadu_pd(p + 8)), _mm_cvtpd_ps(_mm_loadu_pd(p + 10)));
+		__m128 t, u, x, y, z;
+		WFBX__DEINTERLEAVE(_mm_shuffle_ps, f0, f1, f2, x, y, z);
+
+		__m128 o[3];
+		for(isize j = 0; j < 3; ++j) {
+			__m128 v = _mm_mul_ps(m[j * 4], x);
+			v = _mm_add_ps(v, _mm_mul_ps(m[j * 4 + 1], y));
+			v = _mm_add_ps(v, _mm_mul_ps(m[j * 4 + 2], z));
+			o[j] = _mm_add_ps(v, m[j * 4 + 3]);
+		}
+		if(bake->normals) {
+			__m128 length = _mm_mul_ps(o[0], o[0]);
+			length = _mm_add_ps(length, _mm_mul_ps(o[1], o[1]));
+			length = _mm_add_ps(length, _mm_mul_ps(o[2], o[2]));
+			__m128 valid = _mm_cmpgt_ps(length, zero);
+			length = _mm_sqrt_ps(length);
+			for(isize j = 0; j < 3; ++j) {
+				__m128 n = _mm_div_ps(o[j], length);
+				o[j] = _mm_or_ps(_mm_and_ps(valid, n), _mm_andnot_ps(valid, o[j]));
+			}
+		}
+		for(isize j = 0; j < 3; ++j) {
+			lo[j] = _mm_min_ps(lo[j], o[j]);
+			hi[j] = _mm_max_ps(hi[j], o[j]);
+		}
+
+		__m128 r0 = o[0], r1 = o[1], r2 = o[2], r3 = w;
+		_MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+		f32* out = dst + i * 4;
+		_mm_storeu_ps(out, r0);
+		_mm_storeu_ps(out + 4, r1);
+		_mm_storeu_ps(out + 8, r2);
+		_mm_storeu_ps(out + 12, r3);
+	}
+
+	for(isize j = 0; j < 3; ++j) {
+		f32 l[4], h[4];
+		_mm_storeu_ps(l, lo[j]);
+		_mm_storeu_ps(h, hi[j]);
+		for(isize k = 0; k < 4; ++k) {
+			if(l[k] < bake->min[j]) bake->min[j] = l[k];
+			if(h[k] > bake->max[j]) bake->max[j] = h[k];
+		}
+	}
+	return done;
+}
+
+// Same as wfbx__bakeSse, 8 at a time. Points 0-3 go in the
+// low 128-bit lane and 4-7 in the high one, since the shuffles
+// and unpacks all work within lanes anyway.
+static WFBX__AVX2
+isize wfbx__bakeAvx2(wfbx__Bake* bake, f32* dst, const f64* src, isize count)
+{
+	__m256 m[12];
+	for(isize j = 0; j < 12; ++j) m[j] = _mm256_set1_ps(bake->m[j]);
+	__m256 lo[3], hi[3];
+	for(isize j = 0; j < 3; ++j) {
+		lo[j] = _mm256_set1_ps(bake->min[j]);
+		hi[j] = _mm256_set1_ps(bake->max[j]);
+	}
+	__m256 zero = _mm256_setzero_ps();
+	__m256 w = _mm256_set1_ps(bake->normals ? 0.0f : 1.0f);
+
+	isize done = count & ~(isize)7;
+	for(isize i = 0; i < done; i += 8) {
+		const f64* p = src + i * 3;
+		__m128 g[6];
+		for(isize j = 0; j < 6; ++j) {
+			g[j] = _mm256_cvtpd_ps(_mm256_loadu_pd(p + j * 4));
+		}
+		__m256 f0 = _mm256_set_m128(g[3], g[0]);
+		__m256 f1 = _mm256_set_m128(g[4], g[1]);
+		__m256 f2 = _mm256_set_m128(g[5], g[2]);
+		__m256 t, u, x, y, z;
+		WFBX__DEINTERLEAVE(_mm256_shuffle_ps, f0, f1, f2, x, y, z);
+
+		__m256 o[3];
+		for(isize j = 0; j < 3; ++j) {
+			__m256 v = _mm256_mul_ps(m[j * 4], x);
+			v = _mm256_add_ps(v, _mm256_mul_ps(m[j * 4 + 1], y));
+			v = _mm256_add_ps(v, _mm256_mul_ps(m[j * 4 + 2], z));
+			o[j] = _mm256_add_ps(v, m[j * 4 + 3]);
+		}
+		if(bake->normals) {
+			__m256 length = _mm256_mul_ps(o[0], o[0]);
+			length = _mm256_add_ps(length, _mm256_mul_ps(o[1], o[1]));
+			length = _mm256_add_ps(length, _mm256_mul_ps(o[2], o[2]));
+			__m256 valid = _mm256_cmp_ps(length, zero, _CMP_GT_OQ);
+			length = _mm256_sqrt_ps(length);
+			for(isize j = 0; j < 3; ++j) {
+				o[j] = _mm256_blendv_ps(o[j], _mm256_div_ps(o[j], length), valid);
+			}
+		}
+		for(isize j = 0; j < 3; ++j) {
+			lo[j] = _mm256_min_ps(lo[j], o[j]);
+			hi[j] = _mm256_max_ps(hi[j], o[j]);
+		}
+
+		__m256 t0 = _mm256_unpacklo_ps(o[0], o[1]);
+		__m256 t1 = _mm256_unpackhi_ps(o[0], o[1]);
+		__m256 t2 = _mm256_unpacklo_ps(o[2], w);
+		__m256 t3 = _mm256_unpackhi_ps(o[2], w);
+		__m256 r0 = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(1, 0, 1, 0));
+		__m256 r1 = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(3, 2, 3, 2));
+		__m256 r2 = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(1, 0, 1, 0));
+		__m256 r3 = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(3, 2, 3, 2));
+		f32* out = dst + i * 4;
+		_mm256_storeu_ps(out, _mm256_permute2f128_ps(r0, r1, 0x20));
+		_mm256_storeu_ps(out + 8, _mm256_permute2f128_ps(r2, r3, 0x20));
+		_mm256_storeu_ps(out + 16, _mm256_permute2f128_ps(r0, r1, 0x31));
+		_mm256_storeu_ps(out + 24, _mm256_permute2f128_ps(r2, r3, 0x31));
+	}
+
+	for(isize j = 0; j < 3; ++j) {
+		f32 l[8], h[8];
+		_mm256_storeu_ps(l, lo[j]);
+		_mm256_storeu_ps(h, hi[j]);
+		for(isize k = 0; k < 8; ++k) {
+			if(l[k] < bake->min[j]) bake->min[j] = l[k];
+			if(h[k] > bake->max[j]) bake->max[j] = h[k];
+		}
+	}
+	return done;
+}
+
+// Bakes count vectors from src into dst (4 floats each), growing
+// bake->min and max to fit them
+static 
+void wfbx__bake(wfbx__Bake* bake, f32* dst, const f64* src, isize count, int avx2)
+{
+	isize done = 0;
+	if(avx2) done = wfbx__bakeAvx2(bake, dst, src, count);
+	done += wfbx__bakeSse(bake, dst + done * 4, src + done * 3, count - done);
+	wfbx__bakeScalar(bake, dst + done * 4, src + done * 3, count - done);
+}
+
+// Bounding spheres
+//
+// Once the positions are baked, a mesh's sphere is centered on its
+// bounds and reaches out to the farthest of them. The kernels take
+// the baked xyzw points as they are: w is 1 for the points and the
+// center both, so it drops out. SSE transposes 4 points and AVX2
+// does two rounds of horizontal adds, and both sum the squares the
+// same way the scalar tail does, (x + y) + (z + w), so every path
+// finds the same radius.
+static 
+f32 wfbx__radiusScalar(const f32* points, isize count, const f32* center, f32 radius)
+{
+	for(isize i = 0; i < count; ++i) {
+		const f32* p = points + i * 4;
+		f32 x = p[0] - center[0], y = p[1] - center[1];
+		f32 z = p[2] - center[2], w = p[3] - center[3];
+		f32 d = (x * x + y * y) + (z * z + w * w);
+		if(d > radius) radius = d;
+	}
+	return radius;
+}
+
+// Returns how many points it did, a multiple of 4
+static 
+isize wfbx__radiusSse(const f32* points, isize count, const f32* center, f32* radius)
+{
+	__m128 c = _mm_loadu_ps(center);
+	__m128 r = _mm_set1_ps(*radius);
+	isize done = count & ~(isize)3;
+	for(isize i = 0; i < done; i += 4) {
+		const f32* p = points + i * 4;
+		__m128 x = _mm_sub_ps(_mm_loadu_ps(p), c);
+		__m128 y = _mm_sub_ps(_mm_loadu_ps(p + 4), c);
+		__m128 z = _mm_sub_ps(_mm_loadu_ps(p + 8), c);
+		__m128 w = _mm_sub_ps(_mm_loadu_ps(p + 12), c);
+		_MM_TRANSPOSE4_PS(x, y, z, w);
+		__m128 xy = _mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y));
+		__m128 zw = _mm_add_ps(_mm_mul_ps(z, z), _mm_mul_ps(w, w));
+		r = _mm_max_ps(r, _mm_add_ps(xy, zw));
+	}
+
+	f32 lanes[4];
+	_mm_storeu_ps(lanes, r);
+	for(isize k = 0; k < 4; ++k) {
+		if(lanes[k] > *radius) *radius = lanes[k];
+	}
+	return done;
+}
+
+// Same, 8 at a time; each register holds two points, and the
+// in-lane horizontal adds leave points 0 2 4 6 | 1 3 5 7
+static WFBX__AVX2
+isize wfbx__radiusAvx2(const f32* points, isize count, const f32* center, f32* radius)
+{
+	__m256 c = _mm256_broadcast_ps((const __m128*)center);
+	__m256 r = _mm256_set1_ps(*radius);
+	isize done = count & ~(isize)7;
+	for(isize i = 0; i < done; i += 8) {
+		const f32* p = points + i * 4;
+		__m256 d0 = _mm256_sub_ps(_mm256_loadu_ps(p), c);
+		__m256 d1 = _mm256_sub_ps(_mm256_loadu_ps(p + 8), c);
+		__m256 d2 = _mm256_sub_ps(_mm256_loadu_ps(p + 16), c);
+		__m256 d3 = _mm256_sub_ps(_mm256_loadu_ps(p + 24), c);
+		__m256 h0 = _mm256_hadd_ps(_mm256_mul_ps(d0, d0), _mm256_mul_ps(d1, d1));
+		__m256 h1 = _mm256_hadd_ps(_mm256_mul_ps(d2, d2), _mm256_mul_ps(d3, d3));
+		r = _mm256_max_ps(r, _mm256_hadd_ps(h0, h1));
+	}
+
+	f32 lanes[8];
+	_mm256_storeu_ps(lanes, r);
+	for(isize k = 0; k < 8; ++k) {
+		if(lanes[k] > *radius) *radius = lanes[k];
+	}
+	return done;
+}
+
+// Centers sphere on bounds and grows it to the farthest of count
+// baked points (4 floats each, w = 1)
+static 
+void wfbx__boundingSphere(wfbxSphere* sphere, const wfbxBounds* bounds,
+		const f32* points, isize count, int avx2)
+{
+	f32 center[4] = {0, 0, 0, 1};
+	for(isize i = 0; i < 3; ++i) {
+		center[i] = (bounds->min[i] + bounds->max[i]) / 2;
+		sphere->center[i] = center[i];
+	}
+
+	f32 radius = 0;
+	isize done = 0;
+	if(avx2) done = wfbx__radiusAvx2(points, count, center, &radius);
+	done += wfbx__radiusSse(points + done * 4, count - done, center, &radius);
+	radius = wfbx__radiusScalar(points + done * 4, count - done, center, radius);
+	sphere->radius = sqrtf(radius);
+}
+
+// The model's bounds are the union of its meshes'. Its sphere is
+// centered on those, and grown to hold every mesh's sphere; that's
+// looser than going back to the vertices, but needs none of them.
+static 
+void wfbx__modelBounds(wfbxModel* model)
+{
+	wfbxBounds* total = &model->modelBounds;
+	isize used = 0;
+	for(isize i = 0; i < model->count; ++i) {
+		if(!model->meshSizes[i]) continue;
+		wfbxBounds* b = model->bounds + i;
+		for(isize k = 0; k < 3; ++k) {
+			if(!used || b->min[k] < total->min[k]) total->min[k] = b->min[k];
+			if(!used || b->max[k] > total->max[k]) total->max[k] = b->max[k];
+		}
+		used++;
+	}
+	if(!used) memset(total, 0, sizeof(*total));
+
+	wfbxSphere* sphere = &model->modelSphere;
+	sphere->radius = 0;
+	for(isize k = 0; k < 3; ++k) {
+		sphere->center[k] = (total->min[k] + total->max[k]) / 2;
+	}
+	for(isize i = 0; i < model->count; ++i) {
+		if(!model->meshSizes[i]) continue;
+		wfbxSphere* s = model->spheres + i;
+		f32 d = 0;
+		for(isize k = 0; k < 3; ++k) {
+			f32 e = s->center[k] - sphere->center[k];
+			d += e * e;
+		}
+		d = sqrtf(d) + s->radius;
+		if(d > sphere->radius) sphere->radius = d;
+	}
+}
+
+// Sets up position and normal bakes for a matrix. Normals go through
+// the inverse transpose, cofactors over the determinant, so non-uniform
+// scale doesn't skew them. Returns the determinant, which is negative
+// when the matrix mirrors and the winding has to flip.
+static 
+f64 wfbx__setupBakes(const wfbx__Matrix* matrix, wfbx__Bake* positions, wfbx__Bake* normals)
+{
+	memset(positions, 0, sizeof(*positions));
+	memset(normals, 0, sizeof(*normals));
+	normals->normals = 1;
+	for(isize j = 0; j < 3; ++j) {
+		positions->min[j] = normals->min[j] = 1e30f;
+		positions->max[j] = normals->max[j] = -1e30f;
+	}
+
+	const f64* m = matrix->m;
+	f64 a[3][3];
+	for(isize row = 0; row < 3; ++row) {
+		for(isize col = 0; col < 3; ++col) {
+			a[row][col] = m[col * 4 + row];
+			positions->m[row * 4 + col] = (f32)a[row][col];
+		}
+		positions->m[row * 4 + 3] = (f32)m[12 + row];
+	}
+
+	f64 det = a[0][0] * (a[1][1] * a[2][2] - a[1][2] * a[2][1]) -
+		a[0][1] * (a[1][0] * a[2][2] - a[1][2] * a[2][0]) +
+		a[0][2] * (a[1][0] * a[2][1] - a[1][1] * a[2][0]);
+	f64 invDet = det != 0 ? 1 / det : 1;
+	for(isize row = 0; row < 3; ++row) {
+		// Cofactor row i is the cross product of the other two rows
+		const f64* p = a[(row + 1) % 3];
+		const f64* q = a[(row + 2) % 3];
+		normals->m[row * 4 + 0] = (f32)((p[1] * q[2] - p[2] * q[1]) * invDet);
+		normals->m[row * 4 + 1] = (f32)((p[2] * q[0] - p[0] * q[2]) * invDet);
+		normals->m[row * 4 + 2] = (f32)((p[0] * q[1] - p[1] * q[0]) * invDet);
+	}
+	return det;
+}
+
+// Layer elements (normals, UVs)
+//
+// Each one has a mapping (what the array is indexed by) and
+// a reference mode (Direct, or through an IndexToDirect array)
+enum
+{
+	wfbx__MapByControlPoint,
+	wfbx__MapByPolygonVertex,
+	wfbx__MapByPolygon,
+	wfbx__MapAllSame
+};
+
+typedef struct 
+{
+	int mapping;
+	int indexed;
+	isize components;
+	f64* direct;
+	isize directCount;
+	i32* index;
+	isize indexCount;
+} wfbx__Layer;
+
+// Everything we need to build one mesh, once its arrays are decoded
+typedef struct 
+{
+	wfbx__Geometry* geometry;
+	wfbx__Model* node;
+	// World times geometric transform
+	wfbx__Matrix transform;
+
+	f64* verts;
+	isize vertCount;
+	i32* indices;
+	isize indexCount;
+	wfbx__Layer normals, uvs;
+
+	wfbxModel* model;
+	isize meshIndex;
+	wfbxMaterialTexture* material;
+	u32 flags;
+	int avx2;
+	int ok;
+} wfbx__Mesh;
+
+// Array decoding
+//
+// Loading is split in two passes: walking the geometry nodes queues
+// up every array property we need, then they're all inflated at
+// once on the worker pool, each straight into its own slice of
+// one scratch block.
+typedef struct 
+{
+	wfbx__Prop prop;
+	isize offset;
+	// Filled in with the decoded array, or NULL and 0 on failure
+	void** dst;
+	isize* count;
+} wfbx__ArrayJob;
+
+// Vertices, PolygonVertexIndex, Normals, NormalsIndex, UV, UVIndex
+#define WFBX__MAX_MESH_ARRAYS 6
+
+// Async loads count each batch of jobs on its own counter, so
+// polling them says which batch the load is on and how far along.
+typedef struct 
+{
+	wjobCounter decode;
+	wjobCounter build;
+} wfbx__Progress;
+
+typedef struct 
+{
+	wfbx__Scene* scene;
+
+	wfbx__Mesh* meshes;
+	isize meshCount;
+
+	wfbx__ArrayJob* arrays;
+	isize arrayCount;
+
+	u8* scratch;
+	isize scratchSize;
+
+	u32 flags;
+	int avx2;
+} wfbx__Loader;
+
+// Finds the child called name and queues its first property for
+// decoding. dst and count are only valid after the decode jobs finish.
+static 
+int wfbx__queueChildArray(wfbx__Loader* loader, wfbx__Node* parent,
+		const char* name, char type, void** dst, isize* count)
+{
+	wfbx__Node child;
+	wfbx__Prop prop;
+	*dst = NULL;
+	*count = 0;
+	if(!wfbx__findChild(&loader->scene->doc, parent, name, &child)) return 0;
+	if(!wfbx__getProp(&child, 0, &prop) || prop.type != type) return 0;
+
+	wfbx__ArrayJob* job = loader->arrays + loader->arrayCount++;
+	job->prop = prop;
+	job->dst = dst;
+	job->count = count;
+	job->offset = loader->scratchSize;
+
+	isize elementSize = (type == 'd' || type == 'l') ? 8 : 4;
+	// Keep every array 16 byte aligned
+	loader->scratchSize += (prop.count * elementSize + 15) & ~(isize)15;
+	return 1;
+}
+
+static 
+void wfbx__decodeArrayJob(void* data)
+{
+	wfbx__ArrayJob* job = (wfbx__ArrayJob*)data;
+	if(!wfbx__readArray(&job->prop, *job->dst)) {
+		*job->dst = NULL;
+		return;
+	}
+	*job->count = job->prop.count;
+}
+
+// Big arrays first, so the long inflates don't end up at the back of the queue
+static 
+int wfbx__compareArrayJobs(const void* a, const void* b)
+{
+	isize sa = ((const wfbx__ArrayJob*)a)->prop.size;
+	isize sb = ((const wfbx__ArrayJob*)b)->prop.size;
+	return (sa < sb) - (sa > sb);
+}
+
+static 
+void wfbx__queueLayer(wfbx__Loader* loader, wfbx__Node* geometry,
+		const char* elementName, const char* arrayName, const char* indexName,
+		isize components, wfbx__Layer* layer)
+{
+	wfbx__Document* doc = &loader->scene->doc;
+	wfbx__Node element, child;
+	wfbx__Prop prop;
+	memset(layer, 0, sizeof(*layer));
+	layer->components = components;
+
+	//TODO(will): Support for multiple layers
+	if(!wfbx__findChild(doc, geometry, elementName, &element)) return;
+
+	layer->mapping = wfbx__MapByControlPoint;
+	if(wfbx__findChild(doc, &element, "MappingInformationType", &child) &&
+			wfbx__getProp(&child, 0, &prop)) {
+		if(wfbx__propStringIs(&prop, "ByPolygonVertex")) {
+			layer->mapping = wfbx__MapByPolygonVertex;
+		} else if(wfbx__propStringIs(&prop, "ByPolygon")) {
+			layer->mapping = wfbx__MapByPolygon;
+		} else if(wfbx__propStringIs(&prop, "AllSame")) {
+			layer->mapping = wfbx__MapAllSame;
+		}
+	}
+
+	if(wfbx__findChild(doc, &element, "ReferenceInformationType", &child) &&
+			wfbx__getProp(&child, 0, &prop)) {
+		layer->indexed = wfbx__propStringIs(&prop, "IndexToDirect") ||
+			wfbx__propStringIs(&prop, "Index");
+	}
+
+	wfbx__queueChildArray(loader, &element, arrayName, 'd',
+			(void**)&layer->direct, &layer->directCount);
+	if(layer->indexed) {
+		wfbx__queueChildArray(loader, &element, indexName, 'i',
+				(void**)&layer->index, &layer->indexCount);
+	}
+}
+
+// Returns the element of the direct array used by a polygon vertex, or -1
+static inline
+isize wfbx__layerElement(wfbx__Layer* layer,
+		isize controlPoint, isize polygonVertex, isize polygon)
+{
+	isize i = 0;
+	switch(layer->mapping) {
+		case wfbx__MapByControlPoint: i = controlPoint; break;
+		case wfbx__MapByPolygonVertex: i = polygonVertex; break;
+		case wfbx__MapByPolygon: i = polygon; break;
+	}
+	if(layer->indexed) {
+		if(i < 0 || i >= layer->indexCount) return -1;
+		i = layer->index[i];
+	}
+	if(i < 0 || (i + 1) * layer->components > layer->directCount) return -1;
+	return i;
+}
+
+static 
+void gatherMeshesRecursively(
+		wfbx__Loader* loader,
+		i64 nodeId,
+		isize depth,
+		const wfbx__Matrix* parent,
+		wfbxModel* model,
+		wfbxMaterialTexture* defaultMaterial);
+static 
+void countMeshesRecursively(wfbx__Scene* scene, i64 nodeId, isize depth, isize* meshCount);
+static 
+void buildMeshJob(void* data);
+static 
+wfbxModel* wfbx__finishModel(wfbxModel* staging, u32 flags, wfbxArena* arena);
+
+// Nothing sane is this deep; it just keeps a
+// cyclic Connections section from recursing forever
+#define WFBX_MAX_NODE_DEPTH 256
+
+// Model memory
+//
+// A model is two blocks (see wfbxModel), and each is laid out by
+// running the same carving code twice: once over an arena with no
+// memory, just to add up the size, then over the real thing.
+// Pushes past the end leave used past size, so one check at the
+// end covers the lot.
+static 
+void* wfbx__push(wfbxArena* arena, isize size)
+{
+	size_t base = (size_t)arena->base;
+	isize start = (isize)(((base + (size_t)arena->used + 15) & ~(size_t)15) - base);
+	if(arena->used > arena->size || start > arena->size - size) {
+		arena->used = arena->size + 1;
+		return NULL;
+	}
+	arena->used = start + size;
+	return arena->base ? (u8*)arena->base + start : NULL;
+}
+
+// The block holding the model itself, and the storage it
+// carves out for everything that isn't a per-mesh array
+typedef struct 
+{
+	wfbxModel* model;
+	// meshletCount and lodCount descriptors, for all meshes
+	wmeshMeshlet* meshlets;
+	wfbxLod* lods;
+	wfbx__MappedFile* mapping;
+} wfbx__ModelBlock;
+
+static 
+void wfbx__carveModel(wfbxArena* arena, isize meshCount,
+		isize meshletCount, isize lodCount, wfbxModel* model, wfbx__ModelBlock* block)
+{
+	memset(model, 0, sizeof(*model));
+	block->model = (wfbxModel*)wfbx__push(arena, sizeof(wfbxModel));
+	model->meshes = (wfbxVertex**)wfbx__push(arena, sizeof(wfbxVertex*) * meshCount);
+	model->packedMeshes = (wfbxPackedVertex**)wfbx__push(arena, sizeof(wfbxPackedVertex*) * meshCount);
+	model->meshSizes = (isize*)wfbx__push(arena, sizeof(isize) * meshCount);
+	model->indices = (u32**)wfbx__push(arena, sizeof(u32*) * meshCount);
+	model->indexCounts = (isize*)wfbx__push(arena, sizeof(isize) * meshCount);
+	model->meshlets = (wmeshMeshlet**)wfbx__push(arena, sizeof(wmeshMeshlet*) * meshCount);
+	model->meshletCounts = (isize*)wfbx__push(arena, sizeof(isize) * meshCount);
+	model->meshletVertices = (u32**)wfbx__push(arena, sizeof(u32*) * meshCount);
+	model->meshletTriangles = (u8**)wfbx__push(arena, sizeof(u8*) * meshCount);
+	model->lods = (wfbxLod**)wfbx__push(arena, sizeof(wfbxLod*) * meshCount);
+	model->lodCounts = (isize*)wfbx__push(arena, sizeof(isize) * meshCount);
+	model->lodIndices = (u32**)wfbx__push(arena, sizeof(u32*) * meshCount);
+	model->transforms = (wfbxTransform*)wfbx__push(arena, sizeof(wfbxTransform) * meshCount);
+	model->materials = (wfbxMaterialTexture*)wfbx__push(arena, sizeof(wfbxMaterialTexture) * meshCount);
+	model->bounds = (wfbxBounds*)wfbx__push(arena, sizeof(wfbxBounds) * meshCount);
+	model->spheres = (wfbxSphere*)wfbx__push(arena, sizeof(wfbxSphere) * meshCount);
+	model->count = meshCount;
+	block->meshlets = (wmeshMeshlet*)wfbx__push(arena, sizeof(wmeshMeshlet) * meshletCount);
+	block->lods = (wfbxLod*)wfbx__push(arena, sizeof(wfbxLod) * lodCount);
+	block->mapping = (wfbx__MappedFile*)wfbx__push(arena, sizeof(wfbx__MappedFile));
+}
+
+// Carves out a zeroed model in arena, or in one malloc when arena
+// is NULL. Returns 0 if the arena is too small or malloc fails.
+static 
+int wfbx__newModel(wfbxArena* arena, isize meshCount,
+		isize meshletCount, isize lodCount, wfbx__ModelBlock* block)
+{
+	wfbxModel model;
+	wfbxArena heap = {0};
+	if(!arena) {
+		wfbxArena measure = {NULL, PTRDIFF_MAX / 2, 0};
+		wfbx__carveModel(&measure, meshCount, meshletCount, lodCount, &model, block);
+		// The measure lined up from address 0; malloc's block might
+		// not be 16-byte aligned, which can cost up to 15 bytes more
+		heap.size = measure.used + 15;
+		heap.base = wfbxMalloc(heap.size);
+		if(!heap.base) return 0;
+		arena = &heap;
+	}
+
+	isize used = arena->used;
+	wfbx__carveModel(arena, meshCount, meshletCount, lodCount, &model, block);
+	if(arena->used > arena->size) {
+		arena->used = used;
+		if(arena == &heap) wfbxFree(heap.base);
+		return 0;
+	}
+	memset(block->model, 0, (u8*)arena->base + arena->used - (u8*)block->model);
+	*block->model = model;
+	block->model->inArena = arena != &heap;
+	block->model->block = arena == &heap ? heap.base : NULL;
+	return 1;
+}
+
+// Build jobs fill in a staging model, with every array
+// malloced separately; wfbx__finishModel packs it up
+static 
+void wfbx__freeStaging(wfbxModel* model)
+{
+	for(isize i = 0; i < model->count; ++i) {
+		wfbxFree(model->meshes[i]);
+		wfbxFree(model->packedMeshes[i]);
+		wfbxFree(model->indices[i]);
+		wfbxFree(model->meshlets[i]);
+		wfbxFree(model->meshletVertices[i]);
+		wfbxFree(model->meshletTriangles[i]);
+		wfbxFree(model->lods[i]);
+		wfbxFree(model->lodIndices[i]);
+	}
+	wfbxFree(model->block);
+}
+
+void wfbxReleaseGeometry(wfbxModel* model)
+{
+	if(model->cache) {
+		wfbx__unmapFile((wfbx__MappedFile*)model->cache);
+		model->cache = NULL;
+	}
+	if(!model->inArena) wfbxFree(model->geometry);
+	model->geometry = NULL;
+
+	for(isize i = 0; i < model->count; ++i) {
+		model->meshes[i] = NULL;
+		model->packedMeshes[i] = NULL;
+		model->indices[i] = NULL;
+		model->meshletVertices[i] = NULL;
+		model->meshletTriangles[i] = NULL;
+		model->lodIndices[i] = NULL;
+	}
+}
+
+void wfbxFreeModel(wfbxModel* model)
+{
+	if(!model) return;
+	wfbxReleaseGeometry(model);
+	if(!model->inArena) wfbxFree(model->block);
+}
+
+static 
+wfbxModel* wfbx__loadFbx(
+		wfbx__MappedFile* file,
+		wfbxMaterialTexture* defaultMaterial,
+		u32 flags,
+		wfbxArena* arena,
+		wfbx__Progress* progress)
+{
+	wfbx__Scene scene;
+	memset(&scene, 0, sizeof(scene));
+	if(!wfbx__openDocument(&scene.doc, file->data, file->size) ||
+			!wfbx__readScene(&scene)) {
+		wfbx__freeScene(&scene);
+		return NULL;
+	}
+
+	isize meshCount = 0;
+	countMeshesRecursively(&scene, 0, 0, &meshCount);
+	wfbx__ModelBlock staging;
+	if(!wfbx__newModel(NULL, meshCount, 0, 0, &staging)) {
+		wfbx__freeScene(&scene);
+		return NULL;
+	}
+	wfbxModel* model = staging.model;
+
+	wfbx__Loader loader;
+	memset(&loader, 0, sizeof(loader));
+	loader.scene = &scene;
+	loader.flags = flags;
+	loader.avx2 = wfbx__hasAvx2();
+	loader.meshes = wfbxNewArray(wfbx__Mesh, meshCount + 1);
+	loader.arrays = wfbxNewArray(wfbx__ArrayJob, meshCount * WFBX__MAX_MESH_ARRAYS + 1);
+	if(!loader.meshes || !loader.arrays) {
+		wfbxFree(loader.arrays);
+		wfbxFree(loader.meshes);
+		wfbx__freeScene(&scene);
+		wfbx__freeStaging(model);
+		return NULL;
+	}
+
+	wfbx__Matrix root;
+	wfbx__identity(&root);
+	gatherMeshesRecursively(&loader, 0, 0, &root, model, defaultMaterial);
+
+	// Inflate every array in the file at once
+	wjobCounter localCounters[2] = {{0}};
+	wjobCounter* decodeCounter = progress ? &progress->decode : localCounters;
+	wjobCounter* buildCounter = progress ? &progress->build : localCounters + 1;
+	loader.scratch = (u8*)wfbxMalloc(loader.scratchSize + 16);
+	if(!loader.scratch) {
+		wfbxFree(loader.arrays);
+		wfbxFree(loader.meshes);
+		wfbx__freeScene(&scene);
+		wfbx__freeStaging(model);
+		return NULL;
+	}
+	u8* scratch = (u8*)(((size_t)loader.scratch + 15) & ~(size_t)15);
+	qsort(loader.arrays, loader.arrayCount, sizeof(wfbx__ArrayJob), wfbx__compareArrayJobs);
+	for(isize i = 0; i < loader.arrayCount; ++i) {
+		wfbx__ArrayJob* job = loader.arrays + i;
+		*job->dst = scratch + job->offset;
+		wjobAdd(decodeCounter, wfbx__decodeArrayJob, job);
+	}
+	wjobWait(decodeCounter);
+
+	// ...then build the meshes, also in parallel
+	for(isize i = 0; i < loader.meshCount; ++i) {
+		wjobAdd(buildCounter, buildMeshJob, loader.meshes + i);
+	}
+	wjobWait(buildCounter);
+
+	int ok = loader.meshCount == meshCount;
+	for(isize i = 0; i < loader.meshCount; ++i) {
+		ok = ok && loader.meshes[i].ok;
+	}
+
+	wfbxFree(loader.scratch);
+	wfbxFree(loader.arrays);
+	wfbxFree(loader.meshes);
+	wfbx__freeScene(&scene);
+
+	wfbxModel* result = ok ? wfbx__finishModel(model, flags, arena) : NULL;
+	wfbx__freeStaging(model);
+	return result;
+}
+
+// Baked cache
+//
+// Layout, little-endian, with every section page aligned
+// so pointers into the mapping are page aligned too:
+// 		wfbx__CacheHeader
+// 		wfbx__CacheMesh[meshCount]
+// 		one section per wfbx__Section*, each holding that
+// 		array for every mesh, back to back
+#define WFBX__CACHE_MAGIC 0x004D4257 // "WBM\0"
+#define WFBX__CACHE_VERSION 5
+#define WFBX__CACHE_ALIGN 4096
+
+// Load flags that change what ends up in the cache
+#define WFBX__CACHED_FLAGS (WFBX_LOAD_NO_REORDER | WFBX_LOAD_PACKED | \
+		WFBX_LOAD_MESHLETS | WFBX_LOAD_LODS)
+
+enum
+{
+	// wfbxVertex or wfbxPackedVertex, depending on the flags
+	wfbx__SectionVertices,
+	wfbx__SectionIndices,
+	wfbx__SectionMeshlets,
+	wfbx__SectionMeshletVertices,
+	wfbx__SectionMeshletTriangles,
+	wfbx__SectionLods,
+	wfbx__SectionLodIndices,
+	wfbx__SectionCount
+};
+
+typedef struct 
+{
+	i64 offset, bytes;
+} wfbx__CacheSection;
+
+typedef struct 
+{
+	u32 magic;
+	u32 version;
+	u32 loaderVersion;
+	u32 flags;
+	u64 sourceHash;
+	u64 sourceSize;
+	i64 meshCount;
+	wfbx__CacheSection sections[wfbx__SectionCount];
+	i64 fileSize;
+	wfbxBounds modelBounds;
+	wfbxSphere modelSphere;
+} wfbx__CacheHeader;
+
+typedef struct 
+{
+	// In elements, per section
+	i64 first[wfbx__SectionCount];
+	i64 count[wfbx__SectionCount];
+	wfbxTransform transform;
+	wfbxBounds bounds;
+	wfbxSphere sphere;
+	u32 pad;
+} wfbx__CacheMesh;
+
+static inline
+i64 wfbx__sectionElementSize(isize section, u32 flags)
+{
+	switch(section) {
+		case wfbx__SectionVertices:
+			return flags & WFBX_LOAD_PACKED ? sizeof(wfbxPackedVertex) : sizeof(wfbxVertex);
+		case wfbx__SectionIndices: return sizeof(u32);
+		case wfbx__SectionMeshlets: return sizeof(wmeshMeshlet);
+		case wfbx__SectionMeshletVertices: return sizeof(u32);
+		case wfbx__SectionLods: return sizeof(wfbxLod);
+		case wfbx__SectionLodIndices: return sizeof(u32);
+	}
+	return 1;
+}
+
+// Where a mesh's array for each section lives in the model
+static 
+void** wfbx__sectionArray(wfbxModel* model, isize section, isize mesh, u32 flags)
+{
+	switch(section) {
+		case wfbx__SectionVertices:
+			if(flags & WFBX_LOAD_PACKED) return (void**)(model->packedMeshes + mesh);
+			return (void**)(model->meshes + mesh);
+		case wfbx__SectionIndices: return (void**)(model->indices + mesh);
+		case wfbx__SectionMeshlets: return (void**)(model->meshlets + mesh);
+		case wfbx__SectionMeshletVertices: return (void**)(model->meshletVertices + mesh);
+		case wfbx__SectionMeshletTriangles: return (void**)(model->meshletTriangles + mesh);
+		case wfbx__SectionLods: return (void**)(model->lods + mesh);
+		case wfbx__SectionLodIndices: return (void**)(model->lodIndices + mesh);
+	}
+	return NULL;
+}
+
+static 
+i64 wfbx__sectionCount(wfbxModel* model, isize section, isize mesh)
+{
+	isize meshletCount = model->meshletCounts[mesh];
+	wmeshMeshlet* last = meshletCount ? model->meshlets[mesh] + meshletCount - 1 : NULL;
+	isize lodCount = model->lodCounts[mesh];
+	wfbxLod* lastLod = lodCount ? model->lods[mesh] + lodCount - 1 : NULL;
+	switch(section) {
+		case wfbx__SectionVertices: return model->meshSizes[mesh];
+		case wfbx__SectionIndices: return model->indexCounts[mesh];
+		case wfbx__SectionMeshlets: return meshletCount;
+		case wfbx__SectionMeshletVertices:
+			return last ? last->vertexOffset + last->vertexCount : 0;
+		case wfbx__SectionMeshletTriangles:
+			return last ? last->triangleOffset + last->triangleCount * 3 : 0;
+		case wfbx__SectionLods: return lodCount;
+		case wfbx__SectionLodIndices:
+			return lastLod ? lastLod->firstIndex + lastLod->indexCount : 0;
+	}
+	return 0;
+}
+
+// Points every mesh's vertex and index arrays into one block, sized
+// from the counts and descriptors already in the model. Each section
+// is contiguous across meshes, same as in the cache.
+static 
+void wfbx__carveGeometry(wfbxArena* arena, wfbxModel* model, u32 flags)
+{
+	for(isize s = 0; s < wfbx__SectionCount; ++s) {
+		if(s == wfbx__SectionMeshlets || s == wfbx__SectionLods) continue;
+		for(isize i = 0; i < model->count; ++i) {
+			*wfbx__sectionArray(model, s, i, flags) = wfbx__push(arena,
+					wfbx__sectionCount(model, s, i) * wfbx__sectionElementSize(s, flags));
+		}
+	}
+}
+
+// Copies a staging model into its final blocks
+static 
+wfbxModel* wfbx__finishModel(wfbxModel* staging, u32 flags, wfbxArena* arena)
+{
+	isize meshletCount = 0, lodCount = 0;
+	for(isize i = 0; i < staging->count; ++i) {
+		meshletCount += staging->meshletCounts[i];
+		lodCount += staging->lodCounts[i];
+	}
+
+	isize used = arena ? arena->used : 0;
+	wfbx__ModelBlock block;
+	if(!wfbx__newModel(arena, staging->count, meshletCount, lodCount, &block)) {
+		return NULL;
+	}
+
+	wfbxModel* model = block.model;
+	isize meshletOffset = 0, lodOffset = 0;
+	for(isize i = 0; i < model->count; ++i) {
+		model->meshSizes[i] = staging->meshSizes[i];
+		model->indexCounts[i] = staging->indexCounts[i];
+		model->meshletCounts[i] = staging->meshletCounts[i];
+		model->lodCounts[i] = staging->lodCounts[i];
+		model->transforms[i] = staging->transforms[i];
+		model->materials[i] = staging->materials[i];
+		model->bounds[i] = staging->bounds[i];
+		model->spheres[i] = staging->spheres[i];
+
+		model->meshlets[i] = block.meshlets + meshletOffset;
+		model->lods[i] = block.lods + lodOffset;
+		if(model->meshletCounts[i]) {
+			memcpy(model->meshlets[i], staging->meshlets[i],
+					sizeof(wmeshMeshlet) * model->meshletCounts[i]);
+		}
+		if(model->lodCounts[i]) {
+			memcpy(model->lods[i], staging->lods[i], sizeof(wfbxLod) * model->lodCounts[i]);
+		}
+		meshletOffset += model->meshletCounts[i];
+		lodOffset += model->lodCounts[i];
+	}
+	wfbx__modelBounds(model);
+
+	if(arena) {
+		wfbx__carveGeometry(arena, model, flags);
+		if(arena->used > arena->size) {
+			arena->used = used;
+			return NULL;
+		}
+	} else {
+		wfbxArena measure = {NULL, PTRDIFF_MAX / 2, 0};
+		wfbx__carveGeometry(&measure, model, flags);
+		// Room for malloc's block not being 16-byte aligned, same
+		// as wfbx__newModel
+		wfbxArena heap = {wfbxMalloc(measure.used + 15), measure.used + 15, 0};
+		if(!heap.base) {
+			wfbxFreeModel(model);
+			return NULL;
+		}
+		wfbx__carveGeometry(&heap, model, flags);
+		model->geometry = heap.base;
+	}
+
+	for(isize s = 0; s < wfbx__SectionCount; ++s) {
+		if(s == wfbx__SectionMeshlets || s == wfbx__SectionLods) continue;
+		for(isize i = 0; i < model->count; ++i) {
+			i64 bytes = wfbx__sectionCount(model, s, i) * wfbx__sectionElementSize(s, flags);
+			if(bytes) {
+				memcpy(*wfbx__sectionArray(model, s, i, flags),
+						*wfbx__sectionArray(staging, s, i, flags), (size_t)bytes);
+			}
+		}
+	}
+	return model;
+}
+
+static inline
+i64 wfbx__alignCache(i64 x)
+{
+	return (x + WFBX__CACHE_ALIGN - 1) & ~(i64)(WFBX__CACHE_ALIGN - 1);
+}
+
+// Not cryptographic, just enough to notice the source changed
+static 
+u64 wfbx__hashBytes(const u8* data, isize size)
+{
+	u64 h = 0xcbf29ce484222325ull ^ (u64)size;
+	isize i = 0;
+	for(; i + 8 <= size; i += 8) {
+		h = (h ^ wfbx__readU64(data + i)) * 0x100000001b3ull;
+		h ^= h >> 29;
+	}
+	for(; i < size; ++i) {
+		h = (h ^ data[i]) * 0x100000001b3ull;
+	}
+	h ^= h >> 32;
+	h *= 0xd6e8feb86659fd93ull;
+	h ^= h >> 32;
+	return h;
+}
+
+// model.fbx -> model.wbm
+static 
+char* wfbx__cachePath(const char* fileName)
+{
+	isize length = (isize)strlen(fileName);
+	isize extension = length;
+	for(isize i = length - 1; i >= 0; --i) {
+		if(fileName[i] == '/' || fileName[i] == '\\') break;
+		if(fileName[i] == '.') {
+			extension = i;
+			break;
+		}
+	}
+	char* path = (char*)wfbxMalloc(extension + 5);
+	memcpy(path, fileName, extension);
+	memcpy(path + extension, ".wbm", 5);
+	return path;
+}
+
+// Meshlets have to stay inside their mesh's arrays
+static 
+int wfbx__validMeshlets(const wmeshMeshlet* meshlets, i64 count,
+		const u32* vertices, i64 vertexCount,
+		const u8* triangles, i64 triangleBytes, i64 meshVertexCount)
+{
+	for(i64 i = 0; i < count; ++i) {
+		const wmeshMeshlet* m = meshlets + i;
+		if(m->vertexCount > WMESH_MESHLET_MAX_VERTICES ||
+				m->triangleCount > WMESH_MESHLET_MAX_TRIANGLES ||
+				(i64)m->vertexOffset + m->vertexCount > vertexCount ||
+				(i64)m->triangleOffset + m->triangleCount * 3 > triangleBytes) {
+			return 0;
+		}
+		for(u32 j = 0; j < m->vertexCount; ++j) {
+			if(vertices[m->vertexOffset + j] >= (u64)meshVertexCount) return 0;
+		}
+		for(u32 j = 0; j < m->triangleCount * 3; ++j) {
+			if(triangles[m->triangleOffset + j] >= m->vertexCount) return 0;
+		}
+	}
+	return 1;
+}
+
+// Same for LODs, and their indices have to fit the vertices
+static 
+int wfbx__validLods(const wfbxLod* lods, i64 count,
+		const u32* indices, i64 indexCount, i64 meshVertexCount)
+{
+	for(i64 i = 0; i < count; ++i) {
+		const wfbxLod* lod = lods + i;
+		if((i64)lod->firstIndex + lod->indexCount > indexCount ||
+				lod->indexCount % 3 != 0) {
+			return 0;
+		}
+		for(u32 j = 0; j < lod->indexCount; ++j) {
+			if(indices[lod->firstIndex + j] >= (u64)meshVertexCount) return 0;
+		}
+	}
+	return 1;
+}
+
+static 
+wfbxModel* wfbx__readCache(const char* cachePath, u64 sourceHash, u64 sourceSize,
+		u32 flags, wfbxMaterialTexture* defaultMaterial, wfbxArena* arena)
+{
+	wfbx__MappedFile cache;
+	if(!wfbx__mapFile(cachePath, &cache)) return NULL;
+
+	wfbx__CacheHeader header;
+	int ok = cache.size >= (isize)sizeof(header);
+	if(ok) {
+		memcpy(&header, cache.data, sizeof(header));
+		ok = header.magic == WFBX__CACHE_MAGIC &&
+			header.version == WFBX__CACHE_VERSION &&
+			header.loaderVersion == WFBX_LOADER_VERSION &&
+			header.flags == (flags & WFBX__CACHED_FLAGS) &&
+			header.sourceHash == sourceHash &&
+			header.sourceSize == sourceSize &&
+			header.fileSize == cache.size &&
+			header.meshCount >= 0 &&
+			header.meshCount <= (header.fileSize - (i64)sizeof(header)) / (i64)sizeof(wfbx__CacheMesh);
+	}
+
+	// Sections are in order, after the mesh table, and inside the file.
+	// The checks subtract rather than add, so a corrupted size can't
+	// wrap around past them.
+	i64 sectionStart = ok ? sizeof(header) + header.meshCount * (i64)sizeof(wfbx__CacheMesh) : 0;
+	for(isize s = 0; ok && s < wfbx__SectionCount; ++s) {
+		wfbx__CacheSection* section = header.sections + s;
+		ok = section->offset >= sectionStart &&
+			section->bytes >= 0 &&
+			section->offset % WFBX__CACHE_ALIGN == 0 &&
+			section->bytes <= header.fileSize - section->offset;
+		sectionStart = section->offset + section->bytes;
+	}
+
+	// Check every range before handing out pointers
+	const wfbx__CacheMesh* meshes = (const wfbx__CacheMesh*)(cache.data + sizeof(header));
+	for(i64 i = 0; ok && i < header.meshCount; ++i) {
+		const wfbx__CacheMesh* m = meshes + i;
+		for(isize s = 0; ok && s < wfbx__SectionCount; ++s) {
+			i64 capacity = header.sections[s].bytes / wfbx__sectionElementSize(s, flags);
+			ok = m->first[s] >= 0 && m->count[s] >= 0 &&
+				m->count[s] <= capacity - m->first[s];
+		}
+		if(!ok) break;
+
+		const u32* indices = (const u32*)(cache.data +
+				header.sections[wfbx__SectionIndices].offset) + m->first[wfbx__SectionIndices];
+		i64 vertexCount = m->count[wfbx__SectionVertices];
+		for(i64 j = 0; ok && j < m->count[wfbx__SectionIndices]; ++j) {
+			ok = indices[j] < (u64)vertexCount;
+		}
+
+		ok = ok && wfbx__validMeshlets(
+				(const wmeshMeshlet*)(cache.data + header.sections[wfbx__SectionMeshlets].offset) +
+					m->first[wfbx__SectionMeshlets],
+				m->count[wfbx__SectionMeshlets],
+				(const u32*)(cache.data + header.sections[wfbx__SectionMeshletVertices].offset) +
+					m->first[wfbx__SectionMeshletVertices],
+				m->count[wfbx__SectionMeshletVertices],
+				cache.data + header.sections[wfbx__SectionMeshletTriangles].offset +
+					m->first[wfbx__SectionMeshletTriangles],
+				m->count[wfbx__SectionMeshletTriangles],
+				vertexCount);
+
+		ok = ok && wfbx__validLods(
+				(const wfbxLod*)(cache.data + header.sections[wfbx__SectionLods].offset) +
+					m->first[wfbx__SectionLods],
+				m->count[wfbx__SectionLods],
+				(const u32*)(cache.data + header.sections[wfbx__SectionLodIndices].offset) +
+					m->first[wfbx__SectionLodIndices],
+				m->count[wfbx__SectionLodIndices],
+				vertexCount);
+	}
+
+	// Meshlet and LOD descriptors get copied out, so they
+	// outlive the mapping after wfbxReleaseGeometry
+	wfbx__ModelBlock block;
+	ok = ok && wfbx__newModel(arena, (isize)header.meshCount,
+			(isize)(header.sections[wfbx__SectionMeshlets].bytes / sizeof(wmeshMeshlet)),
+			(isize)(header.sections[wfbx__SectionLods].bytes / sizeof(wfbxLod)),
+			&block);
+	if(!ok) {
+		wfbx__unmapFile(&cache);
+		return NULL;
+	}
+
+	wfbxModel* model = block.model;
+	for(isize i = 0; i < model->count; ++i) {
+		const wfbx__CacheMesh* m = meshes + i;
+		for(isize s = 0; s < wfbx__SectionCount; ++s) {
+			*wfbx__sectionArray(model, s, i, flags) = (void*)(cache.data +
+					header.sections[s].offset + m->first[s] * wfbx__sectionElementSize(s, flags));
+		}
+		model->meshSizes[i] = (isize)m->count[wfbx__SectionVertices];
+		model->indexCounts[i] = (isize)m->count[wfbx__SectionIndices];
+		model->meshletCounts[i] = (isize)m->count[wfbx__SectionMeshlets];
+		model->lodCounts[i] = (isize)m->count[wfbx__SectionLods];
+		model->transforms[i] = m->transform;
+		model->bounds[i] = m->bounds;
+		model->spheres[i] = m->sphere;
+		model->materials[i] = *defaultMaterial;
+
+		wmeshMeshlet* meshlets = block.meshlets + m->first[wfbx__SectionMeshlets];
+		if(model->meshletCounts[i]) {
+			memcpy(meshlets, model->meshlets[i], sizeof(wmeshMeshlet) * model->meshletCounts[i]);
+		}
+		model->meshlets[i] = meshlets;
+		wfbxLod* lods = block.lods + m->first[wfbx__SectionLods];
+		if(model->lodCounts[i]) {
+			memcpy(lods, model->lods[i], sizeof(wfbxLod) * model->lodCounts[i]);
+		}
+		model->lods[i] = lods;
+	}
+
+	model->modelBounds = header.modelBounds;
+	model->modelSphere = header.modelSphere;
+	*block.mapping = cache;
+	model->cache = block.mapping;
+	return model;
+}
+
+static 
+int wfbx__writePadding(FILE* f, i64 from, i64 to)
+{
+	static const u8 zeroes[256] = {0};
+	while(from < to) {
+		i64 n = to - from;
+		if(n > (i64)sizeof(zeroes)) n = sizeof(zeroes);
+		if(fwrite(zeroes, 1, (size_t)n, f) != (size_t)n) return 0;
+		from += n;
+	}
+	return 1;
+}
+
+// Failing to write the cache isn't an error; we'll just bake again next time
+static 
+void wfbx__writeCache(const char* cachePath, wfbxModel* model,
+		u64 sourceHash, u64 sourceSize, u32 flags)
+{
+	wfbx__CacheHeader header;
+	memset(&header, 0, sizeof(header));
+	header.magic = WFBX__CACHE_MAGIC;
+	header.version = WFBX__CACHE_VERSION;
+	header.loaderVersion = WFBX_LOADER_VERSION;
+	header.flags = flags & WFBX__CACHED_FLAGS;
+	header.sourceHash = sourceHash;
+	header.sourceSize = sourceSize;
+	header.meshCount = model->count;
+	header.modelBounds = model->modelBounds;
+	header.modelSphere = model->modelSphere;
+
+	wfbx__CacheMesh* meshes = wfbxNewArray(wfbx__CacheMesh, model->count + 1);
+	i64 totals[wfbx__SectionCount] = {0};
+	for(isize i = 0; i < model->count; ++i) {
+		wfbx__CacheMesh* m = meshes + i;
+		memset(m, 0, sizeof(*m));
+		for(isize s = 0; s < wfbx__SectionCount; ++s) {
+			m->first[s] = totals[s];
+			m->count[s] = wfbx__sectionCount(model, s, i);
+			totals[s] += m->count[s];
+		}
+		m->transform = model->transforms[i];
+		m->bounds = model->bounds[i];
+		m->sphere = model->spheres[i];
+	}
+
+	i64 tableEnd = sizeof(header) + model->count * sizeof(wfbx__CacheMesh);
+	i64 end = tableEnd;
+	for(isize s = 0; s < wfbx__SectionCount; ++s) {
+		header.sections[s].offset = wfbx__alignCache(end);
+		header.sections[s].bytes = totals[s] * wfbx__sectionElementSize(s, flags);
+		end = header.sections[s].offset + header.sections[s].bytes;
+	}
+	header.fileSize = end;
+
+	// Write next to the real path and move it over at the end,
+	// so nobody ever maps a half-written cache
+	isize pathLength = (isize)strlen(cachePath);
+	char* tempPath = (char*)wfbxMalloc(pathLength + 5);
+	memcpy(tempPath, cachePath, pathLength);
+	memcpy(tempPath + pathLength, ".tmp", 5);
+
+	FILE* f = fopen(tempPath, "wb");
+	int ok = f != NULL;
+	ok = ok && fwrite(&header, sizeof(header), 1, f) == 1;
+	ok = ok && (model->count == 0 ||
+			fwrite(meshes, sizeof(wfbx__CacheMesh), model->count, f) == (size_t)model->count);
+	end = tableEnd;
+	for(isize s = 0; ok && s < wfbx__SectionCount; ++s) {
+		ok = wfbx__writePadding(f, end, header.sections[s].offset);
+		size_t elementSize = (size_t)wfbx__sectionElementSize(s, flags);
+		for(isize i = 0; ok && i < model->count; ++i) {
+			size_t n = (size_t)meshes[i].count[s];
+			ok = n == 0 || fwrite(*wfbx__sectionArray(model, s, i, flags), elementSize, n, f) == n;
+		}
+		end = header.sections[s].offset + header.sections[s].bytes;
+	}
+	if(f && fclose(f) != 0) ok = 0;
+
+	if(ok) {
+#ifdef _WIN32
+		ok = MoveFileExA(tempPath, cachePath, MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+		ok = rename(tempPath, cachePath) == 0;
+#endif
+	}
+	if(!ok) remove(tempPath);
+
+	wfbxFree(tempPath);
+	wfbxFree(meshes);
+}
+
+int wfbxSelectLod(
+		const wfbxModel* model,
+		ptrdiff_t mesh,
+		float distance,
+		float pixelsPerUnit,
+		float maxPixelError)
+{
+	// Inside the bounds, nothing but the full mesh will do
+	if(distance <= 0) return -1;
+	int lod = -1;
+	for(isize i = 0; i < model->lodCounts[mesh]; ++i) {
+		if(model->lods[mesh][i].error * pixelsPerUnit > maxPixelError * distance) break;
+		lod = (int)i;
+	}
+	return lod;
+}
+
+static 
+wfbxModel* wfbx__load(
+		const char* fileName, 
+		wfbxMaterialTexture* defaultMaterial,
+		unsigned int flags,
+		wfbxArena* arena,
+		wfbx__Progress* progress)
+{
+	wfbx__MappedFile file;
+	if(!wfbx__mapFile(fileName, &file)) {
+		return NULL;
+	}
+
+	if(flags & WFBX_LOAD_SKIP_CACHE) {
+		wfbxModel* model = wfbx__loadFbx(&file, defaultMaterial, flags, arena, progress);
+		wfbx__unmapFile(&file);
+		return model;
+	}
+
+	u64 sourceHash = wfbx__hashBytes(file.data, file.size);
+	char* cachePath = wfbx__cachePath(fileName);
+	wfbxModel* model = wfbx__readCache(cachePath, sourceHash, file.size,
+			flags, defaultMaterial, arena);
+	if(!model) {
+		model = wfbx__loadFbx(&file, defaultMaterial, flags, arena, progress);
+		if(model) {
+			wfbx__writeCache(cachePath, model, sourceHash, file.size, flags);
+		}
+	}
+
+	wfbxFree(cachePath);
+	wfbx__unmapFile(&file);
+	return model;
+}
+
+wfbxModel* wfbxLoadModelInArena(
+		const char* fileName, 
+		wfbxMaterialTexture* defaultMaterial,
+		unsigned int flags,
+		wfbxArena* arena)
+{
+	return wfbx__load(fileName, defaultMaterial, flags, arena, NULL);
+}
+
+wfbxModel* wfbxLoadModel(
+		const char* fileName, 
+		wfbxMaterialTexture* defaultMaterial,
+		unsigned int flags)
+{
+	return wfbxLoadModelInArena(fileName, defaultMaterial, flags, NULL);
+}
+
+wfbxModel* wfbxLoadModelFromFile(
+		const char* fileName, 
+		wfbxMaterialTexture* defaultMaterial)
+{
+	return wfbxLoadModel(fileName, defaultMaterial, 0);
+}
+
+struct wfbxLoad
+{
+	char* fileName;
+	wfbxMaterialTexture material;
+	u32 flags;
+	wfbxModel* model;
+
+	// Counts the one job that runs the whole load
+	wjobCounter done;
+	wfbx__Progress progress;
+	// The most wfbxLoadProgress has said, so it never goes backwards
+	f32 reported;
+};
+
+static 
+void wfbx__loadJob(void* data)
+{
+	wfbxLoad* load = (wfbxLoad*)data;
+	load->model = wfbx__load(load->fileName, &load->material, 
+			load->flags, NULL, &load->progress);
+}
+
+wfbxLoad* wfbxLoadModelAsync(
+		const char* fileName, 
+		wfbxMaterialTexture* defaultMaterial,
+		unsigned int flags)
+{
+	wfbxLoad* load = wfbxNew(wfbxLoad);
+	memset(load, 0, sizeof(wfbxLoad));
+	isize length = strlen(fileName);
+	load->fileName = wfbxNewArray(char, length + 1);
+	memcpy(load->fileName, fileName, length + 1);
+	load->material = *defaultMaterial;
+	load->flags = flags;
+	wjobAdd(&load->done, wfbx__loadJob, load);
+	return load;
+}
+
+int wfbxLoadReady(wfbxLoad* load)
+{
+	return wjobPending(&load->done, NULL) == 0;
+}
+
+float wfbxLoadProgress(wfbxLoad* load)
+{
+	// Roughly where each stage ends, going by enemyFighter.fbx:
+	// reading and parsing, decoding arrays, then building meshes, 
+	// which is most of it, more so with LODs, and writing the cache
+	static const f32 decodeStart = 0.05f, buildStart = 0.2f, buildEnd = 0.95f;
+
+	if(wjobPending(&load->done, NULL) == 0) return 1;
+	long decodeAdded, buildAdded;
+	long decodePending = wjobPending(&load->progress.decode, &decodeAdded);
+	long buildPending = wjobPending(&load->progress.build, &buildAdded);
+
+	f32 progress = 0;
+	if(buildAdded) {
+		progress = buildStart + (buildEnd - buildStart) * 
+			(buildAdded - buildPending) / buildAdded;
+	} else if(decodeAdded) {
+		progress = decodeStart + (buildStart - decodeStart) * 
+			(decodeAdded - decodePending) / decodeAdded;
+	}
+	// A poll in the middle of queueing a batch can overshoot a little,
+	// so never go backwards from there
+	if(progress > load->reported) load->reported = progress;
+	return load->reported;
+}
+
+wfbxModel* wfbxFinishLoad(wfbxLoad* load)
+{
+	wjobWait(&load->done);
+	wfbxModel* model = load->model;
+	wfbxFree(load->fileName);
+	wfbxFree(load);
+	return model;
+}
+
+static 
+void gatherMeshesRecursively(
+		wfbx__Loader* loader,
+		i64 nodeId,
+		isize depth,
+		const wfbx__Matrix* parent,
+		wfbxModel* model,
+		wfbxMaterialTexture* defaultMaterial)
+{
+	if(depth > WFBX_MAX_NODE_DEPTH) return;
+	wfbx__Scene* scene = loader->scene;
+	wfbx__Model* node = wfbx__findModel(scene, nodeId);
+
+	wfbx__Matrix world = *parent;
+	if(node) {
+		wfbx__Matrix local;
+		wfbx__localMatrix(node, &local);
+		wfbx__multiply(parent, &local, &world);
+	}
+
+	// Mesh attributes of this node, then child nodes,
+	// both in the order the connections list them
+	isize childCount;
+	wfbx__Connection* children = wfbx__findChildren(scene, nodeId, &childCount);
+	if(node) {
+		for(isize i = 0; i < childCount; ++i) {
+			wfbx__Geometry* geometry = children[i].geometry;
+			if(!geometry) continue;
+
+			wfbx__Mesh* mesh = loader->meshes + loader->meshCount;
+			memset(mesh, 0, sizeof(*mesh));
+			mesh->geometry = geometry;
+			mesh->node = node;
+			mesh->transform = world;
+			wfbx__geometricMatrix(node, &mesh->transform);
+			mesh->model = model;
+			mesh->meshIndex = loader->meshCount++;
+			mesh->material = defaultMaterial;
+			mesh->flags = loader->flags;
+			mesh->avx2 = loader->avx2;
+
+			wfbx__queueChildArray(loader, &geometry->node, "Vertices", 'd',
+					(void**)&mesh->verts, &mesh->vertCount);
+			wfbx__queueChildArray(loader, &geometry->node, "PolygonVertexIndex", 'i',
+					(void**)&mesh->indices, &mesh->indexCount);
+			wfbx__queueLayer(loader, &geometry->node,
+					"LayerElementNormal", "Normals", "NormalsIndex", 3, &mesh->normals);
+			wfbx__queueLayer(loader, &geometry->node,
+					"LayerElementUV", "UV", "UVIndex", 2, &mesh->uvs);
+		}
+	}
+
+	for(isize i = 0; i < childCount; ++i) {
+		if(!children[i].model) continue;
+		gatherMeshesRecursively(
+				loader,
+				children[i].child,
+				depth + 1,
+				&world,
+				model,
+				defaultMaterial);
+	}
+}
+
+static 
+wfbxPackedVertex* wfbx__packVertices(wfbxVertex* vertices, isize count, wfbxBounds* bounds)
+{
+	wfbxPackedVertex* packed = wfbxNewArray(wfbxPackedVertex, count + 1);
+	f32 scale[3];
+	for(isize i = 0; i < 3; ++i) {
+		f32 extent = bounds->max[i] - bounds->min[i];
+		scale[i] = extent > 0 ? 65535.0f / extent : 0;
+	}
+
+	for(isize i = 0; i < count; ++i) {
+		wfbxVertex* v = vertices + i;
+		wfbxPackedVertex* p = packed + i;
+		for(isize j = 0; j < 3; ++j) {
+			f32 q = (v->pos[j] - bounds->min[j]) * scale[j] + 0.5f;
+			if(q < 0) q = 0;
+			if(q > 65535) q = 65535;
+			p->pos[j] = (unsigned short)q;
+		}
+		wmeshEncodeOctahedral(p->normal, v->normal);
+		// Relative to the normal the shader decodes, not the original
+		f32 normal[3];
+		wmeshDecodeOctahedral(normal, p->normal);
+		p->pos[3] = wmeshEncodeTangent(normal, v->tangent);
+		p->uv[0] = wmeshQuantizeHalf(v->uv[0]);
+		p->uv[1] = wmeshQuantizeHalf(v->uv[1]);
+	}
+	return packed;
+}
+
+// Meshlets get built at the worst case size, then copied down
+static 
+void wfbx__buildMeshlets(wfbxModel* model, isize meshIndex, wfbxVertex* modelMesh)
+{
+	isize indexCount = model->indexCounts[meshIndex];
+	wmeshMeshlet* meshlets = wfbxNewArray(wmeshMeshlet,
+			wmeshMeshletCountBound(indexCount));
+	u32* vertices = wfbxNewArray(u32, wmeshMeshletVertexBound(indexCount));
+	u8* triangles = wfbxNewArray(u8, wmeshMeshletTriangleBound(indexCount));
+	isize count = wmeshBuildMeshlets(meshlets, vertices, triangles,
+			model->indices[meshIndex], indexCount,
+			modelMesh, model->meshSizes[meshIndex], sizeof(wfbxVertex));
+
+	isize vertexCount = 0, triangleBytes = 0;
+	if(count > 0) {
+		wmeshMeshlet* last = meshlets + count - 1;
+		vertexCount = last->vertexOffset + last->vertexCount;
+		triangleBytes = last->triangleOffset + last->triangleCount * 3;
+	}
+
+	model->meshletCounts[meshIndex] = count;
+	model->meshlets[meshIndex] = wfbxNewArray(wmeshMeshlet, count + 1);
+	model->meshletVertices[meshIndex] = wfbxNewArray(u32, vertexCount + 1);
+	model->meshletTriangles[meshIndex] = wfbxNewArray(u8, triangleBytes + 1);
+	memcpy(model->meshlets[meshIndex], meshlets, sizeof(wmeshMeshlet) * count);
+	memcpy(model->meshletVertices[meshIndex], vertices, sizeof(u32) * vertexCount);
+	memcpy(model->meshletTriangles[meshIndex], triangles, triangleBytes);
+
+	wfbxFree(triangles);
+	wfbxFree(vertices);
+	wfbxFree(meshlets);
+}
+
+// LOD targets, as fractions of the full mesh's triangles
+static const f32 wfbx__lodLevels[WFBX_MAX_LODS] = {0.5f, 0.25f, 0.1f, 0.03f};
+
+typedef struct 
+{
+	const wfbxVertex* vertices;
+	isize vertexCount;
+	const u32* indices;
+	isize indexCount;
+	f32 level;
+	u32 flags;
+
+	u32* result;
+	isize resultCount;
+	f32 error;
+} wfbx__LodJob;
+
+static 
+void wfbx__simplifyJob(void* data)
+{
+	wfbx__LodJob* job = (wfbx__LodJob*)data;
+
+	// Normals and UVs, with normals counting for less; on a
+	// flat-shaded model, nearly every vertex is on a normal seam
+	static const f32 weights[6] = {0.25f, 0.25f, 0.25f, 0, 1, 1};
+	u32* simplified = wfbxNewArray(u32, job->indexCount + 1);
+	isize target = (isize)(job->indexCount / 3 * job->level) * 3;
+	job->resultCount = wmeshSimplify(simplified, job->indices, job->indexCount,
+			job->vertices, job->vertexCount, sizeof(wfbxVertex),
+			offsetof(wfbxVertex, normal), weights, 6, target, &job->error);
+
+	if(job->flags & WFBX_LOAD_NO_REORDER) {
+		job->result = simplified;
+	} else {
+		job->result = wfbxNewArray(u32, job->resultCount + 1);
+		wmeshOptimizeVertexCache(job->result, simplified, job->resultCount,
+				job->vertexCount, WMESH_VERTEX_CACHE_SIZE);
+		wfbxFree(simplified);
+	}
+}
+
+// Each level simplifies the full mesh on its own, so they all run at once
+static 
+void wfbx__buildLods(wfbxModel* model, isize meshIndex, wfbxVertex* vertices, u32 flags)
+{
+	wfbx__LodJob jobs[WFBX_MAX_LODS];
+	wjobCounter counter = {0};
+	for(isize i = 0; i < WFBX_MAX_LODS; ++i) {
+		wfbx__LodJob* job = jobs + i;
+		memset(job, 0, sizeof(*job));
+		job->vertices = vertices;
+		job->vertexCount = model->meshSizes[meshIndex];
+		job->indices = model->indices[meshIndex];
+		job->indexCount = model->indexCounts[meshIndex];
+		job->level = wfbx__lodLevels[i];
+		job->flags = flags;
+		wjobAdd(&counter, wfbx__simplifyJob, job);
+	}
+	wjobWait(&counter);
+
+	// Errors come back relative to the mesh's size
+	wfbxBounds* bounds = model->bounds + meshIndex;
+	f32 extent = 0;
+	for(isize k = 0; k < 3; ++k) {
+		f32 e = bounds->max[k] - bounds->min[k];
+		if(e > extent) extent = e;
+	}
+
+	// Only keep levels that came out meaningfully smaller than the
+	// last one; a mesh that runs out of collapses stops short, and
+	// every level past that comes out about the same
+	isize keep[WFBX_MAX_LODS];
+	isize lodCount = 0, total = 0;
+	isize previous = model->indexCounts[meshIndex];
+	for(isize i = 0; i < WFBX_MAX_LODS; ++i) {
+		if(jobs[i].resultCount == 0 || jobs[i].resultCount > previous * 9 / 10) continue;
+		keep[lodCount++] = i;
+		total += jobs[i].resultCount;
+		previous = jobs[i].resultCount;
+	}
+
+	wfbxLod* lods = wfbxNewArray(wfbxLod, lodCount + 1);
+	u32* lodIndices = wfbxNewArray(u32, total + 1);
+	isize offset = 0;
+	f32 error = 0;
+	for(isize i = 0; i < lodCount; ++i) {
+		wfbx__LodJob* job = jobs + keep[i];
+		// Coarser levels never claim to be closer than finer ones
+		if(job->error * extent > error) error = job->error * extent;
+		lods[i].firstIndex = (u32)offset;
+		lods[i].indexCount = (u32)job->resultCount;
+		lods[i].error = error;
+		memcpy(lodIndices + offset, job->result, sizeof(u32) * job->resultCount);
+		offset += job->resultCount;
+	}
+	for(isize i = 0; i < WFBX_MAX_LODS; ++i) {
+		wfbxFree(jobs[i].result);
+	}
+
+	model->lods[meshIndex] = lods;
+	model->lodCounts[meshIndex] = lodCount;
+	model->lodIndices[meshIndex] = lodIndices;
+}
+
+static 
+void buildMeshJob(void* data)
+{
+	wfbx__Mesh* mesh = (wfbx__Mesh*)data;
+	wfbxModel* model = mesh->model;
+	isize meshIndex = mesh->meshIndex;
+	if(!mesh->verts || !mesh->indices) return;
+
+	isize count = mesh->vertCount / 3;
+	isize indexCount = mesh->indexCount;
+	f64* verts = mesh->verts;
+	i32* indices = mesh->indices;
+
+	f64* scale = mesh->node->scale;
+	f64* trans = mesh->node->translation;
+	f64* rot = mesh->node->rotation;
+
+	for(isize i = 0; i < 3; ++i) {
+		model->transforms[meshIndex].translation[i] = (f32)trans[i];
+		model->transforms[meshIndex].scale[i] = (f32)scale[i];
+		model->transforms[meshIndex].rotation[i] = (f32)rot[i];
+	}
+
+	// Control points and normals get baked into world space once, up front
+	wfbx__Bake positionBake, normalBake;
+	int mirrored = wfbx__setupBakes(&mesh->transform, &positionBake, &normalBake) < 0;
+	f32* positions = wfbxNewArray(f32, count * 4 + 4);
+	wfbx__bake(&positionBake, positions, verts, count, mesh->avx2);
+	for(isize i = 0; i < 3; ++i) {
+		model->bounds[meshIndex].min[i] = count ? positionBake.min[i] : 0;
+		model->bounds[meshIndex].max[i] = count ? positionBake.max[i] : 0;
+	}
+	wfbx__boundingSphere(model->spheres + meshIndex, model->bounds + meshIndex,
+			positions, count, mesh->avx2);
+
+	// A control point can have a different normal or UV in every
+	// polygon that uses it (hard edges, UV seams), so build one full
+	// vertex per polygon vertex, then weld the identical ones back together.
+	wfbxVertex* stream = wfbxNewArray(wfbxVertex, indexCount + 1);
+	memset(stream, 0, sizeof(wfbxVertex) * indexCount);
+	wfbx__Layer* normals = &mesh->normals;
+	wfbx__Layer* uvs = &mesh->uvs;
+
+	isize normalCount = normals->direct ? normals->directCount / 3 : 0;
+	f32* bakedNormals = wfbxNewArray(f32, normalCount * 4 + 4);
+	wfbx__bake(&normalBake, bakedNormals, normals->direct, normalCount, mesh->avx2);
+
+	// Polygons can be any size, so size the triangle list and the
+	// triangulator's scratch from the polygon lengths first. An
+	// unterminated run at the end still counts as a polygon.
+	isize triangleCount = 0, maxPolygon = 0;
+	for(isize i = 0, start = 0; i < indexCount; ++i) {
+		if(indices[i] < 0 || i == indexCount - 1) {
+			isize n = i + 1 - start;
+			if(n >= 3) triangleCount += n - 2;
+			if(n > maxPolygon) maxPolygon = n;
+			start = i + 1;
+		}
+	}
+	u32* triangles = wfbxNewArray(u32, triangleCount * 3 + 1);
+	void* polygonScratch = wfbxMalloc(wmeshPolygonScratchSize(maxPolygon) + 16);
+
+	isize polygon = 0, polygonStart = 0, triangleIndexCount = 0;
+	for(isize i = 0; i < indexCount; ++i) {
+		// The last vertex of each polygon is stored as ~index
+		i32 index = indices[i] < 0 ? ~indices[i] : indices[i];
+		if(index >= count) index = 0;
+		wfbxVertex* v = stream + i;
+		if(count) {
+			_mm_storeu_ps(v->pos, _mm_loadu_ps(positions + index * 4));
+		}
+
+		isize n = wfbx__layerElement(normals, index, i, polygon);
+		if(n >= 0) {
+			_mm_storeu_ps(v->normal, _mm_loadu_ps(bakedNormals + n * 4));
+		}
+
+		isize uv = wfbx__layerElement(uvs, index, i, polygon);
+		if(uv >= 0) {
+			v->uv[0] = (f32)uvs->direct[uv * 2];
+			v->uv[1] = (f32)uvs->direct[uv * 2 + 1];
+		}
+
+		// Triangulate each polygon as soon as its last vertex is in,
+		// straight into the index list
+		if(indices[i] < 0 || i == indexCount - 1) {
+			u32* dst = triangles + triangleIndexCount;
+			isize n = wmeshTriangulatePolygon(dst, stream + polygonStart,
+					i + 1 - polygonStart, sizeof(wfbxVertex), polygonScratch);
+			for(isize j = 0; j < n * 3; ++j) {
+				dst[j] += (u32)polygonStart;
+			}
+			// A mirroring transform turns every face inside out
+			for(isize j = 0; mirrored && j < n; ++j) {
+				u32 t = dst[j * 3 + 1];
+				dst[j * 3 + 1] = dst[j * 3 + 2];
+				dst[j * 3 + 2] = t;
+			}
+			triangleIndexCount += n * 3;
+			polygonStart = i + 1;
+		}
+
+		if(indices[i] < 0) polygon++;
+	}
+	wfbxFree(polygonScratch);
+	wfbxFree(bakedNormals);
+
+	// Weld, then send the triangles through the weld remap
+	u32* welded = wfbxNewArray(u32, indexCount + 1);
+	isize uniqueCount = wmeshWeld(welded, stream, indexCount, sizeof(wfbxVertex));
+	wmeshRemapVertices(stream, stream, indexCount, sizeof(wfbxVertex), welded);
+	for(isize i = 0; i < triangleIndexCount; ++i) {
+		triangles[i] = welded[triangles[i]];
+	}
+
+	// Tangents come out per triangle corner, but every corner of a
+	// vertex gets the same one unless mirrored UVs meet there, and
+	// then the two differ in bitangent sign. So each vertex keeps the
+	// first sign it sees, and a copy takes the corners with the other.
+	f32* tangents = wfbxNewArray(f32, triangleIndexCount * 4 + 4);
+	wmeshGenerateTangents(tangents, triangles, triangleIndexCount,
+			stream, uniqueCount, sizeof(wfbxVertex),
+			offsetof(wfbxVertex, normal), offsetof(wfbxVertex, uv));
+	wfbxVertex* split = wfbxNewArray(wfbxVertex, uniqueCount * 2 + 1);
+	memcpy(split, stream, sizeof(wfbxVertex) * uniqueCount);
+	wfbxFree(stream);
+	stream = split;
+	u32* mirror = wfbxNewArray(u32, uniqueCount + 1);
+	memset(mirror, 0xFF, sizeof(u32) * uniqueCount);
+	isize splitCount = uniqueCount;
+	for(isize i = 0; i < uniqueCount; ++i) {
+		stream[i].tangent[3] = 0;
+	}
+	for(isize i = 0; i < triangleIndexCount; ++i) {
+		u32 v = triangles[i];
+		f32* tangent = tangents + i * 4;
+		if(stream[v].tangent[3] == 0) {
+			memcpy(stream[v].tangent, tangent, sizeof(f32) * 4);
+		} else if(stream[v].tangent[3] != tangent[3]) {
+			if(mirror[v] == 0xFFFFFFFF) {
+				mirror[v] = (u32)splitCount;
+				stream[splitCount] = stream[v];
+				memcpy(stream[splitCount].tangent, tangent, sizeof(f32) * 4);
+				splitCount++;
+			}
+			triangles[i] = mirror[v];
+		}
+	}
+	uniqueCount = splitCount;
+	wfbxFree(mirror);
+	wfbxFree(tangents);
+
+	// Reorder triangles for the post-transform cache, then lay the
+	// vertices out in the order those triangles first use them.
+	u32* modelIndices = triangles;
+	if(!(mesh->flags & WFBX_LOAD_NO_REORDER)) {
+		modelIndices = wfbxNewArray(u32, triangleIndexCount + 1);
+		wmeshOptimizeVertexCache(modelIndices, triangles, triangleIndexCount,
+				uniqueCount, WMESH_VERTEX_CACHE_SIZE);
+		wfbxFree(triangles);
+	}
+	wfbxVertex* modelMesh = wfbxNewArray(wfbxVertex, uniqueCount + 1);
+	uniqueCount = wmeshOptimizeVertexFetch(modelMesh, modelIndices, triangleIndexCount,
+			stream, uniqueCount, sizeof(wfbxVertex));
+
+	model->meshSizes[meshIndex] = uniqueCount;
+	model->indices[meshIndex] = modelIndices;
+	model->indexCounts[meshIndex] = triangleIndexCount;
+
+	if(mesh->flags & WFBX_LOAD_MESHLETS) {
+		wfbx__buildMeshlets(model, meshIndex, modelMesh);
+	}
+
+	if(mesh->flags & WFBX_LOAD_LODS) {
+		wfbx__buildLods(model, meshIndex, modelMesh, mesh->flags);
+	}
+
+	if(mesh->flags & WFBX_LOAD_PACKED) {
+		model->packedMeshes[meshIndex] = wfbx__packVertices(
+				modelMesh, uniqueCount, model->bounds + meshIndex);
+		wfbxFree(modelMesh);
+	} else {
+		model->meshes[meshIndex] = modelMesh;
+	}
+
+	wfbxFree(welded);
+	wfbxFree(stream);
+	wfbxFree(positions);
+
+	model->materials[meshIndex] = *mesh->material;
+	mesh->ok = 1;
+}
+
+static 
+void countMeshesRecursively(wfbx__Scene* scene, i64 nodeId, isize depth, isize* meshCount)
+{
+	if(depth > WFBX_MAX_NODE_DEPTH) return;
+	isize childCount;
+	wfbx__Connection* children = wfbx__findChildren(scene, nodeId, &childCount);
+	if(wfbx__findModel(scene, nodeId)) {
+		for(isize i = 0; i < childCount; ++i) {
+			if(children[i].geometry) *meshCount = *meshCount + 1;
+		}
+	}
+
+	for(isize i = 0; i < childCount; ++i) {
+		if(children[i].model) {
+			countMeshesRecursively(scene, children[i].child, depth + 1, meshCount);
+		}
 	}
 }
 
@@ -0,0 +1,173 @@
+/* wb_fbx_sdk.cc
+ *
+ * The old fbxsdk-based loader, kept around only so the
+ * benchmark can compare against it. Nothing in the game links this.
+ *
+ * It has all the old restrictions:
+ * 		- UVs must be PolygonVertex and IndexToDirect
+ * 		- Normals must be ControlPoint and Direct
+ *
+ * Build it with `nmake -f windows.mak benchsdk`, which needs
+ * the FBX SDK paths in windows.mak.
+ *
+ */
+
+#include "wb_fbx.cc"
+
+#include <fbxsdk.h>
+#include <xmmintrin.h>
+
+typedef ptrdiff_t isize;
+typedef unsigned int u32;
+typedef float f32;
+
+#define wfbxSdkNewArray(type, count) (type*)malloc(sizeof(type) * count)
+
+static
+void sdkBuildModelFromMeshesRecursively(
+		FbxNode* node,
+		isize* meshIndex,
+		wfbxModel* model,
+		wfbxMaterialTexture* defaultMaterial);
+static
+void sdkCountMeshesRecursively(FbxNode* node, isize* meshCount);
+
+extern "C"
+wfbxModel* wfbxLoadModelFromFileSdk(
+		const char* fileName,
+		wfbxMaterialTexture* defaultMaterial)
+{
+	FbxManager* sdkManager = FbxManager::Create();
+	FbxIOSettings* ios = FbxIOSettings::Create(sdkManager, IOSROOT);
+	FbxImporter* importer = FbxImporter::Create(sdkManager, "");
+	if(!importer->Initialize(fileName, -1, sdkManager->GetIOSettings())) {
+		return NULL;
+	}
+	FbxScene* scene = FbxScene::Create(sdkManager, "defaultScene");
+	importer->Import(scene);
+	importer->Destroy();
+
+	FbxNode* root = scene->GetRootNode();
+	if(!root) { return NULL; }
+
+	wfbxModel* model = (wfbxModel*)malloc(sizeof(wfbxModel));
+	isize meshCount = 0;
+	sdkCountMeshesRecursively(root, &meshCount);
+
+	model->meshes = wfbxSdkNewArray(wfbxVertex*, meshCount);
+	model->meshSizes = wfbxSdkNewArray(isize, meshCount);
+	model->indices = wfbxSdkNewArray(u32*, meshCount);
+	model->indexCounts = wfbxSdkNewArray(isize, meshCount);
+	model->transforms = wfbxSdkNewArray(wfbxTransform, meshCount);
+	model->materials = wfbxSdkNewArray(wfbxMaterialTexture, meshCount);
+	model->count = meshCount;
+	isize meshIndex = 0;
+
+	sdkBuildModelFromMeshesRecursively(root, &meshIndex, model, defaultMaterial);
+	sdkManager->Destroy();
+	return model;
+}
+
+static
+void sdkBuildModelFromMeshesRecursively(
+		FbxNode* node,
+		isize* meshIndex,
+		wfbxModel* model,
+		wfbxMaterialTexture* defaultMaterial)
+{
+	FbxDouble3 nodeTrans = node->LclTranslation.Get();
+	FbxDouble3 nodeRot = node->LclRotation.Get();
+	FbxDouble3 nodeScale = node->LclScaling.Get();
+
+	isize attribCount = node->GetNodeAttributeCount();
+	for(isize i = 0; i < attribCount; ++i) {
+		FbxNodeAttribute* attrib = node->GetNodeAttributeByIndex(i);
+		if(attrib->GetAttributeType() == FbxNodeAttribute::eMesh) {
+			FbxMesh* mesh = (FbxMesh*)attrib;
+			isize count = mesh->GetControlPointsCount();
+
+			wfbxVertex* modelMesh = wfbxSdkNewArray(wfbxVertex, count);
+			model->meshes[*meshIndex] = modelMesh;
+			model->meshSizes[*meshIndex] = count;
+
+			FbxStatus status;
+			FbxDouble4* verts = mesh->GetControlPoints(&status);
+			int* indices = mesh->GetPolygonVertices();
+
+			isize indexCount = mesh->GetPolygonVertexCount();
+			u32* modelIndices = wfbxSdkNewArray(u32, indexCount);
+			model->indices[*meshIndex] = modelIndices;
+			model->indexCounts[*meshIndex] = indexCount;
+
+			for(isize i = 0; i < indexCount; ++i) {
+				modelIndices[i] = (u32)indices[i];
+			}
+
+			double* scale = nodeScale.Buffer();
+			double* trans = nodeTrans.Buffer();
+			double* rot = nodeRot.Buffer();
+
+			for(isize i = 0; i < 3; ++i) {
+				model->transforms[*meshIndex].translation[i] = (f32)trans[i];
+				model->transforms[*meshIndex].scale[i] = (f32)scale[i];
+				model->transforms[*meshIndex].rotation[i] = (f32)rot[i];
+			}
+
+			__m128 vscale = _mm_setr_ps(scale[0], scale[1], scale[2], 1);
+			__m128 vtrans = _mm_setr_ps(trans[0], trans[1], trans[2], 0);
+
+			FbxLayer* l = mesh->GetLayer(0);
+			FbxLayerElementUV* uvs = l->GetUVs();
+
+			FbxLayerElementNormal* normals = l->GetNormals();
+			auto normalArray = normals->GetDirectArray();
+			for(isize i = 0; i < count; ++i) {
+				double* vb = verts[i].Buffer();
+				__m128 v = _mm_setr_ps(vb[0], vb[1], vb[2], vb[3]);
+				v = _mm_mul_ps(v, vscale);
+				v = _mm_add_ps(v, vtrans);
+				*(__m128*)&modelMesh[i].pos = v;
+
+				vb = normalArray[i].Buffer();
+				v = _mm_setr_ps(vb[0], vb[1], vb[2], vb[3]);
+				*(__m128*)&modelMesh[i].normal = v;
+			}
+
+			auto uvArray = uvs->GetDirectArray();
+			auto uvIndices = uvs->GetIndexArray();
+
+			for(isize i = 0; i < indexCount; ++i) {
+				isize index = modelIndices[i];
+				modelMesh[index].uv[0] = uvArray[uvIndices[i]].Buffer()[0];
+				modelMesh[index].uv[1] = uvArray[uvIndices[i]].Buffer()[1];
+			}
+			model->materials[*meshIndex] = *defaultMaterial;
+			*meshIndex = *meshIndex + 1;
+		}
+	}
+	isize childCount = node->GetChildCount();
+	for(isize i = 0; i < childCount; ++i) {
+		sdkBuildModelFromMeshesRecursively(
+				node->GetChild(i),
+				meshIndex,
+				model,
+				defaultMaterial);
+	}
+}
+
+static
+void sdkCountMeshesRecursively(FbxNode* node, isize* meshCount)
+{
+	isize attribCount = node->GetNodeAttributeCount();
+	for(isize i = 0; i < attribCount; ++i) {
+		FbxNodeAttribute* attrib = node->GetNodeAttributeByIndex(i);
+		if(attrib->GetAttributeType() == FbxNodeAttribute::eMesh) {
+			*meshCount = *meshCount + 1;
+		}
+	}
+
+	isize childCount = node->GetChildCount();
+	for(isize i = 0; i < childCount; ++i) {
+		sdkCountMeshesRecursively(node->GetChild(i), meshCount);
+	}
+}
@@ -2386,3 +2386,12 @@ int wbgl_load_all(struct wbgl_ErrorContext* in_ctx)
 #define GL_INT_2_10_10_10_REV 0x8D9F
 #define GL_SHADER_STORAGE_BLOCK 0x92E6
 #define GL_SHADER_STORAGE_BUFFER 0x90D2
+#define GL_DYNAMIC_STORAGE_BIT 0x0100
+#define GL_DRAW_INDIRECT_BUFFER 0x8F3F
+#define GL_COMPRESSED_RGBA_BPTC_UNORM 0x8E8C
+#define GL_MAP_PERSISTENT_BIT 0x0040
+#define GL_MAP_COHERENT_BIT 0x0080
+#define GL_COMPUTE_SHADER 0x91B9
+#define GL_SHADER_STORAGE_BARRIER_BIT 0x00002000
+#define GL_COMMAND_BARRIER_BIT 0x00000040
+#define GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT 0x00000001
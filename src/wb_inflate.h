@@ -0,0 +1,391 @@
+/* wb_inflate.h
+ *
+ * A small DEFLATE/zlib decoder.
+ *
+ * Binary FBX files store their big arrays as zlib streams,
+ * and I didn't want to pull zlib (or stb_image's decoder,
+ * which lives in a different translation unit) into wb_fbx
+ * just for that.
+ *
+ * It only decodes into a caller-provided buffer of known size,
+ * which is always the case for FBX arrays; there's no streaming
+ * interface and no output growth.
+ *
+ * Huffman codes are decoded through a lookup table indexed by
+ * the next WB_INFLATE_FAST_BITS bits of input, with a canonical
+ * slow path for the (rare) longer codes.
+ *
+ * Everything is static, so just include it with
+ * WB_INFLATE_IMPLEMENTATION defined in the file that uses it.
+ *
+ */
+
+#ifndef WB_INFLATE_H
+#define WB_INFLATE_H
+
+#include <stddef.h>
+
+#ifdef WB_INFLATE_IMPLEMENTATION
+#include <string.h>
+
+#ifndef WB_INFLATE_FAST_BITS
+#define WB_INFLATE_FAST_BITS 10
+#endif
+#define WBINF__FAST_SIZE (1 << WB_INFLATE_FAST_BITS)
+#define WBINF__FAST_MASK (WBINF__FAST_SIZE - 1)
+
+typedef struct
+{
+	// fast[bits] = (codeLength << 9) | symbol, or 0 for long codes
+	unsigned short fast[WBINF__FAST_SIZE];
+	// canonical decoding for the slow path
+	unsigned short firstCode[17];
+	unsigned short firstSymbol[17];
+	int maxCode[18];
+	unsigned char sizes[288];
+	unsigned short symbols[288];
+} wbinf__Huffman;
+
+typedef struct
+{
+	const unsigned char* src;
+	const unsigned char* srcEnd;
+	unsigned long long bits;
+	int bitCount;
+	int overrun;
+
+	unsigned char* dst;
+	unsigned char* dstStart;
+	unsigned char* dstEnd;
+
+	wbinf__Huffman lengths;
+	wbinf__Huffman distances;
+} wbinf__State;
+
+static const unsigned short wbinf__lengthBase[31] = {
+	3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+	35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258, 0, 0
+};
+
+static const unsigned char wbinf__lengthExtra[31] = {
+	0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+	3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0, 0, 0
+};
+
+static const unsigned short wbinf__distBase[32] = {
+	1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+	257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145,
+	8193, 12289, 16385, 24577, 0, 0
+};
+
+static const unsigned char wbinf__distExtra[32] = {
+	0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+	7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13, 0, 0
+};
+
+static inline
+void wbinf__refill(wbinf__State* s)
+{
+	while(s->bitCount <= 56) {
+		if(s->src >= s->srcEnd) {
+			// Pretend the stream is padded with zeroes;
+			// we only fail if we actually consume them
+			s->overrun += 8;
+			s->bitCount += 8;
+			continue;
+		}
+		s->bits |= (unsigned long long)*s->src++ << s->bitCount;
+		s->bitCount += 8;
+	}
+}
+
+static inline
+unsigned int wbinf__getBits(wbinf__State* s, int n)
+{
+	if(s->bitCount < n) wbinf__refill(s);
+	unsigned int v = (unsigned int)(s->bits & ((1ull << n) - 1));
+	s->bits >>= n;
+	s->bitCount -= n;
+	return v;
+}
+
+static inline
+int wbinf__reverse(int code, int length)
+{
+	int r = 0;
+	for(int i = 0; i < length; ++i) {
+		r = (r << 1) | (code & 1);
+		code >>= 1;
+	}
+	return r;
+}
+
+static
+int wbinf__buildHuffman(wbinf__Huffman* h, const unsigned char* sizes, int count)
+{
+	int sizeCounts[17];
+	int nextCode[16];
+	memset(sizeCounts, 0, sizeof(sizeCounts));
+	memset(h->fast, 0, sizeof(h->fast));
+
+	for(int i = 0; i < count; ++i) {
+		sizeCounts[sizes[i]]++;
+	}
+	sizeCounts[0] = 0;
+	for(int i = 1; i < 16; ++i) {
+		if(sizeCounts[i] > (1 << i)) return 0;
+	}
+
+	int code = 0, symbol = 0;
+	for(int i = 1; i < 16; ++i) {
+		nextCode[i] = code;
+		h->firstCode[i] = (unsigned short)code;
+		h->firstSymbol[i] = (unsigned short)symbol;
+		code += sizeCounts[i];
+		if(sizeCounts[i] && code - 1 >= (1 << i)) return 0;
+		// maxCode is stored pre-shifted to 16 bits for the slow path
+		h->maxCode[i] = code << (16 - i);
+		code <<= 1;
+		symbol += sizeCounts[i];
+	}
+	h->maxCode[16] = 0x10000;
+
+	for(int i = 0; i < count; ++i) {
+		int length = sizes[i];
+		if(!length) continue;
+		int slot = nextCode[length] - h->firstCode[length] + h->firstSymbol[length];
+		h->sizes[slot] = (unsigned char)length;
+		h->symbols[slot] = (unsigned short)i;
+		if(length <= WB_INFLATE_FAST_BITS) {
+			unsigned short entry = (unsigned short)((length << 9) | i);
+			int j = wbinf__reverse(nextCode[length], length);
+			while(j < WBINF__FAST_SIZE) {
+				h->fast[j] = entry;
+				j += 1 << length;
+			}
+		}
+		nextCode[length]++;
+	}
+	return 1;
+}
+
+static
+int wbinf__decodeSlow(wbinf__State* s, wbinf__Huffman* h)
+{
+	// Codes are packed most-significant-bit first, so flip the
+	// next 16 bits around and compare against the canonical ranges
+	int k = wbinf__reverse((int)(s->bits & 0xFFFF), 16);
+	int length;
+	for(length = WB_INFLATE_FAST_BITS + 1; ; ++length) {
+		if(k < h->maxCode[length]) break;
+	}
+	if(length >= 16) return -1;
+	int slot = (k >> (16 - length)) - h->firstCode[length] + h->firstSymbol[length];
+	if(slot >= 288 || h->sizes[slot] != length) return -1;
+	s->bits >>= length;
+	s->bitCount -= length;
+	return h->symbols[slot];
+}
+
+static inline
+int wbinf__decode(wbinf__State* s, wbinf__Huffman* h)
+{
+	if(s->bitCount < 16) wbinf__refill(s);
+	int entry = h->fast[s->bits & WBINF__FAST_MASK];
+	if(entry) {
+		int length = entry >> 9;
+		s->bits >>= length;
+		s->bitCount -= length;
+		return entry & 511;
+	}
+	return wbinf__decodeSlow(s, h);
+}
+
+static
+int wbinf__readDynamicTables(wbinf__State* s)
+{
+	static const unsigned char order[19] = {
+		16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15
+	};
+	unsigned char codeLengthSizes[19];
+	unsigned char sizes[286 + 32];
+
+	int hlit = wbinf__getBits(s, 5) + 257;
+	int hdist = wbinf__getBits(s, 5) + 1;
+	int hclen = wbinf__getBits(s, 4) + 4;
+
+	memset(codeLengthSizes, 0, sizeof(codeLengthSizes));
+	for(int i = 0; i < hclen; ++i) {
+		codeLengthSizes[order[i]] = (unsigned char)wbinf__getBits(s, 3);
+	}
+
+	wbinf__Huffman codeLengths;
+	if(!wbinf__buildHuffman(&codeLengths, codeLengthSizes, 19)) return 0;
+
+	int n = 0;
+	while(n < hlit + hdist) {
+		int c = wbinf__decode(s, &codeLengths);
+		if(c < 0 || c > 18) return 0;
+		if(c < 16) {
+			sizes[n++] = (unsigned char)c;
+			continue;
+		}
+
+		unsigned char fill = 0;
+		int repeat;
+		if(c == 16) {
+			if(n == 0) return 0;
+			repeat = wbinf__getBits(s, 2) + 3;
+			fill = sizes[n - 1];
+		} else if(c == 17) {
+			repeat = wbinf__getBits(s, 3) + 3;
+		} else {
+			repeat = wbinf__getBits(s, 7) + 11;
+		}
+		if(n + repeat > hlit + hdist) return 0;
+		memset(sizes + n, fill, repeat);
+		n += repeat;
+	}
+
+	if(!wbinf__buildHuffman(&s->lengths, sizes, hlit)) return 0;
+	if(!wbinf__buildHuffman(&s->distances, sizes + hlit, hdist)) return 0;
+	return 1;
+}
+
+static
+void wbinf__buildFixedTables(wbinf__State* s)
+{
+	unsigned char sizes[288];
+	int i = 0;
+	for(; i <= 143; ++i) sizes[i] = 8;
+	for(; i <= 255; ++i) sizes[i] = 9;
+	for(; i <= 279; ++i) sizes[i] = 7;
+	for(; i <= 287; ++i) sizes[i] = 8;
+	wbinf__buildHuffman(&s->lengths, sizes, 288);
+
+	for(i = 0; i < 32; ++i) sizes[i] = 5;
+	wbinf__buildHuffman(&s->distances, sizes, 32);
+}
+
+static
+int wbinf__inflateBlock(wbinf__State* s)
+{
+	for(;;) {
+		int symbol = wbinf__decode(s, &s->lengths);
+		if(symbol < 256) {
+			if(symbol < 0 || s->dst >= s->dstEnd) return 0;
+			*s->dst++ = (unsigned char)symbol;
+			continue;
+		}
+		if(symbol == 256) return 1;
+
+		symbol -= 257;
+		if(symbol >= 29) return 0;
+		int length = wbinf__lengthBase[symbol];
+		if(wbinf__lengthExtra[symbol]) {
+			length += wbinf__getBits(s, wbinf__lengthExtra[symbol]);
+		}
+
+		symbol = wbinf__decode(s, &s->distances);
+		if(symbol < 0 || symbol >= 30) return 0;
+		int dist = wbinf__distBase[symbol];
+		if(wbinf__distExtra[symbol]) {
+			dist += wbinf__getBits(s, wbinf__distExtra[symbol]);
+		}
+
+		if(dist > s->dst - s->dstStart) return 0;
+		if(length > s->dstEnd - s->dst) return 0;
+
+		unsigned char* out = s->dst;
+		const unsigned char* from = out - dist;
+		if(dist >= length) {
+			memcpy(out, from, length);
+		} else if(dist == 1) {
+			memset(out, *from, length);
+		} else {
+			for(int i = 0; i < length; ++i) {
+				out[i] = from[i];
+			}
+		}
+		s->dst += length;
+	}
+}
+
+static
+int wbinf__storedBlock(wbinf__State* s)
+{
+	// Drop to a byte boundary, then hand back any whole
+	// bytes still sitting in the bit buffer
+	wbinf__getBits(s, s->bitCount & 7);
+	unsigned char header[4];
+	for(int i = 0; i < 4; ++i) {
+		header[i] = (unsigned char)wbinf__getBits(s, 8);
+	}
+	int length = header[0] | (header[1] << 8);
+	int nlength = header[2] | (header[3] << 8);
+	if(length != (nlength ^ 0xFFFF)) return 0;
+	if(length > s->dstEnd - s->dst) return 0;
+
+	while(length && s->bitCount >= 8) {
+		*s->dst++ = (unsigned char)wbinf__getBits(s, 8);
+		length--;
+	}
+	if(length > s->srcEnd - s->src) return 0;
+	memcpy(s->dst, s->src, length);
+	s->dst += length;
+	s->src += length;
+	return 1;
+}
+
+// Decodes a raw DEFLATE stream into dst.
+// Returns the number of bytes written, or -1 if the stream
+// is corrupt or doesn't fit in dstSize bytes.
+static
+ptrdiff_t wbInflate(void* dst, ptrdiff_t dstSize, const void* src, ptrdiff_t srcSize)
+{
+	wbinf__State s;
+	s.src = (const unsigned char*)src;
+	s.srcEnd = s.src + srcSize;
+	s.bits = 0;
+	s.bitCount = 0;
+	s.overrun = 0;
+	s.dst = (unsigned char*)dst;
+	s.dstStart = s.dst;
+	s.dstEnd = s.dst + dstSize;
+
+	int final;
+	do {
+		final = wbinf__getBits(&s, 1);
+		int type = wbinf__getBits(&s, 2);
+		int ok = 0;
+		if(type == 0) {
+			ok = wbinf__storedBlock(&s);
+		} else if(type == 1) {
+			wbinf__buildFixedTables(&s);
+			ok = wbinf__inflateBlock(&s);
+		} else if(type == 2) {
+			ok = wbinf__readDynamicTables(&s) && wbinf__inflateBlock(&s);
+		}
+		if(!ok) return -1;
+		// Consuming padding means we ran off the end of the input
+		if(s.overrun > s.bitCount) return -1;
+	} while(!final);
+
+	return s.dst - s.dstStart;
+}
+
+// Decodes a zlib-wrapped stream (2 byte header, DEFLATE data, adler32).
+// The checksum is not verified.
+static
+ptrdiff_t wbInflateZlib(void* dst, ptrdiff_t dstSize, const void* src, ptrdiff_t srcSize)
+{
+	const unsigned char* s = (const unsigned char*)src;
+	if(srcSize < 2) return -1;
+	// Method must be deflate, no preset dictionary
+	if((s[0] & 15) != 8 || (s[1] & 32)) return -1;
+	if(((s[0] << 8) | s[1]) % 31) return -1;
+	return wbInflate(dst, dstSize, s + 2, srcSize - 2);
+}
+
+#endif
+#endif
@@ -0,0 +1,323 @@
+/* wb_jobs.h
+ *
+ * A tiny worker pool.
+ *
+ * Jobs are a function pointer and a data pointer, grouped by
+ * a counter you wait on. Waiting threads run queued jobs
+ * themselves instead of sleeping, so it's fine to wait from
+ * inside a job.
+ *
+ * wjobCounter counter = {0};
+ * for(i = 0; i < count; ++i) {
+ *     wjobAdd(&counter, decodeThing, things + i);
+ * }
+ * wjobWait(&counter);
+ *
+ * Or, from a thread that shouldn't block, check wjobPending(&counter)
+ * every so often until it's 0. A thread that can block briefly, but
+ * not for someone else's long job, can use wjobWaitOwn instead.
+ *
+ * The pool starts itself on first use with one worker per
+ * core, minus one for the calling thread; call wjobStartup
+ * first if you want a different count. The workers live
+ * as long as the process does.
+ *
+ * There's one queue behind one lock, which is plenty for jobs
+ * that each do a decent chunk of work (inflating an array,
+ * decoding an image). Don't use it for tiny jobs.
+ *
+ * The implementation goes in one translation unit, with
+ * WB_JOBS_IMPLEMENTATION defined; wb_fbx does this.
+ *
+ */
+
+#ifndef WB_JOBS_H
+#define WB_JOBS_H
+
+typedef void wjobProc(void* data);
+
+typedef struct
+{
+	volatile long pending;
+	// Every job ever added, for progress bars
+	long added;
+} wjobCounter;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// threadCount <= 0 picks one worker per core, minus one
+void wjobStartup(int threadCount);
+int wjobWorkerCount(void);
+
+void wjobAdd(wjobCounter* counter, wjobProc* proc, void* data);
+void wjobWait(wjobCounter* counter);
+// Like wjobWait, but the only jobs it runs are counter's own, so
+// the render thread can wait on quick jobs while slow ones from
+// elsewhere are queued
+void wjobWaitOwn(wjobCounter* counter);
+
+// How many of counter's jobs haven't finished, and if added isn't
+// NULL, how many were ever added. Never waits or runs jobs, so a
+// render thread can poll it once a frame.
+long wjobPending(wjobCounter* counter, long* added);
+
+#ifdef __cplusplus
+}
+#endif
+
+#ifdef WB_JOBS_IMPLEMENTATION
+#include <stdlib.h>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+typedef CRITICAL_SECTION wjob__Mutex;
+typedef CONDITION_VARIABLE wjob__Cond;
+#define wjob__lock(m) EnterCriticalSection(m)
+#define wjob__unlock(m) LeaveCriticalSection(m)
+#define wjob__wait(c, m) SleepConditionVariableCS(c, m, INFINITE)
+#define wjob__signal(c) WakeConditionVariable(c)
+#define wjob__broadcast(c) WakeAllConditionVariable(c)
+#else
+#include <pthread.h>
+#include <unistd.h>
+typedef pthread_mutex_t wjob__Mutex;
+typedef pthread_cond_t wjob__Cond;
+#define wjob__lock(m) pthread_mutex_lock(m)
+#define wjob__unlock(m) pthread_mutex_unlock(m)
+#define wjob__wait(c, m) pthread_cond_wait(c, m)
+#define wjob__signal(c) pthread_cond_signal(c)
+#define wjob__broadcast(c) pthread_cond_broadcast(c)
+#endif
+
+typedef struct
+{
+	wjobProc* proc;
+	void* data;
+	wjobCounter* counter;
+} wjob__Job;
+
+static struct
+{
+	wjob__Mutex lock;
+	// signalled when jobs are queued
+	wjob__Cond work;
+	// signalled when a counter reaches zero
+	wjob__Cond done;
+
+	wjob__Job* jobs;
+	long capacity, head, count;
+
+	int requestedThreads;
+	int workerCount;
+} wjob__pool;
+
+static
+int wjob__pop(wjob__Job* job)
+{
+	if(wjob__pool.count == 0) return 0;
+	*job = wjob__pool.jobs[wjob__pool.head];
+	wjob__pool.head = (wjob__pool.head + 1) % wjob__pool.capacity;
+	wjob__pool.count--;
+	return 1;
+}
+
+// The oldest of counter's queued jobs, taken out from wherever
+// it sits; the rest keep their order
+static
+int wjob__popOwn(wjob__Job* job, wjobCounter* counter)
+{
+	long i = 0;
+	while(i < wjob__pool.count && 
+			wjob__pool.jobs[(wjob__pool.head + i) % wjob__pool.capacity].counter != counter) {
+		++i;
+	}
+	if(i == wjob__pool.count) return 0;
+	*job = wjob__pool.jobs[(wjob__pool.head + i) % wjob__pool.capacity];
+	for(; i + 1 < wjob__pool.count; ++i) {
+		wjob__pool.jobs[(wjob__pool.head + i) % wjob__pool.capacity] = 
+			wjob__pool.jobs[(wjob__pool.head + i + 1) % wjob__pool.capacity];
+	}
+	wjob__pool.count--;
+	return 1;
+}
+
+// Call with the lock held; drops it while the job runs
+static
+void wjob__run(wjob__Job* job)
+{
+	wjob__unlock(&wjob__pool.lock);
+	job->proc(job->data);
+	wjob__lock(&wjob__pool.lock);
+	if(--job->counter->pending == 0) {
+		wjob__broadcast(&wjob__pool.done);
+	}
+}
+
+#ifdef _WIN32
+static
+DWORD WINAPI wjob__worker(void* unused)
+#else
+static
+void* wjob__worker(void* unused)
+#endif
+{
+	wjob__Job job;
+	wjob__lock(&wjob__pool.lock);
+	for(;;) {
+		while(!wjob__pop(&job)) {
+			wjob__wait(&wjob__pool.work, &wjob__pool.lock);
+		}
+		wjob__run(&job);
+	}
+	return 0;
+}
+
+static
+int wjob__coreCount(void)
+{
+#ifdef _WIN32
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	return (int)info.dwNumberOfProcessors;
+#else
+	long n = sysconf(_SC_NPROCESSORS_ONLN);
+	return n > 0 ? (int)n : 1;
+#endif
+}
+
+static
+void wjob__init(void)
+{
+	int count = wjob__pool.requestedThreads;
+	if(count <= 0) count = wjob__coreCount() - 1;
+	if(count < 1) count = 1;
+
+#ifdef _WIN32
+	InitializeCriticalSection(&wjob__pool.lock);
+	InitializeConditionVariable(&wjob__pool.work);
+	InitializeConditionVariable(&wjob__pool.done);
+#else
+	pthread_mutex_init(&wjob__pool.lock, NULL);
+	pthread_cond_init(&wjob__pool.work, NULL);
+	pthread_cond_init(&wjob__pool.done, NULL);
+#endif
+
+	wjob__pool.capacity = 256;
+	wjob__pool.jobs = (wjob__Job*)malloc(sizeof(wjob__Job) * wjob__pool.capacity);
+
+	for(int i = 0; i < count; ++i) {
+#ifdef _WIN32
+		HANDLE thread = CreateThread(NULL, 0, wjob__worker, NULL, 0, NULL);
+		if(!thread) break;
+		CloseHandle(thread);
+#else
+		pthread_t thread;
+		if(pthread_create(&thread, NULL, wjob__worker, NULL) != 0) break;
+		pthread_detach(thread);
+#endif
+		wjob__pool.workerCount++;
+	}
+}
+
+#ifdef _WIN32
+static INIT_ONCE wjob__once = INIT_ONCE_STATIC_INIT;
+static
+BOOL CALLBACK wjob__initOnce(PINIT_ONCE once, void* param, void** context)
+{
+	wjob__init();
+	return TRUE;
+}
+#define wjob__ensureStarted() InitOnceExecuteOnce(&wjob__once, wjob__initOnce, NULL, NULL)
+#else
+static pthread_once_t wjob__once = PTHREAD_ONCE_INIT;
+#define wjob__ensureStarted() pthread_once(&wjob__once, wjob__init)
+#endif
+
+void wjobStartup(int threadCount)
+{
+	wjob__pool.requestedThreads = threadCount;
+	wjob__ensureStarted();
+}
+
+int wjobWorkerCount(void)
+{
+	wjob__ensureStarted();
+	return wjob__pool.workerCount;
+}
+
+void wjobAdd(wjobCounter* counter, wjobProc* proc, void* data)
+{
+	wjob__ensureStarted();
+	wjob__lock(&wjob__pool.lock);
+	if(wjob__pool.count == wjob__pool.capacity) {
+		// Unroll the ring into a bigger buffer
+		long capacity = wjob__pool.capacity * 2;
+		wjob__Job* jobs = (wjob__Job*)malloc(sizeof(wjob__Job) * capacity);
+		for(long i = 0; i < wjob__pool.count; ++i) {
+			jobs[i] = wjob__pool.jobs[(wjob__pool.head + i) % wjob__pool.capacity];
+		}
+		free(wjob__pool.jobs);
+		wjob__pool.jobs = jobs;
+		wjob__pool.capacity = capacity;
+		wjob__pool.head = 0;
+	}
+
+	wjob__Job* job = wjob__pool.jobs +
+		(wjob__pool.head + wjob__pool.count) % wjob__pool.capacity;
+	job->proc = proc;
+	job->data = data;
+	job->counter = counter;
+	wjob__pool.count++;
+	counter->pending++;
+	counter->added++;
+	wjob__signal(&wjob__pool.work);
+	wjob__unlock(&wjob__pool.lock);
+}
+
+void wjobWait(wjobCounter* counter)
+{
+	wjob__Job job;
+	wjob__ensureStarted();
+	wjob__lock(&wjob__pool.lock);
+	while(counter->pending > 0) {
+		if(wjob__pop(&job)) {
+			wjob__run(&job);
+		} else {
+			wjob__wait(&wjob__pool.done, &wjob__pool.lock);
+		}
+	}
+	wjob__unlock(&wjob__pool.lock);
+}
+
+void wjobWaitOwn(wjobCounter* counter)
+{
+	wjob__Job job;
+	wjob__ensureStarted();
+	wjob__lock(&wjob__pool.lock);
+	while(counter->pending > 0) {
+		if(wjob__popOwn(&job, counter)) {
+			wjob__run(&job);
+		} else {
+			wjob__wait(&wjob__pool.done, &wjob__pool.lock);
+		}
+	}
+	wjob__unlock(&wjob__pool.lock);
+}
+
+long wjobPending(wjobCounter* counter, long* added)
+{
+	wjob__ensureStarted();
+	wjob__lock(&wjob__pool.lock);
+	long pending = counter->pending;
+	if(added) *added = counter->added;
+	wjob__unlock(&wjob__pool.lock);
+	return pending;
+}
+
+#endif
+#endif
@@ -0,0 +1,1874 @@
+/* wb_mesh.h
+ *
+ * Mesh processing for the model baker: the stuff that happens
+ * between reading a file and having buffers worth uploading.
+ *
+ * Nothing in here knows about FBX, or about any particular
+ * vertex layout; vertices are opaque blobs of `stride` bytes,
+ * and positions are read from the first three floats of each.
+ * Indices are always 32-bit triangle lists.
+ *
+ * The usual order for a freshly loaded mesh is weld, then
+ * wmeshOptimizeVertexCache, then wmeshOptimizeVertexFetch.
+ *
+ * Like wb_jobs.h, the implementation goes in one translation
+ * unit with WB_MESH_IMPLEMENTATION defined; wb_fbx does this.
+ *
+ */
+
+#ifndef WB_MESH_H
+#define WB_MESH_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Vertex welding
+//
+// Finds the unique vertices in a stream, comparing all stride bytes
+// of each. remap[i] gets the new index of vertex i, with unique
+// vertices kept in the order they were first seen.
+// Returns the unique vertex count. stride must be a multiple of 4.
+ptrdiff_t wmeshWeld(
+		unsigned int* remap,
+		const void* vertices,
+		ptrdiff_t count,
+		ptrdiff_t stride);
+
+// Moves each vertex to remap[i]; dst needs room for the unique count.
+// dst can be the same buffer as src.
+void wmeshRemapVertices(
+		void* dst,
+		const void* src,
+		ptrdiff_t count,
+		ptrdiff_t stride,
+		const unsigned int* remap);
+
+// Polygon triangulation
+//
+// Splits one polygon of count corners (vertices stride bytes apart)
+// into count - 2 triangles, writing corner numbers 0..count-1 to dst
+// with the polygon's winding. Triangles and quads are done on the
+// spot, quads along their shorter diagonal unless that one folds;
+// anything bigger is ear clipped in the plane of its Newell normal.
+//
+// scratch needs wmeshPolygonScratchSize(count) bytes, so one buffer
+// sized for the biggest polygon does a whole mesh.
+// Returns the triangle count, 0 for fewer than 3 corners.
+#define wmeshPolygonScratchSize(count) ((ptrdiff_t)(count) * 16)
+ptrdiff_t wmeshTriangulatePolygon(
+		unsigned int* dst,
+		const void* vertices,
+		ptrdiff_t count,
+		ptrdiff_t stride,
+		void* scratch);
+
+// Tangent generation
+//
+// MikkTSpace-style tangents (Mikkelsen 2008), so normal maps baked
+// by the usual tools come out right. dst gets four floats for every
+// index, one tangent per triangle corner: xyz is the tangent, and w is
+// the bitangent's sign, so bitangent = w * cross(normal, tangent).
+//
+// Each triangle's UV-space tangent is projected onto a corner's normal
+// and weighted by that corner's angle, then summed with every other
+// corner on the same vertex and of the same handedness. Mirrored UVs
+// meeting at a vertex keep their own tangents, which is why they're
+// per corner: write them into the vertices and weld again. Triangles
+// with no UV area borrow their vertices' tangents.
+//
+// normalOffset and uvOffset are where the normal's three floats and
+// the UV's two start, in bytes, in each vertex.
+void wmeshGenerateTangents(
+		float* dst,
+		const unsigned int* indices,
+		ptrdiff_t indexCount,
+		const void* vertices,
+		ptrdiff_t vertexCount,
+		ptrdiff_t stride,
+		ptrdiff_t normalOffset,
+		ptrdiff_t uvOffset);
+
+// Vertex cache optimization
+//
+// Reorders triangles so vertices get reused while they're still in
+// the GPU's post-transform cache. This is Tipsify (Sander, Nehab and
+// Barczak 2007): it fans around one vertex at a time, picking the next
+// fanning vertex from the ones just emitted, which keeps it linear in
+// the triangle count. cacheSize is the FIFO size to optimize for;
+// pass WMESH_VERTEX_CACHE_SIZE if you don't know better.
+// dst and indices must not overlap.
+#define WMESH_VERTEX_CACHE_SIZE 16
+void wmeshOptimizeVertexCache(
+		unsigned int* dst,
+		const unsigned int* indices,
+		ptrdiff_t indexCount,
+		ptrdiff_t vertexCount,
+		ptrdiff_t cacheSize);
+
+// Vertex fetch optimization
+//
+// Reorders vertices into the order the index buffer first uses them,
+// so vertex fetches walk memory forwards, and rewrites indices to
+// match. Unused vertices are dropped; returns the new vertex count.
+// dst needs room for vertexCount vertices and mustn't overlap vertices.
+ptrdiff_t wmeshOptimizeVertexFetch(
+		void* dst,
+		unsigned int* indices,
+		ptrdiff_t indexCount,
+		const void* vertices,
+		ptrdiff_t vertexCount,
+		ptrdiff_t stride);
+
+typedef struct
+{
+	// Average cache miss ratio: vertex shader runs per triangle,
+	// 0.5 at best for big regular meshes, 3 at worst
+	float acmr;
+	// Average transform to vertex ratio: shader runs per
+	// referenced vertex, 1 is perfect
+	float atvr;
+} wmeshVertexCacheStats;
+
+// Simulates a FIFO post-transform cache of cacheSize entries
+wmeshVertexCacheStats wmeshAnalyzeVertexCache(
+		const unsigned int* indices,
+		ptrdiff_t indexCount,
+		ptrdiff_t vertexCount,
+		ptrdiff_t cacheSize);
+
+// Meshlets
+//
+// Splits a mesh into small clusters that can be culled on their own.
+// Each meshlet lists its vertices (as indices into the mesh's vertex
+// buffer) and its triangles as byte-sized indices into that list.
+// Triangles are grown greedily from their neighbours, preferring ones
+// that add no new vertices and face the same way as the rest, which
+// keeps both the vertex count and the normal cone tight.
+#define WMESH_MESHLET_MAX_VERTICES 64
+#define WMESH_MESHLET_MAX_TRIANGLES 124
+
+typedef struct
+{
+	// Into the meshletVertices and meshletTriangles arrays;
+	// triangleOffset counts bytes, three per triangle
+	unsigned int vertexOffset, triangleOffset;
+	unsigned int vertexCount, triangleCount;
+
+	// Bounding sphere
+	float center[3];
+	float radius;
+
+	// Normal cone: every triangle faces within some angle of the
+	// axis, and coneCutoff is the sine of that angle. A cutoff of
+	// 1 means the cone is too wide to ever backface cull.
+	float coneAxis[3];
+	float coneCutoff;
+} wmeshMeshlet;
+
+// Upper bounds for the arrays wmeshBuildMeshlets fills
+#define wmeshMeshletCountBound(indexCount) ((indexCount) / 3 + 1)
+#define wmeshMeshletVertexBound(indexCount) ((indexCount) + 1)
+#define wmeshMeshletTriangleBound(indexCount) ((indexCount) + 1)
+
+// Returns the meshlet count
+ptrdiff_t wmeshBuildMeshlets(
+		wmeshMeshlet* meshlets,
+		unsigned int* meshletVertices,
+		unsigned char* meshletTriangles,
+		const unsigned int* indices,
+		ptrdiff_t indexCount,
+		const void* vertices,
+		ptrdiff_t vertexCount,
+		ptrdiff_t stride);
+
+// Pulls the six planes (a, b, c, d; inside is ax + by + cz + d >= 0)
+// out of a column-major OpenGL view-projection matrix
+void wmeshFrustumPlanes(float* planes, const float* viewProjection);
+
+// Returns 1 if the meshlet is entirely outside the frustum, or
+// faces away from the camera. Both are in the mesh's space.
+int wmeshCullMeshlet(
+		const wmeshMeshlet* meshlet,
+		const float* cameraPos,
+		const float* planes);
+
+// Simplification
+//
+// Quadric error metric edge collapse (Garland and Heckbert), with
+// attributes folded into the quadrics the way Hoppe's 1999 paper does
+// it. Collapses are half-edge collapses, so the result indexes the same
+// vertex buffer and needs no new vertices; LODs are just index buffers.
+//
+// Borders only collapse along themselves, and attribute seams (two
+// vertices at one position) collapse both sides together, so neither
+// tears open. Anything more tangled than that is left alone.
+//
+// The attributes are attributeCount floats starting attributeOffset
+// bytes into each vertex, each scaled by its weight; a weight of 0
+// ignores that float. Positions are normalized to the mesh's size, so
+// weights are relative to that, and so is the error: *error gets the
+// largest collapse error, as a fraction of the mesh's largest extent.
+//
+// Returns the new index count, which can stay above
+// targetIndexCount if the mesh runs out of safe collapses.
+#define WMESH_SIMPLIFY_MAX_ATTRIBUTES 8
+ptrdiff_t wmeshSimplify(
+		unsigned int* dst,
+		const unsigned int* indices,
+		ptrdiff_t indexCount,
+		const void* vertices,
+		ptrdiff_t vertexCount,
+		ptrdiff_t stride,
+		ptrdiff_t attributeOffset,
+		const float* attributeWeights,
+		ptrdiff_t attributeCount,
+		ptrdiff_t targetIndexCount,
+		float* error);
+
+// Quantization
+//
+// Float to IEEE half, rounding to nearest even; out of range
+// values become infinity
+unsigned short wmeshQuantizeHalf(float v);
+float wmeshDequantizeHalf(unsigned short h);
+
+// Octahedral normal encoding, as two snorm16s: the unit sphere is
+// folded onto an octahedron and flattened into a square. Angular
+// error is well under a hundredth of a degree. n doesn't have to be
+// normalized; a zero vector comes back as +z.
+void wmeshEncodeOctahedral(short* dst, const float* n);
+void wmeshDecodeOctahedral(float* dst, const short* e);
+
+// Tangents in 16 bits, as an angle around the normal: bits 0-13 are
+// the angle from the first axis of an orthonormal basis built from the
+// normal (Duff et al. 2017), bit 14 says which of the basis' two
+// hemispheres that was, and bit 15 is set when the bitangent sign is
+// negative. Pass the normal the decoder will see, ie the octahedral
+// one, so both build the same basis. tangent needn't be normalized.
+unsigned short wmeshEncodeTangent(const float* normal, const float* tangent);
+// dst gets the unit tangent, and the bitangent sign in dst[3]
+void wmeshDecodeTangent(float* dst, const float* normal, unsigned short e);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
+
+// wb_fbx.cc includes this header twice, once for the types and once
+// for the implementation, so the implementation gets its own guard
+#if defined(WB_MESH_IMPLEMENTATION) && !defined(WB_MESH_IMPLEMENTED)
+#define WB_MESH_IMPLEMENTED
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef wmeshMalloc
+#define wmeshMalloc(size) malloc(size)
+#define wmeshFree(ptr) free(ptr)
+#endif
+
+typedef unsigned int wmesh__u32;
+
+static inline
+wmesh__u32 wmesh__hashVertex(const unsigned char* v, ptrdiff_t stride)
+{
+	// murmur3's block mix, a word at a time
+	wmesh__u32 h = 0x9747b28c;
+	for(ptrdiff_t i = 0; i < stride; i += 4) {
+		wmesh__u32 k;
+		memcpy(&k, v + i, 4);
+		k *= 0xcc9e2d51;
+		k = (k << 15) | (k >> 17);
+		k *= 0x1b873593;
+		h ^= k;
+		h = (h << 13) | (h >> 19);
+		h = h * 5 + 0xe6546b64;
+	}
+	h ^= h >> 16;
+	h *= 0x85ebca6b;
+	h ^= h >> 13;
+	return h;
+}
+
+ptrdiff_t wmeshWeld(
+		unsigned int* remap,
+		const void* vertices,
+		ptrdiff_t count,
+		ptrdiff_t stride)
+{
+	const unsigned char* base = (const unsigned char*)vertices;
+
+	// Open addressing with linear probing, at most half full.
+	// Each slot keeps the hash next to the vertex index, so most
+	// probes are settled without touching the vertex data at all.
+	ptrdiff_t capacity = 16;
+	while(capacity < count * 2) capacity *= 2;
+	ptrdiff_t mask = capacity - 1;
+
+	wmesh__u32* table = (wmesh__u32*)wmeshMalloc(sizeof(wmesh__u32) * 2 * capacity);
+	memset(table, 0xFF, sizeof(wmesh__u32) * 2 * capacity);
+	// The unique vertex each new index came from
+	wmesh__u32* firsts = (wmesh__u32*)wmeshMalloc(sizeof(wmesh__u32) * (count + 1));
+
+	ptrdiff_t unique = 0;
+	for(ptrdiff_t i = 0; i < count; ++i) {
+		const unsigned char* v = base + i * stride;
+		wmesh__u32 hash = wmesh__hashVertex(v, stride);
+		ptrdiff_t slot = hash & mask;
+		for(;;) {
+			wmesh__u32* entry = table + slot * 2;
+			if(entry[1] == 0xFFFFFFFF) {
+				entry[0] = hash;
+				entry[1] = (wmesh__u32)unique;
+				firsts[unique] = (wmesh__u32)i;
+				remap[i] = (wmesh__u32)unique++;
+				break;
+			}
+			if(entry[0] == hash &&
+					memcmp(base + (ptrdiff_t)firsts[entry[1]] * stride, v, stride) == 0) {
+				remap[i] = entry[1];
+				break;
+			}
+			slot = (slot + 1) & mask;
+		}
+	}
+
+	wmeshFree(firsts);
+	wmeshFree(table);
+	return unique;
+}
+
+void wmeshRemapVertices(
+		void* dst,
+		const void* src,
+		ptrdiff_t count,
+		ptrdiff_t stride,
+		const unsigned int* remap)
+{
+	// Welded remaps only ever move vertices towards the front,
+	// and the first copy of each lands first, so this is safe in place
+	for(ptrdiff_t i = 0; i < count; ++i) {
+		unsigned char* d = (unsigned char*)dst + (ptrdiff_t)remap[i] * stride;
+		const unsigned char* s = (const unsigned char*)src + i * stride;
+		if(d != s) memmove(d, s, stride);
+	}
+}
+
+static inline
+float wmesh__cross2(const float* o, const float* a, const float* b)
+{
+	return (a[0] - o[0]) * (b[1] - o[1]) - (a[1] - o[1]) * (b[0] - o[0]);
+}
+
+ptrdiff_t wmeshTriangulatePolygon(
+		unsigned int* dst,
+		const void* vertices,
+		ptrdiff_t count,
+		ptrdiff_t stride,
+		void* scratch)
+{
+	const unsigned char* base = (const unsigned char*)vertices;
+	if(count < 3) return 0;
+	if(count == 3) {
+		dst[0] = 0;
+		dst[1] = 1;
+		dst[2] = 2;
+		return 1;
+	}
+
+	float p[4][3];
+	if(count == 4) {
+		for(int i = 0; i < 4; ++i) memcpy(p[i], base + i * stride, sizeof(p[i]));
+		float d02 = 0, d13 = 0;
+		for(int k = 0; k < 3; ++k) {
+			d02 += (p[2][k] - p[0][k]) * (p[2][k] - p[0][k]);
+			d13 += (p[3][k] - p[1][k]) * (p[3][k] - p[1][k]);
+		}
+		// On a concave quad one diagonal runs outside, and the two
+		// triangles it makes face opposite ways
+		float e1[3], e2[3], e3[3], n1[3], n2[3];
+		for(int k = 0; k < 3; ++k) {
+			e1[k] = p[1][k] - p[0][k];
+			e2[k] = p[2][k] - p[0][k];
+			e3[k] = p[3][k] - p[0][k];
+		}
+		n1[0] = e1[1] * e2[2] - e1[2] * e2[1];
+		n1[1] = e1[2] * e2[0] - e1[0] * e2[2];
+		n1[2] = e1[0] * e2[1] - e1[1] * e2[0];
+		n2[0] = e2[1] * e3[2] - e2[2] * e3[1];
+		n2[1] = e2[2] * e3[0] - e2[0] * e3[2];
+		n2[2] = e2[0] * e3[1] - e2[1] * e3[0];
+		int folds02 = n1[0] * n2[0] + n1[1] * n2[1] + n1[2] * n2[2] < 0;
+
+		static const unsigned int split02[6] = {0, 1, 2, 0, 2, 3};
+		static const unsigned int split13[6] = {0, 1, 3, 1, 2, 3};
+		memcpy(dst, (d02 <= d13 && !folds02) ? split02 : split13, sizeof(split02));
+		return 2;
+	}
+
+	// Newell's normal, then drop its biggest axis to get a 2D polygon
+	float normal[3] = {0, 0, 0};
+	for(ptrdiff_t i = 0; i < count; ++i) {
+		float a[3], b[3];
+		memcpy(a, base + i * stride, sizeof(a));
+		memcpy(b, base + ((i + 1) % count) * stride, sizeof(b));
+		normal[0] += (a[1] - b[1]) * (a[2] + b[2]);
+		normal[1] += (a[2] - b[2]) * (a[0] + b[0]);
+		normal[2] += (a[0] - b[0]) * (a[1] + b[1]);
+	}
+	float ax = normal[0] < 0 ? -normal[0] : normal[0];
+	float ay = normal[1] < 0 ? -normal[1] : normal[1];
+	float az = normal[2] < 0 ? -normal[2] : normal[2];
+	int u = 1, v = 2;
+	float facing = normal[0];
+	if(ay > ax && ay >= az) {
+		u = 2;
+		v = 0;
+		facing = normal[1];
+	} else if(az > ax && az > ay) {
+		u = 0;
+		v = 1;
+		facing = normal[2];
+	}
+
+	float* points = (float*)scratch;
+	wmesh__u32* next = (wmesh__u32*)(points + count * 2);
+	wmesh__u32* prev = next + count;
+	for(ptrdiff_t i = 0; i < count; ++i) {
+		const float* q = (const float*)(base + i * stride);
+		points[i * 2] = q[u];
+		// Mirror it if needed so the polygon always winds counterclockwise
+		points[i * 2 + 1] = facing < 0 ? -q[v] : q[v];
+		next[i] = (wmesh__u32)((i + 1) % count);
+		prev[i] = (wmesh__u32)((i + count - 1) % count);
+	}
+
+	// Clip ears until a triangle is left. An ear is a convex corner
+	// with no other corner inside it; if a full lap finds none (the
+	// polygon is self-intersecting or degenerate), clip one anyway.
+	ptrdiff_t written = 0, remaining = count;
+	wmesh__u32 corner = 0, lap = 0;
+	while(remaining > 3) {
+		wmesh__u32 a = prev[corner], b = corner, c = next[corner];
+		const float* pa = points + a * 2;
+		const float* pb = points + b * 2;
+		const float* pc = points + c * 2;
+		int ear = wmesh__cross2(pa, pb, pc) > 0;
+		for(wmesh__u32 j = next[c]; ear && j != a; j = next[j]) {
+			const float* pj = points + j * 2;
+			// Corners sitting exactly on the ear's corners don't count
+			if((pj[0] == pa[0] && pj[1] == pa[1]) ||
+					(pj[0] == pb[0] && pj[1] == pb[1]) ||
+					(pj[0] == pc[0] && pj[1] == pc[1])) {
+				continue;
+			}
+			ear = !(wmesh__cross2(pa, pb, pj) >= 0 &&
+					wmesh__cross2(pb, pc, pj) >= 0 &&
+					wmesh__cross2(pc, pa, pj) >= 0);
+		}
+
+		if(!ear && lap < remaining) {
+			corner = c;
+			lap++;
+			continue;
+		}
+
+		dst[written * 3] = a;
+		dst[written * 3 + 1] = b;
+		dst[written * 3 + 2] = c;
+		written++;
+		next[a] = c;
+		prev[c] = a;
+		remaining--;
+		// Step back so the corner before gets another look
+		corner = a;
+		lap = 0;
+	}
+	dst[written * 3] = prev[corner];
+	dst[written * 3 + 1] = corner;
+	dst[written * 3 + 2] = next[corner];
+	return written + 1;
+}
+
+static inline
+void wmesh__position(float* dst, const void* vertices, ptrdiff_t stride, wmesh__u32 index)
+{
+	memcpy(dst, (const unsigned char*)vertices + (ptrdiff_t)index * stride, sizeof(float) * 3);
+}
+
+static inline
+void wmesh__attribute(float* dst, const void* vertices, ptrdiff_t stride,
+		wmesh__u32 index, ptrdiff_t offset, ptrdiff_t count)
+{
+	memcpy(dst, (const unsigned char*)vertices + (ptrdiff_t)index * stride + offset, 
+			sizeof(float) * count);
+}
+
+// Normalizes v in place and returns its old length
+static inline
+float wmesh__normalize(float* v)
+{
+	float length = sqrtf(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+	if(length > 0) {
+		float scale = 1 / length;
+		v[0] *= scale;
+		v[1] *= scale;
+		v[2] *= scale;
+	}
+	return length;
+}
+
+// acos to within 7e-5 radians (Abramowitz and Stegun 4.4.45), which
+// is plenty for weighting; acosf was most of wmeshGenerateTangents
+static inline
+float wmesh__acos(float x)
+{
+	float a = x < 0 ? -x : x;
+	if(a > 1) a = 1;
+	float r = sqrtf(1 - a) * (1.5707288f + a * (-0.2121144f + a * (0.0742610f - 0.0187293f * a)));
+	return x < 0 ? 3.14159265f - r : r;
+}
+
+// v minus its component along the unit vector n
+static inline
+void wmesh__reject(float* dst, const float* v, const float* n)
+{
+	float d = v[0] * n[0] + v[1] * n[1] + v[2] * n[2];
+	dst[0] = v[0] - n[0] * d;
+	dst[1] = v[1] - n[1] * d;
+	dst[2] = v[2] - n[2] * d;
+}
+
+// Orthonormal basis around the unit vector n, from "Building an
+// Orthonormal Basis, Revisited" (Duff et al. 2017). s picks the
+// hemisphere the formula is built for; it only breaks down at n.z == -s.
+static inline
+void wmesh__basis(float* b1, float* b2, const float* n, float s)
+{
+	float a = -1 / (s + n[2]);
+	float b = n[0] * n[1] * a;
+	b1[0] = 1 + s * n[0] * n[0] * a;
+	b1[1] = s * b;
+	b1[2] = -s * n[0];
+	b2[0] = b;
+	b2[1] = s + n[1] * n[1] * a;
+	b2[2] = -n[1];
+}
+
+void wmeshGenerateTangents(
+		float* dst,
+		const unsigned int* indices,
+		ptrdiff_t indexCount,
+		const void* vertices,
+		ptrdiff_t vertexCount,
+		ptrdiff_t stride,
+		ptrdiff_t normalOffset,
+		ptrdiff_t uvOffset)
+{
+	ptrdiff_t triangleCount = indexCount / 3;
+
+	// Per vertex, a running sum for each handedness: xyz, then
+	// whether anything went into it
+	float* sums = (float*)wmeshMalloc(sizeof(float) * 8 * (vertexCount + 1));
+	memset(sums, 0, sizeof(float) * 8 * (vertexCount + 1));
+	// Each triangle's handedness, or 0 when it has no UV area
+	signed char* sides = (signed char*)wmeshMalloc(triangleCount + 1);
+
+	for(ptrdiff_t t = 0; t < triangleCount; ++t) {
+		const unsigned int* tri = indices + t * 3;
+		float p[3][3], uv[3][2];
+		for(ptrdiff_t c = 0; c < 3; ++c) {
+			wmesh__position(p[c], vertices, stride, tri[c]);
+			wmesh__attribute(uv[c], vertices, stride, tri[c], uvOffset, 2);
+		}
+		float d1[3] = {p[1][0] - p[0][0], p[1][1] - p[0][1], p[1][2] - p[0][2]};
+		float d2[3] = {p[2][0] - p[0][0], p[2][1] - p[0][1], p[2][2] - p[0][2]};
+		float s1[2] = {uv[1][0] - uv[0][0], uv[1][1] - uv[0][1]};
+		float s2[2] = {uv[2][0] - uv[0][0], uv[2][1] - uv[0][1]};
+
+		// The tangent is dP/du, which is this over the UV area; only
+		// the area's sign matters once it gets normalized
+		float area = s1[0] * s2[1] - s1[1] * s2[0];
+		float side = area >= 0 ? 1.0f : -1.0f;
+		float tangent[3];
+		for(ptrdiff_t i = 0; i < 3; ++i) {
+			tangent[i] = (s2[1] * d1[i] - s1[1] * d2[i]) * side;
+		}
+		sides[t] = 0;
+		if(area == 0 || wmesh__normalize(tangent) == 0) continue;
+		sides[t] = area > 0 ? 1 : -1;
+
+		for(ptrdiff_t c = 0; c < 3; ++c) {
+			float n[3];
+			wmesh__attribute(n, vertices, stride, tri[c], normalOffset, 3);
+			wmesh__normalize(n);
+
+			float projected[3];
+			wmesh__reject(projected, tangent, n);
+			if(wmesh__normalize(projected) == 0) continue;
+
+			// The corner's angle, measured in the normal's plane
+			const float* o = p[c];
+			const float* a = p[(c + 1) % 3];
+			const float* b = p[(c + 2) % 3];
+			float ea[3] = {a[0] - o[0], a[1] - o[1], a[2] - o[2]};
+			float eb[3] = {b[0] - o[0], b[1] - o[1], b[2] - o[2]};
+			wmesh__reject(ea, ea, n);
+			wmesh__reject(eb, eb, n);
+			float lengths = (ea[0] * ea[0] + ea[1] * ea[1] + ea[2] * ea[2]) *
+				(eb[0] * eb[0] + eb[1] * eb[1] + eb[2] * eb[2]);
+			if(lengths == 0) continue;
+			float angle = wmesh__acos((ea[0] * eb[0] + ea[1] * eb[1] + ea[2] * eb[2]) / sqrtf(lengths));
+
+			float* sum = sums + tri[c] * 8 + (sides[t] > 0 ? 0 : 4);
+			sum[0] += projected[0] * angle;
+			sum[1] += projected[1] * angle;
+			sum[2] += projected[2] * angle;
+			sum[3] = 1;
+		}
+	}
+
+	for(ptrdiff_t i = 0; i < triangleCount * 3; ++i) {
+		wmesh__u32 v = indices[i];
+		float* positive = sums + v * 8;
+		float* negative = positive + 4;
+
+		// Corners take their own side's sum; ones off flat-UV
+		// triangles take whichever side their vertex has
+		int side = sides[i / 3];
+		if(side == 0) side = positive[3] != 0 || negative[3] == 0 ? 1 : -1;
+		float* sum = side > 0 ? positive : negative;
+
+		float* out = dst + i * 4;
+		out[0] = sum[0];
+		out[1] = sum[1];
+		out[2] = sum[2];
+		out[3] = (float)side;
+		if(wmesh__normalize(out) == 0) {
+			// Nothing to go on; any tangent will do
+			float n[3], other[3];
+			wmesh__attribute(n, vertices, stride, v, normalOffset, 3);
+			if(wmesh__normalize(n) == 0) n[2] = 1;
+			wmesh__basis(out, other, n, n[2] >= 0 ? 1.0f : -1.0f);
+		}
+	}
+	for(ptrdiff_t i = triangleCount * 3; i < indexCount; ++i) {
+		dst[i * 4] = 1;
+		dst[i * 4 + 1] = dst[i * 4 + 2] = 0;
+		dst[i * 4 + 3] = 1;
+	}
+
+	wmeshFree(sides);
+	wmeshFree(sums);
+}
+
+// Vertex -> triangle adjacency, as one flat array with per-vertex offsets
+typedef struct
+{
+	wmesh__u32* counts;
+	wmesh__u32* offsets;
+	wmesh__u32* triangles;
+} wmesh__Adjacency;
+
+static
+void wmesh__buildAdjacency(wmesh__Adjacency* adj,
+		const unsigned int* indices, ptrdiff_t indexCount, ptrdiff_t vertexCount)
+{
+	ptrdiff_t triangleCount = indexCount / 3;
+	adj->counts = (wmesh__u32*)wmeshMalloc(sizeof(wmesh__u32) * (vertexCount + 1));
+	adj->offsets = (wmesh__u32*)wmeshMalloc(sizeof(wmesh__u32) * (vertexCount + 1));
+	adj->triangles = (wmesh__u32*)wmeshMalloc(sizeof(wmesh__u32) * (triangleCount * 3 + 1));
+	memset(adj->counts, 0, sizeof(wmesh__u32) * vertexCount);
+
+	for(ptrdiff_t i = 0; i < triangleCount * 3; ++i) {
+		adj->counts[indices[i]]++;
+	}
+	wmesh__u32 offset = 0;
+	for(ptrdiff_t v = 0; v < vertexCount; ++v) {
+		adj->offsets[v] = offset;
+		offset += adj->counts[v];
+	}
+	// Fill using offsets as cursors, then walk them back
+	for(ptrdiff_t i = 0; i < triangleCount * 3; ++i) {
+		adj->triangles[adj->offsets[indices[i]]++] = (wmesh__u32)(i / 3);
+	}
+	for(ptrdiff_t v = 0; v < vertexCount; ++v) {
+		adj->offsets[v] -= adj->counts[v];
+	}
+	adj->offsets[vertexCount] = offset;
+}
+
+static
+void wmesh__freeAdjacency(wmesh__Adjacency* adj)
+{
+	wmeshFree(adj->triangles);
+	wmeshFree(adj->offsets);
+	wmeshFree(adj->counts);
+}
+
+void wmeshOptimizeVertexCache(
+		unsigned int* dst,
+		const unsigned int* indices,
+		ptrdiff_t indexCount,
+		ptrdiff_t vertexCount,
+		ptrdiff_t cacheSize)
+{
+	ptrdiff_t triangleCount = indexCount / 3;
+	if(triangleCount == 0 || vertexCount == 0) return;
+
+	wmesh__Adjacency adj;
+	wmesh__buildAdjacency(&adj, indices, indexCount, vertexCount);
+
+	// live is how many unemitted triangles still use each vertex;
+	// adj.counts gets reused for it
+	wmesh__u32* live = adj.counts;
+	wmesh__u32* cacheTime = (wmesh__u32*)wmeshMalloc(sizeof(wmesh__u32) * vertexCount);
+	unsigned char* emitted = (unsigned char*)wmeshMalloc(triangleCount);
+	// Every emitted vertex gets pushed here. The ones pushed by the
+	// current fan double as the candidates for the next fanning vertex.
+	wmesh__u32* deadEnd = (wmesh__u32*)wmeshMalloc(sizeof(wmesh__u32) * triangleCount * 3);
+	memset(cacheTime, 0, sizeof(wmesh__u32) * vertexCount);
+	memset(emitted, 0, triangleCount);
+
+	ptrdiff_t deadEndTop = 0;
+	ptrdiff_t cursor = 0;
+	ptrdiff_t written = 0;
+	wmesh__u32 time = (wmesh__u32)cacheSize + 1;
+	ptrdiff_t fan = 0;
+
+	while(fan >= 0) {
+		ptrdiff_t candidates = deadEndTop;
+		const wmesh__u32* tris = adj.triangles + adj.offsets[fan];
+		ptrdiff_t triCount = adj.offsets[fan + 1] - adj.offsets[fan];
+
+		for(ptrdiff_t t = 0; t < triCount; ++t) {
+			wmesh__u32 tri = tris[t];
+			if(emitted[tri]) continue;
+			emitted[tri] = 1;
+			for(ptrdiff_t k = 0; k < 3; ++k) {
+				wmesh__u32 v = indices[tri * 3 + k];
+				dst[written++] = v;
+				deadEnd[deadEndTop++] = v;
+				live[v]--;
+				if(time - cacheTime[v] > (wmesh__u32)cacheSize) {
+					cacheTime[v] = time++;
+				}
+			}
+		}
+
+		// Next fan: the candidate that'll still be in the cache after
+		// its remaining triangles are emitted, and has been there longest
+		fan = -1;
+		wmesh__u32 bestPriority = 0;
+		for(ptrdiff_t c = candidates; c < deadEndTop; ++c) {
+			wmesh__u32 v = deadEnd[c];
+			if(live[v] == 0) continue;
+			wmesh__u32 priority = 0;
+			if(time - cacheTime[v] + 2 * live[v] <= (wmesh__u32)cacheSize) {
+				priority = time - cacheTime[v];
+			}
+			if(fan < 0 || priority > bestPriority) {
+				bestPriority = priority;
+				fan = v;
+			}
+		}
+
+		// Dead end: back up through recently used vertices,
+		// then fall back to the next unfinished one in order
+		while(fan < 0 && deadEndTop > 0) {
+			wmesh__u32 v = deadEnd[--deadEndTop];
+			if(live[v] > 0) fan = v;
+		}
+		while(fan < 0 && cursor < vertexCount) {
+			if(live[cursor] > 0) fan = cursor;
+			cursor++;
+		}
+	}
+
+	wmeshFree(deadEnd);
+	wmeshFree(emitted);
+	wmeshFree(cacheTime);
+	wmesh__freeAdjacency(&adj);
+}
+
+ptrdiff_t wmeshOptimizeVertexFetch(
+		void* dst,
+		unsigned int* indices,
+		ptrdiff_t indexCount,
+		const void* vertices,
+		ptrdiff_t vertexCount,
+		ptrdiff_t stride)
+{
+	wmesh__u32* remap = (wmesh__u32*)wmeshMalloc(sizeof(wmesh__u32) * (vertexCount + 1));
+	memset(remap, 0xFF, sizeof(wmesh__u32) * vertexCount);
+
+	ptrdiff_t next = 0;
+	for(ptrdiff_t i = 0; i < indexCount; ++i) {
+		wmesh__u32 v = indices[i];
+		if(remap[v] == 0xFFFFFFFF) {
+			memcpy((unsigned char*)dst + next * stride,
+					(const unsigned char*)vertices + (ptrdiff_t)v * stride, stride);
+			remap[v] = (wmesh__u32)next++;
+		}
+		indices[i] = remap[v];
+	}
+
+	wmeshFree(remap);
+	return next;
+}
+
+wmeshVertexCacheStats wmeshAnalyzeVertexCache(
+		const unsigned int* indices,
+		ptrdiff_t indexCount,
+		ptrdiff_t vertexCount,
+		ptrdiff_t cacheSize)
+{
+	wmeshVertexCacheStats stats = {0, 0};
+	if(indexCount < 3 || vertexCount == 0) return stats;
+
+	// A vertex is in the FIFO if fewer than cacheSize misses
+	// happened since it was last loaded
+	wmesh__u32* loadedAt = (wmesh__u32*)wmeshMalloc(sizeof(wmesh__u32) * vertexCount);
+	unsigned char* used = (unsigned char*)wmeshMalloc(vertexCount);
+	memset(loadedAt, 0, sizeof(wmesh__u32) * vertexCount);
+	memset(used, 0, vertexCount);
+
+	wmesh__u32 misses = 0;
+	ptrdiff_t usedCount = 0;
+	for(ptrdiff_t i = 0; i < indexCount; ++i) {
+		wmesh__u32 v = indices[i];
+		if(!used[v]) {
+			used[v] = 1;
+			usedCount++;
+		} else if(misses - loadedAt[v] < (wmesh__u32)cacheSize) {
+			continue;
+		}
+		misses++;
+		loadedAt[v] = misses;
+	}
+
+	stats.acmr = (float)misses / (float)(indexCount / 3);
+	stats.atvr = (float)misses / (float)usedCount;
+	wmeshFree(used);
+	wmeshFree(loadedAt);
+	return stats;
+}
+
+// Unit normal of a triangle, or zero if it's degenerate
+static
+void wmesh__triangleNormal(float* n, const float* a, const float* b, const float* c)
+{
+	float e0[3] = {b[0] - a[0], b[1] - a[1], b[2] - a[2]};
+	float e1[3] = {c[0] - a[0], c[1] - a[1], c[2] - a[2]};
+	n[0] = e0[1] * e1[2] - e0[2] * e1[1];
+	n[1] = e0[2] * e1[0] - e0[0] * e1[2];
+	n[2] = e0[0] * e1[1] - e0[1] * e1[0];
+	float length = sqrtf(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+	float scale = length > 0 ? 1 / length : 0;
+	n[0] *= scale;
+	n[1] *= scale;
+	n[2] *= scale;
+}
+
+static
+void wmesh__finishMeshlet(wmeshMeshlet* m, const unsigned int* meshletVertices,
+		const float* triangleNormals, const wmesh__u32* meshletTriangleIds,
+		const void* vertices, ptrdiff_t stride)
+{
+	const unsigned int* mv = meshletVertices + m->vertexOffset;
+	float p[3], lo[3], hi[3];
+
+	// Sphere around the box center; not the tightest, but cheap and close
+	wmesh__position(lo, vertices, stride, mv[0]);
+	memcpy(hi, lo, sizeof(hi));
+	for(wmesh__u32 i = 1; i < m->vertexCount; ++i) {
+		wmesh__position(p, vertices, stride, mv[i]);
+		for(int k = 0; k < 3; ++k) {
+			if(p[k] < lo[k]) lo[k] = p[k];
+			if(p[k] > hi[k]) hi[k] = p[k];
+		}
+	}
+	float radius = 0;
+	for(int k = 0; k < 3; ++k) m->center[k] = (lo[k] + hi[k]) * 0.5f;
+	for(wmesh__u32 i = 0; i < m->vertexCount; ++i) {
+		wmesh__position(p, vertices, stride, mv[i]);
+		float dx = p[0] - m->center[0], dy = p[1] - m->center[1], dz = p[2] - m->center[2];
+		float d = dx * dx + dy * dy + dz * dz;
+		if(d > radius) radius = d;
+	}
+	m->radius = sqrtf(radius);
+
+	// Cone axis is the average facing; the cutoff comes from the
+	// triangle furthest from it
+	float axis[3] = {0, 0, 0};
+	for(wmesh__u32 t = 0; t < m->triangleCount; ++t) {
+		const float* n = triangleNormals + meshletTriangleIds[t] * 3;
+		axis[0] += n[0];
+		axis[1] += n[1];
+		axis[2] += n[2];
+	}
+	float length = sqrtf(axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2]);
+	float minDot = 1;
+	if(length > 0) {
+		for(int k = 0; k < 3; ++k) axis[k] /= length;
+		for(wmesh__u32 t = 0; t < m->triangleCount; ++t) {
+			const float* n = triangleNormals + meshletTriangleIds[t] * 3;
+			float d = n[0] * axis[0] + n[1] * axis[1] + n[2] * axis[2];
+			if(d < minDot) minDot = d;
+		}
+	} else {
+		minDot = -1;
+	}
+
+	// Past about 84 degrees, the cone is never going to cull anything
+	if(minDot <= 0.1f) {
+		memset(m->coneAxis, 0, sizeof(m->coneAxis));
+		m->coneCutoff = 1;
+	} else {
+		memcpy(m->coneAxis, axis, sizeof(axis));
+		m->coneCutoff = sqrtf(1 - minDot * minDot);
+	}
+}
+
+ptrdiff_t wmeshBuildMeshlets(
+		wmeshMeshlet* meshlets,
+		unsigned int* meshletVertices,
+		unsigned char* meshletTriangles,
+		const unsigned int* indices,
+		ptrdiff_t indexCount,
+		const void* vertices,
+		ptrdiff_t vertexCount,
+		ptrdiff_t stride)
+{
+	ptrdiff_t triangleCount = indexCount / 3;
+	if(triangleCount == 0 || vertexCount == 0) return 0;
+
+	wmesh__Adjacency adj;
+	wmesh__buildAdjacency(&adj, indices, indexCount, vertexCount);
+
+	float* triangleNormals = (float*)wmeshMalloc(sizeof(float) * 3 * triangleCount);
+	for(ptrdiff_t t = 0; t < triangleCount; ++t) {
+		float a[3], b[3], c[3];
+		wmesh__position(a, vertices, stride, indices[t * 3]);
+		wmesh__position(b, vertices, stride, indices[t * 3 + 1]);
+		wmesh__position(c, vertices, stride, indices[t * 3 + 2]);
+		wmesh__triangleNormal(triangleNormals + t * 3, a, b, c);
+	}
+
+	unsigned char* emitted = (unsigned char*)wmeshMalloc(triangleCount);
+	memset(emitted, 0, triangleCount);
+	// Which meshlet each vertex was last added to (+1), and where in it
+	wmesh__u32* owner = (wmesh__u32*)wmeshMalloc(sizeof(wmesh__u32) * vertexCount);
+	unsigned char* local = (unsigned char*)wmeshMalloc(vertexCount);
+	memset(owner, 0, sizeof(wmesh__u32) * vertexCount);
+	wmesh__u32 triangleIds[WMESH_MESHLET_MAX_TRIANGLES];
+
+	ptrdiff_t meshletCount = 0;
+	ptrdiff_t vertexTotal = 0, triangleTotal = 0;
+	ptrdiff_t cursor = 0;
+	ptrdiff_t remaining = triangleCount;
+
+	while(remaining > 0) {
+		wmeshMeshlet* m = meshlets + meshletCount;
+		wmesh__u32 id = (wmesh__u32)(meshletCount + 1);
+		memset(m, 0, sizeof(*m));
+		m->vertexOffset = (unsigned int)vertexTotal;
+		m->triangleOffset = (unsigned int)triangleTotal * 3;
+		float axis[3] = {0, 0, 0};
+
+		for(;;) {
+			// Best fitting neighbour of anything already in the meshlet
+			ptrdiff_t best = -1;
+			float bestScore = 1e30f;
+			float axisLength = sqrtf(axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2]);
+			float axisScale = axisLength > 0 ? 1 / axisLength : 0;
+			for(wmesh__u32 i = 0; i < m->vertexCount; ++i) {
+				wmesh__u32 v = meshletVertices[m->vertexOffset + i];
+				const wmesh__u32* tris = adj.triangles + adj.offsets[v];
+				wmesh__u32 triCount = adj.offsets[v + 1] - adj.offsets[v];
+				for(wmesh__u32 j = 0; j < triCount; ++j) {
+					wmesh__u32 t = tris[j];
+					if(emitted[t]) continue;
+					int added = 0;
+					for(int k = 0; k < 3; ++k) {
+						added += owner[indices[t * 3 + k]] != id;
+					}
+					if(m->vertexCount + added > WMESH_MESHLET_MAX_VERTICES) continue;
+					const float* n = triangleNormals + t * 3;
+					float facing = (n[0] * axis[0] + n[1] * axis[1] + n[2] * axis[2]) * axisScale;
+					float score = added + (1 - facing);
+					if(score < bestScore) {
+						bestScore = score;
+						best = t;
+					}
+				}
+			}
+
+			// Nothing connected fits; start on the next unused triangle
+			if(best < 0) {
+				while(cursor < triangleCount && emitted[cursor]) cursor++;
+				if(cursor == triangleCount) break;
+				int added = 0;
+				for(int k = 0; k < 3; ++k) {
+					added += owner[indices[cursor * 3 + k]] != id;
+				}
+				if(m->vertexCount + added > WMESH_MESHLET_MAX_VERTICES) break;
+				best = cursor;
+			}
+
+			emitted[best] = 1;
+			remaining--;
+			for(int k = 0; k < 3; ++k) {
+				wmesh__u32 v = indices[best * 3 + k];
+				if(owner[v] != id) {
+					owner[v] = id;
+					local[v] = (unsigned char)m->vertexCount;
+					meshletVertices[vertexTotal++] = v;
+					m->vertexCount++;
+				}
+				meshletTriangles[triangleTotal * 3 + k] = local[v];
+			}
+			const float* n = triangleNormals + best * 3;
+			axis[0] += n[0];
+			axis[1] += n[1];
+			axis[2] += n[2];
+			triangleIds[m->triangleCount++] = (wmesh__u32)best;
+			triangleTotal++;
+
+			if(m->triangleCount == WMESH_MESHLET_MAX_TRIANGLES || remaining == 0) break;
+		}
+
+		wmesh__finishMeshlet(m, meshletVertices,
+				triangleNormals, triangleIds, vertices, stride);
+		meshletCount++;
+	}
+
+	wmeshFree(local);
+	wmeshFree(owner);
+	wmeshFree(emitted);
+	wmeshFree(triangleNormals);
+	wmesh__freeAdjacency(&adj);
+	return meshletCount;
+}
+
+void wmeshFrustumPlanes(float* planes, const float* m)
+{
+	// Gribb and Hartmann: each plane is the w row plus or minus another row
+	for(int i = 0; i < 6; ++i) {
+		int row = i / 2;
+		float sign = i & 1 ? -1.0f : 1.0f;
+		float* p = planes + i * 4;
+		for(int k = 0; k < 4; ++k) {
+			p[k] = m[k * 4 + 3] + sign * m[k * 4 + row];
+		}
+		float length = sqrtf(p[0] * p[0] + p[1] * p[1] + p[2] * p[2]);
+		if(length > 0) {
+			for(int k = 0; k < 4; ++k) p[k] /= length;
+		}
+	}
+}
+
+int wmeshCullMeshlet(
+		const wmeshMeshlet* meshlet,
+		const float* cameraPos,
+		const float* planes)
+{
+	const float* c = meshlet->center;
+	for(int i = 0; i < 6; ++i) {
+		const float* p = planes + i * 4;
+		if(p[0] * c[0] + p[1] * c[1] + p[2] * c[2] + p[3] < -meshlet->radius) return 1;
+	}
+
+	// Backfacing if the view direction to the sphere is inside the
+	// cone, pushed out by the angle the sphere covers
+	if(meshlet->coneCutoff < 1) {
+		float d[3] = {c[0] - cameraPos[0], c[1] - cameraPos[1], c[2] - cameraPos[2]};
+		float distance = sqrtf(d[0] * d[0] + d[1] * d[1] + d[2] * d[2]);
+		const float* a = meshlet->coneAxis;
+		if(d[0] * a[0] + d[1] * a[1] + d[2] * a[2] >=
+				meshlet->coneCutoff * distance + meshlet->radius) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+// Simplification internals
+//
+// A quadric is p'Ap + 2b.p + c over position, plus, for each attribute
+// value s, w*s*s - 2s(g.p + d), where g and d come from how the
+// attribute varies across each triangle. Each vertex keeps its quadric
+// around its own position, which never moves (collapses only remove
+// vertices); around the origin, c and d get big enough next to the
+// tiny errors we care about that floats can't tell them apart.
+typedef struct
+{
+	float a00, a11, a22, a01, a02, a12;
+	float b0, b1, b2;
+	float c;
+	float w;
+} wmesh__Quadric;
+
+enum
+{
+	wmesh__KindManifold,
+	wmesh__KindBorder,
+	wmesh__KindSeam,
+	wmesh__KindLocked
+};
+
+#define wmesh__NoEdge 0xFFFFFFFF
+#define wmesh__ManyEdges 0xFFFFFFFE
+
+typedef struct
+{
+	const unsigned char* vertices;
+	ptrdiff_t stride;
+	ptrdiff_t vertexCount;
+
+	// Normalized positions and weighted attributes, packed
+	float* positions;
+	float* attributes;
+	ptrdiff_t attributeCount;
+
+	wmesh__Quadric* quadrics;
+	// g (3) and d per attribute, per vertex
+	float* attributeQuadrics;
+	// Just the planes, for the error we hand back
+	wmesh__Quadric* shapeQuadrics;
+
+	// Other vertices at the same position, as a ring
+	wmesh__u32* siblings;
+	unsigned char* kinds;
+
+	// The one open edge leaving and entering each vertex, or
+	// wmesh__NoEdge, or wmesh__ManyEdges
+	wmesh__u32* openOut;
+	wmesh__u32* openIn;
+} wmesh__Simplifier;
+
+static
+void wmesh__addQuadric(wmesh__Quadric* q, const wmesh__Quadric* r)
+{
+	q->a00 += r->a00; q->a11 += r->a11; q->a22 += r->a22;
+	q->a01 += r->a01; q->a02 += r->a02; q->a12 += r->a12;
+	q->b0 += r->b0; q->b1 += r->b1; q->b2 += r->b2;
+	q->c += r->c;
+	q->w += r->w;
+}
+
+// The plane n.p + d = 0, weighted
+static
+void wmesh__planeQuadric(wmesh__Quadric* q, const float* n, float d, float w)
+{
+	q->a00 = w * n[0] * n[0];
+	q->a11 = w * n[1] * n[1];
+	q->a22 = w * n[2] * n[2];
+	q->a01 = w * n[0] * n[1];
+	q->a02 = w * n[0] * n[2];
+	q->a12 = w * n[1] * n[2];
+	q->b0 = w * n[0] * d;
+	q->b1 = w * n[1] * d;
+	q->b2 = w * n[2] * d;
+	q->c = w * d * d;
+	q->w = w;
+}
+
+static
+float wmesh__evaluateQuadric(const wmesh__Quadric* q, const float* p)
+{
+	float rx = q->a00 * p[0] + q->a01 * p[1] + q->a02 * p[2];
+	float ry = q->a01 * p[0] + q->a11 * p[1] + q->a12 * p[2];
+	float rz = q->a02 * p[0] + q->a12 * p[1] + q->a22 * p[2];
+	return rx * p[0] + ry * p[1] + rz * p[2] +
+		2 * (q->b0 * p[0] + q->b1 * p[1] + q->b2 * p[2]) + q->c;
+}
+
+// Moves a quadric's origin by t
+static
+void wmesh__translateQuadric(wmesh__Quadric* q, const float* t)
+{
+	float at0 = q->a00 * t[0] + q->a01 * t[1] + q->a02 * t[2];
+	float at1 = q->a01 * t[0] + q->a11 * t[1] + q->a12 * t[2];
+	float at2 = q->a02 * t[0] + q->a12 * t[1] + q->a22 * t[2];
+	q->c += at0 * t[0] + at1 * t[1] + at2 * t[2] +
+		2 * (q->b0 * t[0] + q->b1 * t[1] + q->b2 * t[2]);
+	q->b0 += at0;
+	q->b1 += at1;
+	q->b2 += at2;
+}
+
+// Just the geometric part of v's error at vertex at
+static
+float wmesh__shapeError(const wmesh__Simplifier* s, wmesh__u32 v, wmesh__u32 at)
+{
+	const wmesh__Quadric* q = s->shapeQuadrics + v;
+	const float* pa = s->positions + at * 3;
+	const float* pv = s->positions + v * 3;
+	float p[3] = {pa[0] - pv[0], pa[1] - pv[1], pa[2] - pv[2]};
+	float e = wmesh__evaluateQuadric(q, p);
+	e = e < 0 ? -e : e;
+	return q->w > 0 ? e / q->w : e;
+}
+
+// v's quadric, at vertex at's position and attributes
+static
+float wmesh__quadricError(const wmesh__Simplifier* s, wmesh__u32 v, wmesh__u32 at)
+{
+	const wmesh__Quadric* q = s->quadrics + v;
+	const float* pa = s->positions + at * 3;
+	const float* pv = s->positions + v * 3;
+	float p[3] = {pa[0] - pv[0], pa[1] - pv[1], pa[2] - pv[2]};
+	float e = wmesh__evaluateQuadric(q, p);
+
+	const float* attributes = s->attributes + at * s->attributeCount;
+	const float* g = s->attributeQuadrics + v * s->attributeCount * 4;
+	for(ptrdiff_t j = 0; j < s->attributeCount; ++j, g += 4) {
+		float a = attributes[j];
+		e += q->w * a * a - 2 * a * (g[0] * p[0] + g[1] * p[1] + g[2] * p[2] + g[3]);
+	}
+	// Dividing by the total weight keeps this a squared distance
+	e = e < 0 ? -e : e;
+	return q->w > 0 ? e / q->w : e;
+}
+
+// Adds v's quadric to u's, moving it over to u's position first
+static
+void wmesh__mergeQuadric(wmesh__Simplifier* s, wmesh__u32 u, wmesh__u32 v)
+{
+	const float* pu = s->positions + u * 3;
+	const float* pv = s->positions + v * 3;
+	float t[3] = {pu[0] - pv[0], pu[1] - pv[1], pu[2] - pv[2]};
+	wmesh__Quadric q = s->quadrics[v];
+	wmesh__translateQuadric(&q, t);
+	wmesh__addQuadric(s->quadrics + u, &q);
+	q = s->shapeQuadrics[v];
+	wmesh__translateQuadric(&q, t);
+	wmesh__addQuadric(s->shapeQuadrics + u, &q);
+
+	float* gu = s->attributeQuadrics + u * s->attributeCount * 4;
+	const float* gv = s->attributeQuadrics + v * s->attributeCount * 4;
+	for(ptrdiff_t j = 0; j < s->attributeCount * 4; j += 4) {
+		gu[j] += gv[j];
+		gu[j + 1] += gv[j + 1];
+		gu[j + 2] += gv[j + 2];
+		gu[j + 3] += gv[j + 3] + gv[j] * t[0] + gv[j + 1] * t[1] + gv[j + 2] * t[2];
+	}
+}
+
+static
+void wmesh__cross(float* r, const float* a, const float* b)
+{
+	r[0] = a[1] * b[2] - a[2] * b[1];
+	r[1] = a[2] * b[0] - a[0] * b[2];
+	r[2] = a[0] * b[1] - a[1] * b[0];
+}
+
+static
+void wmesh__buildQuadrics(wmesh__Simplifier* s, const unsigned int* indices, ptrdiff_t indexCount)
+{
+	ptrdiff_t ac = s->attributeCount;
+	memset(s->quadrics, 0, sizeof(wmesh__Quadric) * s->vertexCount);
+	memset(s->shapeQuadrics, 0, sizeof(wmesh__Quadric) * s->vertexCount);
+	memset(s->attributeQuadrics, 0, sizeof(float) * 4 * ac * s->vertexCount);
+
+	for(ptrdiff_t i = 0; i + 2 < indexCount; i += 3) {
+		wmesh__u32 t[3] = {indices[i], indices[i + 1], indices[i + 2]};
+		const float* p[3] = {
+			s->positions + t[0] * 3,
+			s->positions + t[1] * 3,
+			s->positions + t[2] * 3
+		};
+		float e1[3] = {p[1][0] - p[0][0], p[1][1] - p[0][1], p[1][2] - p[0][2]};
+		float e2[3] = {p[2][0] - p[0][0], p[2][1] - p[0][1], p[2][2] - p[0][2]};
+		float n[3];
+		wmesh__cross(n, e1, e2);
+		float length = sqrtf(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+		if(length == 0) continue;
+		float area = length * 0.5f;
+		n[0] /= length;
+		n[1] /= length;
+		n[2] /= length;
+
+		// Attribute gradients: g is in the triangle's plane,
+		// with g.e1 and g.e2 matching the attribute's change
+		float d11 = e1[0] * e1[0] + e1[1] * e1[1] + e1[2] * e1[2];
+		float d12 = e1[0] * e2[0] + e1[1] * e2[1] + e1[2] * e2[2];
+		float d22 = e2[0] * e2[0] + e2[1] * e2[1] + e2[2] * e2[2];
+		float det = d11 * d22 - d12 * d12;
+		float inverse = det != 0 ? 1 / det : 0;
+		float g[WMESH_SIMPLIFY_MAX_ATTRIBUTES][3];
+		for(ptrdiff_t j = 0; j < ac; ++j) {
+			float s0 = s->attributes[t[0] * ac + j];
+			float s1 = s->attributes[t[1] * ac + j];
+			float s2 = s->attributes[t[2] * ac + j];
+			float x = ((s1 - s0) * d22 - (s2 - s0) * d12) * inverse;
+			float y = ((s2 - s0) * d11 - (s1 - s0) * d12) * inverse;
+			g[j][0] = e1[0] * x + e2[0] * y;
+			g[j][1] = e1[1] * x + e2[1] * y;
+			g[j][2] = e1[2] * x + e2[2] * y;
+		}
+
+		// Around each corner, the triangle's plane goes through the
+		// corner itself, and each attribute's d is its value there
+		for(int k = 0; k < 3; ++k) {
+			wmesh__Quadric q;
+			wmesh__planeQuadric(&q, n, 0, area);
+			wmesh__addQuadric(s->shapeQuadrics + t[k], &q);
+			float* aq = s->attributeQuadrics + t[k] * ac * 4;
+			for(ptrdiff_t j = 0; j < ac; ++j) {
+				float d = s->attributes[t[k] * ac + j];
+				q.a00 += area * g[j][0] * g[j][0];
+				q.a11 += area * g[j][1] * g[j][1];
+				q.a22 += area * g[j][2] * g[j][2];
+				q.a01 += area * g[j][0] * g[j][1];
+				q.a02 += area * g[j][0] * g[j][2];
+				q.a12 += area * g[j][1] * g[j][2];
+				q.b0 += area * d * g[j][0];
+				q.b1 += area * d * g[j][1];
+				q.b2 += area * d * g[j][2];
+				q.c += area * d * d;
+
+				aq[j * 4] += area * g[j][0];
+				aq[j * 4 + 1] += area * g[j][1];
+				aq[j * 4 + 2] += area * g[j][2];
+				aq[j * 4 + 3] += area * d;
+			}
+			wmesh__addQuadric(s->quadrics + t[k], &q);
+		}
+
+		// Open edges get a plane standing up along them, so the
+		// border keeps its shape as vertices slide along it
+		for(int k = 0; k < 3; ++k) {
+			wmesh__u32 a = t[k], b = t[(k + 1) % 3];
+			if(s->openOut[a] != b) continue;
+			const float* pa = p[k];
+			const float* pb = p[(k + 1) % 3];
+			float e[3] = {pb[0] - pa[0], pb[1] - pa[1], pb[2] - pa[2]};
+			float m[3];
+			wmesh__cross(m, e, n);
+			float ml = sqrtf(m[0] * m[0] + m[1] * m[1] + m[2] * m[2]);
+			if(ml == 0) continue;
+			m[0] /= ml;
+			m[1] /= ml;
+			m[2] /= ml;
+			// The plane goes through both ends, so it's the same
+			// around either of them. w is the attributes' weight
+			// too, so leave it alone.
+			wmesh__Quadric border;
+			wmesh__planeQuadric(&border, m, 0, (e[0] * e[0] + e[1] * e[1] + e[2] * e[2]) * 2);
+			border.w = 0;
+			wmesh__addQuadric(s->quadrics + a, &border);
+			wmesh__addQuadric(s->quadrics + b, &border);
+			wmesh__addQuadric(s->shapeQuadrics + a, &border);
+			wmesh__addQuadric(s->shapeQuadrics + b, &border);
+		}
+	}
+}
+
+static inline
+wmesh__u32 wmesh__hashEdge(wmesh__u32 a, wmesh__u32 b)
+{
+	wmesh__u32 h = a * 0x9E3779B1u ^ (b + 0x7F4A7C15u) * 0x85EBCA77u;
+	return h ^ (h >> 15);
+}
+
+// Finds the open (unpaired) half-edges of the current triangles
+static
+void wmesh__findOpenEdges(wmesh__Simplifier* s, const unsigned int* indices, ptrdiff_t indexCount)
+{
+	ptrdiff_t capacity = 16;
+	while(capacity < indexCount * 2) capacity *= 2;
+	ptrdiff_t mask = capacity - 1;
+	wmesh__u32* table = (wmesh__u32*)wmeshMalloc(sizeof(wmesh__u32) * 2 * capacity);
+	memset(table, 0xFF, sizeof(wmesh__u32) * 2 * capacity);
+
+	for(ptrdiff_t i = 0; i < indexCount; ++i) {
+		wmesh__u32 a = indices[i];
+		wmesh__u32 b = indices[i % 3 == 2 ? i - 2 : i + 1];
+		ptrdiff_t slot = wmesh__hashEdge(a, b) & mask;
+		while(table[slot * 2] != 0xFFFFFFFF &&
+				(table[slot * 2] != a || table[slot * 2 + 1] != b)) {
+			slot = (slot + 1) & mask;
+		}
+		table[slot * 2] = a;
+		table[slot * 2 + 1] = b;
+	}
+
+	memset(s->openOut, 0xFF, sizeof(wmesh__u32) * s->vertexCount);
+	memset(s->openIn, 0xFF, sizeof(wmesh__u32) * s->vertexCount);
+	for(ptrdiff_t i = 0; i < indexCount; ++i) {
+		wmesh__u32 a = indices[i];
+		wmesh__u32 b = indices[i % 3 == 2 ? i - 2 : i + 1];
+		ptrdiff_t slot = wmesh__hashEdge(b, a) & mask;
+		int paired = 0;
+		while(table[slot * 2] != 0xFFFFFFFF) {
+			if(table[slot * 2] == b && table[slot * 2 + 1] == a) {
+				paired = 1;
+				break;
+			}
+			slot = (slot + 1) & mask;
+		}
+		if(paired) continue;
+		s->openOut[a] = s->openOut[a] == wmesh__NoEdge ? b : wmesh__ManyEdges;
+		s->openIn[b] = s->openIn[b] == wmesh__NoEdge ? a : wmesh__ManyEdges;
+	}
+	wmeshFree(table);
+}
+
+static
+void wmesh__classifyVertices(wmesh__Simplifier* s)
+{
+	// Group vertices by position, with the same hash table trick as welding
+	ptrdiff_t n = s->vertexCount;
+	wmesh__u32* first = (wmesh__u32*)wmeshMalloc(sizeof(wmesh__u32) * n);
+	wmeshWeld(first, s->positions, n, sizeof(float) * 3);
+	// first[] is a welded index now; point each group at its first vertex
+	wmesh__u32* head = (wmesh__u32*)wmeshMalloc(sizeof(wmesh__u32) * n);
+	memset(head, 0xFF, sizeof(wmesh__u32) * n);
+	for(ptrdiff_t v = 0; v < n; ++v) {
+		wmesh__u32 g = first[v];
+		if(head[g] == 0xFFFFFFFF) {
+			head[g] = (wmesh__u32)v;
+			s->siblings[v] = (wmesh__u32)v;
+		} else {
+			// Splice into the group's ring
+			wmesh__u32 h = head[g];
+			s->siblings[v] = s->siblings[h];
+			s->siblings[h] = (wmesh__u32)v;
+		}
+	}
+	wmeshFree(head);
+	wmeshFree(first);
+
+	for(ptrdiff_t v = 0; v < n; ++v) {
+		wmesh__u32 out = s->openOut[v], in = s->openIn[v];
+		wmesh__u32 sibling = s->siblings[v];
+		int single = out < wmesh__ManyEdges && in < wmesh__ManyEdges;
+		unsigned char kind = wmesh__KindLocked;
+
+		if(sibling == (wmesh__u32)v) {
+			if(out == wmesh__NoEdge && in == wmesh__NoEdge) {
+				kind = wmesh__KindManifold;
+			} else if(single) {
+				kind = wmesh__KindBorder;
+			}
+		} else if(s->siblings[sibling] == (wmesh__u32)v && single) {
+			// A seam has the sibling's open edges running the other way,
+			// to the same positions
+			wmesh__u32 so = s->openOut[sibling], si = s->openIn[sibling];
+			if(so < wmesh__ManyEdges && si < wmesh__ManyEdges &&
+					memcmp(s->positions + out * 3, s->positions + si * 3, 12) == 0 &&
+					memcmp(s->positions + in * 3, s->positions + so * 3, 12) == 0) {
+				kind = wmesh__KindSeam;
+			}
+		}
+		s->kinds[v] = kind;
+	}
+}
+
+// Where v's seam sibling goes when v collapses to u, or wmesh__NoEdge
+static
+wmesh__u32 wmesh__seamTarget(wmesh__Simplifier* s, wmesh__u32 v, wmesh__u32 u)
+{
+	wmesh__u32 w = s->siblings[v];
+	wmesh__u32 target = wmesh__NoEdge;
+	if(u == s->openOut[v]) target = s->openIn[w];
+	if(u == s->openIn[v]) target = s->openOut[w];
+	if(target >= wmesh__ManyEdges) return wmesh__NoEdge;
+	if(memcmp(s->positions + target * 3, s->positions + u * 3, 12) != 0) return wmesh__NoEdge;
+	return target;
+}
+
+// Would moving v onto u flip or badly skew any of v's other triangles?
+// This looks through remap, so it sees this pass's earlier collapses.
+static
+int wmesh__flips(wmesh__Simplifier* s, const wmesh__Adjacency* adj,
+		const unsigned int* indices, const wmesh__u32* remap, wmesh__u32 v, wmesh__u32 u)
+{
+	const float* pu = s->positions + u * 3;
+	const float* pv = s->positions + v * 3;
+	for(wmesh__u32 i = adj->offsets[v]; i < adj->offsets[v + 1]; ++i) {
+		const unsigned int* t = indices + adj->triangles[i] * 3;
+		// Rotate so v comes first
+		int k = t[0] == v ? 0 : t[1] == v ? 1 : 2;
+		wmesh__u32 ia = remap[t[(k + 1) % 3]], ib = remap[t[(k + 2) % 3]];
+		// Already gone, or about to be
+		if(ia == ib || ia == v || ib == v || ia == u || ib == u) continue;
+		const float* a = s->positions + ia * 3;
+		const float* b = s->positions + ib * 3;
+		float ea[3] = {a[0] - pv[0], a[1] - pv[1], a[2] - pv[2]};
+		float eb[3] = {b[0] - pv[0], b[1] - pv[1], b[2] - pv[2]};
+		float fa[3] = {a[0] - pu[0], a[1] - pu[1], a[2] - pu[2]};
+		float fb[3] = {b[0] - pu[0], b[1] - pu[1], b[2] - pu[2]};
+		float before[3], after[3];
+		wmesh__cross(before, ea, eb);
+		wmesh__cross(after, fa, fb);
+		float dot = before[0] * after[0] + before[1] * after[1] + before[2] * after[2];
+		float lb = before[0] * before[0] + before[1] * before[1] + before[2] * before[2];
+		float la = after[0] * after[0] + after[1] * after[1] + after[2] * after[2];
+		if(dot <= 0.25f * sqrtf(lb * la)) return 1;
+	}
+	return 0;
+}
+
+typedef struct
+{
+	float error;
+	wmesh__u32 v, u;
+} wmesh__Collapse;
+
+static
+int wmesh__compareCollapses(const void* a, const void* b)
+{
+	float ea = ((const wmesh__Collapse*)a)->error;
+	float eb = ((const wmesh__Collapse*)b)->error;
+	return (ea > eb) - (ea < eb);
+}
+
+ptrdiff_t wmeshSimplify(
+		unsigned int* dst,
+		const unsigned int* indices,
+		ptrdiff_t indexCount,
+		const void* vertices,
+		ptrdiff_t vertexCount,
+		ptrdiff_t stride,
+		ptrdiff_t attributeOffset,
+		const float* attributeWeights,
+		ptrdiff_t attributeCount,
+		ptrdiff_t targetIndexCount,
+		float* error)
+{
+	indexCount -= indexCount % 3;
+	memcpy(dst, indices, sizeof(unsigned int) * indexCount);
+	if(error) *error = 0;
+	if(indexCount <= targetIndexCount || vertexCount == 0) return indexCount;
+
+	wmesh__Simplifier s;
+	memset(&s, 0, sizeof(s));
+	s.vertices = (const unsigned char*)vertices;
+	s.stride = stride;
+	s.vertexCount = vertexCount;
+
+	// Normalize positions, and pull out the attributes that count
+	float lo[3], hi[3];
+	wmesh__position(lo, vertices, stride, 0);
+	memcpy(hi, lo, sizeof(hi));
+	for(ptrdiff_t v = 1; v < vertexCount; ++v) {
+		float p[3];
+		wmesh__position(p, vertices, stride, (wmesh__u32)v);
+		for(int k = 0; k < 3; ++k) {
+			if(p[k] < lo[k]) lo[k] = p[k];
+			if(p[k] > hi[k]) hi[k] = p[k];
+		}
+	}
+	float extent = hi[0] - lo[0];
+	if(hi[1] - lo[1] > extent) extent = hi[1] - lo[1];
+	if(hi[2] - lo[2] > extent) extent = hi[2] - lo[2];
+	float scale = extent > 0 ? 1 / extent : 0;
+
+	ptrdiff_t used[WMESH_SIMPLIFY_MAX_ATTRIBUTES];
+	for(ptrdiff_t j = 0; j < attributeCount && j < WMESH_SIMPLIFY_MAX_ATTRIBUTES; ++j) {
+		if(attributeWeights[j] != 0) used[s.attributeCount++] = j;
+	}
+
+	s.positions = (float*)wmeshMalloc(sizeof(float) * 3 * vertexCount);
+	s.attributes = (float*)wmeshMalloc(sizeof(float) * (s.attributeCount * vertexCount + 1));
+	for(ptrdiff_t v = 0; v < vertexCount; ++v) {
+		float* p = s.positions + v * 3;
+		wmesh__position(p, vertices, stride, (wmesh__u32)v);
+		for(int k = 0; k < 3; ++k) p[k] = (p[k] - lo[k]) * scale;
+
+		const unsigned char* a = s.vertices + v * stride + attributeOffset;
+		for(ptrdiff_t j = 0; j < s.attributeCount; ++j) {
+			float value;
+			memcpy(&value, a + used[j] * sizeof(float), sizeof(float));
+			s.attributes[v * s.attributeCount + j] = value * attributeWeights[used[j]];
+		}
+	}
+
+	s.quadrics = (wmesh__Quadric*)wmeshMalloc(sizeof(wmesh__Quadric) * vertexCount);
+	s.shapeQuadrics = (wmesh__Quadric*)wmeshMalloc(sizeof(wmesh__Quadric) * vertexCount);
+	s.attributeQuadrics = (float*)wmeshMalloc(sizeof(float) * (4 * s.attributeCount * vertexCount + 1));
+	s.siblings = (wmesh__u32*)wmeshMalloc(sizeof(wmesh__u32) * vertexCount);
+	s.kinds = (unsigned char*)wmeshMalloc(vertexCount);
+	s.openOut = (wmesh__u32*)wmeshMalloc(sizeof(wmesh__u32) * vertexCount);
+	s.openIn = (wmesh__u32*)wmeshMalloc(sizeof(wmesh__u32) * vertexCount);
+
+	wmesh__findOpenEdges(&s, dst, indexCount);
+	wmesh__classifyVertices(&s);
+	wmesh__buildQuadrics(&s, dst, indexCount);
+
+	wmesh__Collapse* collapses = (wmesh__Collapse*)wmeshMalloc(sizeof(wmesh__Collapse) * vertexCount);
+	wmesh__u32* remap = (wmesh__u32*)wmeshMalloc(sizeof(wmesh__u32) * vertexCount);
+	wmesh__u32* locked = (wmesh__u32*)wmeshMalloc(sizeof(wmesh__u32) * vertexCount);
+	memset(locked, 0, sizeof(wmesh__u32) * vertexCount);
+	float worst = 0;
+	int unlimited = 0;
+
+	// Each pass picks the cheapest collapse for every vertex, then does
+	// as many as it can in order of error without two of them touching
+	// the same triangles, and rebuilds the index buffer
+	for(wmesh__u32 pass = 1; indexCount > targetIndexCount; ++pass) {
+		wmesh__Adjacency adj;
+		wmesh__buildAdjacency(&adj, dst, indexCount, vertexCount);
+		if(pass > 1) wmesh__findOpenEdges(&s, dst, indexCount);
+
+		ptrdiff_t collapseCount = 0;
+		for(ptrdiff_t v = 0; v < vertexCount; ++v) {
+			unsigned char kind = s.kinds[v];
+			if(kind == wmesh__KindLocked || adj.offsets[v] == adj.offsets[v + 1]) continue;
+
+			wmesh__Collapse best = {1e30f, (wmesh__u32)v, wmesh__NoEdge};
+			for(wmesh__u32 i = adj.offsets[v]; i < adj.offsets[v + 1]; ++i) {
+				const unsigned int* t = dst + adj.triangles[i] * 3;
+				for(int k = 0; k < 3; ++k) {
+					wmesh__u32 u = t[k];
+					if(u == (wmesh__u32)v) continue;
+					// Borders and seams only slide along their open edges
+					if(kind != wmesh__KindManifold && u != s.openOut[v] && u != s.openIn[v]) continue;
+
+					float e = wmesh__quadricError(&s, (wmesh__u32)v, u);
+					if(kind == wmesh__KindSeam) {
+						wmesh__u32 w = s.siblings[v];
+						wmesh__u32 target = wmesh__seamTarget(&s, (wmesh__u32)v, u);
+						if(target == wmesh__NoEdge) continue;
+						e += wmesh__quadricError(&s, w, target);
+					}
+					if(e < best.error) {
+						best.error = e;
+						best.u = u;
+					}
+				}
+			}
+			if(best.u != wmesh__NoEdge) collapses[collapseCount++] = best;
+		}
+		if(collapseCount == 0) {
+			wmesh__freeAdjacency(&adj);
+			break;
+		}
+		qsort(collapses, collapseCount, sizeof(wmesh__Collapse), wmesh__compareCollapses);
+
+		// Don't go much past the error we'd need to reach the target
+		// this pass, so later passes get to pick with fresh errors.
+		// Most collapses take two triangles with them, but plenty get
+		// turned down, so always let at least a quarter of them try;
+		// otherwise the last few passes crawl.
+		ptrdiff_t goal = (indexCount - targetIndexCount) / 3 / 2;
+		if(goal < collapseCount / 4) goal = collapseCount / 4;
+		if(goal >= collapseCount) goal = collapseCount - 1;
+		float passLimit = collapses[goal].error * 1.5f;
+		if(unlimited) passLimit = 1e30f;
+
+		for(ptrdiff_t v = 0; v < vertexCount; ++v) remap[v] = (wmesh__u32)v;
+		ptrdiff_t removed = 0, done = 0;
+		for(ptrdiff_t i = 0; i < collapseCount; ++i) {
+			wmesh__Collapse* c = collapses + i;
+			if(c->error > passLimit || removed * 3 >= indexCount - targetIndexCount) break;
+			wmesh__u32 v = c->v, u = c->u;
+			if(locked[v] == pass || locked[u] == pass) continue;
+
+			wmesh__u32 w = wmesh__NoEdge, wTarget = wmesh__NoEdge;
+			if(s.kinds[v] == wmesh__KindSeam) {
+				w = s.siblings[v];
+				wTarget = wmesh__seamTarget(&s, v, u);
+				if(locked[w] == pass || locked[wTarget] == pass) continue;
+				if(wmesh__flips(&s, &adj, dst, remap, w, wTarget)) continue;
+			}
+			if(wmesh__flips(&s, &adj, dst, remap, v, u)) continue;
+
+			// Only the ends of the edge are locked for the rest of the
+			// pass; the flip checks see everything else through remap
+			wmesh__u32 ends[2][2] = {{v, u}, {w, wTarget}};
+			for(int r = 0; r < 2 && ends[r][0] != wmesh__NoEdge; ++r) {
+				wmesh__u32 x = ends[r][0], y = ends[r][1];
+				locked[x] = locked[y] = pass;
+				// Triangles with both ends of the edge go away
+				for(wmesh__u32 j = adj.offsets[x]; j < adj.offsets[x + 1]; ++j) {
+					const unsigned int* t = dst + adj.triangles[j] * 3;
+					if(remap[t[0]] == y || remap[t[1]] == y || remap[t[2]] == y) removed++;
+				}
+			}
+
+			float shape = wmesh__shapeError(&s, v, u);
+			remap[v] = u;
+			wmesh__mergeQuadric(&s, u, v);
+			if(w != wmesh__NoEdge) {
+				float other = wmesh__shapeError(&s, w, wTarget);
+				if(other > shape) shape = other;
+				remap[w] = wTarget;
+				wmesh__mergeQuadric(&s, wTarget, w);
+				s.kinds[w] = wmesh__KindLocked;
+			}
+			s.kinds[v] = wmesh__KindLocked;
+			if(shape > worst) worst = shape;
+			done++;
+		}
+		wmesh__freeAdjacency(&adj);
+
+		// If everything under the limit got turned down, try once
+		// more with all of them before giving up
+		if(done == 0) {
+			if(unlimited || passLimit >= collapses[collapseCount - 1].error) break;
+			unlimited = 1;
+			continue;
+		}
+		unlimited = 0;
+
+		// Rebuild the index buffer without the collapsed triangles
+		ptrdiff_t write = 0;
+		for(ptrdiff_t i = 0; i < indexCount; i += 3) {
+			wmesh__u32 a = remap[dst[i]], b = remap[dst[i + 1]], c = remap[dst[i + 2]];
+			if(a == b || b == c || a == c) continue;
+			dst[write++] = a;
+			dst[write++] = b;
+			dst[write++] = c;
+		}
+		indexCount = write;
+	}
+
+	wmeshFree(locked);
+	wmeshFree(remap);
+	wmeshFree(collapses);
+	wmeshFree(s.openIn);
+	wmeshFree(s.openOut);
+	wmeshFree(s.kinds);
+	wmeshFree(s.siblings);
+	wmeshFree(s.attributeQuadrics);
+	wmeshFree(s.shapeQuadrics);
+	wmeshFree(s.quadrics);
+	wmeshFree(s.attributes);
+	wmeshFree(s.positions);
+
+	if(error) *error = sqrtf(worst);
+	return indexCount;
+}
+
+unsigned short wmeshQuantizeHalf(float v)
+{
+	wmesh__u32 x;
+	memcpy(&x, &v, 4);
+	wmesh__u32 sign = (x >> 16) & 0x8000;
+	wmesh__u32 a = x & 0x7FFFFFFF;
+
+	// NaN stays NaN, inf and anything that rounds past 65504 is inf
+	if(a > 0x7F800000) return (unsigned short)(sign | 0x7E00);
+	if(a >= 0x477FF000) return (unsigned short)(sign | 0x7C00);
+
+	// Half denormals: shift the mantissa into place and round by hand
+	if(a < 0x38800000) {
+		wmesh__u32 shift = 126 - (a >> 23);
+		if(shift > 24) return (unsigned short)sign;
+		wmesh__u32 m = (a & 0x7FFFFF) | 0x800000;
+		wmesh__u32 r = m >> shift;
+		wmesh__u32 rest = m & ((1u << shift) - 1);
+		wmesh__u32 half = 1u << (shift - 1);
+		if(rest > half || (rest == half && (r & 1))) r++;
+		return (unsigned short)(sign | r);
+	}
+
+	// Rebias the exponent; a mantissa carry rolls into it correctly
+	a += 0xFFF + ((a >> 13) & 1);
+	return (unsigned short)(sign | ((a - 0x38000000) >> 13));
+}
+
+float wmeshDequantizeHalf(unsigned short h)
+{
+	wmesh__u32 sign = (wmesh__u32)(h & 0x8000) << 16;
+	wmesh__u32 exponent = (h >> 10) & 0x1F;
+	wmesh__u32 mantissa = h & 0x3FF;
+	wmesh__u32 x;
+	if(exponent == 0x1F) {
+		x = sign | 0x7F800000 | (mantissa << 13);
+	} else if(exponent == 0) {
+		float f = (float)mantissa * (1.0f / 16777216.0f);
+		memcpy(&x, &f, 4);
+		x |= sign;
+	} else {
+		x = sign | ((exponent + 112) << 23) | (mantissa << 13);
+	}
+	float v;
+	memcpy(&v, &x, 4);
+	return v;
+}
+
+static inline
+float wmesh__abs(float x)
+{
+	return x < 0 ? -x : x;
+}
+
+static inline
+short wmesh__snorm16(float x)
+{
+	if(x > 1) x = 1;
+	if(x < -1) x = -1;
+	return (short)(x * 32767.0f + (x >= 0 ? 0.5f : -0.5f));
+}
+
+void wmeshEncodeOctahedral(short* dst, const float* n)
+{
+	float l1 = wmesh__abs(n[0]) + wmesh__abs(n[1]) + wmesh__abs(n[2]);
+	if(l1 == 0) {
+		dst[0] = dst[1] = 0;
+		return;
+	}
+	float x = n[0] / l1;
+	float y = n[1] / l1;
+	// The lower half folds out over the corners
+	if(n[2] < 0) {
+		float fx = (1 - wmesh__abs(y)) * (x >= 0 ? 1 : -1);
+		float fy = (1 - wmesh__abs(x)) * (y >= 0 ? 1 : -1);
+		x = fx;
+		y = fy;
+	}
+	dst[0] = wmesh__snorm16(x);
+	dst[1] = wmesh__snorm16(y);
+}
+
+void wmeshDecodeOctahedral(float* dst, const short* e)
+{
+	// Same as vert3d.glsl's octDecode
+	float x = e[0] < -32767 ? -1 : e[0] / 32767.0f;
+	float y = e[1] < -32767 ? -1 : e[1] / 32767.0f;
+	float z = 1 - wmesh__abs(x) - wmesh__abs(y);
+	float t = z < 0 ? -z : 0;
+	x += x >= 0 ? -t : t;
+	y += y >= 0 ? -t : t;
+	float length = sqrtf(x * x + y * y + z * z);
+	dst[0] = x / length;
+	dst[1] = y / length;
+	dst[2] = z / length;
+}
+
+unsigned short wmeshEncodeTangent(const float* normal, const float* tangent)
+{
+	float s = normal[2] >= 0 ? 1.0f : -1.0f;
+	float b1[3], b2[3];
+	wmesh__basis(b1, b2, normal, s);
+	float x = tangent[0] * b1[0] + tangent[1] * b1[1] + tangent[2] * b1[2];
+	float y = tangent[0] * b2[0] + tangent[1] * b2[1] + tangent[2] * b2[2];
+	float angle = x == 0 && y == 0 ? 0 : atan2f(y, x);
+	int q = (int)((angle + 3.14159265f) * (16383 / 6.28318531f) + 0.5f);
+	if(q < 0) q = 0;
+	if(q > 16383) q = 16383;
+	return (unsigned short)(q | (s < 0 ? 0x4000 : 0) | (tangent[3] < 0 ? 0x8000 : 0));
+}
+
+void wmeshDecodeTangent(float* dst, const float* normal, unsigned short e)
+{
+	// Same as vert3d.glsl's tangentDecode
+	float b1[3], b2[3];
+	wmesh__basis(b1, b2, normal, e & 0x4000 ? -1.0f : 1.0f);
+	float angle = (e & 0x3FFF) * (6.28318531f / 16383) - 3.14159265f;
+	float c = cosf(angle), s = sinf(angle);
+	for(int i = 0; i < 3; ++i) {
+		dst[i] = b1[i] * c + b2[i] * s;
+	}
+	dst[3] = e & 0x8000 ? -1.0f : 1.0f;
+}
+
+#endif
@@ -0,0 +1,950 @@
+/* wb_png.h
+ *
+ * PNG decoding for the textures: the same RGBA8 stb_image makes of
+ * a PNG, byte for byte, in a fraction of the time.
+ *
+ * Nearly all of stb_image's time on our textures goes to inflating
+ * them and undoing the row filters. Inflate here reads through a
+ * 64-bit bit buffer that refills 8 bytes at a time, and decodes
+ * through tables 11 bits wide whose entries hold two literals
+ * whenever both codes fit, so runs of literals take half the
+ * lookups. Rows get unfiltered with SSE2, a pixel at a time for
+ * the filters that lean on the pixel to their left, with two Paeth
+ * rows in a row going through together, and 32 bytes at a time
+ * with AVX2 for Up, which doesn't. RGBA8 images unfilter
+ * straight into the caller's buffer; the rest go through a row
+ * buffer and get expanded to RGBA8 from there.
+ *
+ * It takes every non-interlaced PNG stb_image does. Interlaced
+ * ones, and anything that looks broken, it turns down, so callers
+ * can hand those to stb_image and get its answer instead.
+ *
+ * Like wb_tex.h, the implementation goes in one translation
+ * unit with WB_PNG_IMPLEMENTATION defined; main.c does this.
+ *
+ */
+
+#ifndef WB_PNG_H
+#define WB_PNG_H
+
+#include <stddef.h>
+
+enum
+{
+	// Bottom row first, like stbi_set_flip_vertically_on_load(1)
+	WPNG_FLIP = 1 << 0,
+	// The plain C unfilters, for benchmarks. They make the same bytes.
+	WPNG_SCALAR = 1 << 1,
+};
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// The size of a PNG wpngDecode will take, or 0 if it won't
+int wpngInfo(const void* data, ptrdiff_t size, int* width, int* height);
+
+// Decodes into width * height RGBA8 pixels at dst, the same ones
+// stbi_load_from_memory gives with STBI_rgb_alpha. Returns 0, with
+// dst half written, if the image is broken or wpngInfo turns it down.
+int wpngDecode(unsigned char* dst, const void* data, ptrdiff_t size, unsigned int flags);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
+
+#if defined(WB_PNG_IMPLEMENTATION) && !defined(WB_PNG_IMPLEMENTED)
+#define WB_PNG_IMPLEMENTED
+#include <stdlib.h>
+#include <string.h>
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+#ifndef wpngMalloc
+#define wpngMalloc(size) malloc(size)
+#define wpngFree(ptr) free(ptr)
+#endif
+
+typedef unsigned char wpng__u8;
+typedef unsigned short wpng__u16;
+typedef unsigned int wpng__u32;
+typedef unsigned long long wpng__u64;
+
+// Room past the end of every buffer, so inflate's match copies and
+// the SIMD loops can run a little over instead of checking
+#define WPNG__SLACK 64
+
+static
+wpng__u32 wpng__get32(const wpng__u8* p)
+{
+	return (wpng__u32)p[0] << 24 | (wpng__u32)p[1] << 16 | (wpng__u32)p[2] << 8 | p[3];
+}
+
+#define WPNG__TYPE(a, b, c, d) ((wpng__u32)(a) << 24 | (wpng__u32)(b) << 16 | (wpng__u32)(c) << 8 | (d))
+
+// Chunks
+//
+// Everything out of the chunks that decoding needs. It's checked
+// the way stb_image checks it, so whatever gets past here stb_image
+// would have decoded too.
+typedef struct
+{
+	int width, height;
+	int depth, color;
+	// Samples per pixel as stored, so 1 for a palette index
+	int channels;
+	// Bytes per row, not counting the filter byte, and how
+	// far back the filters reach
+	ptrdiff_t rowBytes;
+	int filterBytes;
+	wpng__u8 palette[256 * 4];
+	int paletteSize;
+	int hasTransparency;
+	// The color that's transparent, for gray and RGB images,
+	// as stb_image compares it
+	wpng__u8 transparent8[3];
+	wpng__u16 transparent16[3];
+	// The first IDAT, and all of them together
+	const wpng__u8* idat;
+	ptrdiff_t idatSize;
+	int idatCount;
+} wpng__Png;
+
+static
+int wpng__parse(wpng__Png* png, const wpng__u8* data, ptrdiff_t size)
+{
+	static const wpng__u8 signature[8] = {137, 80, 78, 71, 13, 10, 26, 10};
+	// What a sample's top value scales to, so it reaches 255
+	static const wpng__u8 depthScale[9] = {0, 0xff, 0x55, 0, 0x11, 0, 0, 0, 0x01};
+	memset(png, 0, sizeof(*png));
+	if(size < 8 || memcmp(data, signature, 8) != 0) return 0;
+
+	const wpng__u8* p = data + 8;
+	const wpng__u8* end = data + size;
+	int paletted = 0;
+	for(;;) {
+		if(end - p < 12) return 0;
+		wpng__u32 length = wpng__get32(p);
+		wpng__u32 type = wpng__get32(p + 4);
+		const wpng__u8* c = p + 8;
+		if((ptrdiff_t)length > end - c - 4) return 0;
+		p = c + length + 4;
+		if(type != WPNG__TYPE('I', 'H', 'D', 'R') && !png->width) return 0;
+
+		switch(type) {
+			case WPNG__TYPE('I', 'H', 'D', 'R'): {
+				if(png->width || length != 13) return 0;
+				wpng__u32 w = wpng__get32(c), h = wpng__get32(c + 4);
+				int depth = c[8], color = c[9];
+				if(!w || !h || w > (1 << 24) || h > (1 << 24)) return 0;
+				if(depth != 1 && depth != 2 && depth != 4 && depth != 8 && depth != 16) return 0;
+				if(color > 6 || (color != 3 && (color & 1)) || (color == 3 && depth == 16)) return 0;
+				// Compression, filter method, and interlacing
+				if(c[10] || c[11] || c[12]) return 0;
+				paletted = color == 3;
+				png->channels = paletted ? 1 : (color & 2 ? 3 : 1) + (color & 4 ? 1 : 0);
+				// stb_image's limit, which keeps the sizes in 32 bits
+				if((1u << 30) / w / (paletted ? 4 : png->channels) < h) return 0;
+				png->width = (int)w;
+				png->height = (int)h;
+				png->depth = depth;
+				png->color = color;
+				png->rowBytes = ((ptrdiff_t)png->channels * w * depth + 7) >> 3;
+				png->filterBytes = depth < 8 ? 1 : png->channels * depth / 8;
+			} break;
+
+			case WPNG__TYPE('P', 'L', 'T', 'E'): {
+				if(length > 256 * 3 || length % 3) return 0;
+				png->paletteSize = length / 3;
+				for(int i = 0; i < png->paletteSize; ++i) {
+					memcpy(png->palette + i * 4, c + i * 3, 3);
+					png->palette[i * 4 + 3] = 255;
+				}
+			} break;
+
+			case WPNG__TYPE('t', 'R', 'N', 'S'): {
+				if(png->idatCount) return 0;
+				if(paletted) {
+					if(!png->paletteSize || (int)length > png->paletteSize) return 0;
+					for(wpng__u32 i = 0; i < length; ++i) png->palette[i * 4 + 3] = c[i];
+				} else {
+					if(!(png->channels & 1) || length != (wpng__u32)png->channels * 2) return 0;
+					png->hasTransparency = 1;
+					for(int k = 0; k < png->channels; ++k) {
+						wpng__u16 value = (wpng__u16)(c[k * 2] << 8 | c[k * 2 + 1]);
+						png->transparent16[k] = value;
+						if(png->depth < 16) png->transparent8[k] = (wpng__u8)((value & 255) * depthScale[png->depth]);
+					}
+				}
+			} break;
+
+			case WPNG__TYPE('I', 'D', 'A', 'T'): {
+				if(paletted && !png->paletteSize) return 0;
+				if(!png->idatCount) png->idat = c;
+				png->idatSize += length;
+				png->idatCount += 1;
+			} break;
+
+			case WPNG__TYPE('I', 'E', 'N', 'D'):
+				return png->idatCount > 0;
+
+			default:
+				// Apple's CgBI, and anything else critical we don't know
+				if(!(type & (1u << 29))) return 0;
+				break;
+		}
+	}
+}
+
+// Inflate
+//
+// Table entries are 32 bits: the code's length in bits on the bottom,
+// then what it decodes to. Codes longer than the table's root bits
+// go through a subtable, found by the root bits, and indexed by the
+// bits after them.
+#define WPNG__LITBITS 11
+#define WPNG__DISTBITS 8
+#define WPNG__LENBITS 7
+
+#define WPNG__KIND(e) ((e) & (7 << 5))
+// One or two literals, in bits 8-15 and 16-23, with how many in 24-31
+#define WPNG__LITERAL (0 << 5)
+// A length or distance: extra bits in 8-15 and a base in 16-31
+#define WPNG__BASE (1 << 5)
+#define WPNG__END (2 << 5)
+// A subtable: its bits in 8-15 and where it starts in 16-31
+#define WPNG__SUBTABLE (3 << 5)
+#define WPNG__INVALID (4 << 5)
+
+typedef struct
+{
+	// Subtables hold one code each at most, 16 entries
+	// at most for lengths and 128 for distances
+	wpng__u32 lit[(1 << WPNG__LITBITS) + 288 * 16];
+	wpng__u32 dist[(1 << WPNG__DISTBITS) + 32 * 128];
+	wpng__u32 lens[1 << WPNG__LENBITS];
+	wpng__u32 litSymbols[288];
+	wpng__u32 distSymbols[32];
+	wpng__u32 lenSymbols[19];
+} wpng__Tables;
+
+static
+void wpng__symbols(wpng__Tables* t)
+{
+	static const wpng__u16 lengthBase[29] = {
+		3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+		35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258
+	};
+	static const wpng__u8 lengthExtra[29] = {
+		0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+		3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0
+	};
+	static const wpng__u16 distBase[30] = {
+		1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+		257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577
+	};
+	static const wpng__u8 distExtra[30] = {
+		0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+		7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13
+	};
+	for(int i = 0; i < 288; ++i) {
+		if(i < 256) t->litSymbols[i] = WPNG__LITERAL | i << 8 | 1u << 24;
+		else if(i == 256) t->litSymbols[i] = WPNG__END;
+		else if(i < 286) t->litSymbols[i] = WPNG__BASE | lengthExtra[i - 257] << 8 | (wpng__u32)lengthBase[i - 257] << 16;
+		else t->litSymbols[i] = WPNG__INVALID;
+	}
+	for(int i = 0; i < 32; ++i) {
+		t->distSymbols[i] = i < 30 ? WPNG__BASE | distExtra[i] << 8 | (wpng__u32)distBase[i] << 16 : WPNG__INVALID;
+	}
+	for(int i = 0; i < 19; ++i) t->lenSymbols[i] = WPNG__LITERAL | i << 8;
+}
+
+// Fills a table for canonical codes of the given lengths. Codes
+// that leave gaps are fine, and the gaps decode as invalid; codes
+// that don't fit in their lengths aren't, and return 0.
+static
+int wpng__build(wpng__u32* table, int rootBits, const wpng__u8* lengths, const wpng__u32* symbols, int count)
+{
+	int counts[16] = {0};
+	for(int i = 0; i < count; ++i) counts[lengths[i]] += 1;
+	int left = 1;
+	for(int i = 1; i < 16; ++i) {
+		left = (left << 1) - counts[i];
+		if(left < 0) return 0;
+	}
+	int next[16];
+	int code = 0;
+	counts[0] = 0;
+	for(int i = 1; i < 16; ++i) {
+		code = (code + counts[i - 1]) << 1;
+		next[i] = code;
+	}
+
+	int rootSize = 1 << rootBits;
+	wpng__u8 longest[1 << WPNG__LITBITS] = {0};
+	wpng__u16 codes[288];
+	for(int i = 0; i < rootSize; ++i) table[i] = WPNG__INVALID;
+	for(int i = 0; i < count; ++i) {
+		int length = lengths[i];
+		if(!length) continue;
+		// Deflate sends codes from the top bit down, and we read
+		// from the bottom up, so tables go by the codes reversed
+		int c = next[length]++, reversed = 0;
+		for(int b = 0; b < length; ++b) reversed |= ((c >> b) & 1) << (length - 1 - b);
+		codes[i] = (wpng__u16)reversed;
+		if(length <= rootBits) {
+			for(int j = reversed; j < rootSize; j += 1 << length) table[j] = symbols[i] | length;
+		} else if(length > longest[reversed & (rootSize - 1)]) {
+			longest[reversed & (rootSize - 1)] = (wpng__u8)length;
+		}
+	}
+
+	int offset = rootSize;
+	for(int i = 0; i < rootSize; ++i) {
+		if(!longest[i]) continue;
+		int bits = longest[i] - rootBits;
+		table[i] = WPNG__SUBTABLE | bits << 8 | (wpng__u32)offset << 16 | rootBits;
+		for(int j = 0; j < 1 << bits; ++j) table[offset + j] = WPNG__INVALID;
+		offset += 1 << bits;
+	}
+	for(int i = 0; i < count; ++i) {
+		int length = lengths[i];
+		if(length <= rootBits) continue;
+		wpng__u32 root = table[codes[i] & (rootSize - 1)];
+		wpng__u32* sub = table + (root >> 16);
+		int bits = (root >> 8) & 255;
+		for(int j = codes[i] >> rootBits; j < 1 << bits; j += 1 << (length - rootBits)) {
+			sub[j] = symbols[i] | length;
+		}
+	}
+	return 1;
+}
+
+// Wherever a literal's code leaves room in the root bits for the
+// whole of another literal's, the entry gets both
+static
+void wpng__pairLiterals(wpng__u32* table)
+{
+	wpng__u32 single[1 << WPNG__LITBITS];
+	memcpy(single, table, sizeof(single));
+	for(int i = 0; i < 1 << WPNG__LITBITS; ++i) {
+		wpng__u32 first = single[i];
+		if(WPNG__KIND(first) != WPNG__LITERAL) continue;
+		int length = first & 31;
+		// The bits after the first code, with zeros past what the
+		// index knows; the second code has to fit in what it knows
+		wpng__u32 second = single[i >> length];
+		if(WPNG__KIND(second) != WPNG__LITERAL || length + (second & 31) > WPNG__LITBITS) continue;
+		table[i] = WPNG__LITERAL | (length + (second & 31)) | (first & 0xff00) | (second & 0xff00) << 8 | 2u << 24;
+	}
+}
+
+static inline
+wpng__u32 wpng__lookup(const wpng__u32* table, wpng__u64 bits, int rootBits)
+{
+	wpng__u32 e = table[bits & ((1 << rootBits) - 1)];
+	if(WPNG__KIND(e) == WPNG__SUBTABLE) {
+		e = table[(e >> 16) + ((bits >> rootBits) & ((1u << ((e >> 8) & 255)) - 1))];
+	}
+	return e;
+}
+
+static inline
+wpng__u64 wpng__load64(const wpng__u8* p)
+{
+	wpng__u64 v;
+	memcpy(&v, p, 8);
+	return v;
+}
+
+// Inflates a zlib stream into exactly outSize bytes at out, which
+// has WPNG__SLACK more after it to write over. Like stb_image, it
+// doesn't check the Adler-32 at the end.
+static
+int wpng__inflate(wpng__u8* out, ptrdiff_t outSize, const wpng__u8* in, ptrdiff_t inSize, wpng__Tables* t)
+{
+	const wpng__u8* inEnd = in + inSize;
+	wpng__u8* outStart = out;
+	wpng__u8* outEnd = out + outSize;
+	// Bits come off the bottom. Above count there can be bits of the
+	// bytes past in, which get ORed in again, unchanged, later on.
+	wpng__u64 bits = 0;
+	int count = 0;
+	// Zero bytes made up past the end of the input; using any of
+	// their bits means the stream was cut short
+	int padded = 0;
+
+	// Tops the buffer up to at least 56 bits: a whole word at a time
+	// while there's one left, and a byte at a time after that
+#define WPNG__REFILL() do { \
+	if(inEnd - in >= 8) { \
+		bits |= wpng__load64(in) << count; \
+		in += (63 - count) >> 3; \
+		count |= 56; \
+	} else { \
+		while(count <= 56) { \
+			if(in < inEnd) bits |= (wpng__u64)*in++ << count; \
+			else padded += 1; \
+			count += 8; \
+		} \
+	} \
+} while(0)
+#define WPNG__CONSUME(n) (bits >>= (n), count -= (n))
+
+	if(inSize < 2) return 0;
+	int cmf = in[0], flg = in[1];
+	if((cmf * 256 + flg) % 31 || (flg & 32) || (cmf & 15) != 8) return 0;
+	in += 2;
+	wpng__symbols(t);
+
+	int final = 0;
+	while(!final) {
+		WPNG__REFILL();
+		if(padded > 8) return 0;
+		final = bits & 1;
+		int type = (bits >> 1) & 3;
+		WPNG__CONSUME(3);
+
+		if(type == 0) {
+			// Stored: back up to the byte boundary and copy
+			WPNG__CONSUME(count & 7);
+			ptrdiff_t buffered = (count >> 3) - padded;
+			if(buffered < 0) return 0;
+			in -= buffered;
+			bits = 0;
+			count = 0;
+			padded = 0;
+			if(inEnd - in < 4) return 0;
+			int length = in[0] | in[1] << 8;
+			if((length ^ 0xffff) != (in[2] | in[3] << 8)) return 0;
+			in += 4;
+			if(inEnd - in < length || outEnd - out < length) return 0;
+			memcpy(out, in, length);
+			in += length;
+			out += length;
+			continue;
+		}
+
+		if(type == 1) {
+			wpng__u8 lengths[288 + 32];
+			memset(lengths, 8, 144);
+			memset(lengths + 144, 9, 112);
+			memset(lengths + 256, 7, 24);
+			memset(lengths + 280, 8, 8);
+			memset(lengths + 288, 5, 32);
+			wpng__build(t->lit, WPNG__LITBITS, lengths, t->litSymbols, 288);
+			wpng__build(t->dist, WPNG__DISTBITS, lengths + 288, t->distSymbols, 32);
+		} else if(type == 2) {
+			static const wpng__u8 order[19] = {16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15};
+			int litCount = (bits & 31) + 257;
+			int distCount = ((bits >> 5) & 31) + 1;
+			int lenCount = ((bits >> 10) & 15) + 4;
+			WPNG__CONSUME(14);
+			wpng__u8 lenLengths[19] = {0};
+			for(int i = 0; i < lenCount; ++i) {
+				if(count < 3) WPNG__REFILL();
+				lenLengths[order[i]] = bits & 7;
+				WPNG__CONSUME(3);
+			}
+			if(!wpng__build(t->lens, WPNG__LENBITS, lenLengths, t->lenSymbols, 19)) return 0;
+
+			wpng__u8 lengths[288 + 32] = {0};
+			int total = litCount + distCount;
+			for(int n = 0; n < total;) {
+				WPNG__REFILL();
+				if(padded > 8) return 0;
+				wpng__u32 e = t->lens[bits & ((1 << WPNG__LENBITS) - 1)];
+				if(WPNG__KIND(e) == WPNG__INVALID) return 0;
+				WPNG__CONSUME(e & 31);
+				int symbol = (e >> 8) & 255;
+				if(symbol < 16) {
+					lengths[n++] = (wpng__u8)symbol;
+					continue;
+				}
+				int repeat, value = 0;
+				if(symbol == 16) {
+					if(!n) return 0;
+					value = lengths[n - 1];
+					repeat = 3 + (bits & 3);
+					WPNG__CONSUME(2);
+				} else if(symbol == 17) {
+					repeat = 3 + (bits & 7);
+					WPNG__CONSUME(3);
+				} else {
+					repeat = 11 + (bits & 127);
+					WPNG__CONSUME(7);
+				}
+				if(n + repeat > total) return 0;
+				memset(lengths + n, value, repeat);
+				n += repeat;
+			}
+			// Distances start right after however many lengths there were
+			wpng__u8 distLengths[32] = {0};
+			memcpy(distLengths, lengths + litCount, distCount);
+			memset(lengths + litCount, 0, 288 - litCount);
+			if(!wpng__build(t->lit, WPNG__LITBITS, lengths, t->litSymbols, 288)) return 0;
+			if(!wpng__build(t->dist, WPNG__DISTBITS, distLengths, t->distSymbols, 32)) return 0;
+		} else {
+			return 0;
+		}
+		wpng__pairLiterals(t->lit);
+
+		// One refill covers the longest length and distance together,
+		// 48 bits with their extra bits
+		for(;;) {
+			WPNG__REFILL();
+			wpng__u32 e = wpng__lookup(t->lit, bits, WPNG__LITBITS);
+			WPNG__CONSUME(e & 31);
+			wpng__u32 kind = WPNG__KIND(e);
+			// One literal or two, the same way; with one, the second
+			// byte gets written over next time
+			if(kind == WPNG__LITERAL) {
+				ptrdiff_t literals = e >> 24;
+				if(outEnd - out < literals) return 0;
+				out[0] = (wpng__u8)(e >> 8);
+				out[1] = (wpng__u8)(e >> 16);
+				out += literals;
+				continue;
+			}
+			if(kind != WPNG__BASE) {
+				if(kind != WPNG__END || padded > 8) return 0;
+				break;
+			}
+
+			int extra = (e >> 8) & 255;
+			ptrdiff_t length = (e >> 16) + (bits & ((1u << extra) - 1));
+			WPNG__CONSUME(extra);
+			e = wpng__lookup(t->dist, bits, WPNG__DISTBITS);
+			if(WPNG__KIND(e) != WPNG__BASE) return 0;
+			WPNG__CONSUME(e & 31);
+			extra = (e >> 8) & 255;
+			ptrdiff_t distance = (e >> 16) + (bits & ((1u << extra) - 1));
+			WPNG__CONSUME(extra);
+			if(distance > out - outStart || length > outEnd - out) return 0;
+
+			// Far enough back, it goes 8 bytes at a time, at least 16
+			// of them, so most matches never loop. It can run up to 15
+			// past the end, into what comes next or the slack.
+			const wpng__u8* from = out - distance;
+			wpng__u8* to = out + length;
+			if(distance >= 8) {
+				memcpy(out, from, 8);
+				memcpy(out + 8, from + 8, 8);
+				out += 16;
+				from += 16;
+				while(out < to) {
+					memcpy(out, from, 8);
+					out += 8;
+					from += 8;
+				}
+			} else if(distance == 1) {
+				memset(out, *from, length);
+			} else {
+				do *out++ = *from++; while(out < to);
+			}
+			out = to;
+		}
+	}
+#undef WPNG__REFILL
+#undef WPNG__CONSUME
+
+	// Any made-up bytes have to be left over, not read
+	if((count >> 3) < padded) return 0;
+	return out == outEnd;
+}
+
+// Unfiltering
+//
+// Each row is filtered against the one above it, prior, and the
+// pixel filterBytes to its left, with both of those zero past the
+// edges. The filter each row uses comes first, then its bytes.
+static inline
+int wpng__paeth(int a, int b, int c)
+{
+	int p = a + b - c;
+	int pa = abs(p - a), pb = abs(p - b), pc = abs(p - c);
+	if(pa <= pb && pa <= pc) return a;
+	if(pb <= pc) return b;
+	return c;
+}
+
+static
+void wpng__unfilterScalar(wpng__u8* cur, const wpng__u8* raw, const wpng__u8* prior,
+		ptrdiff_t rowBytes, int filterBytes, int filter)
+{
+	ptrdiff_t n = filterBytes;
+	switch(filter) {
+		case 0:
+			memcpy(cur, raw, rowBytes);
+			break;
+		case 1:
+			for(ptrdiff_t k = 0; k < n; ++k) cur[k] = raw[k];
+			for(ptrdiff_t k = n; k < rowBytes; ++k) cur[k] = (wpng__u8)(raw[k] + cur[k - n]);
+			break;
+		case 2:
+			for(ptrdiff_t k = 0; k < rowBytes; ++k) cur[k] = (wpng__u8)(raw[k] + prior[k]);
+			break;
+		case 3:
+			for(ptrdiff_t k = 0; k < n; ++k) cur[k] = (wpng__u8)(raw[k] + (prior[k] >> 1));
+			for(ptrdiff_t k = n; k < rowBytes; ++k) cur[k] = (wpng__u8)(raw[k] + ((prior[k] + cur[k - n]) >> 1));
+			break;
+		case 4:
+			for(ptrdiff_t k = 0; k < n; ++k) cur[k] = (wpng__u8)(raw[k] + prior[k]);
+			for(ptrdiff_t k = n; k < rowBytes; ++k) {
+				cur[k] = (wpng__u8)(raw[k] + wpng__paeth(cur[k - n], prior[k], prior[k - n]));
+			}
+			break;
+	}
+}
+
+static inline
+__m128i wpng__load32(const wpng__u8* p)
+{
+	int v;
+	memcpy(&v, p, 4);
+	return _mm_cvtsi32_si128(v);
+}
+
+static inline
+void wpng__store32(wpng__u8* p, __m128i v)
+{
+	int x = _mm_cvtsi128_si32(v);
+	memcpy(p, &x, 4);
+}
+
+// Paeth on 16-bit lanes. This is the form later stb_image uses:
+// with lo and hi the smaller and larger of a and b, where 3c - a - b
+// falls picks the same one as comparing the three distances.
+static inline
+__m128i wpng__paethSse(__m128i a, __m128i b, __m128i c)
+{
+	__m128i threshold = _mm_sub_epi16(_mm_add_epi16(c, _mm_add_epi16(c, c)), _mm_add_epi16(a, b));
+	__m128i lo = _mm_min_epi16(a, b);
+	__m128i hi = _mm_max_epi16(a, b);
+	__m128i useC = _mm_cmpgt_epi16(hi, threshold);
+	__m128i loOrC = _mm_or_si128(_mm_and_si128(useC, c), _mm_andnot_si128(useC, lo));
+	__m128i useHi = _mm_cmpgt_epi16(threshold, lo);
+	return _mm_or_si128(_mm_and_si128(useHi, loOrC), _mm_andnot_si128(useHi, hi));
+}
+
+// Sub, Avg and Paeth for 3 and 4 byte pixels, one pixel per step,
+// since each one needs the one before it. Pixels go in and out 4
+// bytes at a time, so with 3 byte pixels they read and write one
+// byte past the row, into what comes next or the slack.
+static
+void wpng__unfilterSse(wpng__u8* cur, const wpng__u8* raw, const wpng__u8* prior,
+		ptrdiff_t rowBytes, int filterBytes, int filter)
+{
+	const __m128i zero = _mm_setzero_si128();
+	ptrdiff_t n = filterBytes;
+	if(filter == 1) {
+		__m128i a = zero;
+		for(ptrdiff_t k = 0; k < rowBytes; k += n) {
+			a = _mm_add_epi8(a, wpng__load32(raw + k));
+			wpng__store32(cur + k, a);
+		}
+	} else if(filter == 3) {
+		// avg rounds up, and the filter rounds down
+		const __m128i one = _mm_set1_epi8(1);
+		__m128i a = zero;
+		for(ptrdiff_t k = 0; k < rowBytes; k += n) {
+			__m128i b = wpng__load32(prior + k);
+			__m128i average = _mm_sub_epi8(_mm_avg_epu8(a, b), _mm_and_si128(_mm_xor_si128(a, b), one));
+			a = _mm_add_epi8(wpng__load32(raw + k), average);
+			wpng__store32(cur + k, a);
+		}
+	} else {
+		const __m128i mask = _mm_set1_epi16(255);
+		__m128i a = zero, c = zero;
+		for(ptrdiff_t k = 0; k < rowBytes; k += n) {
+			__m128i b = _mm_unpacklo_epi8(wpng__load32(prior + k), zero);
+			__m128i d = _mm_unpacklo_epi8(wpng__load32(raw + k), zero);
+			a = _mm_and_si128(_mm_add_epi16(wpng__paethSse(a, b, c), d), mask);
+			wpng__store32(cur + k, _mm_packus_epi16(a, a));
+			c = b;
+		}
+	}
+}
+
+// Two Paeth rows at once. One row alone leaves most of the register
+// waiting on the pixel to the left, so the second row runs a pixel
+// behind in the high half: its above is the first row's pixel that
+// just came out of the low half, and its above-left the one before.
+static
+void wpng__paethPairSse(wpng__u8* cur0, wpng__u8* cur1, const wpng__u8* raw0, const wpng__u8* raw1,
+		const wpng__u8* prior, ptrdiff_t rowBytes, int filterBytes)
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i mask = _mm_set1_epi16(255);
+	ptrdiff_t n = filterBytes;
+
+	// The first row's first pixel has only the one above it
+	__m128i c = _mm_unpacklo_epi8(wpng__load32(prior), zero);
+	__m128i a = _mm_and_si128(_mm_add_epi16(c, _mm_unpacklo_epi8(wpng__load32(raw0), zero)), mask);
+	wpng__store32(cur0, _mm_packus_epi16(a, a));
+	for(ptrdiff_t k = n; k < rowBytes; k += n) {
+		__m128i b = _mm_unpacklo_epi64(_mm_unpacklo_epi8(wpng__load32(prior + k), zero), a);
+		__m128i d = _mm_unpacklo_epi8(_mm_unpacklo_epi32(wpng__load32(raw0 + k), wpng__load32(raw1 + k - n)), zero);
+		a = _mm_and_si128(_mm_add_epi16(wpng__paethSse(a, b, c), d), mask);
+		__m128i packed = _mm_packus_epi16(a, a);
+		wpng__store32(cur0 + k, packed);
+		wpng__store32(cur1 + k - n, _mm_srli_si128(packed, 4));
+		c = b;
+	}
+	// And the second row's last pixel is left over
+	__m128i b = _mm_unpacklo_epi64(zero, a);
+	__m128i d = _mm_unpacklo_epi8(_mm_unpacklo_epi32(zero, wpng__load32(raw1 + rowBytes - n)), zero);
+	a = _mm_and_si128(_mm_add_epi16(wpng__paethSse(a, b, c), d), mask);
+	wpng__store32(cur1 + rowBytes - n, _mm_srli_si128(_mm_packus_epi16(a, a), 4));
+}
+
+#if defined(__GNUC__) || defined(__clang__)
+#define WPNG__AVX2 __attribute__((target("avx2")))
+#else
+#define WPNG__AVX2
+#endif
+
+static
+int wpng__hasAvx2(void)
+{
+#if defined(_MSC_VER)
+	int info[4];
+	__cpuid(info, 0);
+	if(info[0] < 7) return 0;
+	__cpuid(info, 1);
+	// The OS has to save the YMM registers too
+	if(!(info[2] & (1 << 27)) || !(info[2] & (1 << 28))) return 0;
+	if((_xgetbv(0) & 6) != 6) return 0;
+	__cpuidex(info, 7, 0);
+	return (info[1] & (1 << 5)) != 0;
+#elif defined(__GNUC__) || defined(__clang__)
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("avx2") != 0;
+#else
+	return 0;
+#endif
+}
+
+static
+void wpng__upSse(wpng__u8* cur, const wpng__u8* raw, const wpng__u8* prior, ptrdiff_t rowBytes)
+{
+	ptrdiff_t k = 0;
+	for(; k + 16 <= rowBytes; k += 16) {
+		__m128i x = _mm_loadu_si128((const __m128i*)(raw + k));
+		__m128i b = _mm_loadu_si128((const __m128i*)(prior + k));
+		_mm_storeu_si128((__m128i*)(cur + k), _mm_add_epi8(x, b));
+	}
+	for(; k < rowBytes; ++k) cur[k] = (wpng__u8)(raw[k] + prior[k]);
+}
+
+static WPNG__AVX2
+void wpng__upAvx2(wpng__u8* cur, const wpng__u8* raw, const wpng__u8* prior, ptrdiff_t rowBytes)
+{
+	ptrdiff_t k = 0;
+	for(; k + 32 <= rowBytes; k += 32) {
+		__m256i x = _mm256_loadu_si256((const __m256i*)(raw + k));
+		__m256i b = _mm256_loadu_si256((const __m256i*)(prior + k));
+		_mm256_storeu_si256((__m256i*)(cur + k), _mm256_add_epi8(x, b));
+	}
+	for(; k < rowBytes; ++k) cur[k] = (wpng__u8)(raw[k] + prior[k]);
+}
+
+// Expanding to RGBA8
+//
+// Gray copies into red, green and blue, missing alpha is 255, and
+// 16-bit samples keep their top byte, the way stb_image converts
+// them. A pixel matching the tRNS color gets alpha 0; stb_image
+// compares 16-bit ones before they lose their bottom byte, and
+// 1, 2 and 4-bit gray after it's scaled up to 8. Palette indices
+// past the end of the palette return 0, since stb_image reads
+// whatever happens to be on its stack for those.
+static
+int wpng__expandScalar(wpng__u8* dst, const wpng__u8* src, const wpng__Png* png)
+{
+	static const wpng__u8 depthScale[9] = {0, 0xff, 0x55, 0, 0x11, 0, 0, 0, 0x01};
+	int w = png->width;
+	int trns = png->hasTransparency;
+	if(png->depth < 8) {
+		int depth = png->depth, top = (1 << depth) - 1;
+		wpng__u8 scale = depthScale[depth];
+		for(int x = 0; x < w; ++x) {
+			int bit = x * depth;
+			int v = (src[bit >> 3] >> (8 - depth - (bit & 7))) & top;
+			if(png->color == 3) {
+				if(v >= png->paletteSize) return 0;
+				memcpy(dst + x * 4, png->palette + v * 4, 4);
+			} else {
+				wpng__u8 g = (wpng__u8)(v * scale);
+				dst[x * 4 + 0] = dst[x * 4 + 1] = dst[x * 4 + 2] = g;
+				dst[x * 4 + 3] = trns && g == png->transparent8[0] ? 0 : 255;
+			}
+		}
+		return 1;
+	}
+
+	int step = png->depth / 8;
+	int n = png->channels * step;
+	for(int x = 0; x < w; ++x) {
+		const wpng__u8* s = src + x * n;
+		wpng__u8* d = dst + x * 4;
+		switch(png->color) {
+			case 0: {
+				d[0] = d[1] = d[2] = s[0];
+				int match = step == 2 ? (s[0] << 8 | s[1]) == png->transparent16[0] : s[0] == png->transparent8[0];
+				d[3] = trns && match ? 0 : 255;
+			} break;
+			case 2: {
+				d[0] = s[0];
+				d[1] = s[step];
+				d[2] = s[step * 2];
+				int match = 1;
+				for(int k = 0; k < 3; ++k) {
+					if(step == 2) match &= (s[k * 2] << 8 | s[k * 2 + 1]) == png->transparent16[k];
+					else match &= s[k] == png->transparent8[k];
+				}
+				d[3] = trns && match ? 0 : 255;
+			} break;
+			case 3:
+				if(s[0] >= png->paletteSize) return 0;
+				memcpy(d, png->palette + s[0] * 4, 4);
+				break;
+			case 4:
+				d[0] = d[1] = d[2] = s[0];
+				d[3] = s[step];
+				break;
+			case 6:
+				d[0] = s[0];
+				d[1] = s[step];
+				d[2] = s[step * 2];
+				d[3] = s[step * 3];
+				break;
+		}
+	}
+	return 1;
+}
+
+// RGB8 without tRNS, 8 pixels at a time. It reads 32 bytes for
+// every 24 it uses, so it runs 8 past the row into the slack.
+static WPNG__AVX2
+void wpng__expandRgbAvx2(wpng__u8* dst, const wpng__u8* src, int width)
+{
+	const __m256i spread = _mm256_setr_epi32(0, 1, 2, 0, 3, 4, 5, 0);
+	const __m256i shuffle = _mm256_setr_epi8(
+			0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1,
+			0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+	const __m256i alpha = _mm256_set1_epi32((int)0xff000000);
+	int x = 0;
+	for(; x + 8 <= width; x += 8) {
+		__m256i v = _mm256_loadu_si256((const __m256i*)(src + x * 3));
+		v = _mm256_permutevar8x32_epi32(v, spread);
+		v = _mm256_or_si256(_mm256_shuffle_epi8(v, shuffle), alpha);
+		_mm256_storeu_si256((__m256i*)(dst + x * 4), v);
+	}
+	for(; x < width; ++x) {
+		dst[x * 4 + 0] = src[x * 3 + 0];
+		dst[x * 4 + 1] = src[x * 3 + 1];
+		dst[x * 4 + 2] = src[x * 3 + 2];
+		dst[x * 4 + 3] = 255;
+	}
+}
+
+int wpngInfo(const void* data, ptrdiff_t size, int* width, int* height)
+{
+	wpng__Png png;
+	if(!wpng__parse(&png, (const wpng__u8*)data, size)) return 0;
+	*width = png.width;
+	*height = png.height;
+	return 1;
+}
+
+int wpngDecode(unsigned char* dst, const void* data, ptrdiff_t size, unsigned int flags)
+{
+	wpng__Png* png = (wpng__Png*)wpngMalloc(sizeof(wpng__Png));
+	wpng__Tables* tables = (wpng__Tables*)wpngMalloc(sizeof(wpng__Tables));
+	if(!png || !tables || !wpng__parse(png, (const wpng__u8*)data, size)) {
+		wpngFree(png);
+		wpngFree(tables);
+		return 0;
+	}
+
+	// One IDAT inflates from where it is; more get put together first
+	const wpng__u8* idat = png->idat;
+	wpng__u8* gathered = NULL;
+	if(png->idatCount > 1) {
+		gathered = (wpng__u8*)wpngMalloc(png->idatSize);
+		ptrdiff_t at = 0;
+		const wpng__u8* p = (const wpng__u8*)data + 8;
+		for(int found = 0; gathered && found < png->idatCount; p += 12 + wpng__get32(p)) {
+			if(wpng__get32(p + 4) != WPNG__TYPE('I', 'D', 'A', 'T')) continue;
+			memcpy(gathered + at, p + 8, wpng__get32(p));
+			at += wpng__get32(p);
+			found += 1;
+		}
+		idat = gathered;
+	}
+
+	ptrdiff_t stride = png->rowBytes + 1;
+	ptrdiff_t rawSize = stride * png->height;
+	wpng__u8* raw = (wpng__u8*)wpngMalloc(rawSize + WPNG__SLACK);
+	// A row of zeros above the first, and three to unfilter into
+	// for images that aren't RGBA8 already: two at once and the
+	// one above them
+	ptrdiff_t rowSize = png->rowBytes + WPNG__SLACK;
+	wpng__u8* rows = (wpng__u8*)wpngMalloc(rowSize * 4);
+	int ok = idat && raw && rows && wpng__inflate(raw, rawSize, idat, png->idatSize, tables);
+	wpngFree(gathered);
+	wpngFree(tables);
+
+	if(ok) {
+		int simd = !(flags & WPNG_SCALAR);
+		int avx2 = simd && wpng__hasAvx2();
+		int direct = png->color == 6 && png->depth == 8;
+		int rgb = png->color == 2 && png->depth == 8 && !png->hasTransparency;
+		int n = png->filterBytes;
+		ptrdiff_t dstStride = (ptrdiff_t)png->width * 4;
+		wpng__u8* zeros = rows + rowSize * 3;
+		memset(zeros, 0, rowSize);
+		const wpng__u8* prior = zeros;
+		for(int y = 0; ok && y < png->height;) {
+			const wpng__u8* line = raw + stride * y;
+			int filter = line[0];
+			if(filter > 4) {
+				ok = 0;
+				break;
+			}
+			int pixelSimd = simd && (n == 3 || n == 4);
+			int count = pixelSimd && filter == 4 && y + 1 < png->height && line[stride] == 4 ? 2 : 1;
+			wpng__u8* out[2];
+			wpng__u8* cur[2];
+			for(int i = 0; i < count; ++i) {
+				out[i] = dst + dstStride * (flags & WPNG_FLIP ? png->height - 1 - (y + i) : y + i);
+				cur[i] = direct ? out[i] : rows + rowSize * ((y + i) % 3);
+			}
+			if(count == 2) {
+				wpng__paethPairSse(cur[0], cur[1], line + 1, line + stride + 1, prior, png->rowBytes, n);
+			} else if(!simd || filter == 0 || (!pixelSimd && filter != 2)) {
+				wpng__unfilterScalar(cur[0], line + 1, prior, png->rowBytes, n, filter);
+			} else if(filter == 2) {
+				if(avx2) wpng__upAvx2(cur[0], line + 1, prior, png->rowBytes);
+				else wpng__upSse(cur[0], line + 1, prior, png->rowBytes);
+			} else {
+				wpng__unfilterSse(cur[0], line + 1, prior, png->rowBytes, n, filter);
+			}
+			for(int i = 0; i < count; ++i) {
+				if(rgb && avx2) wpng__expandRgbAvx2(out[i], cur[i], png->width);
+				else if(!direct && !wpng__expandScalar(out[i], cur[i], png)) ok = 0;
+			}
+			prior = cur[count - 1];
+			y += count;
+		}
+	}
+	wpngFree(raw);
+	wpngFree(rows);
+	wpngFree(png);
+	return ok;
+}
+
+#endif
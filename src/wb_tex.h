@@ -0,0 +1,1616 @@
+/* wb_tex.h
+ *
+ * Texture cooking: turns decoded RGBA8 images into block compressed
+ * mip chains the GPU samples straight from, and lays them out as
+ * .wbt files, so the work only happens once per source image.
+ *
+ * BC7 is for color, and anything else with three or four channels
+ * that matter; BC5 is for tangent-space normal maps, which only keep
+ * x and y and leave z to the shader; BC4 is for single channels.
+ * That's 1 byte per texel for BC7 and BC5, and half that for BC4,
+ * instead of RGBA8's 4.
+ *
+ * Mips are filtered on the CPU, in linear light for color and as
+ * unit vectors for normals, with a box or a Kaiser-windowed sinc.
+ *
+ * Mips and compression both run on the wb_jobs pool, a band of rows
+ * per job, so include wb_jobs.h's dependencies when linking, same
+ * as wb_fbx.
+ *
+ * Like wb_mesh.h, the implementation goes in one translation
+ * unit with WB_TEX_IMPLEMENTATION defined; main.c does this.
+ *
+ */
+
+#ifndef WB_TEX_H
+#define WB_TEX_H
+
+#include <stddef.h>
+
+// Goes up whenever the cooker's output changes, so old .wbt
+// files stop matching and get cooked again
+#define WTEX_COOK_VERSION 3
+
+enum
+{
+	// 8 bytes per 4x4 block: red only
+	WTEX_FORMAT_BC4 = 1,
+	// 16 bytes per block: red and green, as two BC4 blocks
+	WTEX_FORMAT_BC5 = 2,
+	// 16 bytes per block: RGBA
+	WTEX_FORMAT_BC7 = 3,
+};
+
+enum
+{
+	// Color: mips are averaged in linear light instead of on
+	// the sRGB values, so they don't darken as they shrink
+	WTEX_MIPS_SRGB = 1 << 0,
+	// Tangent-space normals in RGB: mips are averaged as
+	// vectors and renormalized
+	WTEX_MIPS_NORMAL = 1 << 1,
+	// A Kaiser-windowed sinc, 8 taps a side, instead of a 2x2 box:
+	// sharper mips, for a little ringing around hard edges
+	WTEX_MIPS_KAISER = 1 << 2,
+	// The plain C loops instead of SSE2 and AVX2, for benchmarks.
+	// They make the same bits, so .wbt files don't keep it.
+	WTEX_MIPS_SCALAR = 1 << 3,
+};
+
+// 32768 on a side
+#define WTEX_MAX_LEVELS 16
+
+typedef struct
+{
+	int format;
+	int width, height;
+	// Level 0 is the full image, and each level after it is half the
+	// last, rounded down, to 1x1. Blocks are row major; levels that
+	// aren't a multiple of 4 have their edge blocks padded out.
+	int levelCount;
+	const unsigned char* levels[WTEX_MAX_LEVELS];
+	ptrdiff_t levelSizes[WTEX_MAX_LEVELS];
+	unsigned int mipFlags;
+	// Whatever the caller passed wtexCook to keep with it, like the
+	// color a mask in the alpha channel is for; see wtexFindTint
+	unsigned char tint[4];
+	// What it was cooked from, for telling when it's stale
+	unsigned long long sourceHash;
+	unsigned long long sourceSize;
+} wtexImage;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Block compression
+//
+// Each encoder takes one 4x4 block of RGBA8 pixels, row by row. BC7
+// writes 16 bytes, mostly in mode 6: one subset, with 7-bit RGBA
+// endpoints and a p-bit each, and 4-bit indices. That's the mode
+// with the most index precision, and does well on everything short
+// of blocks with several distinct colors, where the multi-subset
+// modes would pull ahead. Blocks whose alpha varies try mode 5 as
+// well, with separate color and alpha indices, and keep whichever
+// does better. Endpoints start out along the block's
+// principal axis, and are refit by least squares to the indices
+// they get. BC5 writes 16 bytes from red and green, and BC4 writes
+// 8 from red.
+void wtexEncodeBc7(unsigned char* dst, const unsigned char* rgba);
+void wtexEncodeBc5(unsigned char* dst, const unsigned char* rgba);
+void wtexEncodeBc4(unsigned char* dst, const unsigned char* rgba);
+
+// Back to RGBA8, for checking quality. BC4 and BC5 leave the
+// channels they don't store at 0, with alpha at 255. Only BC7's
+// modes 5 (unrotated) and 6 are decoded, since that's all the
+// encoder writes.
+void wtexDecodeBlock(unsigned char* rgba, const unsigned char* block, int format);
+
+ptrdiff_t wtexBlockBytes(int format);
+ptrdiff_t wtexLevelSize(int format, int width, int height);
+int wtexLevelCount(int width, int height);
+
+// Compresses width x height RGBA8 pixels into dst, which needs
+// wtexLevelSize bytes, and waits for it on the job pool
+void wtexCompress(
+		unsigned char* dst,
+		const unsigned char* rgba,
+		int width,
+		int height,
+		int format);
+
+// Mip generation
+//
+// Fills dst with levels 1 and up of width x height RGBA8 pixels,
+// one after another, wtexMipBytes in all. Each level is filtered
+// from the last in float, so nothing gets rounded to 8 bits until
+// it's written out, and addressing wraps the way the textures are
+// sampled. Rows go out to the job pool in bands; this waits for them.
+void wtexBuildMips(
+		unsigned char* dst,
+		const unsigned char* rgba,
+		int width,
+		int height,
+		unsigned int mipFlags);
+ptrdiff_t wtexMipBytes(int width, int height);
+
+// Repacking
+//
+// Checks whether an image's color is one color all over, or one
+// color scaled by a mask, to within tolerance on every channel of
+// every texel; either way, it doesn't need a texture of its own, just
+// the color in a uniform and the mask in some other texture's spare
+// channel. Returns what it found, with the color in tint (alpha 255)
+// and what scales it in every fourth byte of mask, so mask can point
+// at another image's alpha; or 0, leaving both alone. Alpha is
+// ignored, and mask can be NULL.
+enum
+{
+	WTEX_TINT_CONSTANT = 1,
+	WTEX_TINT_MASK = 2,
+};
+
+int wtexFindTint(
+		unsigned char* tint,
+		unsigned char* mask,
+		const unsigned char* rgba,
+		int width,
+		int height,
+		int tolerance);
+
+// Cooked files (.wbt)
+//
+// wtexCook builds the whole mip chain, compresses every level and
+// lays it all out as a .wbt in one malloced block, returning it and
+// its size, with tint (which can be NULL) stored alongside, or NULL
+// if it runs out of memory. Write that to disk as is. wtexParse reads it back, checks
+// every range, and points image's levels into data; it returns 0 for
+// anything malformed, or cooked by a different WTEX_COOK_VERSION.
+unsigned char* wtexCook(
+		ptrdiff_t* size,
+		const unsigned char* rgba,
+		int width,
+		int height,
+		int format,
+		unsigned int mipFlags,
+		const unsigned char* tint,
+		unsigned long long sourceHash,
+		unsigned long long sourceSize);
+int wtexParse(wtexImage* image, const void* data, ptrdiff_t size);
+
+// Not cryptographic, just enough to notice a source image changed
+unsigned long long wtexHash(const void* data, ptrdiff_t size);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
+
+#if defined(WB_TEX_IMPLEMENTATION) && !defined(WB_TEX_IMPLEMENTED)
+#define WB_TEX_IMPLEMENTED
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#include "wb_jobs.h"
+
+#ifndef wtexMalloc
+#define wtexMalloc(size) malloc(size)
+#define wtexFree(ptr) free(ptr)
+#endif
+
+typedef unsigned char wtex__u8;
+typedef unsigned int wtex__u32;
+typedef unsigned long long wtex__u64;
+
+// BC7 interpolation weights, out of 64, for 4-bit indices
+static const int wtex__weights4[16] = {
+	0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64
+};
+
+static inline
+int wtex__clamp(int x, int lo, int hi)
+{
+	return x < lo ? lo : x > hi ? hi : x;
+}
+
+static
+void wtex__putBits(wtex__u8* dst, int* bit, wtex__u32 value, int count)
+{
+	for(int i = 0; i < count; ++i, ++*bit) {
+		if((value >> i) & 1) dst[*bit >> 3] |= (wtex__u8)(1 << (*bit & 7));
+	}
+}
+
+static
+wtex__u32 wtex__getBits(const wtex__u8* src, int* bit, int count)
+{
+	wtex__u32 value = 0;
+	for(int i = 0; i < count; ++i, ++*bit) {
+		value |= (wtex__u32)((src[*bit >> 3] >> (*bit & 7)) & 1) << i;
+	}
+	return value;
+}
+
+// BC7
+//
+// Every candidate gets its indices from an exhaustive search over the
+// 16 palette entries, which is where the time goes, so that part is
+// SSE2: four entries per register, squared differences through madd,
+// and the error and index packed into one float, err * 16 + index,
+// so a plain min finds both. The errors fit in 18 bits, so
+// that's exact.
+typedef struct
+{
+	// 7-bit endpoints and their p-bits
+	int q[2][4];
+	int p[2];
+	wtex__u8 indices[16];
+	wtex__u32 error;
+} wtex__Bc7;
+
+static
+wtex__u32 wtex__bc7Indices(wtex__u8* indices, const wtex__u8* rgba, const wtex__u8* palette)
+{
+	__m128i entries[4];
+	for(int k = 0; k < 4; ++k) {
+		entries[k] = _mm_loadu_si128((const __m128i*)(palette + k * 16));
+	}
+	__m128i zero = _mm_setzero_si128();
+	__m128 lanes = _mm_setr_ps(0, 1, 2, 3);
+
+	wtex__u32 total = 0;
+	for(int i = 0; i < 16; ++i) {
+		int pixel;
+		memcpy(&pixel, rgba + i * 4, 4);
+		__m128i p = _mm_set1_epi32(pixel);
+		__m128 best = _mm_set1_ps(1e30f);
+		for(int k = 0; k < 4; ++k) {
+			__m128i d = _mm_or_si128(_mm_subs_epu8(p, entries[k]), _mm_subs_epu8(entries[k], p));
+			__m128i lo = _mm_unpacklo_epi8(d, zero);
+			__m128i hi = _mm_unpackhi_epi8(d, zero);
+			__m128 a = _mm_castsi128_ps(_mm_madd_epi16(lo, lo));
+			__m128 b = _mm_castsi128_ps(_mm_madd_epi16(hi, hi));
+			__m128i error = _mm_add_epi32(
+					_mm_castps_si128(_mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0))),
+					_mm_castps_si128(_mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1))));
+			__m128 key = _mm_cvtepi32_ps(_mm_slli_epi32(error, 4));
+			key = _mm_add_ps(key, _mm_add_ps(lanes, _mm_set1_ps((float)(k * 4))));
+			best = _mm_min_ps(best, key);
+		}
+		best = _mm_min_ps(best, _mm_shuffle_ps(best, best, _MM_SHUFFLE(1, 0, 3, 2)));
+		best = _mm_min_ps(best, _mm_shuffle_ps(best, best, _MM_SHUFFLE(2, 3, 0, 1)));
+		wtex__u32 key = (wtex__u32)_mm_cvtss_f32(best);
+		indices[i] = (wtex__u8)(key & 15);
+		total += key >> 4;
+	}
+	return total;
+}
+
+static
+void wtex__bc7Palette(wtex__u8* palette, const int* e0, const int* e1)
+{
+	for(int i = 0; i < 16; ++i) {
+		int w = wtex__weights4[i];
+		for(int c = 0; c < 4; ++c) {
+			palette[i * 4 + c] = (wtex__u8)(((64 - w) * e0[c] + w * e1[c] + 32) >> 6);
+		}
+	}
+}
+
+// Quantizes a pair of float endpoints with each of the four p-bit
+// combinations, and keeps whichever does best
+static
+void wtex__bc7Try(wtex__Bc7* best, const wtex__u8* rgba, const float* e0, const float* e1)
+{
+	for(int p0 = 0; p0 < 2; ++p0) {
+		for(int p1 = 0; p1 < 2; ++p1) {
+			wtex__Bc7 c;
+			int end[2][4];
+			c.p[0] = p0;
+			c.p[1] = p1;
+			for(int k = 0; k < 4; ++k) {
+				c.q[0][k] = wtex__clamp((int)floorf((e0[k] - p0) * 0.5f + 0.5f), 0, 127);
+				c.q[1][k] = wtex__clamp((int)floorf((e1[k] - p1) * 0.5f + 0.5f), 0, 127);
+				end[0][k] = c.q[0][k] * 2 + p0;
+				end[1][k] = c.q[1][k] * 2 + p1;
+			}
+			wtex__u8 palette[64];
+			wtex__bc7Palette(palette, end[0], end[1]);
+			c.error = wtex__bc7Indices(c.indices, rgba, palette);
+			if(c.error < best->error) *best = c;
+		}
+	}
+}
+
+// Least squares endpoints for the indices a candidate ended up with.
+// Returns 0 when every pixel has the same weight and there's no fit.
+static
+int wtex__bc7Refit(float* e0, float* e1, const wtex__Bc7* c, const wtex__u8* rgba)
+{
+	float aa = 0, ab = 0, bb = 0;
+	float ax[4] = {0}, bx[4] = {0};
+	for(int i = 0; i < 16; ++i) {
+		float w = wtex__weights4[c->indices[i]] / 64.0f;
+		float v = 1 - w;
+		aa += v * v;
+		ab += v * w;
+		bb += w * w;
+		for(int k = 0; k < 4; ++k) {
+			ax[k] += v * rgba[i * 4 + k];
+			bx[k] += w * rgba[i * 4 + k];
+		}
+	}
+	float det = aa * bb - ab * ab;
+	if(fabsf(det) < 1e-6f) return 0;
+	for(int k = 0; k < 4; ++k) {
+		e0[k] = (bb * ax[k] - ab * bx[k]) / det;
+		e1[k] = (aa * bx[k] - ab * ax[k]) / det;
+		if(e0[k] < 0) e0[k] = 0;
+		if(e0[k] > 255) e0[k] = 255;
+		if(e1[k] < 0) e1[k] = 0;
+		if(e1[k] > 255) e1[k] = 255;
+	}
+	return 1;
+}
+
+// Endpoints at either end of the block's principal axis over its
+// first channels, found by power iteration on their covariance,
+// starting from the bounding box diagonal
+static
+void wtex__bc7Axis(float* e0, float* e1, const wtex__u8* rgba, int channels)
+{
+	float mean[4] = {0}, lo[4], hi[4];
+	for(int k = 0; k < channels; ++k) {
+		lo[k] = 255;
+		hi[k] = 0;
+	}
+	for(int i = 0; i < 16; ++i) {
+		for(int k = 0; k < channels; ++k) {
+			float v = rgba[i * 4 + k];
+			mean[k] += v;
+			if(v < lo[k]) lo[k] = v;
+			if(v > hi[k]) hi[k] = v;
+		}
+	}
+	for(int k = 0; k < channels; ++k) mean[k] /= 16;
+
+	float cov[4][4] = {{0}};
+	for(int i = 0; i < 16; ++i) {
+		float d[4];
+		for(int k = 0; k < channels; ++k) d[k] = rgba[i * 4 + k] - mean[k];
+		for(int j = 0; j < channels; ++j) {
+			for(int k = 0; k < channels; ++k) cov[j][k] += d[j] * d[k];
+		}
+	}
+
+	float axis[4];
+	for(int k = 0; k < channels; ++k) axis[k] = hi[k] - lo[k];
+	for(int n = 0; n < 8; ++n) {
+		float next[4] = {0}, length = 0;
+		for(int j = 0; j < channels; ++j) {
+			for(int k = 0; k < channels; ++k) next[j] += cov[j][k] * axis[k];
+			length += next[j] * next[j];
+		}
+		if(length < 1e-12f) break;
+		length = 1 / sqrtf(length);
+		for(int k = 0; k < channels; ++k) axis[k] = next[k] * length;
+	}
+
+	float tMin = 0, tMax = 0;
+	for(int i = 0; i < 16; ++i) {
+		float t = 0;
+		for(int k = 0; k < channels; ++k) t += (rgba[i * 4 + k] - mean[k]) * axis[k];
+		if(t < tMin) tMin = t;
+		if(t > tMax) tMax = t;
+	}
+	for(int k = 0; k < channels; ++k) {
+		e0[k] = wtex__clamp((int)(mean[k] + tMin * axis[k] + 0.5f), 0, 255);
+		e1[k] = wtex__clamp((int)(mean[k] + tMax * axis[k] + 0.5f), 0, 255);
+	}
+}
+
+// Mode 5: color and alpha each get their own endpoints and 2-bit
+// indices, with 7-bit RGB and 8-bit alpha. It only gets tried on
+// blocks where alpha varies, since that's where mode 6's shared
+// indices can lose: alpha that has nothing to do with the color,
+// like a mask packed into a spare channel, pulls the one axis
+// away from both.
+static const int wtex__weights2[4] = {0, 21, 43, 64};
+
+typedef struct
+{
+	int color[2][3];
+	int alpha[2];
+	wtex__u8 colorIndices[16];
+	wtex__u8 alphaIndices[16];
+	wtex__u32 error;
+} wtex__Bc7Mode5;
+
+// Picks each pixel's nearest of the 4 entries between e0 and e1,
+// over channels starting at first, and returns the squared error
+static
+wtex__u32 wtex__bc7Indices2(wtex__u8* indices, const wtex__u8* rgba,
+		const int* e0, const int* e1, int first, int channels)
+{
+	int palette[4][3];
+	for(int j = 0; j < 4; ++j) {
+		int w = wtex__weights2[j];
+		for(int k = 0; k < channels; ++k) {
+			palette[j][k] = ((64 - w) * e0[k] + w * e1[k] + 32) >> 6;
+		}
+	}
+	wtex__u32 total = 0;
+	for(int i = 0; i < 16; ++i) {
+		wtex__u32 best = 0xFFFFFFFF;
+		for(int j = 0; j < 4; ++j) {
+			wtex__u32 error = 0;
+			for(int k = 0; k < channels; ++k) {
+				int d = rgba[i * 4 + first + k] - palette[j][k];
+				error += (wtex__u32)(d * d);
+			}
+			if(error < best) {
+				best = error;
+				indices[i] = (wtex__u8)j;
+			}
+		}
+		total += best;
+	}
+	return total;
+}
+
+// Least squares over 2-bit weights, as wtex__bc7Refit does for 4-bit
+static
+int wtex__bc7Refit2(float* e0, float* e1, const wtex__u8* indices,
+		const wtex__u8* rgba, int first, int channels)
+{
+	float aa = 0, ab = 0, bb = 0;
+	float ax[3] = {0}, bx[3] = {0};
+	for(int i = 0; i < 16; ++i) {
+		float w = wtex__weights2[indices[i]] / 64.0f;
+		float v = 1 - w;
+		aa += v * v;
+		ab += v * w;
+		bb += w * w;
+		for(int k = 0; k < channels; ++k) {
+			ax[k] += v * rgba[i * 4 + first + k];
+			bx[k] += w * rgba[i * 4 + first + k];
+		}
+	}
+	float det = aa * bb - ab * ab;
+	if(fabsf(det) < 1e-6f) return 0;
+	for(int k = 0; k < channels; ++k) {
+		e0[k] = (bb * ax[k] - ab * bx[k]) / det;
+		e1[k] = (aa * bx[k] - ab * ax[k]) / det;
+		e0[k] = e0[k] < 0 ? 0 : e0[k] > 255 ? 255 : e0[k];
+		e1[k] = e1[k] < 0 ? 0 : e1[k] > 255 ? 255 : e1[k];
+	}
+	return 1;
+}
+
+static
+void wtex__bc7Mode5(wtex__Bc7Mode5* out, const wtex__u8* rgba)
+{
+	memset(out, 0, sizeof(*out));
+	// Color: along the RGB axis, 7 bits, with its top bits
+	// repeated at the bottom when it's expanded
+	float e0[3], e1[3];
+	wtex__bc7Axis(e0, e1, rgba, 3);
+	wtex__u32 colorError = 0xFFFFFFFF;
+	for(int n = 0; n < 3; ++n) {
+		int q[2][3], end[2][3];
+		for(int k = 0; k < 3; ++k) {
+			q[0][k] = wtex__clamp((int)(e0[k] * (127 / 255.0f) + 0.5f), 0, 127);
+			q[1][k] = wtex__clamp((int)(e1[k] * (127 / 255.0f) + 0.5f), 0, 127);
+			end[0][k] = (q[0][k] << 1) | (q[0][k] >> 6);
+			end[1][k] = (q[1][k] << 1) | (q[1][k] >> 6);
+		}
+		wtex__u8 indices[16];
+		wtex__u32 error = wtex__bc7Indices2(indices, rgba, end[0], end[1], 0, 3);
+		if(error >= colorError) break;
+		colorError = error;
+		memcpy(out->color, q, sizeof(q));
+		memcpy(out->colorIndices, indices, 16);
+		if(!error || !wtex__bc7Refit2(e0, e1, indices, rgba, 0, 3)) break;
+	}
+
+	// Alpha: from its extremes, then refit the same way
+	float a0 = 255, a1 = 0;
+	for(int i = 0; i < 16; ++i) {
+		if(rgba[i * 4 + 3] < a0) a0 = rgba[i * 4 + 3];
+		if(rgba[i * 4 + 3] > a1) a1 = rgba[i * 4 + 3];
+	}
+	wtex__u32 alphaError = 0xFFFFFFFF;
+	for(int n = 0; n < 3; ++n) {
+		int end[2] = {(int)(a0 + 0.5f), (int)(a1 + 0.5f)};
+		wtex__u8 indices[16];
+		wtex__u32 error = wtex__bc7Indices2(indices, rgba, end, end + 1, 3, 1);
+		if(error >= alphaError) break;
+		alphaError = error;
+		out->alpha[0] = end[0];
+		out->alpha[1] = end[1];
+		memcpy(out->alphaIndices, indices, 16);
+		if(!error || !wtex__bc7Refit2(&a0, &a1, indices, rgba, 3, 1)) break;
+	}
+	out->error = colorError + alphaError;
+}
+
+static
+void wtex__bc7PackMode5(wtex__u8* dst, wtex__Bc7Mode5* m)
+{
+	// Same as mode 6, each index set has an implied top bit of 0
+	if(m->colorIndices[0] & 2) {
+		for(int k = 0; k < 3; ++k) {
+			int t = m->color[0][k];
+			m->color[0][k] = m->color[1][k];
+			m->color[1][k] = t;
+		}
+		for(int i = 0; i < 16; ++i) m->colorIndices[i] = (wtex__u8)(3 - m->colorIndices[i]);
+	}
+	if(m->alphaIndices[0] & 2) {
+		int t = m->alpha[0];
+		m->alpha[0] = m->alpha[1];
+		m->alpha[1] = t;
+		for(int i = 0; i < 16; ++i) m->alphaIndices[i] = (wtex__u8)(3 - m->alphaIndices[i]);
+	}
+
+	memset(dst, 0, 16);
+	int bit = 0;
+	// Mode, then no channel rotation
+	wtex__putBits(dst, &bit, 1 << 5, 6);
+	wtex__putBits(dst, &bit, 0, 2);
+	for(int k = 0; k < 3; ++k) {
+		wtex__putBits(dst, &bit, m->color[0][k], 7);
+		wtex__putBits(dst, &bit, m->color[1][k], 7);
+	}
+	wtex__putBits(dst, &bit, m->alpha[0], 8);
+	wtex__putBits(dst, &bit, m->alpha[1], 8);
+	for(int i = 0; i < 16; ++i) wtex__putBits(dst, &bit, m->colorIndices[i], i ? 2 : 1);
+	for(int i = 0; i < 16; ++i) wtex__putBits(dst, &bit, m->alphaIndices[i], i ? 2 : 1);
+}
+
+void wtexEncodeBc7(unsigned char* dst, const unsigned char* rgba)
+{
+	float e0[4], e1[4];
+	wtex__bc7Axis(e0, e1, rgba, 4);
+
+	wtex__Bc7 best;
+	best.error = 0xFFFFFFFF;
+	wtex__bc7Try(&best, rgba, e0, e1);
+	for(int n = 0; n < 2 && best.error > 0; ++n) {
+		wtex__u32 before = best.error;
+		if(!wtex__bc7Refit(e0, e1, &best, rgba)) break;
+		wtex__bc7Try(&best, rgba, e0, e1);
+		if(best.error >= before) break;
+	}
+
+	int alphaVaries = 0;
+	for(int i = 1; i < 16; ++i) alphaVaries |= rgba[i * 4 + 3] != rgba[3];
+	if(alphaVaries && best.error) {
+		wtex__Bc7Mode5 mode5;
+		wtex__bc7Mode5(&mode5, rgba);
+		if(mode5.error < best.error) {
+			wtex__bc7PackMode5(dst, &mode5);
+			return;
+		}
+	}
+
+	// The first pixel's index has an implied top bit of 0
+	if(best.indices[0] & 8) {
+		for(int k = 0; k < 4; ++k) {
+			int t = best.q[0][k];
+			best.q[0][k] = best.q[1][k];
+			best.q[1][k] = t;
+		}
+		int t = best.p[0];
+		best.p[0] = best.p[1];
+		best.p[1] = t;
+		for(int i = 0; i < 16; ++i) best.indices[i] = (wtex__u8)(15 - best.indices[i]);
+	}
+
+	memset(dst, 0, 16);
+	int bit = 0;
+	wtex__putBits(dst, &bit, 1 << 6, 7);
+	for(int k = 0; k < 4; ++k) {
+		wtex__putBits(dst, &bit, best.q[0][k], 7);
+		wtex__putBits(dst, &bit, best.q[1][k], 7);
+	}
+	wtex__putBits(dst, &bit, best.p[0], 1);
+	wtex__putBits(dst, &bit, best.p[1], 1);
+	wtex__putBits(dst, &bit, best.indices[0], 3);
+	for(int i = 1; i < 16; ++i) {
+		wtex__putBits(dst, &bit, best.indices[i], 4);
+	}
+}
+
+// BC4
+//
+// Always the 8 value mode, with red0 > red1. Endpoints start at the
+// block's extremes, and a few pulled in by 1 or 2 get tried too,
+// since the interpolated values often land closer that way. Indices
+// are SSE2 too: the 16 pixels in four registers, against each of
+// the 8 palette values.
+static
+float wtex__bc4Indices(wtex__u8* indices, const float* values, const float* palette)
+{
+	__m128 v[4], best[4];
+	__m128i index[4];
+	for(int i = 0; i < 4; ++i) {
+		v[i] = _mm_loadu_ps(values + i * 4);
+		best[i] = _mm_set1_ps(1e30f);
+		index[i] = _mm_setzero_si128();
+	}
+	for(int j = 0; j < 8; ++j) {
+		__m128 p = _mm_set1_ps(palette[j]);
+		__m128i jj = _mm_set1_epi32(j);
+		for(int i = 0; i < 4; ++i) {
+			__m128 d = _mm_sub_ps(v[i], p);
+			d = _mm_mul_ps(d, d);
+			__m128i closer = _mm_castps_si128(_mm_cmplt_ps(d, best[i]));
+			best[i] = _mm_min_ps(best[i], d);
+			index[i] = _mm_or_si128(_mm_and_si128(closer, jj), _mm_andnot_si128(closer, index[i]));
+		}
+	}
+
+	float error = 0;
+	for(int i = 0; i < 4; ++i) {
+		float e[4];
+		int n[4];
+		_mm_storeu_ps(e, best[i]);
+		_mm_storeu_si128((__m128i*)n, index[i]);
+		for(int k = 0; k < 4; ++k) {
+			error += e[k];
+			indices[i * 4 + k] = (wtex__u8)n[k];
+		}
+	}
+	return error;
+}
+
+static
+void wtex__bc4Palette(float* palette, int red0, int red1)
+{
+	palette[0] = (float)red0;
+	palette[1] = (float)red1;
+	if(red0 > red1) {
+		for(int i = 2; i < 8; ++i) {
+			palette[i] = ((8 - i) * red0 + (i - 1) * red1) / 7.0f;
+		}
+	} else {
+		for(int i = 2; i < 6; ++i) {
+			palette[i] = ((6 - i) * red0 + (i - 1) * red1) / 5.0f;
+		}
+		palette[6] = 0;
+		palette[7] = 255;
+	}
+}
+
+static
+void wtex__encodeBc4Channel(wtex__u8* dst, const wtex__u8* rgba, int channel)
+{
+	float values[16];
+	int lo = 255, hi = 0;
+	for(int i = 0; i < 16; ++i) {
+		int v = rgba[i * 4 + channel];
+		values[i] = (float)v;
+		if(v < lo) lo = v;
+		if(v > hi) hi = v;
+	}
+
+	memset(dst, 0, 8);
+	if(lo == hi) {
+		dst[0] = (wtex__u8)hi;
+		dst[1] = (wtex__u8)lo;
+		return;
+	}
+
+	float bestError = 1e30f;
+	wtex__u8 bestIndices[16];
+	int best0 = hi, best1 = lo;
+	for(int a = 0; a < 3; ++a) {
+		for(int b = 0; b < 3; ++b) {
+			int red0 = hi - a, red1 = lo + b;
+			if(red0 <= red1) continue;
+			float palette[8];
+			wtex__u8 indices[16];
+			wtex__bc4Palette(palette, red0, red1);
+			float error = wtex__bc4Indices(indices, values, palette);
+			if(error < bestError) {
+				bestError = error;
+				best0 = red0;
+				best1 = red1;
+				memcpy(bestIndices, indices, 16);
+			}
+		}
+	}
+
+	dst[0] = (wtex__u8)best0;
+	dst[1] = (wtex__u8)best1;
+	int bit = 16;
+	for(int i = 0; i < 16; ++i) {
+		wtex__putBits(dst, &bit, bestIndices[i], 3);
+	}
+}
+
+void wtexEncodeBc4(unsigned char* dst, const unsigned char* rgba)
+{
+	wtex__encodeBc4Channel(dst, rgba, 0);
+}
+
+void wtexEncodeBc5(unsigned char* dst, const unsigned char* rgba)
+{
+	wtex__encodeBc4Channel(dst, rgba, 0);
+	wtex__encodeBc4Channel(dst + 8, rgba, 1);
+}
+
+static
+void wtex__decodeBc4Channel(wtex__u8* rgba, const wtex__u8* block, int channel)
+{
+	float palette[8];
+	wtex__bc4Palette(palette, block[0], block[1]);
+	int bit = 16;
+	for(int i = 0; i < 16; ++i) {
+		rgba[i * 4 + channel] = (wtex__u8)(palette[wtex__getBits(block, &bit, 3)] + 0.5f);
+	}
+}
+
+void wtexDecodeBlock(unsigned char* rgba, const unsigned char* block, int format)
+{
+	for(int i = 0; i < 16; ++i) {
+		rgba[i * 4] = rgba[i * 4 + 1] = rgba[i * 4 + 2] = 0;
+		rgba[i * 4 + 3] = 255;
+	}
+
+	if(format == WTEX_FORMAT_BC4) {
+		wtex__decodeBc4Channel(rgba, block, 0);
+	} else if(format == WTEX_FORMAT_BC5) {
+		wtex__decodeBc4Channel(rgba, block, 0);
+		wtex__decodeBc4Channel(rgba, block + 8, 1);
+	} else if(format == WTEX_FORMAT_BC7 && block[0] == 1 << 5) {
+		// Mode 5 with no rotation
+		int bit = 8;
+		int color[2][3], alpha[2];
+		for(int k = 0; k < 3; ++k) {
+			color[0][k] = (int)wtex__getBits(block, &bit, 7);
+			color[1][k] = (int)wtex__getBits(block, &bit, 7);
+			color[0][k] = (color[0][k] << 1) | (color[0][k] >> 6);
+			color[1][k] = (color[1][k] << 1) | (color[1][k] >> 6);
+		}
+		alpha[0] = (int)wtex__getBits(block, &bit, 8);
+		alpha[1] = (int)wtex__getBits(block, &bit, 8);
+		for(int i = 0; i < 16; ++i) {
+			int w = wtex__weights2[wtex__getBits(block, &bit, i ? 2 : 1)];
+			for(int k = 0; k < 3; ++k) {
+				rgba[i * 4 + k] = (wtex__u8)(((64 - w) * color[0][k] + w * color[1][k] + 32) >> 6);
+			}
+		}
+		for(int i = 0; i < 16; ++i) {
+			int w = wtex__weights2[wtex__getBits(block, &bit, i ? 2 : 1)];
+			rgba[i * 4 + 3] = (wtex__u8)(((64 - w) * alpha[0] + w * alpha[1] + 32) >> 6);
+		}
+	} else if(format == WTEX_FORMAT_BC7) {
+		int bit = 0;
+		if(wtex__getBits(block, &bit, 7) != 1 << 6) return;
+		int end[2][4];
+		for(int k = 0; k < 4; ++k) {
+			end[0][k] = (int)wtex__getBits(block, &bit, 7) << 1;
+			end[1][k] = (int)wtex__getBits(block, &bit, 7) << 1;
+		}
+		int p0 = (int)wtex__getBits(block, &bit, 1);
+		int p1 = (int)wtex__getBits(block, &bit, 1);
+		for(int k = 0; k < 4; ++k) {
+			end[0][k] |= p0;
+			end[1][k] |= p1;
+		}
+		wtex__u8 palette[64];
+		wtex__bc7Palette(palette, end[0], end[1]);
+		for(int i = 0; i < 16; ++i) {
+			int index = (int)wtex__getBits(block, &bit, i ? 4 : 3);
+			memcpy(rgba + i * 4, palette + index * 4, 4);
+		}
+	}
+}
+
+ptrdiff_t wtexBlockBytes(int format)
+{
+	return format == WTEX_FORMAT_BC4 ? 8 : 16;
+}
+
+ptrdiff_t wtexLevelSize(int format, int width, int height)
+{
+	return (ptrdiff_t)((width + 3) / 4) * ((height + 3) / 4) * wtexBlockBytes(format);
+}
+
+int wtexLevelCount(int width, int height)
+{
+	int count = 1;
+	while((width > 1 || height > 1) && count < WTEX_MAX_LEVELS) {
+		width = width > 1 ? width / 2 : 1;
+		height = height > 1 ? height / 2 : 1;
+		count++;
+	}
+	return count;
+}
+
+// A band of block rows, so each job does a decent amount of work
+typedef struct
+{
+	unsigned char* dst;
+	const unsigned char* rgba;
+	int width, height, format;
+	int firstRow, rowCount;
+} wtex__CompressJob;
+
+static
+void wtex__compressJob(void* data)
+{
+	wtex__CompressJob* job = (wtex__CompressJob*)data;
+	int blocksX = (job->width + 3) / 4;
+	ptrdiff_t blockBytes = wtexBlockBytes(job->format);
+	for(int by = job->firstRow; by < job->firstRow + job->rowCount; ++by) {
+		for(int bx = 0; bx < blocksX; ++bx) {
+			// Edge blocks repeat the last row and column
+			wtex__u8 block[64];
+			for(int y = 0; y < 4; ++y) {
+				int sy = by * 4 + y;
+				if(sy >= job->height) sy = job->height - 1;
+				for(int x = 0; x < 4; ++x) {
+					int sx = bx * 4 + x;
+					if(sx >= job->width) sx = job->width - 1;
+					memcpy(block + (y * 4 + x) * 4,
+							job->rgba + ((ptrdiff_t)sy * job->width + sx) * 4, 4);
+				}
+			}
+
+			wtex__u8* out = job->dst + ((ptrdiff_t)by * blocksX + bx) * blockBytes;
+			switch(job->format) {
+				case WTEX_FORMAT_BC4: wtexEncodeBc4(out, block); break;
+				case WTEX_FORMAT_BC5: wtexEncodeBc5(out, block); break;
+				default: wtexEncodeBc7(out, block); break;
+			}
+		}
+	}
+}
+
+// About a thousand blocks per band
+static
+int wtex__bandRows(int width)
+{
+	int blocksX = (width + 3) / 4;
+	int rows = 1024 / blocksX;
+	return rows < 1 ? 1 : rows;
+}
+
+static
+int wtex__bandCount(int width, int height)
+{
+	int blocksY = (height + 3) / 4;
+	int rows = wtex__bandRows(width);
+	return (blocksY + rows - 1) / rows;
+}
+
+// Queues a level's bands on counter, filling in jobs, which needs
+// wtex__bandCount entries and has to outlive the wait
+static
+void wtex__queueCompress(wjobCounter* counter, wtex__CompressJob* jobs,
+		unsigned char* dst, const unsigned char* rgba, int width, int height, int format)
+{
+	int blocksY = (height + 3) / 4;
+	int rows = wtex__bandRows(width);
+	for(int i = 0, row = 0; row < blocksY; ++i, row += rows) {
+		wtex__CompressJob* job = jobs + i;
+		job->dst = dst;
+		job->rgba = rgba;
+		job->width = width;
+		job->height = height;
+		job->format = format;
+		job->firstRow = row;
+		job->rowCount = row + rows > blocksY ? blocksY - row : rows;
+		wjobAdd(counter, wtex__compressJob, job);
+	}
+}
+
+void wtexCompress(
+		unsigned char* dst,
+		const unsigned char* rgba,
+		int width,
+		int height,
+		int format)
+{
+	wtex__CompressJob* jobs = (wtex__CompressJob*)wtexMalloc(
+			sizeof(wtex__CompressJob) * wtex__bandCount(width, height));
+	wjobCounter counter = {0};
+	wtex__queueCompress(&counter, jobs, dst, rgba, width, height, format);
+	wjobWait(&counter);
+	wtexFree(jobs);
+}
+
+// Mips
+//
+// Color is expanded to linear light first, and normals to unit
+// vectors, and every level after that stays in float. The filter is
+// separable: each output row sums its kernel's source rows into one
+// wide row, padded with the pixels that wrap around, and each output
+// pixel sums its kernel's pixels along that.
+//
+// The SSE2 and AVX2 loops do the same multiplies and adds in the
+// same order as the plain ones, with no FMA, so every path and
+// every machine cooks the same bits.
+#if defined(__GNUC__) || defined(__clang__)
+#define WTEX__AVX2 __attribute__((target("avx2")))
+#else
+#define WTEX__AVX2
+#endif
+
+static
+int wtex__hasAvx2(void)
+{
+#if defined(_MSC_VER)
+	int info[4];
+	__cpuid(info, 0);
+	if(info[0] < 7) return 0;
+	__cpuid(info, 1);
+	// The OS has to save the YMM registers too
+	if(!(info[2] & (1 << 27)) || !(info[2] & (1 << 28))) return 0;
+	if((_xgetbv(0) & 6) != 6) return 0;
+	__cpuidex(info, 7, 0);
+	return (info[1] & (1 << 5)) != 0;
+#elif defined(__GNUC__) || defined(__clang__)
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("avx2") != 0;
+#else
+	return 0;
+#endif
+}
+
+static
+float wtex__srgbToLinear(float s)
+{
+	return s <= 0.04045f ? s / 12.92f : powf((s + 0.055f) / 1.055f, 2.4f);
+}
+
+static
+float wtex__linearToSrgb(float l)
+{
+	return l <= 0.0031308f ? l * 12.92f : 1.055f * powf(l, 1 / 2.4f) - 0.055f;
+}
+
+// Linear values go back to sRGB through 16384 steps, which is
+// finer than 8-bit sRGB even at the dark end
+#define WTEX__SRGB_STEPS 16384
+
+typedef struct
+{
+	float toLinear[256];
+	wtex__u8 toSrgb[WTEX__SRGB_STEPS];
+} wtex__MipTables;
+
+// Output pixel x sums source pixels 2x + offsets
+typedef struct
+{
+	int count;
+	int offsets[8];
+	float weights[8];
+} wtex__Kernel;
+
+// Wrapped pixels on either side of a padded row; the Kaiser
+// kernel reaches 3 back and 4 forward
+#define WTEX__PAD 4
+
+static
+double wtex__besselI0(double x)
+{
+	double sum = 1, term = 1;
+	for(int k = 1; k < 32; ++k) {
+		term *= (x / (2 * k)) * (x / (2 * k));
+		sum += term;
+	}
+	return sum;
+}
+
+// Along a side that's already 1 pixel, the kernel is just that pixel
+static
+void wtex__kernel(wtex__Kernel* kernel, unsigned int mipFlags, int size)
+{
+	if(size == 1) {
+		kernel->count = 1;
+		kernel->offsets[0] = 0;
+		kernel->weights[0] = 1;
+	} else if(!(mipFlags & WTEX_MIPS_KAISER)) {
+		kernel->count = 2;
+		kernel->offsets[0] = 0;
+		kernel->offsets[1] = 1;
+		kernel->weights[0] = kernel->weights[1] = 0.5f;
+	} else {
+		// sinc cut off at half the source rate, under a Kaiser
+		// window (alpha 4) 4 source pixels out from the center
+		const double pi = 3.14159265358979323846, alpha = 4, radius = 4;
+		double weights[8], sum = 0;
+		for(int i = 0; i < 8; ++i) {
+			double d = i - 3 - 0.5;
+			double t = d / 2 * pi;
+			double r = d / radius;
+			weights[i] = sin(t) / t * wtex__besselI0(alpha * sqrt(1 - r * r)) / wtex__besselI0(alpha);
+			sum += weights[i];
+		}
+		kernel->count = 8;
+		for(int i = 0; i < 8; ++i) {
+			kernel->offsets[i] = i - 3;
+			kernel->weights[i] = (float)(weights[i] / sum);
+		}
+	}
+}
+
+static inline
+int wtex__wrap(int i, int size)
+{
+	return ((i % size) + size) % size;
+}
+
+static
+void wtex__expandRow(float* dst, const wtex__u8* src, int width,
+		unsigned int mipFlags, const wtex__MipTables* tables)
+{
+	for(int x = 0; x < width; ++x) {
+		const wtex__u8* p = src + x * 4;
+		float* out = dst + x * 4;
+		if(mipFlags & WTEX_MIPS_NORMAL) {
+			float length = 0;
+			for(int k = 0; k < 3; ++k) {
+				out[k] = p[k] / 127.5f - 1;
+				length += out[k] * out[k];
+			}
+			length = length > 0 ? 1 / sqrtf(length) : 0;
+			for(int k = 0; k < 3; ++k) out[k] *= length;
+		} else if(mipFlags & WTEX_MIPS_SRGB) {
+			for(int k = 0; k < 3; ++k) out[k] = tables->toLinear[p[k]];
+		} else {
+			for(int k = 0; k < 3; ++k) out[k] = p[k] * (1 / 255.0f);
+		}
+		out[3] = p[3] * (1 / 255.0f);
+	}
+}
+
+// Renormalizes or clamps a filtered row in place, so the next level
+// starts from it too, and writes it out as RGBA8
+static
+void wtex__finishRow(wtex__u8* dst, float* row, int width,
+		unsigned int mipFlags, const wtex__MipTables* tables)
+{
+	for(int x = 0; x < width; ++x) {
+		float* v = row + x * 4;
+		wtex__u8* out = dst + x * 4;
+		if(mipFlags & WTEX_MIPS_NORMAL) {
+			float length = v[0] * v[0] + v[1] * v[1] + v[2] * v[2];
+			if(length > 1e-12f) {
+				length = 1 / sqrtf(length);
+			} else {
+				v[0] = v[1] = 0;
+				v[2] = length = 1;
+			}
+			for(int k = 0; k < 3; ++k) {
+				v[k] *= length;
+				out[k] = (wtex__u8)wtex__clamp((int)((v[k] + 1) * 127.5f + 0.5f), 0, 255);
+			}
+		} else {
+			// Kaiser's negative lobes can overshoot
+			for(int k = 0; k < 3; ++k) {
+				v[k] = v[k] < 0 ? 0 : v[k] > 1 ? 1 : v[k];
+				out[k] = mipFlags & WTEX_MIPS_SRGB ?
+					tables->toSrgb[(int)(v[k] * (WTEX__SRGB_STEPS - 1) + 0.5f)] :
+					(wtex__u8)(v[k] * 255 + 0.5f);
+			}
+		}
+		v[3] = v[3] < 0 ? 0 : v[3] > 1 ? 1 : v[3];
+		out[3] = (wtex__u8)(v[3] * 255 + 0.5f);
+	}
+}
+
+static
+void wtex__verticalScalar(float* dst, const float** rows, const wtex__Kernel* kernel, int count)
+{
+	for(int i = 0; i < count; ++i) {
+		float sum = rows[0][i] * kernel->weights[0];
+		for(int k = 1; k < kernel->count; ++k) sum += rows[k][i] * kernel->weights[k];
+		dst[i] = sum;
+	}
+}
+
+static
+void wtex__verticalSse(float* dst, const float** rows, const wtex__Kernel* kernel, int count)
+{
+	int i = 0;
+	for(; i + 4 <= count; i += 4) {
+		__m128 sum = _mm_mul_ps(_mm_loadu_ps(rows[0] + i), _mm_set1_ps(kernel->weights[0]));
+		for(int k = 1; k < kernel->count; ++k) {
+			sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(rows[k] + i), _mm_set1_ps(kernel->weights[k])));
+		}
+		_mm_storeu_ps(dst + i, sum);
+	}
+	const float* tails[8];
+	for(int k = 0; k < kernel->count; ++k) tails[k] = rows[k] + i;
+	wtex__verticalScalar(dst + i, tails, kernel, count - i);
+}
+
+static WTEX__AVX2
+void wtex__verticalAvx2(float* dst, const float** rows, const wtex__Kernel* kernel, int count)
+{
+	__m256 weights[8];
+	for(int k = 0; k < kernel->count; ++k) weights[k] = _mm256_set1_ps(kernel->weights[k]);
+	int i = 0;
+	for(; i + 8 <= count; i += 8) {
+		__m256 sum = _mm256_mul_ps(_mm256_loadu_ps(rows[0] + i), weights[0]);
+		for(int k = 1; k < kernel->count; ++k) {
+			sum = _mm256_add_ps(sum, _mm256_mul_ps(_mm256_loadu_ps(rows[k] + i), weights[k]));
+		}
+		_mm256_storeu_ps(dst + i, sum);
+	}
+	const float* tails[8];
+	for(int k = 0; k < kernel->count; ++k) tails[k] = rows[k] + i;
+	wtex__verticalScalar(dst + i, tails, kernel, count - i);
+}
+
+// row points at source pixel 0 of a padded row
+static
+void wtex__horizontalScalar(float* dst, const float* row, const wtex__Kernel* kernel, int first, int width)
+{
+	for(int x = first; x < width; ++x) {
+		for(int c = 0; c < 4; ++c) {
+			float sum = row[(x * 2 + kernel->offsets[0]) * 4 + c] * kernel->weights[0];
+			for(int k = 1; k < kernel->count; ++k) {
+				sum += row[(x * 2 + kernel->offsets[k]) * 4 + c] * kernel->weights[k];
+			}
+			dst[x * 4 + c] = sum;
+		}
+	}
+}
+
+// One RGBA pixel per register
+static
+void wtex__horizontalSse(float* dst, const float* row, const wtex__Kernel* kernel, int width)
+{
+	for(int x = 0; x < width; ++x) {
+		const float* p = row + x * 8;
+		__m128 sum = _mm_mul_ps(_mm_loadu_ps(p + kernel->offsets[0] * 4), _mm_set1_ps(kernel->weights[0]));
+		for(int k = 1; k < kernel->count; ++k) {
+			sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(p + kernel->offsets[k] * 4),
+						_mm_set1_ps(kernel->weights[k])));
+		}
+		_mm_storeu_ps(dst + x * 4, sum);
+	}
+}
+
+// Two output pixels per register, from source pixels two apart
+static WTEX__AVX2
+void wtex__horizontalAvx2(float* dst, const float* row, const wtex__Kernel* kernel, int width)
+{
+	__m256 weights[8];
+	for(int k = 0; k < kernel->count; ++k) weights[k] = _mm256_set1_ps(kernel->weights[k]);
+	int x = 0;
+	for(; x + 2 <= width; x += 2) {
+		const float* p = row + x * 8 + kernel->offsets[0] * 4;
+		__m256 sum = _mm256_mul_ps(_mm256_insertf128_ps(
+					_mm256_castps128_ps256(_mm_loadu_ps(p)), _mm_loadu_ps(p + 8), 1), weights[0]);
+		for(int k = 1; k < kernel->count; ++k) {
+			p = row + x * 8 + kernel->offsets[k] * 4;
+			__m256 pixels = _mm256_insertf128_ps(
+					_mm256_castps128_ps256(_mm_loadu_ps(p)), _mm_loadu_ps(p + 8), 1);
+			sum = _mm256_add_ps(sum, _mm256_mul_ps(pixels, weights[k]));
+		}
+		_mm256_storeu_ps(dst + x * 4, sum);
+	}
+	wtex__horizontalScalar(dst, row, kernel, x, width);
+}
+
+// A band of rows of one level, filtered from the one before it. For
+// level 1 that's rgba, expanded a row at a time as the kernel needs
+// it; after that it's src, the float rows level 1 and on leave behind.
+typedef struct
+{
+	const wtex__u8* rgba;
+	const float* src;
+	int srcWidth, srcHeight;
+	float* dst;
+	wtex__u8* packed;
+	int width, height;
+	int firstRow, rowCount;
+	unsigned int mipFlags;
+	int avx2;
+	const wtex__Kernel* kernelX;
+	const wtex__Kernel* kernelY;
+	const wtex__MipTables* tables;
+} wtex__MipJob;
+
+static
+void wtex__mipJob(void* data)
+{
+	wtex__MipJob* job = (wtex__MipJob*)data;
+	int srcWidth = job->srcWidth;
+	ptrdiff_t rowFloats = (ptrdiff_t)srcWidth * 4;
+	float* row = (float*)wtexMalloc(sizeof(float) * (srcWidth + WTEX__PAD * 2) * 4);
+	float* center = row + WTEX__PAD * 4;
+
+	// Expanded rgba rows, in slots by their row number before it
+	// wraps: the kernel's rows are always 8 or fewer in a row, so
+	// they never land on each other's slot
+	float* ring = NULL;
+	int ringRows[8];
+	if(job->rgba) {
+		ring = (float*)wtexMalloc(sizeof(float) * rowFloats * 8);
+		for(int i = 0; i < 8; ++i) ringRows[i] = -WTEX__PAD - 1;
+	}
+
+	const wtex__Kernel* kernelY = job->kernelY;
+	for(int y = job->firstRow; y < job->firstRow + job->rowCount; ++y) {
+		const float* rows[8];
+		for(int k = 0; k < kernelY->count; ++k) {
+			int unwrapped = y * 2 + kernelY->offsets[k];
+			int sy = wtex__wrap(unwrapped, job->srcHeight);
+			if(ring) {
+				float* slot = ring + (unwrapped & 7) * rowFloats;
+				if(ringRows[unwrapped & 7] != unwrapped) {
+					wtex__expandRow(slot, job->rgba + (ptrdiff_t)sy * rowFloats, srcWidth,
+							job->mipFlags, job->tables);
+					ringRows[unwrapped & 7] = unwrapped;
+				}
+				rows[k] = slot;
+			} else {
+				rows[k] = job->src + (ptrdiff_t)sy * rowFloats;
+			}
+		}
+		if(job->mipFlags & WTEX_MIPS_SCALAR) {
+			wtex__verticalScalar(center, rows, kernelY, srcWidth * 4);
+		} else if(job->avx2) {
+			wtex__verticalAvx2(center, rows, kernelY, srcWidth * 4);
+		} else {
+			wtex__verticalSse(center, rows, kernelY, srcWidth * 4);
+		}
+		for(int p = 1; p <= WTEX__PAD; ++p) {
+			memcpy(center - p * 4, center + wtex__wrap(-p, srcWidth) * 4, sizeof(float) * 4);
+			memcpy(center + (srcWidth - 1 + p) * 4,
+					center + wtex__wrap(srcWidth - 1 + p, srcWidth) * 4, sizeof(float) * 4);
+		}
+
+		float* out = job->dst + (ptrdiff_t)y * job->width * 4;
+		if(job->mipFlags & WTEX_MIPS_SCALAR) {
+			wtex__horizontalScalar(out, center, job->kernelX, 0, job->width);
+		} else if(job->avx2) {
+			wtex__horizontalAvx2(out, center, job->kernelX, job->width);
+		} else {
+			wtex__horizontalSse(out, center, job->kernelX, job->width);
+		}
+		wtex__finishRow(job->packed + (ptrdiff_t)y * job->width * 4, out, job->width,
+				job->mipFlags, job->tables);
+	}
+	wtexFree(ring);
+	wtexFree(row);
+}
+
+// About 16k pixels per band
+static
+int wtex__mipBandRows(int width)
+{
+	int rows = 16384 / width;
+	return rows < 1 ? 1 : rows;
+}
+
+static
+void wtex__queueMips(wjobCounter* counter, wtex__MipJob* jobs, const wtex__MipJob* level)
+{
+	int rows = wtex__mipBandRows(level->width);
+	for(int i = 0, row = 0; row < level->height; ++i, row += rows) {
+		jobs[i] = *level;
+		jobs[i].firstRow = row;
+		jobs[i].rowCount = row + rows > level->height ? level->height - row : rows;
+		wjobAdd(counter, wtex__mipJob, jobs + i);
+	}
+}
+
+ptrdiff_t wtexMipBytes(int width, int height)
+{
+	ptrdiff_t bytes = 0;
+	int levelCount = wtexLevelCount(width, height);
+	for(int i = 1; i < levelCount; ++i) {
+		width = width > 1 ? width / 2 : 1;
+		height = height > 1 ? height / 2 : 1;
+		bytes += (ptrdiff_t)width * height * 4;
+	}
+	return bytes;
+}
+
+void wtexBuildMips(
+		unsigned char* dst,
+		const unsigned char* rgba,
+		int width,
+		int height,
+		unsigned int mipFlags)
+{
+	int levelCount = wtexLevelCount(width, height);
+	if(levelCount < 2) return;
+
+	wtex__MipTables* tables = (wtex__MipTables*)wtexMalloc(sizeof(wtex__MipTables));
+	if(mipFlags & WTEX_MIPS_SRGB) {
+		for(int i = 0; i < 256; ++i) tables->toLinear[i] = wtex__srgbToLinear(i / 255.0f);
+		for(int i = 0; i < WTEX__SRGB_STEPS; ++i) {
+			float s = wtex__linearToSrgb(i / (float)(WTEX__SRGB_STEPS - 1));
+			tables->toSrgb[i] = (wtex__u8)(s * 255 + 0.5f);
+		}
+	}
+
+	// Level 1 reads rgba; after that, levels take turns reading
+	// one of these and writing the other
+	int w = width > 1 ? width / 2 : 1, h = height > 1 ? height / 2 : 1;
+	float* floats[2] = {
+		(float*)wtexMalloc(sizeof(float) * 4 * w * h),
+		(float*)wtexMalloc(sizeof(float) * 4 * (w > 1 ? w / 2 : 1) * (h > 1 ? h / 2 : 1)),
+	};
+	int rows = wtex__mipBandRows(w);
+	wtex__MipJob* jobs = (wtex__MipJob*)wtexMalloc(sizeof(wtex__MipJob) * ((h + rows - 1) / rows));
+
+	wtex__Kernel kernelX, kernelY;
+	wtex__MipJob level;
+	memset(&level, 0, sizeof(level));
+	level.rgba = rgba;
+	level.width = width;
+	level.height = height;
+	level.packed = dst;
+	level.mipFlags = mipFlags;
+	level.avx2 = wtex__hasAvx2();
+	level.kernelX = &kernelX;
+	level.kernelY = &kernelY;
+	level.tables = tables;
+	wjobCounter counter = {0};
+	for(int i = 1; i < levelCount; ++i) {
+		wtex__kernel(&kernelX, mipFlags, level.width);
+		wtex__kernel(&kernelY, mipFlags, level.height);
+		level.src = level.dst;
+		level.srcWidth = level.width;
+		level.srcHeight = level.height;
+		level.dst = floats[(i - 1) & 1];
+		level.width = level.width > 1 ? level.width / 2 : 1;
+		level.height = level.height > 1 ? level.height / 2 : 1;
+		wtex__queueMips(&counter, jobs, &level);
+		wjobWait(&counter);
+		level.rgba = NULL;
+		level.packed += (ptrdiff_t)level.width * level.height * 4;
+	}
+
+	wtexFree(jobs);
+	wtexFree(floats[0]);
+	wtexFree(floats[1]);
+	wtexFree(tables);
+}
+
+// Repacking
+
+int wtexFindTint(
+		unsigned char* tint,
+		unsigned char* mask,
+		const unsigned char* rgba,
+		int width,
+		int height,
+		int tolerance)
+{
+	ptrdiff_t count = (ptrdiff_t)width * height;
+	if(count < 1) return 0;
+
+	// The average, and the brightest texel, which the mask
+	// would scale everything else down from
+	wtex__u64 sums[3] = {0};
+	const wtex__u8* brightest = rgba;
+	for(ptrdiff_t i = 0; i < count; ++i) {
+		const wtex__u8* p = rgba + i * 4;
+		for(int k = 0; k < 3; ++k) sums[k] += p[k];
+		if(p[0] + p[1] + p[2] > brightest[0] + brightest[1] + brightest[2]) brightest = p;
+	}
+
+	wtex__u8 average[3];
+	for(int k = 0; k < 3; ++k) average[k] = (wtex__u8)((sums[k] + count / 2) / count);
+	int constant = 1;
+	for(ptrdiff_t i = 0; i < count && constant; ++i) {
+		for(int k = 0; k < 3; ++k) {
+			int d = rgba[i * 4 + k] - average[k];
+			if(d < -tolerance || d > tolerance) constant = 0;
+		}
+	}
+	if(constant) {
+		memcpy(tint, average, 3);
+		tint[3] = 255;
+		if(mask) {
+			for(ptrdiff_t i = 0; i < count; ++i) mask[i * 4] = 255;
+		}
+		return WTEX_TINT_CONSTANT;
+	}
+
+	// Each texel's mask is its projection onto the brightest texel,
+	// and has to bring it back once it's rounded to 8 bits
+	int color[3] = {brightest[0], brightest[1], brightest[2]};
+	int length = color[0] * color[0] + color[1] * color[1] + color[2] * color[2];
+	for(int pass = 0; pass < 2; ++pass) {
+		for(ptrdiff_t i = 0; i < count; ++i) {
+			const wtex__u8* p = rgba + i * 4;
+			int dot = p[0] * color[0] + p[1] * color[1] + p[2] * color[2];
+			int scale = wtex__clamp((int)((dot * 255.0f) / length + 0.5f), 0, 255);
+			if(pass) {
+				if(mask) mask[i * 4] = (wtex__u8)scale;
+				continue;
+			}
+			for(int k = 0; k < 3; ++k) {
+				int d = (color[k] * scale + 127) / 255 - p[k];
+				if(d < -tolerance || d > tolerance) return 0;
+			}
+		}
+	}
+	memcpy(tint, brightest, 3);
+	tint[3] = 255;
+	return WTEX_TINT_MASK;
+}
+
+// Cooked files
+//
+// Layout, little-endian: the header, then each level's
+// blocks, every level starting on a 16 byte boundary.
+#define WTEX__MAGIC 0x00544257 // "WBT\0"
+#define WTEX__FILE_VERSION 2
+
+typedef struct
+{
+	wtex__u64 offset, size;
+} wtex__FileLevel;
+
+typedef struct
+{
+	wtex__u32 magic;
+	wtex__u32 version;
+	wtex__u32 cookVersion;
+	wtex__u32 format;
+	wtex__u32 width, height;
+	wtex__u32 levelCount;
+	wtex__u32 mipFlags;
+	wtex__u8 tint[4];
+	wtex__u32 pad;
+	wtex__u64 sourceHash;
+	wtex__u64 sourceSize;
+	wtex__FileLevel levels[WTEX_MAX_LEVELS];
+} wtex__FileHeader;
+
+unsigned char* wtexCook(
+		ptrdiff_t* size,
+		const unsigned char* rgba,
+		int width,
+		int height,
+		int format,
+		unsigned int mipFlags,
+		const unsigned char* tint,
+		unsigned long long sourceHash,
+		unsigned long long sourceSize)
+{
+	wtex__FileHeader header;
+	memset(&header, 0, sizeof(header));
+	header.magic = WTEX__MAGIC;
+	header.version = WTEX__FILE_VERSION;
+	header.cookVersion = WTEX_COOK_VERSION;
+	header.format = (wtex__u32)format;
+	header.width = (wtex__u32)width;
+	header.height = (wtex__u32)height;
+	header.levelCount = (wtex__u32)wtexLevelCount(width, height);
+	header.mipFlags = mipFlags & ~WTEX_MIPS_SCALAR;
+	if(tint) memcpy(header.tint, tint, 4);
+	header.sourceHash = sourceHash;
+	header.sourceSize = sourceSize;
+
+	// Every level's pixels, so they can all compress at once
+	const wtex__u8* pixels[WTEX_MAX_LEVELS];
+	wtex__u8* mips = NULL;
+	ptrdiff_t end = (sizeof(header) + 15) & ~(ptrdiff_t)15;
+	int bandCount = 0;
+	for(int i = 0, w = width, h = height; i < (int)header.levelCount; ++i) {
+		header.levels[i].offset = (wtex__u64)end;
+		header.levels[i].size = (wtex__u64)wtexLevelSize(format, w, h);
+		end += (ptrdiff_t)((header.levels[i].size + 15) & ~(wtex__u64)15);
+		bandCount += wtex__bandCount(w, h);
+		w = w > 1 ? w / 2 : 1;
+		h = h > 1 ? h / 2 : 1;
+	}
+
+	wtex__u8* file = (wtex__u8*)wtexMalloc(end);
+	mips = (wtex__u8*)wtexMalloc(wtexMipBytes(width, height) + 4);
+	wtex__CompressJob* jobs = (wtex__CompressJob*)wtexMalloc(
+			sizeof(wtex__CompressJob) * bandCount);
+	if(!file || !mips || !jobs) {
+		wtexFree(jobs);
+		wtexFree(mips);
+		wtexFree(file);
+		return NULL;
+	}
+	memset(file, 0, end);
+	memcpy(file, &header, sizeof(header));
+	wtexBuildMips(mips, rgba, width, height, mipFlags);
+	pixels[0] = rgba;
+	for(int i = 1, w = width, h = height; i < (int)header.levelCount; ++i) {
+		pixels[i] = (i == 1 ? mips : pixels[i - 1] + (ptrdiff_t)w * h * 4);
+		w = w > 1 ? w / 2 : 1;
+		h = h > 1 ? h / 2 : 1;
+	}
+
+	wjobCounter counter = {0};
+	for(int i = 0, w = width, h = height, band = 0; i < (int)header.levelCount; ++i) {
+		wtex__queueCompress(&counter, jobs + band, file + header.levels[i].offset,
+				pixels[i], w, h, format);
+		band += wtex__bandCount(w, h);
+		w = w > 1 ? w / 2 : 1;
+		h = h > 1 ? h / 2 : 1;
+	}
+	wjobWait(&counter);
+	wtexFree(jobs);
+	wtexFree(mips);
+
+	*size = end;
+	return file;
+}
+
+int wtexParse(wtexImage* image, const void* data, ptrdiff_t size)
+{
+	memset(image, 0, sizeof(*image));
+	wtex__FileHeader header;
+	if(size < (ptrdiff_t)sizeof(header)) return 0;
+	memcpy(&header, data, sizeof(header));
+	if(header.magic != WTEX__MAGIC ||
+			header.version != WTEX__FILE_VERSION ||
+			header.cookVersion != WTEX_COOK_VERSION ||
+			header.format < WTEX_FORMAT_BC4 || header.format > WTEX_FORMAT_BC7 ||
+			header.width < 1 || header.width > 1u << (WTEX_MAX_LEVELS - 1) ||
+			header.height < 1 || header.height > 1u << (WTEX_MAX_LEVELS - 1) ||
+			header.levelCount != (wtex__u32)wtexLevelCount(header.width, header.height)) {
+		return 0;
+	}
+
+	int w = (int)header.width, h = (int)header.height;
+	for(int i = 0; i < (int)header.levelCount; ++i) {
+		wtex__FileLevel* level = header.levels + i;
+		if(level->size != (wtex__u64)wtexLevelSize(header.format, w, h) ||
+				level->offset < sizeof(header) ||
+				level->offset > (wtex__u64)size ||
+				level->size > (wtex__u64)size - level->offset) {
+			return 0;
+		}
+		image->levels[i] = (const unsigned char*)data + level->offset;
+		image->levelSizes[i] = (ptrdiff_t)level->size;
+		w = w > 1 ? w / 2 : 1;
+		h = h > 1 ? h / 2 : 1;
+	}
+
+	image->format = (int)header.format;
+	image->width = (int)header.width;
+	image->height = (int)header.height;
+	image->levelCount = (int)header.levelCount;
+	image->mipFlags = header.mipFlags;
+	memcpy(image->tint, header.tint, 4);
+	image->sourceHash = header.sourceHash;
+	image->sourceSize = header.sourceSize;
+	return 1;
+}
+
+unsigned long long wtexHash(const void* data, ptrdiff_t size)
+{
+	const wtex__u8* bytes = (const wtex__u8*)data;
+	wtex__u64 h = 0xcbf29ce484222325ull ^ (wtex__u64)size;
+	ptrdiff_t i = 0;
+	for(; i + 8 <= size; i += 8) {
+		wtex__u64 k;
+		memcpy(&k, bytes + i, 8);
+		h = (h ^ k) * 0x100000001b3ull;
+		h ^= h >> 29;
+	}
+	for(; i < size; ++i) {
+		h = (h ^ bytes[i]) * 0x100000001b3ull;
+	}
+	h ^= h >> 32;
+	h *= 0xd6e8feb86659fd93ull;
+	h ^= h >> 32;
+	return h;
+}
+
+#endif
@@ -1,4 +1,6 @@
 
+# Only needed for the benchsdk target, which compares
+# the native loader against the old fbxsdk one
 fbxsdkinclude="C:\Program Files\Autodesk\FBX\FBX SDK\2019.0\include"
 fbxsdklib="C:\Program Files\Autodesk\FBX\FBX SDK\2019.0\lib\vs2015\x64\release"
 disabled=/wd4477\
@@ -9,7 +11,7 @@ disabled=/wd4477\
 		 /D_CRT_SECURE_NO_WARNINGS
 
 .SILENT:
-all: start bindir shaders game2 end
+all: start bindir shaders wbfbx game2 end
 
 bindir:
 	if not exist bin (mkdir bin)
@@ -19,18 +21,33 @@ shaders:
 	usr\bin\lineify.exe -d src\shaders\* > src\shaders.h
 
 wbfbx:
-	cl /nologo /O2 /TP /Gd /MT /I$(fbxsdkinclude) \
+	cl /nologo /O2 /TP /Gd /MT \
 	/EHsc /fp:fast /W3 /c $(disabled)\
 	/DWB_FBX_IMPLEMENTATION src\wb_fbx.cc
 	lib /NOLOGO wb_fbx.obj
 
 game2: src/main.c
-	cl /nologo /TC /Zi /Gd /MT /I"usr/include" /I$(fbxsdkinclude) \
+	cl /nologo /TC /Zi /Gd /MT /I"usr/include" \
 	/EHsc /fp:fast /W3 $(disabled)\
 		$? /Fe"bin/pbr_test.exe" /Fd"bin/pbr_test.pdb" \
 		/link /NOLOGO /INCREMENTAL:NO /SUBSYSTEM:CONSOLE /LIBPATH:"usr/lib"\
-		/LIBPATH:$(fbxsdklib) \
-		kernel32.lib user32.lib SDL2.lib SDL2main.lib wb_fbx.lib libfbxsdk-mt.lib
+		kernel32.lib user32.lib SDL2.lib SDL2main.lib wb_fbx.lib
+
+bench: bindir wbfbx
+	cl /nologo /O2 /TC /Gd /MT /fp:fast /W3 $(disabled)\
+		src\bench.c /Fe"bin/wb_bench.exe" \
+		/link /NOLOGO /INCREMENTAL:NO /SUBSYSTEM:CONSOLE \
+		kernel32.lib psapi.lib wb_fbx.lib
+	del *.obj >nul 2>&1
+
+benchsdk: bindir wbfbx
+	cl /nologo /O2 /TP /Gd /MT /I$(fbxsdkinclude) \
+	/EHsc /fp:fast /W3 /c $(disabled) src\wb_fbx_sdk.cc
+	cl /nologo /O2 /TC /Gd /MT /fp:fast /W3 $(disabled)\
+		/DWB_BENCH_FBXSDK src\bench.c wb_fbx_sdk.obj /Fe"bin/wb_bench_sdk.exe" \
+		/link /NOLOGO /INCREMENTAL:NO /SUBSYSTEM:CONSOLE /LIBPATH:$(fbxsdklib) \
+		kernel32.lib psapi.lib wb_fbx.lib libfbxsdk-mt.lib
+	del *.obj >nul 2>&1
 
 start:
 	usr\bin\ctime.exe -begin usr/bin/pbr_test.ctm